@@ -0,0 +1,96 @@
+; ==============================================================================
+; PyramidOS Application Processor Startup Trampoline
+; ==============================================================================
+; Responsibility:
+; 1. Copied by smp_init() to a free page below 1 MB; a STARTUP IPI starts the
+;    AP here in real mode at CS = page >> 4, IP = 0.
+; 2. Load the kernel GDT, enter protected mode, turn on paging with the boot
+;    CPU's page directory.
+; 3. Switch to the AP's own stack and call the C entry with its CPU index.
+;
+; Everything the AP needs is in the parameter block at the end, filled in by
+; smp_init() before each STARTUP (SmpTrampolineParams in smp.h). Only
+; position-independent code here: offsets are taken relative to the start.
+; ==============================================================================
+
+section .text
+    global ap_trampoline_start
+    global ap_trampoline_pm
+    global ap_trampoline_params
+    global ap_trampoline_end
+
+%define REL(x) ((x) - ap_trampoline_start)
+
+bits 16
+ap_trampoline_start:
+    cli
+    cld
+
+    ; 1. Addressing: DS = CS, EBX = linear address of the trampoline
+    mov ax, cs
+    mov ds, ax
+    xor ebx, ebx
+    mov bx, ax
+    shl ebx, 4
+
+    ; 2. Kernel GDT (32-bit base: operand-size prefix)
+    o32 lgdt [REL(ap_trampoline_params)]
+
+    ; 3. Protected mode; clear CD/NW (set by INIT) so caching is on
+    mov eax, cr0
+    and eax, 0x9FFFFFFF
+    or eax, 1
+    mov cr0, eax
+
+    ; 4. Far jump through the parameter block: 32-bit offset + code selector
+    o32 jmp far [REL(ap_trampoline_params) + 6]
+
+bits 32
+ap_trampoline_pm:
+    ; 5. Flat kernel data segments (GS gets the per-CPU segment in C)
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; 6. Paging: the trampoline page is identity mapped, so EIP stays valid
+    mov eax, [ebx + REL(ap_trampoline_params) + 12]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000
+    mov cr0, eax
+
+    ; 7. Own stack, then smp_ap_main(cpu) - never returns
+    mov esp, [ebx + REL(ap_trampoline_params) + 16]
+    push 0
+    popfd
+    push dword [ebx + REL(ap_trampoline_params) + 24]
+    mov eax, [ebx + REL(ap_trampoline_params) + 20]
+    call eax
+
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+; ------------------------------------------------------------------------------
+; Parameter block (SmpTrampolineParams)
+; ------------------------------------------------------------------------------
+align 4
+ap_trampoline_params:
+    dw 0                ; +0  GDT limit
+    dd 0                ; +2  GDT base
+    dd 0                ; +6  Protected-mode entry (linear address of ap_trampoline_pm)
+    dw 0                ; +10 Code selector
+    dd 0                ; +12 CR3
+    dd 0                ; +16 Stack top
+    dd 0                ; +20 C entry
+    dd 0                ; +24 CPU index
+ap_trampoline_end:
+
+; ------------------------------------------------------------------------------
+; Mark stack as non-executable (silences linker warning)
+; ------------------------------------------------------------------------------
+section .note.GNU-stack noalloc noexec nowrite progbits
@@ -0,0 +1,341 @@
+#include "apic.h"
+
+#include "clock.h"
+#include "cpu.h"
+#include "div64.h"
+#include "idt.h"
+#include "irq.h"
+#include "pic.h"
+#include "string.h"
+#include "vmm.h"
+
+// Vector 0xFF stub (idt_asm.asm): counts and returns, no EOI is owed
+extern void apic_spurious_isr(void);
+volatile uint32_t apic_spurious_count = 0;
+
+static volatile uint32_t *g_lapic;
+static volatile uint32_t *g_ioapic[ACPI_MAX_IOAPICS];
+static ApicInfo g_apic;
+static ApicRoute g_routes[IRQ_LINES];
+
+static inline uint32_t lapic_read(uint32_t reg)
+{
+    return g_lapic[reg / 4u];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value)
+{
+    g_lapic[reg / 4u] = value;
+}
+
+static uint32_t ioapic_read(uint32_t idx, uint32_t reg)
+{
+    g_ioapic[idx][IOAPIC_REG_SELECT / 4u] = reg;
+    return g_ioapic[idx][IOAPIC_REG_WINDOW / 4u];
+}
+
+static void ioapic_write(uint32_t idx, uint32_t reg, uint32_t value)
+{
+    g_ioapic[idx][IOAPIC_REG_SELECT / 4u] = reg;
+    g_ioapic[idx][IOAPIC_REG_WINDOW / 4u] = value;
+}
+
+static void ioapic_set_entry(uint32_t idx, uint32_t pin, uint32_t low, uint32_t high)
+{
+    // High dword first: the entry is live once the mask bit in low clears.
+    ioapic_write(idx, IOAPIC_REDIR_BASE + (2u * pin) + 1u, high);
+    ioapic_write(idx, IOAPIC_REDIR_BASE + (2u * pin), low);
+}
+
+// I/O APIC and pin for a global system interrupt (false = not wired)
+static bool ioapic_for_gsi(uint32_t gsi, uint8_t *idx, uint8_t *pin)
+{
+    const AcpiInfo *acpi = acpi_info();
+
+    for (uint32_t i = 0; i < g_apic.ioapic_count; i++)
+    {
+        uint32_t base = acpi->ioapic[i].gsi_base;
+        if (gsi >= base && gsi < base + g_apic.ioapic_pins[i])
+        {
+            *idx = (uint8_t)i;
+            *pin = (uint8_t)(gsi - base);
+            return true;
+        }
+    }
+    return false;
+}
+
+// --- IrqChip ---
+
+static void apic_eoi(uint8_t irq)
+{
+    (void)irq;
+    lapic_write(APIC_REG_EOI, 0u);
+}
+
+static void apic_unmask(uint8_t irq)
+{
+    // Line 0 belongs to the LAPIC timer once it is calibrated; the PIT pin
+    // stays masked so the two never both raise vector 32.
+    if (irq == 0u && g_apic.timer_khz)
+        return;
+
+    const ApicRoute *r = &g_routes[irq];
+    if (r->routed)
+        ioapic_write(r->ioapic, IOAPIC_REDIR_BASE + (2u * r->pin), r->redir);
+}
+
+static const IrqChip g_apic_chip = {
+    .name = "I/O APIC",
+    .eoi = apic_eoi,
+    .unmask = apic_unmask,
+    .spurious = 0,
+};
+
+// ISA line -> redirection entry, using the MADT overrides (ISA defaults:
+// edge triggered, active high).
+static void apic_route_isa(void)
+{
+    uint32_t gsi[IRQ_LINES];
+    uint16_t flags[IRQ_LINES];
+
+    for (uint8_t irq = 0; irq < IRQ_LINES; irq++)
+        acpi_isa_irq(irq, &gsi[irq], &flags[irq]);
+
+    for (uint8_t irq = 0; irq < IRQ_LINES; irq++)
+    {
+        ApicRoute *r = &g_routes[irq];
+        memset(r, 0, sizeof(*r));
+
+        if (irq == IRQ_CASCADE)
+            continue;
+
+        // An override that moved another line onto this GSI wins over the
+        // line's identity mapping (QEMU: ISA 0 -> GSI 2).
+        bool taken = false;
+        for (uint8_t other = 0; other < IRQ_LINES; other++)
+        {
+            if (other != irq && gsi[other] != other && gsi[other] == gsi[irq])
+                taken = true;
+        }
+        if (taken || !ioapic_for_gsi(gsi[irq], &r->ioapic, &r->pin))
+            continue;
+
+        uint32_t low = APIC_TIMER_VECTOR + irq;
+        if ((flags[irq] & ACPI_INTI_POLARITY_MASK) == ACPI_INTI_ACTIVE_LOW)
+            low |= IOAPIC_REDIR_ACTIVE_LOW;
+        if ((flags[irq] & ACPI_INTI_TRIGGER_MASK) == ACPI_INTI_LEVEL)
+            low |= IOAPIC_REDIR_LEVEL;
+
+        r->routed = true;
+        r->gsi = gsi[irq];
+        r->redir = low;
+        ioapic_set_entry(r->ioapic, r->pin, low | IOAPIC_REDIR_MASKED,
+                         (uint32_t)g_apic.lapic_id << IOAPIC_REDIR_DEST_SHIFT);
+    }
+}
+
+// Enable and program the calling CPU's LAPIC (every CPU sees its own at the
+// same address). Local interrupts: the 8259 ExtINT path (LINT0) is unused,
+// LINT1 is the NMI pin on PC-compatible boards; timer and error stay masked.
+static void lapic_setup(void)
+{
+    uint64_t msr = cpu_rdmsr(APIC_MSR_BASE);
+    if (!(msr & APIC_MSR_ENABLE))
+        cpu_wrmsr(APIC_MSR_BASE, msr | APIC_MSR_ENABLE);
+
+    lapic_write(APIC_REG_TPR, 0u);
+    lapic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_VECTOR);
+    lapic_write(APIC_REG_LVT_LINT0, APIC_LVT_MASKED);
+    lapic_write(APIC_REG_LVT_LINT1, APIC_LVT_NMI);
+    lapic_write(APIC_REG_LVT_ERROR, APIC_LVT_MASKED);
+    lapic_write(APIC_REG_ESR, 0u); // Back-to-back writes clear it
+    lapic_write(APIC_REG_ESR, 0u);
+    lapic_write(APIC_REG_SVR, APIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_write(APIC_REG_EOI, 0u);
+}
+
+int apic_init(void)
+{
+    const AcpiInfo *acpi = acpi_info();
+    if (!acpi)
+        return APIC_ERR_NO_ACPI;
+    if (acpi->ioapic_count == 0u)
+        return APIC_ERR_NO_IOAPIC;
+
+    uint32_t a, b, c, d;
+    cpu_cpuid(1u, &a, &b, &c, &d);
+    if (!(d & CPU_FEATURE_APIC) || !(d & CPU_FEATURE_MSR))
+        return APIC_ERR_NO_APIC;
+
+    // The MSR holds the live base; the MADT copy is only its reset value.
+    uint64_t msr = cpu_rdmsr(APIC_MSR_BASE);
+    uint32_t base = (uint32_t)msr & APIC_MSR_ADDR_MASK;
+    if (!base)
+        base = acpi->lapic_address;
+
+    volatile uint32_t *lapic = (volatile uint32_t *)vmm_map_mmio(base, 0x1000u);
+    if (!lapic)
+        return APIC_ERR_NO_MEMORY;
+
+    volatile uint32_t *ioapic[ACPI_MAX_IOAPICS];
+    for (uint32_t i = 0; i < acpi->ioapic_count; i++)
+    {
+        ioapic[i] = (volatile uint32_t *)vmm_map_mmio(acpi->ioapic[i].address, IOAPIC_MMIO_SIZE);
+        if (!ioapic[i])
+            return APIC_ERR_NO_MEMORY;
+    }
+
+    // Nothing below can fail: commit.
+    g_lapic = lapic;
+    memset(&g_apic, 0, sizeof(g_apic));
+    g_apic.lapic_address = base;
+    g_apic.ioapic_count = acpi->ioapic_count;
+
+    idt_set_gate(APIC_SPURIOUS_VECTOR, (uint32_t)apic_spurious_isr, 0x08, 0x8E);
+    lapic_setup();
+
+    uint32_t version = lapic_read(APIC_REG_VERSION);
+    g_apic.lapic_id = (uint8_t)(lapic_read(APIC_REG_ID) >> 24);
+    g_apic.lapic_version = (uint8_t)version;
+    g_apic.lvt_entries = (uint8_t)(((version >> 16) & 0xFFu) + 1u);
+
+    // Every pin masked first, so a pin no ISA line claims (PCI GSIs 16+)
+    // never fires into an unset vector.
+    for (uint32_t i = 0; i < g_apic.ioapic_count; i++)
+    {
+        g_ioapic[i] = ioapic[i];
+        g_apic.ioapic_pins[i] = ((ioapic_read(i, IOAPIC_VERSION) >> 16) & 0xFFu) + 1u;
+
+        for (uint32_t pin = 0; pin < g_apic.ioapic_pins[i]; pin++)
+            ioapic_set_entry(i, pin, IOAPIC_REDIR_MASKED, 0u);
+    }
+
+    apic_route_isa();
+
+    pic_disable();
+    irq_set_chip(&g_apic_chip);
+    g_apic.active = true;
+    return APIC_OK;
+}
+
+const ApicInfo *apic_info(void)
+{
+    return &g_apic;
+}
+
+const ApicRoute *apic_route(uint8_t irq)
+{
+    return (irq < IRQ_LINES) ? &g_routes[irq] : 0;
+}
+
+uint32_t apic_spurious(void)
+{
+    return apic_spurious_count;
+}
+
+// --- Other CPUs ---
+
+void apic_init_ap(void)
+{
+    lapic_setup();
+}
+
+uint8_t apic_current_id(void)
+{
+    return (uint8_t)(lapic_read(APIC_REG_ID) >> 24);
+}
+
+void apic_send_eoi(void)
+{
+    lapic_write(APIC_REG_EOI, 0u);
+}
+
+int apic_send_ipi(uint8_t apic_id, uint32_t icr)
+{
+    if (!g_apic.active)
+        return APIC_ERR_NO_APIC;
+
+    // An interrupt between the two writes could send its own IPI and
+    // leave this one going to the wrong destination.
+    uint32_t flags = cpu_irq_save();
+
+    lapic_write(APIC_REG_ICR_HIGH, (uint32_t)apic_id << APIC_ICR_DEST_SHIFT);
+    lapic_write(APIC_REG_ICR_LOW, icr);
+
+    int rc = APIC_ERR_IPI_TIMEOUT;
+    for (uint32_t spin = 0; spin < APIC_IPI_SPINS; spin++)
+    {
+        if (!(lapic_read(APIC_REG_ICR_LOW) & APIC_ICR_PENDING))
+        {
+            rc = APIC_OK;
+            break;
+        }
+        asm volatile("pause");
+    }
+
+    cpu_irq_restore(flags);
+    return rc;
+}
+
+// --- LAPIC timer ---
+
+int apic_timer_calibrate(void)
+{
+    if (!g_apic.active || !clock_info()->calibrated)
+        return APIC_ERR_CALIBRATION;
+
+    uint32_t flags = cpu_irq_save();
+
+    // Free-running masked one-shot from the top; counts consumed over a TSC
+    // window give the input rate (bus or crystal clock / 16).
+    lapic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_VECTOR);
+    lapic_write(APIC_REG_TIMER_DIVIDE, APIC_TIMER_DIVIDE_16);
+
+    uint64_t t0 = clock_monotonic_ns();
+    lapic_write(APIC_REG_TIMER_INITIAL, 0xFFFFFFFFu);
+    uint64_t t1;
+    do
+    {
+        t1 = clock_monotonic_ns();
+    } while (t1 - t0 < APIC_CAL_NS);
+    uint32_t left = lapic_read(APIC_REG_TIMER_CURRENT);
+    lapic_write(APIC_REG_TIMER_INITIAL, 0u);
+
+    cpu_irq_restore(flags);
+
+    uint32_t counts = 0xFFFFFFFFu - left;
+    uint32_t elapsed = (uint32_t)(t1 - t0);
+
+    // Rates at or above 1 count/ns do not fit the 0.32 multiplier.
+    if (counts == 0u || left == 0u || counts >= elapsed)
+        return APIC_ERR_CALIBRATION;
+
+    g_apic.timer_counts_per_ns_fp = (uint32_t)div64_u32((uint64_t)counts << 32, elapsed, 0);
+    g_apic.timer_khz = (uint32_t)div64_u32((uint64_t)counts * 1000000u, elapsed, 0);
+    return APIC_OK;
+}
+
+static uint32_t apic_timer_counts(uint32_t ns)
+{
+    // Round up so a one-shot never fires before its deadline.
+    return (uint32_t)(((uint64_t)ns * g_apic.timer_counts_per_ns_fp) >> 32) + 1u;
+}
+
+void apic_timer_oneshot(uint32_t ns)
+{
+    lapic_write(APIC_REG_LVT_TIMER, APIC_TIMER_VECTOR);
+    lapic_write(APIC_REG_TIMER_INITIAL, apic_timer_counts(ns));
+}
+
+void apic_timer_periodic(uint32_t ns)
+{
+    lapic_write(APIC_REG_LVT_TIMER, APIC_LVT_TIMER_PERIODIC | APIC_TIMER_VECTOR);
+    lapic_write(APIC_REG_TIMER_INITIAL, apic_timer_counts(ns));
+}
+
+void apic_timer_stop(void)
+{
+    lapic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_VECTOR);
+    lapic_write(APIC_REG_TIMER_INITIAL, 0u);
+}
@@ -0,0 +1,148 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "acpi.h"
+
+/*
+ * Local APIC + I/O APIC interrupt controller.
+ *
+ * apic_init() takes over from the 8259 pair when ACPI describes the APICs
+ * (MADT) and the CPU has a local APIC: it enables the boot CPU's LAPIC
+ * (EOI is one MMIO store instead of port I/O), masks every I/O APIC pin and
+ * routes the 16 ISA lines, through the MADT interrupt source overrides, to
+ * vectors 32-47 on the boot CPU, then installs itself as the IrqChip (irq.h).
+ * Line numbers, handlers and statistics are unchanged; without ACPI or an
+ * APIC the PIC stays in charge.
+ *
+ * The LAPIC timer (calibrated against the TSC clock) can replace the PIT:
+ * it raises vector 32, so it is dispatched as line 0 and the PIT's own pin is
+ * left masked.
+ *
+ * Device interrupts all go to the boot CPU. The other CPUs (smp.h) enable
+ * their own LAPIC with apic_init_ap() and are reached by inter-processor
+ * interrupts: INIT / STARTUP to boot them, fixed vectors afterwards.
+ */
+
+/* --------------------------------------------------------------------------
+ * Local APIC registers (offsets into the 4 KiB MMIO page)
+ * -------------------------------------------------------------------------- */
+#define APIC_MSR_BASE           0x1Bu
+#define APIC_MSR_ENABLE         (1u << 11)
+#define APIC_MSR_ADDR_MASK      0xFFFFF000u
+
+#define APIC_REG_ID             0x020u
+#define APIC_REG_VERSION        0x030u
+#define APIC_REG_TPR            0x080u
+#define APIC_REG_EOI            0x0B0u
+#define APIC_REG_SVR            0x0F0u
+#define APIC_REG_ESR            0x280u
+#define APIC_REG_ICR_LOW        0x300u
+#define APIC_REG_ICR_HIGH       0x310u
+#define APIC_REG_LVT_TIMER      0x320u
+#define APIC_REG_LVT_LINT0      0x350u
+#define APIC_REG_LVT_LINT1      0x360u
+#define APIC_REG_LVT_ERROR      0x370u
+#define APIC_REG_TIMER_INITIAL  0x380u
+#define APIC_REG_TIMER_CURRENT  0x390u
+#define APIC_REG_TIMER_DIVIDE   0x3E0u
+
+#define APIC_SVR_ENABLE         (1u << 8)
+#define APIC_LVT_MASKED         (1u << 16)
+#define APIC_LVT_NMI            (4u << 8)       /* Delivery mode */
+#define APIC_LVT_TIMER_PERIODIC (1u << 17)
+#define APIC_TIMER_DIVIDE_16    0x3u
+
+/* Interrupt command register (low dword; the destination is in the high one) */
+#define APIC_ICR_FIXED          (0u << 8)       /* Delivery modes */
+#define APIC_ICR_INIT           (5u << 8)
+#define APIC_ICR_STARTUP        (6u << 8)       /* | start page (physical address >> 12) */
+#define APIC_ICR_PENDING        (1u << 12)      /* Delivery status: send pending */
+#define APIC_ICR_ASSERT         (1u << 14)
+#define APIC_ICR_ALL_BUT_SELF   (3u << 18)      /* Destination shorthand */
+#define APIC_ICR_DEST_SHIFT     24u
+#define APIC_IPI_SPINS          1000000u        /* Delivery status polls before giving up */
+
+#define APIC_SPURIOUS_VECTOR    0xFFu           /* Low nibble must be 1111b */
+#define APIC_TIMER_VECTOR       32u             /* Dispatched as line 0 */
+
+/* --------------------------------------------------------------------------
+ * I/O APIC registers
+ * -------------------------------------------------------------------------- */
+#define IOAPIC_MMIO_SIZE        0x20u
+#define IOAPIC_REG_SELECT       0x00u
+#define IOAPIC_REG_WINDOW       0x10u
+
+#define IOAPIC_VERSION          0x01u           /* Bits 23:16: redirection entries - 1 */
+#define IOAPIC_REDIR_BASE       0x10u           /* Pin n: 0x10 + 2n (low), + 1 (high) */
+
+#define IOAPIC_REDIR_ACTIVE_LOW (1u << 13)
+#define IOAPIC_REDIR_LEVEL      (1u << 15)
+#define IOAPIC_REDIR_MASKED     (1u << 16)
+#define IOAPIC_REDIR_DEST_SHIFT 24u             /* High dword: physical APIC ID */
+
+/* Timer calibration window */
+#define APIC_CAL_NS             10000000u       /* 10 ms */
+
+/* Return codes (0 = success) */
+#define APIC_OK                 0
+#define APIC_ERR_NO_ACPI        1       /* No MADT */
+#define APIC_ERR_NO_APIC        2       /* CPUID: no local APIC / MSRs */
+#define APIC_ERR_NO_IOAPIC      3
+#define APIC_ERR_NO_MEMORY      4       /* MMIO window full */
+#define APIC_ERR_CALIBRATION    5       /* TSC clock not calibrated */
+#define APIC_ERR_IPI_TIMEOUT    6       /* ICR delivery status never cleared */
+
+typedef struct
+{
+    bool routed;
+    uint8_t ioapic;             /* Index into ApicInfo.ioapic_pins / AcpiInfo.ioapic */
+    uint8_t pin;
+    uint32_t gsi;
+    uint32_t redir;             /* Low dword as programmed (mask bit excluded) */
+} ApicRoute;
+
+typedef struct
+{
+    bool active;                /* IrqChip installed */
+    uint32_t lapic_address;
+    uint8_t lapic_id;
+    uint8_t lapic_version;
+    uint8_t lvt_entries;
+    uint32_t ioapic_count;
+    uint32_t ioapic_pins[ACPI_MAX_IOAPICS];
+    uint32_t timer_khz;         /* LAPIC timer input / 16 (0 = uncalibrated) */
+    uint32_t timer_counts_per_ns_fp; /* 0.32 fixed point */
+} ApicInfo;
+
+/* Switch from the 8259 pair to the APICs. Needs acpi_init(); interrupts off. */
+int apic_init(void);
+
+const ApicInfo *apic_info(void);
+const ApicRoute *apic_route(uint8_t irq);
+uint32_t apic_spurious(void);
+
+/* Enable the calling AP's LAPIC (after apic_init() on the boot CPU). */
+void apic_init_ap(void);
+
+/* LAPIC id of the calling CPU. */
+uint8_t apic_current_id(void);
+
+/* End of interrupt for a vector outside the IRQ lines (IPIs). */
+void apic_send_eoi(void);
+
+/* Send an IPI: `icr` is the low dword (vector | delivery mode | shorthand),
+ * `apic_id` the destination when no shorthand is set. Waits for the LAPIC
+ * to accept it. */
+int apic_send_ipi(uint8_t apic_id, uint32_t icr);
+
+/* Measure the LAPIC timer against the TSC clock (after clock_init()). */
+int apic_timer_calibrate(void);
+
+/* Fire vector APIC_TIMER_VECTOR once after `ns`, or every `ns`; stop. */
+void apic_timer_oneshot(uint32_t ns);
+void apic_timer_periodic(uint32_t ns);
+void apic_timer_stop(void);
+
+#endif /* APIC_H */
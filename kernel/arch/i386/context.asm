@@ -0,0 +1,40 @@
+; ==============================================================================
+; PyramidOS Kernel Thread Context Switch
+; ==============================================================================
+; void context_switch(uint32_t *save_esp, uint32_t load_esp);
+;
+; Saves the callee-saved registers on the current stack, stores the stack
+; pointer in *save_esp, switches to load_esp and pops the registers saved
+; there; `ret` then resumes the other thread where it called context_switch
+; (or at its start routine, for a new thread: see sched_spawn()).
+;
+; Called with interrupts off. EFLAGS is not switched: each thread restores
+; its own interrupt state after it is switched back in.
+; ==============================================================================
+bits 32
+
+section .text
+    global context_switch
+
+context_switch:
+    mov eax, [esp + 4]  ; save_esp
+    mov edx, [esp + 8]  ; load_esp
+
+    push ebp            ; cdecl callee-saved registers
+    push ebx
+    push esi
+    push edi
+
+    mov [eax], esp      ; Outgoing thread's stack pointer
+    mov esp, edx        ; Incoming thread's stack
+
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; ------------------------------------------------------------------------------
+; Mark stack as non-executable (silences linker warning)
+; ------------------------------------------------------------------------------
+section .note.GNU-stack noalloc noexec nowrite progbits
@@ -3,7 +3,7 @@
 
 #include <stdint.h>
 
-// Structure of the stack passed by isr_common_stub (Assembly)
+// Interrupt frame built by isr_common_stub / irq_common_stub (Assembly)
 // CRITICAL: This matches the 'pusha' and 'push' order in idt_asm.asm
 typedef struct
 {
@@ -16,14 +16,31 @@ typedef struct
 /* --------------------------------------------------------------------------
  * CPU control helpers (i386)
  * Keep asm centralized and consistent across the kernel.
+ *
+ * IRQTRACE builds (irqtrace.h) timestamp every span with interrupts off from
+ * these helpers; they are always inlined so the tracer sees the real caller.
  * -------------------------------------------------------------------------- */
-static inline void cpu_cli(void)
+#ifdef IRQTRACE
+void irqtrace_irqs_off(void);
+void irqtrace_irqs_on(void);
+#define CPU_TRACE_IRQS_OFF() irqtrace_irqs_off()
+#define CPU_TRACE_IRQS_ON()  irqtrace_irqs_on()
+#else
+#define CPU_TRACE_IRQS_OFF() ((void)0)
+#define CPU_TRACE_IRQS_ON()  ((void)0)
+#endif
+
+#define CPU_IRQ_INLINE static inline __attribute__((always_inline))
+
+CPU_IRQ_INLINE void cpu_cli(void)
 {
     asm volatile("cli" ::: "memory");
+    CPU_TRACE_IRQS_OFF();
 }
 
-static inline void cpu_sti(void)
+CPU_IRQ_INLINE void cpu_sti(void)
 {
+    CPU_TRACE_IRQS_ON();
     asm volatile("sti" ::: "memory");
 }
 
@@ -32,9 +49,61 @@ static inline void cpu_hlt(void)
     asm volatile("hlt");
 }
 
+/* EFLAGS.IF: interrupts enabled. */
+#define CPU_EFLAGS_IF 0x200u
+
+/* Disable interrupts, returning the previous EFLAGS for cpu_irq_restore(). */
+CPU_IRQ_INLINE uint32_t cpu_irq_save(void)
+{
+    uint32_t flags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(flags) :: "memory");
+    if (flags & CPU_EFLAGS_IF)
+        CPU_TRACE_IRQS_OFF();
+    return flags;
+}
+
+/* Restore the interrupt state saved by cpu_irq_save(). */
+CPU_IRQ_INLINE void cpu_irq_restore(uint32_t flags)
+{
+    if (flags & CPU_EFLAGS_IF)
+        CPU_TRACE_IRQS_ON();
+    asm volatile("push %0\n\tpopf" :: "r"(flags) : "memory", "cc");
+}
+
+/* Time Stamp Counter (CPU cycles since reset; Pentium and later). */
+static inline uint64_t cpu_rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* CPUID leaf `leaf` (subleaf 0). */
+static inline void cpu_cpuid(uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    asm volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(0u));
+}
+
+/* CPUID.1:EDX feature bits */
+#define CPU_FEATURE_MSR  (1u << 5)
+#define CPU_FEATURE_APIC (1u << 9)
+
+static inline uint64_t cpu_rdmsr(uint32_t msr)
+{
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void cpu_wrmsr(uint32_t msr, uint64_t value)
+{
+    asm volatile("wrmsr" :: "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
 /* Idle the CPU until the next interrupt (enables interrupts first). */
-static inline void cpu_idle(void)
+CPU_IRQ_INLINE void cpu_idle(void)
 {
+    CPU_TRACE_IRQS_ON();
     asm volatile("sti\n\thlt" ::: "memory");
 }
 
@@ -0,0 +1,68 @@
+#include "gdt.h"
+
+// Access bytes: present, ring 0, code (execute/read) or data (read/write)
+#define GDT_ACCESS_CODE 0x9Au
+#define GDT_ACCESS_DATA 0x92u
+
+// 4 KiB granularity, 32-bit (flat segments); byte granularity, 32-bit
+#define GDT_FLAGS_FLAT 0xC0u
+#define GDT_FLAGS_BYTE 0x40u
+
+__attribute__((aligned(8))) static GdtEntry gdt[GDT_ENTRIES];
+static GdtPtr gdt_ptr;
+
+static void gdt_set_entry(uint32_t i, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags)
+{
+    gdt[i].limit_low = (uint16_t)(limit & 0xFFFFu);
+    gdt[i].base_low = (uint16_t)(base & 0xFFFFu);
+    gdt[i].base_mid = (uint8_t)((base >> 16) & 0xFFu);
+    gdt[i].access = access;
+    gdt[i].flags_limit_high = (uint8_t)(flags | ((limit >> 16) & 0x0Fu));
+    gdt[i].base_high = (uint8_t)((base >> 24) & 0xFFu);
+}
+
+void gdt_init(void)
+{
+    // Same layout as the loader's: the selectors in use stay valid.
+    gdt_set_entry(0, 0u, 0u, 0u, 0u);
+    gdt_set_entry(1, 0u, 0xFFFFFu, GDT_ACCESS_CODE, GDT_FLAGS_FLAT);
+    gdt_set_entry(2, 0u, 0xFFFFFu, GDT_ACCESS_DATA, GDT_FLAGS_FLAT);
+
+    // Per-CPU slots start as 1-byte segments at 0 until gdt_set_percpu().
+    for (uint32_t cpu = 0; cpu < GDT_PERCPU_SLOTS; cpu++)
+        gdt_set_entry(GDT_PERCPU_FIRST + cpu, 0u, 0u, GDT_ACCESS_DATA, GDT_FLAGS_BYTE);
+
+    gdt_ptr.limit = (uint16_t)(sizeof(gdt) - 1u);
+    gdt_ptr.base = (uint32_t)&gdt;
+
+    // Far jump reloads CS; the data selectors are reloaded by hand.
+    asm volatile("lgdt (%0)\n\t"
+                 "ljmp %1, $1f\n"
+                 "1:\n\t"
+                 "mov %2, %%ax\n\t"
+                 "mov %%ax, %%ds\n\t"
+                 "mov %%ax, %%es\n\t"
+                 "mov %%ax, %%fs\n\t"
+                 "mov %%ax, %%gs\n\t"
+                 "mov %%ax, %%ss"
+                 :
+                 : "r"(&gdt_ptr), "i"(GDT_KERNEL_CODE), "i"(GDT_KERNEL_DATA)
+                 : "eax", "memory");
+}
+
+const GdtPtr *gdt_pointer(void)
+{
+    return &gdt_ptr;
+}
+
+void gdt_set_percpu(uint32_t cpu, uint32_t base, uint32_t size)
+{
+    if (cpu < GDT_PERCPU_SLOTS && size)
+        gdt_set_entry(GDT_PERCPU_FIRST + cpu, base, size - 1u, GDT_ACCESS_DATA, GDT_FLAGS_BYTE);
+}
+
+void gdt_load_percpu(uint32_t cpu)
+{
+    uint16_t sel = (uint16_t)((GDT_PERCPU_FIRST + cpu) * sizeof(GdtEntry));
+    asm volatile("mov %0, %%gs" ::"r"(sel) : "memory");
+}
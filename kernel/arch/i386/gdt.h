@@ -0,0 +1,50 @@
+#ifndef GDT_H
+#define GDT_H
+
+#include <stdint.h>
+
+/*
+ * Kernel Global Descriptor Table.
+ *
+ * Replaces the loader's table (which lives in reclaimable low memory) with
+ * the same flat ring-0 code and data segments, plus one small data segment
+ * per CPU whose base is that CPU's PerCpu area (smp.h). GS holds it for
+ * good: the interrupt stubs never reload GS, so %gs:0 always finds the
+ * running CPU's data.
+ */
+
+#define GDT_KERNEL_CODE         0x08u
+#define GDT_KERNEL_DATA         0x10u
+#define GDT_PERCPU_FIRST        3u      /* Entry index of CPU 0's segment */
+#define GDT_PERCPU_SLOTS        8u
+#define GDT_ENTRIES             (GDT_PERCPU_FIRST + GDT_PERCPU_SLOTS)
+
+typedef struct __attribute__((packed))
+{
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;
+    uint8_t flags_limit_high;   /* Granularity/size flags | limit 19:16 */
+    uint8_t base_high;
+} GdtEntry;
+
+typedef struct __attribute__((packed))
+{
+    uint16_t limit;
+    uint32_t base;
+} GdtPtr;
+
+/* Load the kernel GDT on the boot CPU and reload every segment register. */
+void gdt_init(void);
+
+/* The LGDT operand (APs load the same table from the startup trampoline). */
+const GdtPtr *gdt_pointer(void);
+
+/* Point CPU `cpu`'s per-CPU segment at [base, base + size). */
+void gdt_set_percpu(uint32_t cpu, uint32_t base, uint32_t size);
+
+/* Load CPU `cpu`'s per-CPU segment into GS (on that CPU). */
+void gdt_load_percpu(uint32_t cpu);
+
+#endif /* GDT_H */
@@ -2,8 +2,11 @@
 #include "pic.h"
 #include "io.h"
 #include <stdint.h>
-#include "keyboard.h"
-#include "timer.h"
+#include "irq.h"
+#include "softirq.h"
+#include "irqtrace.h"
+#include "smp.h"
+#include "sched.h"
 #include "debug.h"
 #include "terminal.h"
 
@@ -147,46 +150,61 @@ void idt_init(void)
     term_print("IDT Loaded. Interrupts configured.\n", 0x0F);
 }
 
-// The Central Interrupt Handler
-void isr_handler(Registers regs)
+// APs load the same table once they are in protected mode
+void idt_reload(void)
 {
+    idt_load((uint32_t)&idt_ptr);
+}
+
+// Hardware interrupts (vectors 32-47), from irq_common_stub
+void irq_entry(Registers *regs)
+{
+    uint8_t irq = (uint8_t)(regs->int_no - 32u);
+    uint64_t trace = irqtrace_irq_enter(irq);
+    PerCpu *cpu = cpu_this();
+
+    cpu->irqs++;
+    cpu->irq_depth++;
+
+    // Drivers register per-line handlers (irq_register); the dispatcher
+    // runs the line's chain, keeps the counters and sends the EOI
+    irq_dispatch(irq);
 
-    // --- Part A: Hardware Interrupts (IRQs) ---
-    if (regs.int_no >= 32 && regs.int_no <= 47)
+    // Deferred work queued by the handlers runs with interrupts enabled
+    softirq_run();
+
+    irqtrace_irq_exit(irq, trace);
+
+    // Leaving the outermost interrupt: switch threads here if a wakeup or
+    // an expired time slice asked for it. The interrupted thread gets its
+    // iret when it is switched back in.
+    if (--cpu->irq_depth == 0u)
     {
-        // IRQ 0: Timer
-        if (regs.int_no == 32)
-        {
-            timer_handler(); // <--- CALL HANDLER
-        }
-
-        // IRQ 1: Keyboard
-        else if (regs.int_no == 33)
-        {
-            keyboard_handler(); // <--- DELEGATE TO DRIVER
-        }
-
-        // Send End-Of-Interrupt (EOI) to PIC
-        pic_send_eoi(regs.int_no - 32);
-        return;
-    }
+        sched_irq_exit();
 
-    // --- Part B: CPU Exceptions (The Crash Logic) ---
+        // A thread switched in here may have blocked with a traced IRQs-off
+        // span open; the iret below ends it.
+        CPU_TRACE_IRQS_ON();
+    }
+}
 
+// The Central Exception Handler (vectors 0-31)
+void isr_handler(Registers *regs)
+{
     // Map common exceptions to messages
     const char *msg = "Unknown Exception";
 
-    if (regs.int_no == 0)
+    if (regs->int_no == 0)
         msg = "Divide By Zero";
-    else if (regs.int_no == 13)
+    else if (regs->int_no == 13)
         msg = "General Protection Fault";
-    else if (regs.int_no == 14)
+    else if (regs->int_no == 14)
         msg = "Page Fault";
-    else if (regs.int_no == 6)
+    else if (regs->int_no == 6)
         msg = "Invalid Opcode";
-    else if (regs.int_no == 8)
+    else if (regs->int_no == 8)
         msg = "Double Fault";
 
     // Call the professional panic handler
-    panic_with_regs(msg, &regs);
+    panic_with_regs(msg, regs);
 }
\ No newline at end of file
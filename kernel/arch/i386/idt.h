@@ -37,5 +37,6 @@ typedef struct __attribute__((packed))
 // --- API ---
 void idt_init(void);
 void idt_set_gate(int n, uint32_t handler, uint16_t selector, uint8_t type);
+void idt_reload(void); // Load the (shared) IDT on another CPU
 
 #endif
\ No newline at end of file
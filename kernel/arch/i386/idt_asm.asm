@@ -6,6 +6,11 @@ bits 32
 section .text
     global idt_load
     extern isr_handler
+    extern irq_entry
+    global apic_spurious_isr
+    extern apic_spurious_count
+    global smp_ipi_isr
+    extern smp_ipi_handler
 
 ; Load the IDT pointer (LIDT instruction)
 ; void idt_load(uint32_t idt_ptr);
@@ -41,13 +46,13 @@ idt_load:
 ; Macro for IRQs (Hardware Interrupts)
 ; IRQs behave like No-Error-Code exceptions.
 ; We map IRQ 0 -> Interrupt 32, etc.
+; No CLI: the interrupt gate (0x8E) already cleared IF.
 %macro IRQ 2
     global irq%1
     irq%1:
-        cli
         push 0          ; Push dummy error code
         push %2         ; Push Interrupt Number (32-47)
-        jmp isr_common_stub
+        jmp irq_common_stub
 %endmacro
 
 ; ------------------------------------------------------------------------------
@@ -109,6 +114,7 @@ IRQ 15, 47 ; Secondary ATA
 ; ------------------------------------------------------------------------------
 ; Common ISR Handler
 ; Saves state, calls C handler, restores state.
+; GS is never touched: it holds the CPU's per-CPU segment (gdt.h, smp.h).
 ; ------------------------------------------------------------------------------
 isr_common_stub:
     pusha               ; Pushes edi, esi, ebp, esp, ebx, edx, ecx, eax
@@ -120,20 +126,75 @@ isr_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
+    push esp            ; Registers * (frame stays in place)
     call isr_handler    ; Call C function
+    add esp, 4
 
     pop eax             ; Restore Data Segment
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     popa                ; Pop general registers
     add esp, 8          ; Clean up error code and ISR number
     iret                ; Interrupt Return (restores IF from saved EFLAGS)
 
+; ------------------------------------------------------------------------------
+; Common IRQ Handler
+; Same frame as isr_common_stub, but the segment registers are only reloaded
+; (and restored) when the interrupted code was not already on the kernel data
+; segment - never, while everything runs in ring 0.
+; ------------------------------------------------------------------------------
+irq_common_stub:
+    pusha               ; Pushes edi, esi, ebp, esp, ebx, edx, ecx, eax
+
+    mov ax, ds          ; Save Data Segment
+    push eax
+    cmp ax, 0x10
+    je .kernel_segs
+
+    mov ax, 0x10        ; Load Kernel Data Segment
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+
+.kernel_segs:
+    push esp            ; Registers *
+    call irq_entry      ; Dispatch, EOI, then softirqs (interrupts enabled)
+    add esp, 4
+
+    pop eax             ; Restore Data Segment if it was changed
+    cmp ax, 0x10
+    je .segs_restored
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+
+.segs_restored:
+    popa                ; Pop general registers
+    add esp, 8          ; Clean up error code and IRQ number
+    iret                ; Interrupt Return (restores IF from saved EFLAGS)
+
+; ------------------------------------------------------------------------------
+; Local APIC spurious interrupt (vector 0xFF)
+; Not an in-service interrupt: no EOI, no frame, just count it.
+; ------------------------------------------------------------------------------
+apic_spurious_isr:
+    lock inc dword [apic_spurious_count]
+    iret
+
+; ------------------------------------------------------------------------------
+; Wakeup IPI (SMP_IPI_VECTOR)
+; Ends an idle CPU's hlt; the C side counts it and sends the EOI.
+; ------------------------------------------------------------------------------
+smp_ipi_isr:
+    pusha
+    cld
+    call smp_ipi_handler
+    popa
+    iret
+
 ; ------------------------------------------------------------------------------
 ; Mark stack as non-executable (silences linker warning)
 ; ------------------------------------------------------------------------------
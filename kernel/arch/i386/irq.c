@@ -0,0 +1,191 @@
+#include "irq.h"
+
+#include "cpu.h"
+#include "pic.h"
+#include "string.h"
+
+// 8259 pair: the default chip until apic_init() switches to the APICs.
+static bool irq_pic_spurious(uint8_t irq)
+{
+    // The PIC raises IRQ7/IRQ15 for requests that went away before the
+    // acknowledge; no in-service bit is set, so no EOI is owed (except to the
+    // master for the cascade on IRQ15).
+    if ((irq != 7u && irq != 15u) || (pic_get_isr() & (1u << irq)))
+        return false;
+
+    if (irq == 15u)
+        pic_send_eoi(IRQ_CASCADE);
+    return true;
+}
+
+static void irq_pic_unmask(uint8_t irq)
+{
+    pic_clear_mask(irq);
+    if (irq >= 8u)
+        pic_clear_mask(IRQ_CASCADE);
+}
+
+static const IrqChip g_pic_chip = {
+    .name = "8259 PIC",
+    .eoi = pic_send_eoi,
+    .unmask = irq_pic_unmask,
+    .spurious = irq_pic_spurious,
+};
+
+static const IrqChip *g_chip = &g_pic_chip;
+
+static IrqAction g_action_pool[IRQ_MAX_ACTIONS];
+static IrqAction *g_actions[IRQ_LINES];
+static IrqStats g_stats[IRQ_LINES];
+
+int irq_register(uint8_t irq, IrqHandler handler, void *ctx, const char *name)
+{
+    if (irq >= IRQ_LINES || irq == IRQ_CASCADE || !handler)
+        return IRQ_ERR_INVALID;
+
+    uint32_t flags = cpu_irq_save();
+    IrqAction **link = &g_actions[irq];
+    int rc = IRQ_OK;
+
+    while (*link)
+    {
+        if ((*link)->handler == handler && (*link)->ctx == ctx)
+        {
+            rc = IRQ_ERR_EXISTS;
+            break;
+        }
+        link = &(*link)->next;
+    }
+
+    if (rc == IRQ_OK)
+    {
+        IrqAction *a = 0;
+        for (uint32_t i = 0; i < IRQ_MAX_ACTIONS && !a; i++)
+        {
+            if (!g_action_pool[i].handler)
+                a = &g_action_pool[i];
+        }
+
+        if (!a)
+        {
+            rc = IRQ_ERR_NO_SLOT;
+        }
+        else
+        {
+            // Appended: handlers are offered a shared line in registration order.
+            a->handler = handler;
+            a->ctx = ctx;
+            a->name = name ? name : "?";
+            a->handled = 0u;
+            a->cycles = 0u;
+            a->next = 0;
+            *link = a;
+        }
+    }
+
+    cpu_irq_restore(flags);
+    return rc;
+}
+
+int irq_unregister(uint8_t irq, IrqHandler handler, void *ctx)
+{
+    if (irq >= IRQ_LINES)
+        return IRQ_ERR_INVALID;
+
+    uint32_t flags = cpu_irq_save();
+    int rc = IRQ_ERR_INVALID;
+
+    for (IrqAction **link = &g_actions[irq]; *link; link = &(*link)->next)
+    {
+        IrqAction *a = *link;
+        if (a->handler == handler && a->ctx == ctx)
+        {
+            *link = a->next;
+            a->handler = 0;
+            a->next = 0;
+            rc = IRQ_OK;
+
+            // A line without handlers starts its counters over.
+            if (!g_actions[irq])
+                memset(&g_stats[irq], 0, sizeof(IrqStats));
+            break;
+        }
+    }
+
+    cpu_irq_restore(flags);
+    return rc;
+}
+
+void irq_dispatch(uint8_t irq)
+{
+    if (irq >= IRQ_LINES)
+        return;
+
+    IrqStats *st = &g_stats[irq];
+
+    if (g_chip->spurious && g_chip->spurious(irq))
+    {
+        st->spurious++;
+        return;
+    }
+
+    uint64_t start = cpu_rdtsc();
+    uint64_t t = start;
+    bool handled = false;
+
+    st->count++;
+
+    for (IrqAction *a = g_actions[irq]; a; a = a->next)
+    {
+        int rc = a->handler(irq, a->ctx);
+        uint64_t now = cpu_rdtsc();
+
+        a->cycles += now - t;
+        t = now;
+
+        if (rc == IRQ_HANDLED)
+        {
+            a->handled++;
+            handled = true;
+        }
+    }
+
+    if (!handled)
+        st->unhandled++;
+
+    uint64_t spent = t - start;
+    st->cycles += spent;
+    if (spent > st->max_cycles)
+        st->max_cycles = (spent >> 32) ? 0xFFFFFFFFu : (uint32_t)spent;
+
+    g_chip->eoi(irq);
+}
+
+void irq_unmask_registered(void)
+{
+    for (uint8_t irq = 0; irq < IRQ_LINES; irq++)
+    {
+        if (g_actions[irq])
+            g_chip->unmask(irq);
+    }
+}
+
+void irq_set_chip(const IrqChip *chip)
+{
+    g_chip = chip ? chip : &g_pic_chip;
+}
+
+const IrqChip *irq_chip(void)
+{
+    return g_chip;
+}
+
+const IrqStats *irq_stats(uint8_t irq)
+{
+    return (irq < IRQ_LINES) ? &g_stats[irq] : 0;
+}
+
+const IrqAction *irq_actions(uint8_t irq)
+{
+    return (irq < IRQ_LINES) ? g_actions[irq] : 0;
+}
@@ -0,0 +1,87 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Hardware interrupt dispatch (8259 PIC lines 0-15, vectors 32-47).
+ *
+ * Drivers attach handlers with irq_register() instead of being called from
+ * isr_handler() by name. Each line has a chain of handlers: legacy lines
+ * usually have one, PCI INTx lines may be shared, in which case every handler
+ * on the chain is offered the interrupt and reports whether its device was
+ * the source.
+ *
+ * Per line: interrupts taken, interrupts no handler claimed, spurious PIC
+ * interrupts (IRQ7/IRQ15 without the in-service bit) and handler time in TSC
+ * cycles; per handler: interrupts claimed and its own time.
+ *
+ * Lines are numbered as ISA IRQs whatever the interrupt controller; the
+ * IrqChip in use (8259 pair, or local + I/O APIC) maps them to its pins and
+ * acknowledges them.
+ */
+
+#define IRQ_LINES               16u
+#define IRQ_VECTOR_BASE         32u
+#define IRQ_CASCADE             2u      /* Slave PIC on master line 2 */
+#define IRQ_MAX_ACTIONS         24u     /* Handlers across all lines */
+
+/* Handler results */
+#define IRQ_NONE                0       /* Not my device */
+#define IRQ_HANDLED             1
+
+/* Return codes (0 = success) */
+#define IRQ_OK                  0
+#define IRQ_ERR_INVALID         1
+#define IRQ_ERR_NO_SLOT         2
+#define IRQ_ERR_EXISTS          3       /* Same handler and ctx already on the line */
+
+typedef int (*IrqHandler)(uint8_t irq, void *ctx);
+
+typedef struct
+{
+    const char *name;
+    void (*eoi)(uint8_t irq);
+    void (*unmask)(uint8_t irq);
+    bool (*spurious)(uint8_t irq);  /* Optional: true = no handler, EOI handled */
+} IrqChip;
+
+typedef struct IrqAction
+{
+    IrqHandler handler;
+    void *ctx;
+    const char *name;
+    uint32_t handled;           /* Interrupts this handler claimed */
+    uint64_t cycles;            /* Time spent in this handler */
+    struct IrqAction *next;
+} IrqAction;
+
+typedef struct
+{
+    uint32_t count;             /* Interrupts dispatched */
+    uint32_t unhandled;         /* ...that no handler claimed */
+    uint32_t spurious;          /* PIC spurious interrupts (not dispatched) */
+    uint64_t cycles;            /* Time in the line's handlers */
+    uint32_t max_cycles;        /* Longest dispatch */
+} IrqStats;
+
+/* Attach handler(irq, ctx) to `irq`; `name` labels it in statistics. */
+int irq_register(uint8_t irq, IrqHandler handler, void *ctx, const char *name);
+/* Detach it again; the line's counters reset once its last handler is gone. */
+int irq_unregister(uint8_t irq, IrqHandler handler, void *ctx);
+
+/* Called by irq_entry() for vectors 32-47: runs the chain, then EOI. */
+void irq_dispatch(uint8_t irq);
+
+/* Unmask every line that has a handler (and the PIC cascade if needed). */
+void irq_unmask_registered(void);
+
+/* Switch interrupt controllers (0 = back to the 8259 pair). Interrupts off. */
+void irq_set_chip(const IrqChip *chip);
+const IrqChip *irq_chip(void);
+
+const IrqStats *irq_stats(uint8_t irq);
+const IrqAction *irq_actions(uint8_t irq);
+
+#endif /* IRQ_H */
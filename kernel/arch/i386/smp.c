@@ -0,0 +1,259 @@
+#include "smp.h"
+
+#include "acpi.h"
+#include "apic.h"
+#include "clock.h"
+#include "cpu.h"
+#include "heap.h"
+#include "idt.h"
+#include "pmm.h"
+#include "spinlock.h"
+#include "string.h"
+
+// Trampoline image (ap_trampoline.asm), copied below 1 MB
+extern const uint8_t ap_trampoline_start[];
+extern const uint8_t ap_trampoline_pm[];
+extern const uint8_t ap_trampoline_params[];
+extern const uint8_t ap_trampoline_end[];
+
+// Wakeup IPI stub (idt_asm.asm)
+extern void smp_ipi_isr(void);
+
+static PerCpu g_cpus[SMP_MAX_CPUS];
+static SmpInfo g_smp = {.present = 1u, .online = 1u};
+
+// Work queue (FIFO) shared by the idle APs
+static Spinlock g_work_lock = SPINLOCK_INIT("smp-work");
+static SmpWork *g_work_head;
+static SmpWork *g_work_tail;
+
+_Static_assert(SMP_MAX_CPUS <= ACPI_MAX_CPUS, "one PerCpu per MADT entry");
+_Static_assert(sizeof(SmpTrampolineParams) == 28u, "ap_trampoline.asm layout");
+
+static void smp_delay_ns(uint32_t ns)
+{
+    uint64_t start = clock_monotonic_ns();
+    while (clock_monotonic_ns() - start < ns)
+        asm volatile("pause");
+}
+
+static void smp_percpu_load(uint32_t cpu)
+{
+    PerCpu *c = &g_cpus[cpu];
+    c->self = c;
+    c->id = cpu;
+    gdt_set_percpu(cpu, (uint32_t)c, sizeof(PerCpu));
+    gdt_load_percpu(cpu);
+}
+
+void smp_init_boot_cpu(void)
+{
+    memset(g_cpus, 0, sizeof(g_cpus));
+    smp_percpu_load(0u);
+    g_cpus[0].online = true;
+}
+
+// Wakeup IPI (from smp_ipi_isr): the hlt is over, nothing else to do
+void smp_ipi_handler(void)
+{
+    cpu_this()->ipis++;
+    apic_send_eoi();
+}
+
+static SmpWork *smp_work_take(void)
+{
+    spin_lock(&g_work_lock);
+
+    SmpWork *work = g_work_head;
+    if (work)
+    {
+        g_work_head = work->next;
+        if (!g_work_head)
+            g_work_tail = 0;
+    }
+
+    spin_unlock(&g_work_lock);
+    return work;
+}
+
+// Parked AP: interrupts off while the queue is checked, so a wakeup IPI sent
+// after an empty check is held pending until the sti;hlt pair and ends the hlt.
+static __attribute__((noreturn)) void smp_idle(PerCpu *self)
+{
+    while (1)
+    {
+        cpu_cli();
+        SmpWork *work = smp_work_take();
+        if (!work)
+        {
+            self->halts++;
+            cpu_idle();
+            continue;
+        }
+        cpu_sti();
+
+        work->fn(work->arg);
+        work->cpu = self->id;
+        self->works++;
+
+        // The owner may reuse the item as soon as it sees done.
+        __atomic_store_n(&work->done, true, __ATOMIC_RELEASE);
+    }
+}
+
+// C entry of an AP (from the trampoline, on its own stack, paging on)
+static __attribute__((noreturn)) void smp_ap_main(uint32_t cpu)
+{
+    smp_percpu_load(cpu);
+    idt_reload();
+    apic_init_ap();
+
+    PerCpu *self = cpu_this();
+    self->apic_id = apic_current_id();
+    __atomic_store_n(&self->online, true, __ATOMIC_RELEASE);
+
+    smp_idle(self);
+}
+
+static bool smp_wait_online(const PerCpu *c, uint32_t ns)
+{
+    uint64_t start = clock_monotonic_ns();
+    while (!__atomic_load_n(&c->online, __ATOMIC_ACQUIRE))
+    {
+        if (clock_monotonic_ns() - start >= ns)
+            return false;
+        asm volatile("pause");
+    }
+    return true;
+}
+
+static int smp_start_ap(uint32_t cpu, uint8_t apic_id, uint32_t page, SmpTrampolineParams *params)
+{
+    PerCpu *c = &g_cpus[cpu];
+
+    uint8_t *stack = (uint8_t *)kmalloc(SMP_AP_STACK_SIZE);
+    if (!stack)
+        return SMP_ERR_NO_MEMORY;
+
+    c->apic_id = apic_id;
+    c->stack_top = ((uint32_t)stack + SMP_AP_STACK_SIZE) & ~15u;
+
+    params->stack_top = c->stack_top;
+    params->cpu = cpu;
+
+    // INIT, then up to two STARTUPs (the second is for CPUs that miss the first)
+    int rc = apic_send_ipi(apic_id, APIC_ICR_INIT | APIC_ICR_ASSERT);
+    if (rc != APIC_OK)
+        return SMP_ERR_TIMEOUT;
+    smp_delay_ns(SMP_INIT_DELAY_NS);
+
+    for (uint32_t attempt = 0; attempt < 2u; attempt++)
+    {
+        if (apic_send_ipi(apic_id, APIC_ICR_STARTUP | (page >> 12)) != APIC_OK)
+            return SMP_ERR_TIMEOUT;
+        if (smp_wait_online(c, SMP_SIPI_DELAY_NS))
+            return SMP_OK;
+    }
+
+    // Its stack stays allocated: it may still wake up late.
+    return smp_wait_online(c, SMP_AP_TIMEOUT_NS) ? SMP_OK : SMP_ERR_TIMEOUT;
+}
+
+int smp_init(void)
+{
+    const AcpiInfo *acpi = acpi_info();
+    if (!apic_info()->active || !acpi)
+        return g_smp.rc = SMP_ERR_NO_APIC;
+    if (!clock_info()->calibrated)
+        return g_smp.rc = SMP_ERR_NO_CLOCK;
+
+    uint8_t boot_id = apic_info()->lapic_id;
+    g_cpus[0].apic_id = boot_id;
+
+    g_smp.present = acpi->cpu_count ? acpi->cpu_count : 1u;
+    if (g_smp.present > SMP_MAX_CPUS)
+        g_smp.present = SMP_MAX_CPUS;
+    if (g_smp.present == 1u)
+        return g_smp.rc = SMP_OK;
+
+    uint32_t size = (uint32_t)(ap_trampoline_end - ap_trampoline_start);
+    uint32_t page = (uint32_t)pmm_alloc_page_low(SMP_TRAMPOLINE_LIMIT);
+    if (!page)
+        return g_smp.rc = SMP_ERR_NO_MEMORY;
+
+    // Position-independent image; the parameter block is patched per AP.
+    memcpy((void *)page, ap_trampoline_start, size);
+    SmpTrampolineParams *params = (SmpTrampolineParams *)(page + (uint32_t)(ap_trampoline_params - ap_trampoline_start));
+
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+
+    params->gdt = *gdt_pointer();
+    params->pm_entry = page + (uint32_t)(ap_trampoline_pm - ap_trampoline_start);
+    params->pm_selector = GDT_KERNEL_CODE;
+    params->cr3 = cr3;
+    params->entry = (uint32_t)smp_ap_main;
+
+    idt_set_gate(SMP_IPI_VECTOR, (uint32_t)smp_ipi_isr, 0x08, 0x8E);
+    g_smp.trampoline = page;
+
+    // One AP at a time: they share the parameter block. A CPU that never
+    // checks in ends the bring-up, so none can pick up another's stack.
+    int rc = SMP_OK;
+    uint32_t cpu = 1u;
+    for (uint32_t i = 0; i < acpi->cpu_count && cpu < SMP_MAX_CPUS; i++)
+    {
+        if (acpi->cpu_apic_id[i] == boot_id)
+            continue;
+
+        rc = smp_start_ap(cpu, acpi->cpu_apic_id[i], page, params);
+        if (rc != SMP_OK)
+            break;
+
+        cpu++;
+        __atomic_store_n(&g_smp.online, cpu, __ATOMIC_RELEASE);
+    }
+
+    return g_smp.rc = rc;
+}
+
+const SmpInfo *smp_info(void)
+{
+    return &g_smp;
+}
+
+const PerCpu *smp_cpu(uint32_t id)
+{
+    return (id < g_smp.online) ? &g_cpus[id] : 0;
+}
+
+void smp_queue_work(SmpWork *work)
+{
+    work->next = 0;
+    work->done = false;
+
+    if (__atomic_load_n(&g_smp.online, __ATOMIC_ACQUIRE) < 2u)
+    {
+        work->fn(work->arg);
+        work->cpu = smp_cpu_id();
+        work->done = true;
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&g_work_lock);
+    if (g_work_tail)
+        g_work_tail->next = work;
+    else
+        g_work_head = work;
+    g_work_tail = work;
+    spin_unlock_irqrestore(&g_work_lock, flags);
+
+    // Wake every parked AP; the first to get the lock takes the item.
+    (void)apic_send_ipi(0u, APIC_ICR_ALL_BUT_SELF | APIC_ICR_FIXED | SMP_IPI_VECTOR);
+}
+
+void smp_work_wait(SmpWork *work)
+{
+    while (!__atomic_load_n(&work->done, __ATOMIC_ACQUIRE))
+        asm volatile("pause");
+}
@@ -0,0 +1,111 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "gdt.h"
+
+/*
+ * Symmetric multiprocessing: application processor (AP) bring-up and
+ * per-CPU data.
+ *
+ * smp_init() starts every enabled processor in the MADT with the
+ * INIT / STARTUP / STARTUP sequence. Each AP runs the real-mode trampoline
+ * (ap_trampoline.asm) from a page below 1 MB, loads the kernel GDT and page
+ * directory, and enters smp_ap_main() on its own stack, where it enables its
+ * LAPIC and parks in an idle loop: hlt until an IPI, then run queued work.
+ *
+ * Device interrupts, the timer and the shell stay on the boot CPU; APs only
+ * take the wakeup IPI and the work handed to them with smp_queue_work().
+ *
+ * Every CPU has a PerCpu area, reached through GS (cpu_this()).
+ */
+
+#define SMP_MAX_CPUS            GDT_PERCPU_SLOTS
+#define SMP_IPI_VECTOR          0xF0u           /* Wakeup IPI */
+#define SMP_AP_STACK_SIZE       16384u
+#define SMP_TRAMPOLINE_LIMIT    0x100000u       /* STARTUP vector: page below 1 MB */
+
+/* INIT / STARTUP timing (Intel MP specification) */
+#define SMP_INIT_DELAY_NS       10000000u       /* 10 ms after INIT */
+#define SMP_SIPI_DELAY_NS       200000u         /* 200 us after each STARTUP */
+#define SMP_AP_TIMEOUT_NS       100000000u      /* 100 ms for the AP to check in */
+
+/* Return codes (0 = success) */
+#define SMP_OK                  0
+#define SMP_ERR_NO_APIC         1       /* APs are started through the LAPIC */
+#define SMP_ERR_NO_CLOCK        2       /* Startup delays need the TSC clock */
+#define SMP_ERR_NO_MEMORY       3       /* Trampoline page or AP stack */
+#define SMP_ERR_TIMEOUT         4       /* An AP never checked in */
+
+typedef struct PerCpu
+{
+    struct PerCpu *self;        /* At GS:0 (cpu_this()) */
+    uint32_t id;                /* 0 = boot CPU */
+    uint8_t apic_id;
+    volatile bool online;
+    uint32_t stack_top;         /* 0 = boot CPU (entry.asm stack) */
+    uint32_t irqs;              /* Device interrupts taken */
+    uint32_t irq_depth;         /* Nested irq_entry() calls */
+    uint32_t ipis;
+    uint32_t halts;             /* Idle-loop hlts */
+    uint32_t works;             /* Work items run */
+} __attribute__((aligned(64))) PerCpu;  /* No shared cache lines */
+
+/* Work for an idle AP. Owned by the caller until `done`. */
+typedef struct SmpWork
+{
+    void (*fn)(void *arg);
+    void *arg;
+    struct SmpWork *next;
+    uint32_t cpu;               /* CPU that ran it */
+    volatile bool done;
+} SmpWork;
+
+/* Trampoline parameter block (ap_trampoline.asm; layout is fixed). */
+typedef struct __attribute__((packed))
+{
+    GdtPtr gdt;
+    uint32_t pm_entry;
+    uint16_t pm_selector;
+    uint32_t cr3;
+    uint32_t stack_top;
+    uint32_t entry;
+    uint32_t cpu;
+} SmpTrampolineParams;
+
+typedef struct
+{
+    uint32_t present;           /* Processors in the MADT (capped at SMP_MAX_CPUS) */
+    uint32_t online;
+    uint32_t trampoline;        /* Physical page the APs started from (0 = none) */
+    int rc;                     /* Last smp_init() result */
+} SmpInfo;
+
+/* The calling CPU's PerCpu area. */
+static inline PerCpu *cpu_this(void)
+{
+    PerCpu *self;
+    asm("movl %%gs:0, %0" : "=r"(self));
+    return self;
+}
+
+static inline uint32_t smp_cpu_id(void)
+{
+    return cpu_this()->id;
+}
+
+/* Boot CPU's PerCpu area and GS; first thing in k_main (after gdt_init). */
+void smp_init_boot_cpu(void);
+
+/* Start the APs. Needs apic_init(), clock_init() and heap_init(). */
+int smp_init(void);
+
+const SmpInfo *smp_info(void);
+const PerCpu *smp_cpu(uint32_t id);     /* 0 = no such CPU */
+
+/* Hand `work` to an idle AP (run here and now if there is none). */
+void smp_queue_work(SmpWork *work);
+void smp_work_wait(SmpWork *work);
+
+#endif /* SMP_H */
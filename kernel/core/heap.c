@@ -1,9 +1,13 @@
 #include "heap.h"
 #include "vmm.h"
 #include "debug.h" // For panic
+#include "spinlock.h"
 
 static HeapHeader *start_header = 0;
 
+// One lock for the whole block list (kmalloc/kfree run on every CPU)
+static Spinlock heap_lock = SPINLOCK_INIT("heap");
+
 void heap_init(void)
 {
     // 1. Allocate pages for the heap
@@ -27,9 +31,12 @@ void heap_init(void)
     start_header->magic = HEAP_MAGIC;
     start_header->next = NULL;
     start_header->prev = NULL;
+
+    spinlock_register(&heap_lock);
 }
 
-void *kmalloc(size_t size)
+// First fit over the block list; heap_lock held
+static void *heap_alloc(size_t size)
 {
     if (!start_header)
     {
@@ -102,16 +109,9 @@ void *kmalloc(size_t size)
     return NULL; // OOM (Phase 1: No expansion yet)
 }
 
-void kfree(void *ptr)
+// Mark free and coalesce with free neighbours; heap_lock held
+static void heap_free(void *ptr)
 {
-    if (!ptr)
-        return;
-
-    if (!start_header)
-    {
-        panic("HEAP: kfree called before heap_init()");
-    }
-
     // 1. Get Header
     HeapHeader *header = (HeapHeader *)((uint32_t)ptr - sizeof(HeapHeader));
 
@@ -150,4 +150,27 @@ void kfree(void *ptr)
             header->next->prev = header->prev;
         }
     }
-}
\ No newline at end of file
+}
+
+void *kmalloc(size_t size)
+{
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    void *ptr = heap_alloc(size);
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return ptr;
+}
+
+void kfree(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    if (!start_header)
+    {
+        panic("HEAP: kfree called before heap_init()");
+    }
+
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    heap_free(ptr);
+    spin_unlock_irqrestore(&heap_lock, flags);
+}
@@ -0,0 +1,155 @@
+#include "irqtrace.h"
+
+#include "clock.h"
+#include "cpu.h"
+#include "smp.h"
+#include "string.h"
+
+#ifdef IRQTRACE
+#define IRQTRACE_SPANS true
+#else
+#define IRQTRACE_SPANS false
+#endif
+
+volatile bool irqtrace_enabled = false;
+
+static IrqTraceInfo g_trace = {.spans = IRQTRACE_SPANS};
+
+// Open IRQs-off span (0 = interrupts on, or not tracing)
+static uint64_t g_off_start;
+static uint32_t g_off_site;
+static uint8_t g_off_vector;
+
+uint32_t irqtrace_bucket(uint32_t ns)
+{
+    uint32_t us = ns / 1000u;
+    uint32_t b = us ? 32u - (uint32_t)__builtin_clz(us) : 0u;
+    return (b < IRQTRACE_BUCKETS) ? b : IRQTRACE_BUCKETS - 1u;
+}
+
+static uint32_t irqtrace_ns(uint64_t cycles)
+{
+    uint64_t ns = clock_cycles_to_ns(cycles);
+    return (ns >> 32) ? 0xFFFFFFFFu : (uint32_t)ns;
+}
+
+static void irqtrace_hist_add(IrqTraceHist *h, uint32_t ns)
+{
+    h->count++;
+    h->hist[irqtrace_bucket(ns)]++;
+    if (ns > h->max_ns)
+        h->max_ns = ns;
+}
+
+// Interrupts are off: no other span can be recorded concurrently.
+static void irqtrace_span_end(uint32_t on_site)
+{
+    uint32_t ns = irqtrace_ns(cpu_rdtsc() - g_off_start);
+    g_off_start = 0u;
+
+    irqtrace_hist_add(&g_trace.off, ns);
+
+    if (ns <= g_trace.worst[IRQTRACE_WORST - 1u].ns)
+        return;
+
+    uint32_t i = IRQTRACE_WORST - 1u;
+    while (i > 0u && g_trace.worst[i - 1u].ns < ns)
+    {
+        g_trace.worst[i] = g_trace.worst[i - 1u];
+        i--;
+    }
+
+    g_trace.worst[i].ns = ns;
+    g_trace.worst[i].off_site = g_off_site;
+    g_trace.worst[i].on_site = on_site;
+    g_trace.worst[i].vector = g_off_vector;
+}
+
+// Spans are traced on the boot CPU only (where interrupts are routed); the
+// APs' idle loops would otherwise open and close the shared span.
+__attribute__((noinline)) void irqtrace_irqs_off(void)
+{
+    if (!irqtrace_enabled || g_off_start || smp_cpu_id() != 0u)
+        return;
+
+    g_off_site = (uint32_t)(uintptr_t)__builtin_return_address(0);
+    g_off_vector = IRQTRACE_NO_VECTOR;
+    g_off_start = cpu_rdtsc();
+}
+
+__attribute__((noinline)) void irqtrace_irqs_on(void)
+{
+    if (g_off_start && smp_cpu_id() == 0u)
+        irqtrace_span_end((uint32_t)(uintptr_t)__builtin_return_address(0));
+}
+
+uint64_t irqtrace_irq_enter_slow(uint8_t irq)
+{
+    uint64_t now = cpu_rdtsc();
+
+#ifdef IRQTRACE
+    // The gate cleared IF: a new span, unless the interrupted code's own
+    // span is still open (it cannot be, short of an untraced sti).
+    if (!g_off_start)
+    {
+        g_off_site = 0u;
+        g_off_vector = irq;
+        g_off_start = now;
+    }
+#else
+    (void)irq;
+#endif
+
+    return now;
+}
+
+void irqtrace_irq_exit_slow(uint8_t irq, uint64_t start)
+{
+    uint64_t now = cpu_rdtsc();
+
+    if (irq < IRQ_LINES)
+        irqtrace_hist_add(&g_trace.line[irq], irqtrace_ns(now - start));
+
+#ifdef IRQTRACE
+    // iret restores IF=1 (interrupts are only taken with it set).
+    if (g_off_start)
+        irqtrace_span_end(0u);
+#endif
+}
+
+void irqtrace_wakeup_slow(uint64_t deadline_ns)
+{
+    uint64_t now = clock_monotonic_ns();
+    uint64_t late = (now > deadline_ns) ? now - deadline_ns : 0u;
+
+    irqtrace_hist_add(&g_trace.wakeup, (late >> 32) ? 0xFFFFFFFFu : (uint32_t)late);
+}
+
+void irqtrace_enable(bool enabled)
+{
+    uint32_t flags = cpu_irq_save();
+
+    g_off_start = 0u;
+    irqtrace_enabled = enabled;
+    g_trace.enabled = enabled;
+
+    cpu_irq_restore(flags);
+}
+
+void irqtrace_reset(void)
+{
+    uint32_t flags = cpu_irq_save();
+
+    bool enabled = g_trace.enabled;
+    memset(&g_trace, 0, sizeof(g_trace));
+    g_trace.enabled = enabled;
+    g_trace.spans = IRQTRACE_SPANS;
+    g_off_start = 0u;
+
+    cpu_irq_restore(flags);
+}
+
+const IrqTraceInfo *irqtrace_info(void)
+{
+    return &g_trace;
+}
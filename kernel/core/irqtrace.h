@@ -0,0 +1,95 @@
+#ifndef IRQTRACE_H
+#define IRQTRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "irq.h"
+
+/*
+ * Interrupt latency and IRQs-off tracer.
+ *
+ * Per IRQ line: a histogram of service time, from irq_entry() to the iret
+ * (handlers, EOI and the softirqs that ran on the way out), and for the timer
+ * the lateness of each one-shot against the deadline it was armed for - the
+ * delay an IRQs-off section adds to a wakeup.
+ *
+ * Built with IRQTRACE=1 (make IRQTRACE=1, defines IRQTRACE), cpu_cli /
+ * cpu_irq_save / cpu_sti / cpu_irq_restore / cpu_idle and interrupt entry
+ * and exit also timestamp every span with interrupts disabled: a histogram
+ * of all spans and the IRQTRACE_WORST longest, with the addresses that
+ * disabled and re-enabled interrupts (look them up in kernel.map). Spans
+ * are only timed on the boot CPU, which takes every device interrupt.
+ *
+ * Histogram bucket 0 counts spans under 1 us, bucket b >= 1 spans of
+ * [2^(b-1), 2^b) us; the last bucket is open-ended.
+ */
+
+#define IRQTRACE_BUCKETS        16u
+#define IRQTRACE_WORST          8u
+#define IRQTRACE_NO_VECTOR      0xFFu   /* Span opened by cli, not an interrupt */
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max_ns;
+    uint32_t hist[IRQTRACE_BUCKETS];
+} IrqTraceHist;
+
+typedef struct
+{
+    uint32_t ns;
+    uint32_t off_site;          /* Return address of the disabling call (0 = interrupt entry) */
+    uint32_t on_site;           /* Return address of the enabling call (0 = iret) */
+    uint8_t vector;             /* Line whose entry opened it, or IRQTRACE_NO_VECTOR */
+} IrqTraceSpan;
+
+typedef struct
+{
+    bool enabled;
+    bool spans;                 /* cli/sti hooks built in (IRQTRACE) */
+    IrqTraceHist off;           /* Every IRQs-off span */
+    IrqTraceSpan worst[IRQTRACE_WORST]; /* Longest first; ns = 0 marks unused */
+    IrqTraceHist line[IRQ_LINES];       /* Service time per line */
+    IrqTraceHist wakeup;        /* Timer one-shot lateness */
+} IrqTraceInfo;
+
+extern volatile bool irqtrace_enabled;
+
+/* Start or stop recording (on at boot in IRQTRACE builds); reset clears. */
+void irqtrace_enable(bool enabled);
+void irqtrace_reset(void);
+const IrqTraceInfo *irqtrace_info(void);
+
+/* Span hooks (cpu.h, IRQTRACE builds): right after interrupts go off, right
+ * before they come back on. The caller's address is the callsite. */
+void irqtrace_irqs_off(void);
+void irqtrace_irqs_on(void);
+
+/* Bucket index for a duration. */
+uint32_t irqtrace_bucket(uint32_t ns);
+
+/* Out-of-line halves of the hooks below. */
+uint64_t irqtrace_irq_enter_slow(uint8_t irq);
+void irqtrace_irq_exit_slow(uint8_t irq, uint64_t start);
+void irqtrace_wakeup_slow(uint64_t deadline_ns);
+
+/* irq_entry(): returns the entry timestamp for irqtrace_irq_exit(). */
+static inline uint64_t irqtrace_irq_enter(uint8_t irq)
+{
+    return irqtrace_enabled ? irqtrace_irq_enter_slow(irq) : 0u;
+}
+
+static inline void irqtrace_irq_exit(uint8_t irq, uint64_t start)
+{
+    if (start)
+        irqtrace_irq_exit_slow(irq, start);
+}
+
+/* Timer interrupt for a one-shot armed for deadline_ns. */
+static inline void irqtrace_wakeup(uint64_t deadline_ns)
+{
+    if (irqtrace_enabled && deadline_ns)
+        irqtrace_wakeup_slow(deadline_ns);
+}
+
+#endif /* IRQTRACE_H */
@@ -6,13 +6,21 @@
 #include "bootinfo.h"
 #include "pmm.h"
 #include "idt.h"
+#include "gdt.h"
+#include "smp.h"
 #include "vmm.h"
 #include "pic.h"
+#include "irq.h"
+#include "irqtrace.h"
+#include "apic.h"
+#include "acpi.h"
 #include "io.h"
 #include "shell.h"
 #include "selftest.h"
 #include "heap.h"
+#include "sched.h"
 #include "timer.h"
+#include "clock.h"
 #include "keyboard.h"
 #include "ata.h"      // Added for Storage
 #include "string.h"   // Added for strcpy
@@ -20,9 +28,15 @@
 #include "cpu.h"
 #include "debug.h"
 
+#include "pci.h"
 #include "block.h"
 #include "ata_block.h"
+#include "ahci.h"
+#include "virtio_blk.h"
+#include "nvme.h"
+#include "md.h"
 #include "mbr.h"
+#include "ramdisk.h"
 
 #include "fs/vfs.h"
 #include "fs/nullfs.h"
@@ -186,6 +200,10 @@ void test_ata(void) {
 // --- Main Entry ---
 
 void k_main(void) {
+    // Own GDT before anything else: GS becomes the per-CPU segment
+    gdt_init();
+    smp_init_boot_cpu();
+
     term_init();
     term_print("PyramidOS Kernel v0.8 - Storage Test\n", COLOR_GREEN);
     term_print("------------------------------------\n", COLOR_WHITE);
@@ -196,10 +214,56 @@ void k_main(void) {
     pic_remap();
     vmm_init();
 
+    // Interrupt controller: the APICs when ACPI describes them, else the
+    // 8259 pair stays in charge (pic_remap above).
+    term_print("Probing ACPI / APIC...\n", COLOR_WHITE);
+    {
+        int acpi_rc = acpi_init();
+        int apic_rc = (acpi_rc == ACPI_OK) ? apic_init() : APIC_ERR_NO_ACPI;
+        if (apic_rc == APIC_OK)
+        {
+            term_print("APIC: LAPIC id ", COLOR_WHITE);
+            term_print_dec(apic_info()->lapic_id, COLOR_YELLOW);
+            term_print(", ", COLOR_WHITE);
+            term_print_dec(apic_info()->ioapic_count, COLOR_YELLOW);
+            term_print(" I/O APIC(s), ", COLOR_WHITE);
+            term_print_dec(acpi_info()->cpu_count, COLOR_YELLOW);
+            term_print(" CPU(s)\n", COLOR_WHITE);
+        }
+        else
+        {
+            term_print("WARN: no APIC (acpi rc=", COLOR_WHITE);
+            term_print_hex((uint32_t)acpi_rc, COLOR_YELLOW);
+            term_print(", apic rc=", COLOR_WHITE);
+            term_print_hex((uint32_t)apic_rc, COLOR_YELLOW);
+            term_print("), using the 8259 PIC\n", COLOR_WHITE);
+        }
+    }
+
     // Hardware Init (before enabling interrupts)
     term_print("Initializing PIT Timer...\n", COLOR_WHITE);
     timer_init();
 
+    term_print("Calibrating TSC Clock...\n", COLOR_WHITE);
+    if (clock_init() == CLOCK_OK)
+    {
+        term_print("TSC: ", COLOR_WHITE);
+        term_print_dec(clock_info()->tsc_khz / 1000u, COLOR_YELLOW);
+        term_print(" MHz, tickless timer\n", COLOR_WHITE);
+
+        if (apic_info()->active && timer_use_lapic())
+        {
+            term_print("LAPIC timer: ", COLOR_WHITE);
+            term_print_dec(apic_info()->timer_khz, COLOR_YELLOW);
+            term_print(" kHz (replaces the PIT)\n", COLOR_WHITE);
+        }
+        timer_set_tickless(true);
+    }
+    else
+    {
+        term_print("WARN: TSC calibration failed, clock at tick resolution\n", COLOR_WHITE);
+    }
+
     term_print("Initializing Keyboard...\n", COLOR_WHITE);
     keyboard_init();
     
@@ -207,9 +271,34 @@ void k_main(void) {
     term_print("Initializing Heap...\n", COLOR_WHITE);
     heap_init();
 
+    // APs park in their idle loops; device interrupts stay on this CPU
+    term_print("Starting Application Processors...\n", COLOR_WHITE);
+    {
+        int smp_rc = smp_init();
+        if (smp_rc == SMP_OK || smp_rc == SMP_ERR_TIMEOUT)
+        {
+            term_print("SMP: ", COLOR_WHITE);
+            term_print_dec(smp_info()->online, COLOR_YELLOW);
+            term_print(" of ", COLOR_WHITE);
+            term_print_dec(smp_info()->present, COLOR_YELLOW);
+            term_print(" CPU(s) online\n", COLOR_WHITE);
+        }
+        if (smp_rc != SMP_OK)
+        {
+            term_print("WARN: AP startup incomplete (rc=", COLOR_WHITE);
+            term_print_hex((uint32_t)smp_rc, COLOR_YELLOW);
+            term_print("), continuing on ", COLOR_WHITE);
+            term_print_dec(smp_info()->online, COLOR_YELLOW);
+            term_print(" CPU(s)\n", COLOR_WHITE);
+        }
+    }
+
     /* ----------------------------------------------------------------------
      * Block layer + VFS bring-up
      * ---------------------------------------------------------------------- */
+    term_print("Scanning PCI Bus...\n", COLOR_WHITE);
+    pci_init();
+
     term_print("Initializing Block Layer...\n", COLOR_WHITE);
     block_init();
 
@@ -224,10 +313,59 @@ void k_main(void) {
         }
     }
 
+    term_print("Registering AHCI SATA Disks...\n", COLOR_WHITE);
+    {
+        int ahci_rc = ahci_register_devices();
+        if (ahci_rc != AHCI_OK && ahci_rc != AHCI_ERR_NO_DEVICE)
+        {
+            term_print("WARN: AHCI registration failed (rc=", COLOR_WHITE);
+            term_print_hex((uint32_t)ahci_rc, COLOR_YELLOW);
+            term_print(")\n", COLOR_WHITE);
+        }
+    }
+
+    term_print("Registering virtio-blk Disks...\n", COLOR_WHITE);
+    {
+        int vblk_rc = virtio_blk_register_devices();
+        if (vblk_rc != VIRTIO_BLK_OK && vblk_rc != VIRTIO_BLK_ERR_NO_DEVICE)
+        {
+            term_print("WARN: virtio-blk registration failed (rc=", COLOR_WHITE);
+            term_print_hex((uint32_t)vblk_rc, COLOR_YELLOW);
+            term_print(")\n", COLOR_WHITE);
+        }
+    }
+
+    term_print("Registering NVMe Namespaces...\n", COLOR_WHITE);
+    {
+        int nvme_rc = nvme_register_devices();
+        if (nvme_rc != NVME_OK && nvme_rc != NVME_ERR_NO_DEVICE)
+        {
+            term_print("WARN: NVMe registration failed (rc=", COLOR_WHITE);
+            term_print_hex((uint32_t)nvme_rc, COLOR_YELLOW);
+            term_print(")\n", COLOR_WHITE);
+        }
+    }
+
+    term_print("Assembling md Arrays...\n", COLOR_WHITE);
+    {
+        uint32_t md_started = md_assemble();
+        if (md_started != 0u)
+        {
+            term_print("md: started ", COLOR_WHITE);
+            term_print_dec(md_started, COLOR_YELLOW);
+            term_print(" array(s)\n", COLOR_WHITE);
+        }
+    }
+
     term_print("Scanning MBR Partitions...\n", COLOR_WHITE);
     {
+        /* Array members are only accessed through their array. */
         BlockDevice *disk0 = block_get_by_name("disk0");
-        if (disk0)
+        if (disk0 && md_is_member(disk0))
+        {
+            term_print("disk0 is an md member; skipping its partitions\n", COLOR_WHITE);
+        }
+        else if (disk0)
         {
             int mbr_rc = mbr_scan_and_register(disk0, "disk0");
             if (mbr_rc != 0)
@@ -241,6 +379,32 @@ void k_main(void) {
         {
             term_print("WARN: disk0 not present; skipping MBR scan\n", COLOR_WHITE);
         }
+
+        BlockDevice *sata0 = block_get_by_name("sata0");
+        if (sata0 && !md_is_member(sata0))
+            (void)mbr_scan_and_register(sata0, "sata0");
+
+        BlockDevice *vd0 = block_get_by_name("vd0");
+        if (vd0 && !md_is_member(vd0))
+            (void)mbr_scan_and_register(vd0, "vd0");
+
+        BlockDevice *nvme0n1 = block_get_by_name("nvme0n1");
+        if (nvme0n1 && !md_is_member(nvme0n1))
+            (void)mbr_scan_and_register(nvme0n1, "nvme0n1");
+
+        for (uint32_t i = 0; i < md_count(); i++)
+            (void)mbr_scan_and_register(md_device(i), md_info(i)->name);
+    }
+
+    term_print("Creating RAM Disks...\n", COLOR_WHITE);
+    {
+        int ram_rc = ramdisk_init(RAMDISK_DEFAULT_COUNT, RAMDISK_DEFAULT_SECTORS);
+        if (ram_rc != RAMDISK_OK)
+        {
+            term_print("WARN: RAM disk creation failed (rc=", COLOR_WHITE);
+            term_print_hex((uint32_t)ram_rc, COLOR_YELLOW);
+            term_print(")\n", COLOR_WHITE);
+        }
     }
 
     term_print("Initializing VFS...\n", COLOR_WHITE);
@@ -258,9 +422,12 @@ void k_main(void) {
             panic("VFS: mount('/dev') failed");
     }
 
-    term_print("Probing PyFS on disk0p1...\n", COLOR_WHITE);
+    term_print("Probing PyFS on md0p1 / disk0p1...\n", COLOR_WHITE);
     {
-        BlockDevice *p1 = block_get_by_name("disk0p1");
+        /* An assembled array takes precedence over the plain boot disk. */
+        BlockDevice *p1 = block_get_by_name("md0p1");
+        if (!p1)
+            p1 = block_get_by_name("disk0p1");
         if (p1)
         {
             PyfsCtx *pyfs = 0;
@@ -284,17 +451,46 @@ void k_main(void) {
         }
         else
         {
-            term_print("WARN: disk0p1 not found; skipping PyFS mount\n", COLOR_WHITE);
+            term_print("WARN: no md0p1 or disk0p1; skipping PyFS mount\n", COLOR_WHITE);
         }
     }
 
     // Run Diagnostics (PMM + Heap + ATA)
     selftest_run_all();
 
-    // IRQ Policy: start with everything masked, then enable only what we use.
+    // IRQ Policy: start with everything masked, then enable only the lines
+    // drivers registered handlers on (timer, keyboard, ATA, PCI INTx) on
+    // whichever controller is in charge (I/O APIC pins are masked already).
     pic_disable();
-    pic_clear_mask(0); // IRQ0: PIT Timer
-    pic_clear_mask(1); // IRQ1: PS/2 Keyboard
+    irq_unmask_registered();
+
+    // Selftests above ran with polled disks; from here on disk waits sleep until an IRQ.
+    ata_block_set_irq_mode(true);
+    ahci_set_irq_mode(true);
+    virtio_blk_set_irq_mode(true);
+    nvme_set_irq_mode(true);
+
+    // Kernel threads: this context becomes "main" (the shell). Started after
+    // the selftests so they keep their interrupts-off boot environment.
+    term_print("Starting Scheduler...\n", COLOR_WHITE);
+    {
+        int sched_rc = sched_init();
+        if (sched_rc != SCHED_OK)
+        {
+            term_print("WARN: scheduler not started (rc=", COLOR_WHITE);
+            term_print_hex((uint32_t)sched_rc, COLOR_YELLOW);
+            term_print("), waits halt the CPU\n", COLOR_WHITE);
+        }
+        else if (block_writeback_start() != BLOCK_SUCCESS)
+        {
+            term_print("WARN: no writeback thread, staged data waits for the next I/O\n", COLOR_WHITE);
+        }
+    }
+
+#ifdef IRQTRACE
+    // Instrumented build: trace IRQs-off spans from the first interrupt on.
+    irqtrace_enable(true);
+#endif
     cpu_sti();
 
     shell_init();
@@ -2,6 +2,7 @@
 #include "string.h"
 #include "debug.h"
 #include "terminal.h"
+#include "spinlock.h"
 
 // Pointer to the bitmap in physical memory
 static uint8_t *bitmap = (uint8_t *)PMM_BITMAP_BASE;
@@ -9,6 +10,9 @@ static uint32_t total_blocks = 0;
 static uint32_t used_blocks = 0;
 static uint32_t bitmap_size = 0;
 
+// Bitmap, counters and cursors; APs allocate too (smp.h)
+static Spinlock pmm_lock = SPINLOCK_INIT("pmm");
+
 // Next-Fit cursors (frame indices)
 static uint32_t last_free_index = 0;
 static uint32_t last_free_index_low = 0;
@@ -185,6 +189,8 @@ void pmm_init(BootInfo *boot_info)
         }
     }
 
+    spinlock_register(&pmm_lock);
+
     // 2. Initialize Bitmap
     total_blocks = (uint32_t)((highest_addr + (PMM_PAGE_SIZE - 1)) / PMM_PAGE_SIZE);
     bitmap_size = (total_blocks + 7) / 8;
@@ -223,9 +229,14 @@ void pmm_init(BootInfo *boot_info)
 
 void *pmm_alloc_page(void)
 {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+
     int32_t frame = pmm_first_free();
     if (frame == -1)
+    {
+        spin_unlock_irqrestore(&pmm_lock, flags);
         return 0;
+    }
 
     pmm_set((uint32_t)frame);
 
@@ -236,6 +247,8 @@ void *pmm_alloc_page(void)
         last_free_index = 0;
     }
 
+    spin_unlock_irqrestore(&pmm_lock, flags);
+
     uint32_t addr = (uint32_t)frame * PMM_PAGE_SIZE;
     return (void *)addr;
 }
@@ -247,12 +260,17 @@ void *pmm_alloc_page_low(uint32_t max_addr)
     if (max_frame == 0u)
         return 0;
 
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+
     if (max_frame > total_blocks)
         max_frame = total_blocks;
 
     int32_t frame = pmm_first_free_low(max_frame);
     if (frame == -1)
+    {
+        spin_unlock_irqrestore(&pmm_lock, flags);
         return 0;
+    }
 
     pmm_set((uint32_t)frame);
 
@@ -263,10 +281,51 @@ void *pmm_alloc_page_low(uint32_t max_addr)
         last_free_index_low = 0;
     }
 
+    spin_unlock_irqrestore(&pmm_lock, flags);
+
     uint32_t addr = (uint32_t)frame * PMM_PAGE_SIZE;
     return (void *)addr;
 }
 
+// Contiguous frames below max_addr (DMA rings that span pages). First-fit:
+// only used at driver init, so a linear scan is fine.
+void *pmm_alloc_pages_low(uint32_t count, uint32_t max_addr)
+{
+    uint32_t max_frame = max_addr / PMM_PAGE_SIZE;
+
+    if (count == 0u)
+        return 0;
+
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+
+    if (max_frame > total_blocks)
+        max_frame = total_blocks;
+
+    void *result = 0;
+    uint32_t run = 0u;
+    for (uint32_t frame = 0; frame < max_frame; frame++)
+    {
+        if (pmm_test(frame))
+        {
+            run = 0u;
+            continue;
+        }
+
+        if (++run == count)
+        {
+            uint32_t first = frame + 1u - count;
+            for (uint32_t f = first; f <= frame; f++)
+                pmm_set(f);
+
+            result = (void *)(first * PMM_PAGE_SIZE);
+            break;
+        }
+    }
+
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return result;
+}
+
 void pmm_free_page(void *p)
 {
     if (!p)
@@ -282,6 +341,8 @@ void pmm_free_page(void *p)
     if (frame >= total_blocks)
         pmm_panic_u32("pmm_free_page: address out of range", addr);
 
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+
     /* Double-free / invalid free detection. */
     if (!pmm_test(frame))
         pmm_panic_u32("pmm_free_page: double free or corrupt frame", frame);
@@ -297,6 +358,8 @@ void pmm_free_page(void *p)
     {
         last_free_index_low = frame;
     }
+
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
 
 void pmm_mark_region_used(uint64_t base, uint64_t length)
@@ -308,6 +371,8 @@ void pmm_mark_region_used(uint64_t base, uint64_t length)
     uint64_t start_frame = base / PMM_PAGE_SIZE;
     uint64_t end_frame = (base + length + (PMM_PAGE_SIZE - 1)) / PMM_PAGE_SIZE;
 
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+
     if (end_frame > (uint64_t)total_blocks)
         end_frame = (uint64_t)total_blocks;
 
@@ -315,6 +380,8 @@ void pmm_mark_region_used(uint64_t base, uint64_t length)
     {
         pmm_set((uint32_t)frame);
     }
+
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
 
 void pmm_mark_region_free(uint64_t base, uint64_t length)
@@ -326,6 +393,8 @@ void pmm_mark_region_free(uint64_t base, uint64_t length)
     uint64_t start_frame = base / PMM_PAGE_SIZE;
     uint64_t end_frame = (base + length + (PMM_PAGE_SIZE - 1)) / PMM_PAGE_SIZE;
 
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+
     if (end_frame > (uint64_t)total_blocks)
         end_frame = (uint64_t)total_blocks;
 
@@ -333,6 +402,8 @@ void pmm_mark_region_free(uint64_t base, uint64_t length)
     {
         pmm_unset((uint32_t)frame);
     }
+
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
 
 uint32_t pmm_get_free_memory(void)
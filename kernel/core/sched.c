@@ -0,0 +1,541 @@
+#include "sched.h"
+
+#include "clock.h"
+#include "cpu.h"
+#include "heap.h"
+#include "smp.h"
+#include "string.h"
+#include "timer.h"
+
+// context.asm
+extern void context_switch(uint32_t *save_esp, uint32_t load_esp);
+
+typedef struct
+{
+    Thread *head;
+    Thread *tail;
+} RunQueue;
+
+static RunQueue g_ready[SCHED_PRIORITIES];
+static SchedInfo g_info;
+
+static Thread g_main;           // The boot context: its stack is entry.asm's
+static Thread *g_current;
+static Thread *g_idle;
+static Thread *g_all;           // all_next list
+static Thread *g_sleepers;      // Timed waits, unsorted (sleep_next)
+static uint32_t g_next_tid;
+static bool g_need_resched;
+
+_Static_assert(SCHED_PRIORITIES <= 32u, "one ready_bitmap bit per priority");
+
+static const char *const g_state_names[] = { "ready", "running", "blocked", "zombie" };
+
+// ---------------------------------------------------------------------------
+// Run queue: FIFO per priority, bitmap of the non-empty ones
+// ---------------------------------------------------------------------------
+
+static void run_queue_push(Thread *t)
+{
+    RunQueue *q = &g_ready[t->priority];
+
+    t->state = THREAD_READY;
+    t->next = 0;
+    if (q->tail)
+        q->tail->next = t;
+    else
+        q->head = t;
+    q->tail = t;
+
+    g_info.ready_bitmap |= 1u << t->priority;
+}
+
+static Thread *run_queue_pop(void)
+{
+    if (!g_info.ready_bitmap)
+        return 0;
+
+    uint32_t prio = (uint32_t)__builtin_ctz(g_info.ready_bitmap);
+    RunQueue *q = &g_ready[prio];
+    Thread *t = q->head;
+
+    q->head = t->next;
+    if (!q->head)
+    {
+        q->tail = 0;
+        g_info.ready_bitmap &= ~(1u << prio);
+    }
+    t->next = 0;
+    return t;
+}
+
+// ---------------------------------------------------------------------------
+// Switching
+// ---------------------------------------------------------------------------
+
+// Make sure a timer interrupt ends the running thread's slice if another
+// thread of its priority is waiting (tickless mode; the periodic tick
+// checks anyway). Interrupts off.
+static void sched_arm_slice(void)
+{
+    Thread *cur = g_current;
+
+    if (cur != g_idle && (g_info.ready_bitmap & (1u << cur->priority)))
+        timer_schedule_event(cur->slice_end_ns);
+}
+
+// Switch to the most urgent ready thread (or idle). The caller has set its
+// own state: RUNNING goes back on the run queue, anything else stays off it.
+// Interrupts off; returns when the caller is switched back in.
+static void schedule(void)
+{
+    Thread *prev = g_current;
+    g_need_resched = false;
+
+    if (prev->state == THREAD_RUNNING && prev != g_idle)
+        run_queue_push(prev);
+
+    Thread *next = run_queue_pop();
+    if (!next)
+        next = g_idle;
+
+    if (next == prev)
+    {
+        prev->state = THREAD_RUNNING;
+        prev->slice_end_ns = clock_monotonic_ns() + SCHED_SLICE_NS;
+        sched_arm_slice();
+        return;
+    }
+
+    if (prev->state == THREAD_READY)
+    {
+        prev->preemptions++;
+        g_info.preemptions++;
+    }
+    if (prev == g_idle)
+        prev->state = THREAD_READY;
+
+    next->state = THREAD_RUNNING;
+    next->switches++;
+    next->slice_end_ns = clock_monotonic_ns() + SCHED_SLICE_NS;
+    g_info.switches++;
+    g_current = next;
+    sched_arm_slice();
+
+    context_switch(&prev->esp, next->esp);
+}
+
+// Blocking is possible in thread context on the boot CPU once the scheduler
+// runs; the idle thread, interrupt handlers and the APs halt instead.
+static bool sched_can_block(void)
+{
+    return g_info.running && smp_cpu_id() == 0u && g_current != g_idle && cpu_this()->irq_depth == 0u;
+}
+
+// After making threads ready: a more urgent one runs now if the caller had
+// interrupts on (otherwise at the next interrupt exit or block).
+static void sched_preempt(uint32_t flags)
+{
+    if (g_need_resched && (flags & CPU_EFLAGS_IF) && sched_can_block())
+        schedule();
+}
+
+static void make_ready(Thread *t)
+{
+    run_queue_push(t);
+
+    Thread *cur = g_current;
+    if (cur == g_idle || t->priority < cur->priority)
+        g_need_resched = true;
+    else if (t->priority == cur->priority)
+        sched_arm_slice();
+}
+
+void sched_irq_exit(void)
+{
+    if (g_need_resched && g_info.running && smp_cpu_id() == 0u)
+        schedule();
+}
+
+// ---------------------------------------------------------------------------
+// Wait queues
+// ---------------------------------------------------------------------------
+
+static void sleepers_remove(Thread *t)
+{
+    for (Thread **link = &g_sleepers; *link; link = &(*link)->sleep_next)
+    {
+        if (*link == t)
+        {
+            *link = t->sleep_next;
+            break;
+        }
+    }
+    t->sleep_next = 0;
+    t->wake_ns = 0;
+}
+
+static void wait_queue_remove(WaitQueue *wq, Thread *t)
+{
+    Thread *prev = 0;
+
+    for (Thread *w = wq->head; w; prev = w, w = w->next)
+    {
+        if (w != t)
+            continue;
+
+        if (prev)
+            prev->next = t->next;
+        else
+            wq->head = t->next;
+        if (wq->tail == t)
+            wq->tail = prev;
+        break;
+    }
+    t->next = 0;
+}
+
+// Take the first waiter off `wq` and make it ready. Interrupts off.
+static bool wait_queue_wake_first(WaitQueue *wq)
+{
+    Thread *t = wq->head;
+    if (!t)
+        return false;
+
+    wq->head = t->next;
+    if (!wq->head)
+        wq->tail = 0;
+    t->next = 0;
+    t->wq = 0;
+
+    if (t->wake_ns)
+        sleepers_remove(t);
+    make_ready(t);
+    return true;
+}
+
+bool wait_queue_sleep(WaitQueue *wq, uint64_t deadline_ns)
+{
+    if (!sched_can_block())
+    {
+        // Nobody to switch to: halt until an interrupt (which may be the
+        // wakeup) or the deadline. The caller re-checks its condition.
+        if (deadline_ns)
+            timer_idle_until(deadline_ns);
+        else
+        {
+            cpu_idle();
+            cpu_cli();
+        }
+        return !deadline_ns || clock_monotonic_ns() < deadline_ns;
+    }
+
+    if (deadline_ns && clock_monotonic_ns() >= deadline_ns)
+        return false;
+
+    Thread *t = g_current;
+    t->state = THREAD_BLOCKED;
+    t->wq = wq;
+    t->timed_out = false;
+    t->next = 0;
+    if (wq->tail)
+        wq->tail->next = t;
+    else
+        wq->head = t;
+    wq->tail = t;
+
+    if (deadline_ns)
+    {
+        t->wake_ns = deadline_ns;
+        t->sleep_next = g_sleepers;
+        g_sleepers = t;
+        timer_schedule_event(deadline_ns);
+    }
+
+    schedule();
+    return !t->timed_out;
+}
+
+void wait_queue_wake_one(WaitQueue *wq)
+{
+    uint32_t flags = cpu_irq_save();
+
+    wait_queue_wake_first(wq);
+    sched_preempt(flags);
+
+    cpu_irq_restore(flags);
+}
+
+void wait_queue_wake_all(WaitQueue *wq)
+{
+    uint32_t flags = cpu_irq_save();
+
+    while (wait_queue_wake_first(wq))
+    {
+    }
+    sched_preempt(flags);
+
+    cpu_irq_restore(flags);
+}
+
+void sched_timer_tick(void)
+{
+    if (!g_info.running)
+        return;
+
+    uint64_t now = clock_monotonic_ns();
+    uint64_t next_wake = 0;
+    Thread **link = &g_sleepers;
+
+    // Expire timed waits; remember the next deadline.
+    while (*link)
+    {
+        Thread *t = *link;
+
+        if (t->wake_ns <= now)
+        {
+            *link = t->sleep_next;
+            t->sleep_next = 0;
+            t->wake_ns = 0;
+            t->timed_out = true;
+            if (t->wq)
+            {
+                wait_queue_remove(t->wq, t);
+                t->wq = 0;
+            }
+            make_ready(t);
+            continue;
+        }
+
+        if (!next_wake || t->wake_ns < next_wake)
+            next_wake = t->wake_ns;
+        link = &t->sleep_next;
+    }
+
+    // Slice used up with another thread of the same priority waiting.
+    Thread *cur = g_current;
+    if (cur != g_idle && (g_info.ready_bitmap & (1u << cur->priority)) && now >= cur->slice_end_ns)
+        g_need_resched = true;
+
+    if (next_wake)
+        timer_schedule_event(next_wake);
+    sched_arm_slice();
+}
+
+// ---------------------------------------------------------------------------
+// Threads
+// ---------------------------------------------------------------------------
+
+static __attribute__((noreturn)) void sched_thread_start(void)
+{
+    // First switch-in: schedule() left interrupts off.
+    Thread *t = g_current;
+    cpu_sti();
+    t->entry(t->arg);
+    sched_exit();
+}
+
+static void sched_idle(void *arg)
+{
+    (void)arg;
+
+    for (;;)
+    {
+        cpu_cli();
+        if (g_info.ready_bitmap)
+        {
+            schedule();
+        }
+        else
+        {
+            g_info.idle_halts++;
+            cpu_idle(); // sti; hlt: a wakeup cannot slip in before the halt
+        }
+    }
+}
+
+static void sched_set_name(Thread *t, const char *name)
+{
+    uint32_t i = 0;
+    while (name && name[i] && i < SCHED_NAME_MAX - 1u)
+    {
+        t->name[i] = name[i];
+        i++;
+    }
+    t->name[i] = '\0';
+}
+
+// PCB and stack for a thread that will start in sched_thread_start(); not
+// on any queue yet. Interrupts may be on.
+static Thread *sched_create(const char *name, void (*entry)(void *arg), void *arg, uint8_t priority)
+{
+    Thread *t = kmalloc(sizeof(Thread));
+    uint8_t *stack = kmalloc(SCHED_STACK_SIZE);
+
+    if (!t || !stack)
+    {
+        kfree(stack);
+        kfree(t);
+        return 0;
+    }
+
+    memset(t, 0, sizeof(Thread));
+    sched_set_name(t, name);
+    t->priority = priority;
+    t->stack = stack;
+    t->stack_size = SCHED_STACK_SIZE;
+    t->entry = entry;
+    t->arg = arg;
+
+    // The frame context_switch() pops: edi, esi, ebx, ebp, return address.
+    uint32_t *sp = (uint32_t *)(stack + SCHED_STACK_SIZE);
+    *--sp = 0u;                                 // sched_thread_start's own return slot
+    *--sp = (uint32_t)(uintptr_t)sched_thread_start;
+    *--sp = 0u;                                 // ebp
+    *--sp = 0u;                                 // ebx
+    *--sp = 0u;                                 // esi
+    *--sp = 0u;                                 // edi
+    t->esp = (uint32_t)(uintptr_t)sp;
+
+    uint32_t flags = cpu_irq_save();
+    t->tid = g_next_tid++;
+    t->all_next = g_all;
+    g_all = t;
+    g_info.threads++;
+    cpu_irq_restore(flags);
+
+    return t;
+}
+
+int sched_init(void)
+{
+    Thread *m = &g_main;
+
+    sched_set_name(m, "main");
+    m->tid = g_next_tid++;
+    m->priority = SCHED_PRIO_NORMAL;
+    m->state = THREAD_RUNNING;
+    m->switches = 1u;
+    g_all = m;
+    g_info.threads = 1u;
+    g_current = m;
+
+    g_idle = sched_create("idle", sched_idle, 0, (uint8_t)(SCHED_PRIORITIES - 1u));
+    if (!g_idle)
+        return SCHED_ERR_NO_MEMORY;
+
+    m->slice_end_ns = clock_monotonic_ns() + SCHED_SLICE_NS;
+    g_info.running = true;
+    return SCHED_OK;
+}
+
+int sched_spawn(const char *name, void (*entry)(void *arg), void *arg, uint8_t priority, Thread **out)
+{
+    if (!entry || priority >= SCHED_PRIORITIES)
+        return SCHED_ERR_INVALID;
+    if (!g_info.running)
+        return SCHED_ERR_NOT_STARTED;
+
+    Thread *t = sched_create(name, entry, arg, priority);
+    if (!t)
+        return SCHED_ERR_NO_MEMORY;
+    if (out)
+        *out = t;
+
+    uint32_t flags = cpu_irq_save();
+    make_ready(t);
+    sched_preempt(flags);
+    cpu_irq_restore(flags);
+
+    return SCHED_OK;
+}
+
+void sched_exit(void)
+{
+    cpu_cli();
+
+    Thread *t = g_current;
+    t->state = THREAD_ZOMBIE;
+    while (wait_queue_wake_first(&t->joiners))
+    {
+    }
+
+    schedule();
+
+    // Never switched back in: sched_join() frees the stack.
+    for (;;)
+        cpu_hlt();
+}
+
+void sched_join(Thread *t)
+{
+    if (!t || t == g_current || t == &g_main || t == g_idle)
+        return;
+
+    uint32_t flags = cpu_irq_save();
+
+    while (t->state != THREAD_ZOMBIE)
+        wait_queue_sleep(&t->joiners, 0);
+
+    for (Thread **link = &g_all; *link; link = &(*link)->all_next)
+    {
+        if (*link == t)
+        {
+            *link = t->all_next;
+            break;
+        }
+    }
+    g_info.threads--;
+
+    cpu_irq_restore(flags);
+
+    kfree(t->stack);
+    kfree(t);
+}
+
+void sched_yield(void)
+{
+    uint32_t flags = cpu_irq_save();
+
+    if (sched_can_block())
+        schedule();
+
+    cpu_irq_restore(flags);
+}
+
+void sched_sleep_until(uint64_t deadline_ns)
+{
+    // Nobody wakes this queue: only the deadline ends the wait.
+    WaitQueue wq = WAIT_QUEUE_INIT;
+
+    if (!deadline_ns)
+        return;
+
+    uint32_t flags = cpu_irq_save();
+
+    while (wait_queue_sleep(&wq, deadline_ns))
+    {
+    }
+
+    cpu_irq_restore(flags);
+}
+
+Thread *sched_current(void)
+{
+    return g_info.running ? g_current : 0;
+}
+
+const Thread *sched_threads(void)
+{
+    return g_all;
+}
+
+const SchedInfo *sched_info(void)
+{
+    return &g_info;
+}
+
+const char *sched_state_name(uint8_t state)
+{
+    return (state <= THREAD_ZOMBIE) ? g_state_names[state] : "?";
+}
@@ -0,0 +1,141 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Preemptive kernel threads with an O(1) priority scheduler.
+ *
+ * Each thread has a Thread control block (PCB): saved stack pointer, kernel
+ * stack, state and priority. Priority 0 is the most urgent of
+ * SCHED_PRIORITIES levels; every level is a FIFO run queue and a bitmap
+ * records the non-empty ones, so picking the next thread is one
+ * count-trailing-zeros whatever the number of threads.
+ *
+ * A thread runs until it blocks, yields, or is preempted: by a wakeup of a
+ * more urgent thread, or by the timer once its SCHED_SLICE_NS time slice is
+ * used up while another thread of the same priority is ready (the slice end
+ * is armed as a timer event, so tickless mode stays tickless). Preemption
+ * happens on the way out of the outermost interrupt, after the softirqs.
+ *
+ * Wait queues block a thread until a wakeup or an optional deadline. Until
+ * sched_init() starts the scheduler (and on the application processors,
+ * which never run threads) a wait is the old sti;hlt loop, so code can wait
+ * the same way before and after.
+ *
+ * The boot context (k_main, then the shell) becomes the "main" thread; the
+ * "idle" thread halts the CPU whenever nothing else is ready. Threads run on
+ * the boot CPU only and share the kernel address space (no per-thread CR3).
+ * A thread is only switched out with interrupts off on its own behalf or
+ * when it had them on, so an _irqsave section (spinlock.h) is never
+ * preempted.
+ */
+
+#define SCHED_PRIORITIES        32u
+#define SCHED_PRIO_HIGH         8u
+#define SCHED_PRIO_NORMAL       16u
+#define SCHED_PRIO_LOW          24u
+#define SCHED_SLICE_NS          10000000u       /* 10 ms */
+#define SCHED_STACK_SIZE        8192u
+#define SCHED_NAME_MAX          16u
+
+/* Thread states */
+#define THREAD_READY            0u
+#define THREAD_RUNNING          1u
+#define THREAD_BLOCKED          2u
+#define THREAD_ZOMBIE           3u      /* Exited, waiting for sched_join() */
+
+/* Return codes (0 = success) */
+#define SCHED_OK                0
+#define SCHED_ERR_INVALID       1
+#define SCHED_ERR_NO_MEMORY     2
+#define SCHED_ERR_NOT_STARTED   3
+
+struct Thread;
+
+/* Threads blocked on some condition, woken in FIFO order. */
+typedef struct WaitQueue
+{
+    struct Thread *head;
+    struct Thread *tail;
+} WaitQueue;
+
+#define WAIT_QUEUE_INIT { 0, 0 }
+
+typedef struct Thread
+{
+    uint32_t esp;               /* Saved stack pointer: first (context.asm) */
+    uint32_t tid;
+    char name[SCHED_NAME_MAX];
+    uint8_t state;
+    uint8_t priority;
+    uint8_t *stack;             /* 0 = boot stack (main thread) */
+    uint32_t stack_size;
+    void (*entry)(void *arg);
+    void *arg;
+
+    struct Thread *next;        /* Run queue or wait queue link */
+    struct Thread *all_next;    /* Every thread, newest first */
+    struct Thread *sleep_next;  /* Threads with a wakeup deadline */
+    WaitQueue *wq;              /* Queue it is blocked on */
+    uint64_t wake_ns;           /* Deadline of a timed wait (0 = none) */
+    bool timed_out;
+    uint64_t slice_end_ns;
+
+    uint32_t switches;          /* Times switched in */
+    uint32_t preemptions;       /* Times switched out while still ready */
+    WaitQueue joiners;          /* sched_join() callers */
+} Thread;
+
+typedef struct
+{
+    bool running;               /* sched_init() done */
+    uint32_t threads;           /* Including main and idle */
+    uint32_t ready_bitmap;      /* Bit p: priority p has ready threads */
+    uint32_t switches;
+    uint32_t preemptions;       /* Switches away from a still-ready thread */
+    uint32_t idle_halts;
+} SchedInfo;
+
+/* Adopt the calling context as "main", create "idle", start scheduling.
+ * Needs heap_init() and the timer; call with interrupts off. */
+int sched_init(void);
+
+/* New thread, ready to run `entry(arg)` (SCHED_OK, PCB in *out if given).
+ * A more urgent thread runs at once if the caller has interrupts on. */
+int sched_spawn(const char *name, void (*entry)(void *arg), void *arg, uint8_t priority, Thread **out);
+
+/* End the calling thread (returning from its entry does the same). */
+void sched_exit(void) __attribute__((noreturn));
+
+/* Wait for `t` to exit, then free its stack and PCB. */
+void sched_join(Thread *t);
+
+/* Let a ready thread of the same or a more urgent priority run. */
+void sched_yield(void);
+
+/* Block until clock_monotonic_ns() reaches deadline_ns. */
+void sched_sleep_until(uint64_t deadline_ns);
+
+Thread *sched_current(void);
+const Thread *sched_threads(void);      /* all_next list */
+const SchedInfo *sched_info(void);
+const char *sched_state_name(uint8_t state);
+
+/* Interrupts must be off; the caller has just found its condition false.
+ * Sleeps until woken or until deadline_ns (0 = no deadline) and returns with
+ * interrupts still off: true if woken, false on timeout. */
+bool wait_queue_sleep(WaitQueue *wq, uint64_t deadline_ns);
+
+/* Make the first / every waiter ready (any context on the boot CPU). */
+void wait_queue_wake_one(WaitQueue *wq);
+void wait_queue_wake_all(WaitQueue *wq);
+
+/* Timer interrupt: expire timed waits, end time slices. */
+void sched_timer_tick(void);
+
+/* Outermost interrupt exit (interrupts off): switch if a reschedule is due. */
+void sched_irq_exit(void);
+
+#endif /* SCHED_H */
@@ -10,7 +10,32 @@
  */
 int selftest_pmm(void);
 int selftest_heap(void);
+int selftest_clock(void);
+int selftest_timer_tickless(void);
+int selftest_timer_wheel(void);
+int selftest_irq(void);
+int selftest_softirq(void);
+int selftest_apic(void);
+int selftest_irqtrace(void);
+int selftest_smp(void);
+int selftest_sched(void);
 int selftest_ata(void);
+int selftest_block_queue(void);
+int selftest_ramdisk(void);
+int selftest_block_write(void);
+int selftest_block_async(void);
+int selftest_block_hybrid_poll(void);
+int selftest_block_flush(void);
+int selftest_ata_dma(void);
+int selftest_ata_lba48(void);
+int selftest_ata_channels(void);
+int selftest_ata_partition_irq(void);
+int selftest_ata_lost_irq(void);
+int selftest_ata_shared_channel(void);
+int selftest_ahci_ncq(void);
+int selftest_virtio_blk(void);
+int selftest_nvme(void);
+int selftest_md(void);
 
 /*
  * Runs all self-tests and prints a summary report to the console.
@@ -4,18 +4,100 @@
 #include "pmm.h"
 #include "io.h"
 #include "timer.h"
+#include "timer_wheel.h"
+#include "irq.h"
+#include "softirq.h"
+#include "irqtrace.h"
+#include "apic.h"
+#include "acpi.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "sched.h"
+#include "cpu.h"
+#include "clock.h"
+#include "div64.h"
 #include "rtc.h"
-#include "ata.h"
 #include "block.h"
+#include "ata.h"
+#include "ata_block.h"
+#include "ahci.h"
+#include "virtio_blk.h"
+#include "nvme.h"
+#include "md.h"
+#include "pci.h"
 #include "fs/vfs.h"
 #include "heap.h"
 #include "selftest.h"
 #include "terminal.h"
 
 #define CMD_BUF_SIZE 128
+
+/* 'cat' stops after this many bytes (guards endless nodes like /dev/zero). */
+#define CAT_MAX_BYTES 8192u
+
+/* 'threads' lists at most this many (copied with interrupts off). */
+#define THREADS_MAX_LISTED 16u
 static char cmd_buffer[CMD_BUF_SIZE];
 static int cmd_idx = 0;
 
+/* Decimal with leading zeros to `digits` places (fractions, clock fields). */
+static void shell_print_dec_pad(uint32_t n, uint32_t digits, uint8_t color)
+{
+    char buf[11];
+    uint32_t i = digits < 10u ? digits : 10u;
+
+    buf[i] = '\0';
+    while (i > 0u)
+    {
+        buf[--i] = (char)('0' + n % 10u);
+        n /= 10u;
+    }
+    term_print(buf, color);
+}
+
+/* Nanoseconds as seconds with microsecond precision ("12.345678"). */
+static void shell_print_ns(uint64_t ns, uint8_t color)
+{
+    uint32_t rem = 0u;
+    uint32_t sec = clock_ns_to_sec(ns, &rem);
+
+    term_print_dec(sec, color);
+    term_print(".", color);
+    shell_print_dec_pad(rem / 1000u, 6u, color);
+}
+
+/* TSC cycles as microseconds (saturates at ~71 minutes). */
+static uint32_t shell_cycles_to_us(uint64_t cycles)
+{
+    uint64_t us = div64_u32(clock_cycles_to_ns(cycles), 1000u, 0);
+    return (us >> 32) ? 0xFFFFFFFFu : (uint32_t)us;
+}
+
+/* Histogram summary, then its non-empty buckets as "<from us>:count". */
+static void shell_print_trace_hist(const IrqTraceHist *h)
+{
+    term_print("n=", 0x07);
+    term_print_dec(h->count, 0x0E);
+    term_print(" max=", 0x07);
+    term_print_dec(h->max_ns / 1000u, 0x0E);
+    term_print(" us |", 0x07);
+
+    for (uint32_t b = 0; b < IRQTRACE_BUCKETS; b++)
+    {
+        if (!h->hist[b])
+            continue;
+
+        term_print(" ", 0x07);
+        if (b == 0u)
+            term_print("<1", 0x0B);
+        else
+            term_print_dec(1u << (b - 1u), 0x0B);
+        term_print(":", 0x07);
+        term_print_dec(h->hist[b], 0x0E);
+    }
+    term_print("\n", 0x07);
+}
+
 void shell_init(void)
 {
     term_print("\nWelcome to PyramidOS Shell (KShell v1.0)\n", 0x0B); // Cyan
@@ -37,11 +119,31 @@ void execute_command(void)
         term_print("  mem     - Show memory statistics\n", 0x07);
         term_print("  uptime  - Show system uptime\n", 0x07);
         term_print("  time    - Show current date and time\n", 0x07);
+        term_print("  clock   - Show the TSC clock (calibration, monotonic/wall time)\n", 0x07);
+        term_print("  timer   - Show timer mode, wakeups and kernel timers ('timer tickless|periodic')\n", 0x07);
         term_print("  sleep   - Sleep for 1 second\n", 0x07);
-        term_print("  reboot   - Restart the system\n", 0x07);
+        term_print("  irqstat - Show per-line interrupt counts, handler time and softirq work\n", 0x07);
+        term_print("  irqtrace - Show IRQs-off spans and interrupt latency ('irqtrace on|off|reset')\n", 0x07);
+        term_print("  apic    - Show the interrupt controller (ACPI MADT, LAPIC, I/O APIC routes)\n", 0x07);
+        term_print("  cpus    - Show per-CPU counters and spinlock contention\n", 0x07);
+        term_print("  threads - Show kernel threads and scheduler statistics\n", 0x07);
+        term_print("  reboot   - Restart the system (syncs disks first)\n", 0x07);
+        term_print("  sync     - Write out staged data and flush disk caches\n", 0x07);
         term_print("  crash    - Force a kernel crash (for testing)\n", 0x07);
         term_print("  diskread - Read a disk sector (e.g., diskread 0)\n", 0x07);
         term_print("  blkinfo  - List registered block devices\n", 0x07);
+        term_print("  atainfo  - Show ATA drive capabilities (IDENTIFY)\n", 0x07);
+        term_print("  atadma   - Switch ATA bus-master DMA (atadma on|off)\n", 0x07);
+        term_print("  ahciinfo - Show AHCI SATA ports (NCQ depth, commands)\n", 0x07);
+        term_print("  vblkinfo - Show virtio-blk disks (queue, requests, IRQs)\n", 0x07);
+        term_print("  nvmeinfo - Show NVMe controllers, queue pairs and namespaces\n", 0x07);
+        term_print("  mdstat   - Show md RAID arrays and member states\n", 0x07);
+        term_print("  mdcreate - Build an array (mdcreate raid1 disk0 disk1 [chunk])\n", 0x07);
+        term_print("  lspci    - List PCI devices\n", 0x07);
+        term_print("  blkq     - Show block request queue statistics\n", 0x07);
+        term_print("  iostat   - Show block I/O statistics ('iostat reset' clears)\n", 0x07);
+        term_print("  blkpoll  - Switch hybrid completion polling (blkpoll on|off)\n", 0x07);
+        term_print("  cat      - Print a text file (e.g., cat /dev/iostat)\n", 0x07);
         term_print("  mounts   - List VFS mounts\n", 0x07);
         term_print("  pyfs_sb  - Read /py/superblock (PyFS probe via VFS)\n", 0x07);
         term_print("  diagnose - Run kernel diagnostics (PMM/Heap/ATA)\n", 0x07);
@@ -79,7 +181,615 @@ void execute_command(void)
             term_print(dev->name, 0x0B);
             term_print("  sector_size=", 0x07);
             term_print_hex(dev->sector_size, 0x0E);
+            term_print("  sectors=", 0x07);
+            term_print_hex(dev->sector_count, 0x0E);
+            term_print("\n", 0x07);
+        }
+    }
+    else if (strcmp(cmd_buffer, "atainfo") == 0)
+    {
+        static const char *const positions[ATA_DRIVE_COUNT] = {
+            "  pri master: ", "  pri slave:  ", "  sec master: ", "  sec slave:  "
+        };
+
+        for (int d = 0; d < (int)ATA_DRIVE_COUNT; d++)
+        {
+            const AtaDriveInfo *info = ata_get_info(d);
+
+            term_print(positions[d], 0x07);
+            if (!info || !info->present)
+            {
+                term_print("absent\n", 0x07);
+                continue;
+            }
+
+            term_print(info->model, 0x0B);
+            term_print("\n    lba28_sectors=", 0x07);
+            term_print_hex(info->lba28_sectors, 0x0E);
+            term_print("  lba48=", 0x07);
+            term_print(info->lba48 ? "yes" : "no", 0x0E);
+            if (info->lba48)
+            {
+                term_print(" (sectors=", 0x07);
+                if ((info->sectors >> 32) != 0u)
+                {
+                    term_print_hex((uint32_t)(info->sectors >> 32), 0x0E);
+                    term_print(":", 0x07);
+                }
+                term_print_hex((uint32_t)info->sectors, 0x0E);
+                term_print(")", 0x07);
+            }
+            term_print("  max_cmd=", 0x07);
+            term_print_hex(ata_max_sectors(d), 0x0E);
+            term_print("  dma=", 0x07);
+            term_print(info->dma ? "yes" : "no", 0x0E);
+            term_print("  wcache=", 0x07);
+            term_print(info->write_cache ? "yes" : "no", 0x0E);
+            term_print("\n    multiple=", 0x07);
+            term_print_hex(info->multiple, 0x0E);
+            term_print(" (max ", 0x07);
+            term_print_hex(info->max_multiple, 0x0E);
+            term_print(")  mwdma=", 0x07);
+            term_print_hex(info->mwdma_modes, 0x0E);
+            term_print("  udma=", 0x07);
+            term_print_hex(info->udma_modes, 0x0E);
+            term_print("\n", 0x07);
+        }
+
+        term_print("  completion: ", 0x07);
+        term_print(ata_block_irq_mode() ? "IRQ14/15" : "polling", 0x0B);
+        for (int c = 0; c < (int)ATA_CHANNEL_COUNT; c++)
+        {
+            uint32_t spurious = 0u;
+            uint32_t irqs = ata_block_irq_count(c, &spurious);
+
+            term_print((c == ATA_CHANNEL_PRIMARY) ? "  irq14=" : "  irq15=", 0x07);
+            term_print_hex(irqs, 0x0E);
+            term_print(" (spurious ", 0x07);
+            term_print_hex(spurious, 0x0E);
+            term_print(")", 0x07);
+        }
+        term_print("\n  overlapped commands: ", 0x07);
+        term_print_hex(ata_block_overlapped(), 0x0E);
+        term_print("\n", 0x07);
+
+        uint32_t fallbacks = 0u;
+        uint32_t dma_xfers = ata_dma_transfers(&fallbacks);
+
+        term_print("  dma: ", 0x07);
+        if (!ata_dma_available())
+            term_print("unavailable", 0x0B);
+        else
+            term_print(ata_dma_enabled() ? "bus-master" : "off (PIO)", 0x0B);
+        term_print("  transfers=", 0x07);
+        term_print_hex(dma_xfers, 0x0E);
+        term_print("  pio_fallbacks=", 0x07);
+        term_print_hex(fallbacks, 0x0E);
+        term_print("\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "atadma on") == 0 || strcmp(cmd_buffer, "atadma off") == 0)
+    {
+        if (!ata_dma_available())
+        {
+            term_print("No bus-master IDE controller; staying on PIO.\n", 0x0C);
+        }
+        else
+        {
+            ata_dma_set_enabled(cmd_buffer[8] == 'n');
+            term_print(ata_dma_enabled() ? "ATA DMA enabled.\n" : "ATA DMA disabled (PIO).\n", 0x07);
+        }
+    }
+    else if (strcmp(cmd_buffer, "ahciinfo") == 0)
+    {
+        uint32_t n = ahci_disk_count();
+        uint32_t cap = ahci_hba_cap();
+
+        if (cap == 0u)
+        {
+            term_print("No AHCI controller found.\n", 0x07);
+        }
+        else
+        {
+            term_print("  hba: slots=", 0x07);
+            term_print_hex(((cap >> AHCI_CAP_NCS_SHIFT) & AHCI_CAP_NCS_MASK) + 1u, 0x0E);
+            term_print("  ncq=", 0x07);
+            term_print((cap & AHCI_CAP_SNCQ) ? "yes" : "no", 0x0E);
+            term_print("  irq=", 0x07);
+            term_print_hex(ahci_irq_line(), 0x0E);
+            term_print(" (count ", 0x07);
+            term_print_hex(ahci_irq_count(), 0x0E);
+            term_print(")\n", 0x07);
+        }
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const AhciDiskInfo *info = ahci_disk_info(i);
+            if (!info)
+                continue;
+
+            term_print("  sata", 0x07);
+            term_print_dec(i, 0x07);
+            term_print(" (port ", 0x07);
+            term_print_hex(info->port, 0x07);
+            term_print("): ", 0x07);
+            term_print(info->model, 0x0B);
+            term_print("\n    sectors=", 0x07);
+            if ((info->sectors >> 32) != 0u)
+            {
+                term_print_hex((uint32_t)(info->sectors >> 32), 0x0E);
+                term_print(":", 0x07);
+            }
+            term_print_hex((uint32_t)info->sectors, 0x0E);
+            term_print("  lba48=", 0x07);
+            term_print(info->lba48 ? "yes" : "no", 0x0E);
+            term_print("  ncq=", 0x07);
+            term_print(info->ncq ? "yes" : "no", 0x0E);
+            term_print("  wcache=", 0x07);
+            term_print(info->write_cache ? "yes" : "no", 0x0E);
+            term_print("  fua=", 0x07);
+            term_print(info->fua ? "yes" : "no", 0x0E);
+            term_print("  depth=", 0x07);
+            term_print_hex(info->queue_depth, 0x0E);
+            term_print("\n    commands=", 0x07);
+            term_print_hex(info->commands, 0x0E);
+            term_print("  max_outstanding=", 0x07);
+            term_print_hex(info->max_outstanding, 0x0E);
+            term_print("  errors=", 0x07);
+            term_print_hex(info->errors, 0x0E);
+            term_print("\n", 0x07);
+        }
+    }
+    else if (strcmp(cmd_buffer, "vblkinfo") == 0)
+    {
+        uint32_t n = virtio_blk_count();
+
+        if (n == 0u)
+            term_print("No virtio-blk disks found.\n", 0x07);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const VirtioBlkInfo *info = virtio_blk_info(i);
+            if (!info)
+                continue;
+
+            term_print("  vd", 0x07);
+            term_print_dec(i, 0x07);
+            term_print(info->modern ? " (modern)" : " (legacy)", 0x0B);
+            term_print(info->read_only ? " read-only" : "", 0x0C);
+            term_print("\n    sectors=", 0x07);
+            if ((info->sectors >> 32) != 0u)
+            {
+                term_print_hex((uint32_t)(info->sectors >> 32), 0x0E);
+                term_print(":", 0x07);
+            }
+            term_print_hex((uint32_t)info->sectors, 0x0E);
+            term_print("  max_sectors=", 0x07);
+            term_print_hex(info->max_sectors, 0x0E);
+            term_print("  flush=", 0x07);
+            term_print(info->flush ? "yes" : "no", 0x0E);
+            term_print("\n    queue=", 0x07);
+            term_print_hex(info->queue_size, 0x0E);
+            term_print("  depth=", 0x07);
+            term_print_hex(info->queue_depth, 0x0E);
+            term_print("  irq=", 0x07);
+            term_print_hex(info->irq_line, 0x0E);
+            term_print(" (count ", 0x07);
+            term_print_hex(info->irqs, 0x0E);
+            term_print(")\n    requests=", 0x07);
+            term_print_hex(info->requests, 0x0E);
+            term_print("  max_outstanding=", 0x07);
+            term_print_hex(info->max_outstanding, 0x0E);
+            term_print("  errors=", 0x07);
+            term_print_hex(info->errors, 0x0E);
+            term_print("\n", 0x07);
+        }
+    }
+    else if (strcmp(cmd_buffer, "nvmeinfo") == 0)
+    {
+        uint32_t n = nvme_controller_count();
+
+        if (n == 0u)
+            term_print("No NVMe controller found.\n", 0x07);
+
+        for (uint32_t c = 0; c < n; c++)
+        {
+            const NvmeControllerInfo *info = nvme_controller_info(c);
+            if (!info)
+                continue;
+
+            term_print("  nvme", 0x07);
+            term_print_dec(c, 0x07);
+            term_print(": ", 0x07);
+            term_print(info->model, 0x0B);
+            term_print(" (sn ", 0x07);
+            term_print(info->serial, 0x07);
+            term_print(")\n    version=", 0x07);
+            term_print_hex(info->version, 0x0E);
+            term_print("  queues=", 0x07);
+            term_print_hex(info->io_queues, 0x0E);
+            term_print("x", 0x07);
+            term_print_hex(info->queue_size, 0x0E);
+            term_print("  max_sectors=", 0x07);
+            term_print_hex(info->max_sectors, 0x0E);
+            term_print("  cache=", 0x07);
+            term_print(info->write_cache ? "yes" : "no", 0x0E);
+            term_print("\n    commands=", 0x07);
+            term_print_hex(info->commands, 0x0E);
+            term_print("  doorbells=", 0x07);
+            term_print_hex(info->doorbells, 0x0E);
+            term_print("  irq=", 0x07);
+            term_print_hex(info->irq_line, 0x0E);
+            term_print(" (count ", 0x07);
+            term_print_hex(info->irqs, 0x0E);
+            term_print(")\n", 0x07);
+
+            for (uint32_t i = 0; i < info->namespaces; i++)
+            {
+                const NvmeNamespaceInfo *ns = nvme_namespace_info(c, i);
+                if (!ns)
+                    continue;
+
+                term_print("    n", 0x07);
+                term_print_dec(ns->nsid, 0x07);
+                term_print(": sectors=", 0x07);
+                if ((ns->sectors >> 32) != 0u)
+                {
+                    term_print_hex((uint32_t)(ns->sectors >> 32), 0x0E);
+                    term_print(":", 0x07);
+                }
+                term_print_hex((uint32_t)ns->sectors, 0x0E);
+                term_print("  depth=", 0x07);
+                term_print_hex(ns->queue_depth, 0x0E);
+                term_print("  requests=", 0x07);
+                term_print_hex(ns->requests, 0x0E);
+                term_print("  max_outstanding=", 0x07);
+                term_print_hex(ns->max_outstanding, 0x0E);
+                term_print("  errors=", 0x07);
+                term_print_hex(ns->errors, 0x0E);
+                term_print("\n", 0x07);
+            }
+        }
+    }
+    else if (strcmp(cmd_buffer, "mdstat") == 0)
+    {
+        uint32_t n = md_count();
+
+        if (n == 0u)
+            term_print("No md arrays.\n", 0x07);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const MdArrayInfo *info = md_info(i);
+            if (!info)
+                continue;
+
+            term_print(info->name, 0x0B);
+            term_print((info->level == MD_LEVEL_RAID0) ? " : raid0" : " : raid1", 0x07);
+            if (info->degraded)
+                term_print(" (degraded)", 0x0C);
+            term_print("  sectors=", 0x07);
+            term_print_dec(info->sectors, 0x0E);
+            if (info->level == MD_LEVEL_RAID0)
+            {
+                term_print("  chunk=", 0x07);
+                term_print_dec(info->chunk_sectors, 0x0E);
+            }
+            term_print("  events=", 0x07);
+            term_print_dec(info->events, 0x0E);
+            term_print("\n", 0x07);
+
+            for (uint32_t m = 0; m < info->raid_disks; m++)
+            {
+                term_print("    [", 0x07);
+                term_print_dec(m, 0x07);
+                term_print("] ", 0x07);
+                term_print(info->member[m][0] ? info->member[m] : "(missing)", 0x0B);
+                term_print(info->failed[m] ? "  failed" : "  active", info->failed[m] ? 0x0C : 0x07);
+                term_print("  rd=", 0x07);
+                term_print_dec(info->reads[m], 0x0E);
+                term_print(" wr=", 0x07);
+                term_print_dec(info->writes[m], 0x0E);
+                term_print("\n", 0x07);
+            }
+
+            if (info->errors != 0u || info->retries != 0u)
+            {
+                term_print("    errors=", 0x07);
+                term_print_dec(info->errors, 0x0C);
+                term_print(" retried_reads=", 0x07);
+                term_print_dec(info->retries, 0x0E);
+                term_print("\n", 0x07);
+            }
+        }
+    }
+    else if (strncmp(cmd_buffer, "mdcreate ", 9) == 0)
+    {
+        // mdcreate <raid0|raid1> <dev> <dev> [<dev> <dev>] [chunk_sectors]
+        char *args[MD_MAX_MEMBERS + 2u];
+        uint32_t argc = 0u;
+        char *p = cmd_buffer + 9;
+
+        while (*p && argc < MD_MAX_MEMBERS + 2u)
+        {
+            while (*p == ' ')
+                *p++ = '\0';
+            if (!*p)
+                break;
+
+            args[argc++] = p;
+            while (*p && *p != ' ')
+                p++;
+        }
+
+        uint32_t level = 0xFFFFFFFFu;
+        if (argc > 0u && strcmp(args[0], "raid0") == 0)
+            level = MD_LEVEL_RAID0;
+        else if (argc > 0u && strcmp(args[0], "raid1") == 0)
+            level = MD_LEVEL_RAID1;
+
+        uint32_t chunk = 0u;
+        if (argc > 3u && args[argc - 1u][0] >= '0' && args[argc - 1u][0] <= '9')
+            chunk = (uint32_t)atoi(args[--argc]);
+
+        BlockDevice *members[MD_MAX_MEMBERS];
+        uint32_t count = 0u;
+        bool ok = level != 0xFFFFFFFFu && argc >= 3u && argc - 1u <= MD_MAX_MEMBERS;
+
+        for (uint32_t i = 1; ok && i < argc; i++)
+        {
+            members[count] = block_get_by_name(args[i]);
+            if (!members[count])
+            {
+                term_print("No such block device: ", 0x0C);
+                term_print(args[i], 0x0C);
+                term_print("\n", 0x0C);
+                ok = false;
+            }
+            count++;
+        }
+
+        if (!ok)
+        {
+            term_print("Usage: mdcreate raid0|raid1 <dev> <dev>... [chunk_sectors]\n", 0x07);
+        }
+        else
+        {
+            term_print("Building array (member data is overwritten)...\n", 0x07);
+            int rc = md_create(level, chunk, members, count);
+            if (rc == MD_OK)
+            {
+                term_print("Created ", 0x07);
+                term_print(md_info(md_count() - 1u)->name, 0x0B);
+                term_print("\n", 0x07);
+            }
+            else
+            {
+                term_print("mdcreate failed (rc=", 0x0C);
+                term_print_hex((uint32_t)rc, 0x0C);
+                term_print(")\n", 0x0C);
+            }
+        }
+    }
+    else if (strcmp(cmd_buffer, "lspci") == 0)
+    {
+        uint32_t n = pci_count();
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const PciDevice *dev = pci_get(i);
+            if (!dev)
+                continue;
+
+            term_print("  ", 0x07);
+            term_print_hex(dev->bus, 0x07);
+            term_print(":", 0x07);
+            term_print_hex(dev->slot, 0x07);
+            term_print(".", 0x07);
+            term_print_hex(dev->func, 0x07);
+            term_print("  ", 0x07);
+            term_print_hex(dev->vendor_id, 0x0B);
+            term_print(":", 0x07);
+            term_print_hex(dev->device_id, 0x0B);
+            term_print("  class=", 0x07);
+            term_print_hex(dev->class_code, 0x0E);
+            term_print("/", 0x07);
+            term_print_hex(dev->subclass, 0x0E);
+            term_print("/", 0x07);
+            term_print_hex(dev->prog_if, 0x0E);
+            term_print("  irq=", 0x07);
+            term_print_hex(dev->irq_line, 0x0E);
+            term_print("\n", 0x07);
+        }
+
+        if (n == 0u)
+            term_print("No PCI devices found.\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "blkq") == 0)
+    {
+        uint32_t n = block_count();
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            BlockDevice *dev = block_get(i);
+            if (!dev)
+                continue;
+
+            const BlockQueueStats *st = &dev->queue.stats;
+            uint32_t merges = st->back_merges + st->front_merges + st->overlap_merges;
+
+            term_print(dev->name, 0x0B);
+            term_print("  submitted=", 0x07);
+            term_print_hex(st->submitted, 0x0E);
+            term_print(" dispatched=", 0x07);
+            term_print_hex(st->dispatched, 0x0E);
+            term_print(" sectors=", 0x07);
+            term_print_hex(st->sectors, 0x0E);
+            term_print("\n    merges=", 0x07);
+            term_print_hex(merges, 0x0E);
+            term_print(" (back=", 0x07);
+            term_print_hex(st->back_merges, 0x07);
+            term_print(" front=", 0x07);
+            term_print_hex(st->front_merges, 0x07);
+            term_print(" overlap=", 0x07);
+            term_print_hex(st->overlap_merges, 0x07);
+            term_print(") merge%=", 0x07);
+            term_print_hex(st->submitted ? (merges * 100u) / st->submitted : 0u, 0x0E);
+            term_print("\n    depth max=", 0x07);
+            term_print_hex(st->max_depth, 0x0E);
+            term_print(" avg=", 0x07);
+            term_print_hex(st->submitted ? st->depth_sum / st->submitted : 0u, 0x0E);
+            term_print(" deadline=", 0x07);
+            term_print_hex(st->deadline_dispatches, 0x07);
+            term_print(" bounced=", 0x07);
+            term_print_hex(st->bounced, 0x07);
+            term_print(" drains=", 0x07);
+            term_print_hex(st->drains, 0x07);
+            term_print(" errors=", 0x07);
+            term_print_hex(st->errors, 0x07);
+            term_print("\n    tags=", 0x07);
+            term_print_hex((dev->queue_depth > 1u) ? dev->queue_depth : 1u, 0x0E);
+            term_print(" max_inflight=", 0x07);
+            term_print_hex(st->max_inflight, 0x0E);
+            term_print("\n", 0x07);
+        }
+    }
+    else if (strcmp(cmd_buffer, "iostat") == 0)
+    {
+        uint32_t n = block_count();
+
+        term_print("Latency buckets: N = [2^N, 2^(N+1)) TSC cycles (2^10 = ", 0x07);
+        term_print_dec((uint32_t)clock_cycles_to_ns(1024u), 0x0E);
+        term_print(" ns)\n", 0x07);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            BlockDevice *dev = block_get(i);
+            if (!dev)
+                continue;
+
+            const BlockStats *st = &dev->stats;
+
+            term_print(dev->name, 0x0B);
+            term_print("  rd=", 0x07);
+            term_print_dec(st->reads, 0x0E);
+            term_print(" wr=", 0x07);
+            term_print_dec(st->writes, 0x0E);
+            term_print(" rsect=", 0x07);
+            term_print_dec(st->sectors_read, 0x0E);
+            term_print(" wsect=", 0x07);
+            term_print_dec(st->sectors_written, 0x0E);
+            term_print(" err=", 0x07);
+            term_print_dec(st->errors, 0x0E);
+            term_print(" inflight=", 0x07);
+            term_print_dec(st->in_flight, 0x0E);
+            term_print("/", 0x07);
+            term_print_dec(st->max_in_flight, 0x0E);
             term_print("\n", 0x07);
+
+            if (st->poll_waits != 0u || st->irq_waits != 0u)
+            {
+                // Cycle totals in units of 1024 (term_print_dec is 32-bit).
+                term_print("    wait: poll=", 0x07);
+                term_print_dec(st->poll_waits, 0x0E);
+                term_print(" (miss ", 0x07);
+                term_print_dec(st->poll_misses, 0x0E);
+                term_print(") irq=", 0x07);
+                term_print_dec(st->irq_waits, 0x0E);
+                term_print(" spin_kcyc=", 0x07);
+                term_print_dec((uint32_t)(st->poll_cycles >> 10), 0x0E);
+                term_print(" saved_kcyc=", 0x07);
+                term_print_dec((uint32_t)(st->irq_cycles >> 10), 0x0E);
+                term_print("\n", 0x07);
+            }
+
+            if (st->flush_requests != 0u || st->fua_writes != 0u || st->flushes != 0u)
+            {
+                term_print("    cache: ", 0x07);
+                term_print(dev->write_cache ? (dev->fua ? "write-back+fua" : "write-back") : "none", 0x0B);
+                term_print(" flush_rq=", 0x07);
+                term_print_dec(st->flush_requests, 0x0E);
+                term_print(" fua=", 0x07);
+                term_print_dec(st->fua_writes, 0x0E);
+                term_print(" flushes=", 0x07);
+                term_print_dec(st->flushes, 0x0E);
+                if (st->flushes != 0u)
+                {
+                    term_print(" avg_us=", 0x07);
+                    term_print_dec((uint32_t)div64_u32(clock_cycles_to_ns(st->flush_cycles), st->flushes * 1000u, 0), 0x0E);
+                }
+                term_print("\n", 0x07);
+            }
+
+            for (uint32_t dir = 0; dir < 3u; dir++)
+            {
+                static const char *const labels[3] = { "    rd_lat", "    wr_lat", "    fl_lat" };
+                const uint32_t *hist = (dir == 0u) ? st->read_lat : (dir == 1u) ? st->write_lat : st->flush_lat;
+                uint32_t total = (dir == 0u) ? st->reads : (dir == 1u) ? st->writes : st->flushes;
+                if (total == 0u)
+                    continue;
+
+                term_print(labels[dir], 0x07);
+                for (uint32_t b = 0; b < BLOCK_LAT_BUCKETS; b++)
+                {
+                    if (hist[b] == 0u)
+                        continue;
+
+                    term_print(" ", 0x07);
+                    term_print_dec(b, 0x0B);
+                    term_print(":", 0x07);
+                    term_print_dec(hist[b], 0x0E);
+                }
+                term_print("\n", 0x07);
+            }
+        }
+    }
+    else if (strcmp(cmd_buffer, "blkpoll on") == 0 || strcmp(cmd_buffer, "blkpoll off") == 0)
+    {
+        block_set_hybrid_poll(cmd_buffer[9] == 'n');
+        term_print(block_hybrid_poll() ? "Hybrid polling enabled.\n" : "Hybrid polling disabled (interrupt waits only).\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "iostat reset") == 0)
+    {
+        for (uint32_t i = 0; i < block_count(); i++)
+            block_stats_reset(block_get(i));
+
+        term_print("Block I/O statistics cleared.\n", 0x07);
+    }
+    else if (strncmp(cmd_buffer, "cat ", 4) == 0)
+    {
+        uint32_t fd = 0u;
+        int rc = vfs_open(cmd_buffer + 4, VFS_OPEN_READ, &fd);
+        if (rc != VFS_OK)
+        {
+            term_print("cat: open failed (rc=", 0x0C);
+            term_print_hex((uint32_t)rc, 0x0C);
+            term_print(")\n", 0x0C);
+        }
+        else
+        {
+            char buf[129];
+            uint32_t read = 0u;
+            uint32_t total = 0u;
+
+            while (total < CAT_MAX_BYTES)
+            {
+                rc = vfs_read(fd, buf, (uint32_t)(sizeof(buf) - 1u), &read);
+                if (rc != VFS_OK || read == 0u)
+                    break;
+
+                buf[read] = '\0';
+                term_print(buf, 0x07);
+                total += read;
+            }
+
+            if (rc != VFS_OK)
+            {
+                term_print("cat: read failed (rc=", 0x0C);
+                term_print_hex((uint32_t)rc, 0x0C);
+                term_print(")\n", 0x0C);
+            }
+
+            (void)vfs_close(fd);
         }
     }
     else if (strcmp(cmd_buffer, "mounts") == 0)
@@ -144,45 +854,489 @@ void execute_command(void)
     }
     else if (strcmp(cmd_buffer, "uptime") == 0)
     {
-        uint64_t t = timer_get_ticks();
-        // Ticks / 100 = Seconds
-        uint32_t seconds = (uint32_t)(t / 100);
-
         term_print("System Uptime: ", 0x07);
-        term_print_hex(seconds, 0x07);
+        shell_print_ns(clock_monotonic_ns(), 0x0E);
         term_print(" seconds (", 0x07);
-        term_print_hex((uint32_t)t, 0x07);
+        term_print_dec((uint32_t)timer_get_ticks(), 0x0E);
         term_print(" ticks)\n", 0x07);
     }
     else if (strcmp(cmd_buffer, "time") == 0)
     {
+        // Boot-time RTC sample + monotonic clock: no CMOS access here.
         DateTime dt;
-        rtc_get_time(&dt);
+        rtc_from_epoch(clock_realtime(), &dt);
 
         term_print("Date: ", 0x0B);
-        // Simple print: 2023 11 19
-        term_print_hex(dt.year, 0x0B);
+        term_print_dec(dt.year, 0x0B);
         term_print("/", 0x0B);
-        term_print_hex(dt.month, 0x0B);
+        shell_print_dec_pad(dt.month, 2u, 0x0B);
         term_print("/", 0x0B);
-        term_print_hex(dt.day, 0x0B);
+        shell_print_dec_pad(dt.day, 2u, 0x0B);
 
         term_print("\nTime: ", 0x0B);
-        term_print_hex(dt.hour, 0x0B);
+        shell_print_dec_pad(dt.hour, 2u, 0x0B);
         term_print(":", 0x0B);
-        term_print_hex(dt.minute, 0x0B);
+        shell_print_dec_pad(dt.minute, 2u, 0x0B);
         term_print(":", 0x0B);
-        term_print_hex(dt.second, 0x0B);
+        shell_print_dec_pad(dt.second, 2u, 0x0B);
+        term_print(" UTC\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "clock") == 0)
+    {
+        const ClockInfo *ci = clock_info();
+
+        term_print("TSC: ", 0x07);
+        if (ci->calibrated)
+        {
+            term_print_dec(ci->tsc_khz, 0x0E);
+            term_print(" kHz (PIT ch2, ", 0x07);
+            term_print_dec(CLOCK_CAL_RUNS, 0x0E);
+            term_print(" runs, cycles ", 0x07);
+            term_print_dec(ci->cal_cycles_min, 0x0E);
+            term_print("..", 0x07);
+            term_print_dec(ci->cal_cycles_max, 0x0E);
+            term_print(")\n", 0x07);
+            term_print("  scale: mult=", 0x07);
+            term_print_dec(ci->mult, 0x0E);
+            term_print(" shift=", 0x07);
+            term_print_dec(ci->shift, 0x0E);
+            term_print(" (1M cycles = ", 0x07);
+            term_print_dec((uint32_t)clock_cycles_to_ns(1000000u), 0x0E);
+            term_print(" ns) updates=", 0x07);
+            term_print_dec(ci->updates, 0x0E);
+            term_print("\n", 0x07);
+        }
+        else
+        {
+            term_print("uncalibrated (tick resolution)\n", 0x0C);
+        }
+
+        uint64_t t0 = clock_monotonic_ns();
+        uint64_t t1 = clock_monotonic_ns();
+
+        term_print("  monotonic: ", 0x07);
+        shell_print_ns(t1, 0x0E);
+        term_print(" s (back-to-back read: ", 0x07);
+        term_print_dec((uint32_t)(t1 - t0), 0x0E);
+        term_print(" ns)\n", 0x07);
+        term_print("  realtime:  ", 0x07);
+        shell_print_ns(clock_realtime_ns(), 0x0E);
+        term_print(" s since 1970 (RTC sample ", 0x07);
+        term_print_dec(ci->boot_epoch, 0x0E);
+        term_print(")\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "timer") == 0)
+    {
+        const TimerInfo *ti = timer_info();
+        uint32_t secs = clock_ns_to_sec(clock_monotonic_ns(), 0);
+
+        term_print("Timer: ", 0x07);
+        term_print(ti->tickless ? "tickless (one-shot)" : "periodic (100 Hz)", 0x0B);
+        term_print(ti->lapic ? " on the LAPIC timer" : " on the PIT", 0x07);
+        term_print("\n  irqs=", 0x07);
+        term_print_dec(ti->irqs, 0x0E);
+        term_print(" (", 0x07);
+        term_print_dec(secs ? ti->irqs / secs : ti->irqs, 0x0E);
+        term_print("/s avg) oneshots=", 0x07);
+        term_print_dec(ti->oneshots, 0x0E);
+        term_print(" idle_waits=", 0x07);
+        term_print_dec(ti->idle_waits, 0x0E);
+        term_print(" ticks=", 0x07);
+        term_print_dec((uint32_t)timer_get_ticks(), 0x0E);
         term_print("\n", 0x07);
+
+        const TimerWheelStats *ws = timer_wheel_stats();
+        term_print("  wheel: pending=", 0x07);
+        term_print_dec(ws->pending, 0x0E);
+        term_print(" added=", 0x07);
+        term_print_dec(ws->added, 0x0E);
+        term_print(" cancelled=", 0x07);
+        term_print_dec(ws->cancelled, 0x0E);
+        term_print(" fired=", 0x07);
+        term_print_dec(ws->fired, 0x0E);
+        term_print(" cascaded=", 0x07);
+        term_print_dec(ws->cascaded, 0x0E);
+        term_print(" batches=", 0x07);
+        term_print_dec(ws->batches, 0x0E);
+        term_print(" (max ", 0x07);
+        term_print_dec(ws->max_batch, 0x0E);
+        term_print(")\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "timer tickless") == 0 || strcmp(cmd_buffer, "timer periodic") == 0)
+    {
+        timer_set_tickless(cmd_buffer[6] == 't');
+        if (timer_tickless())
+            term_print("Timer is tickless.\n", 0x07);
+        else if (cmd_buffer[6] == 't')
+            term_print("Tickless mode needs a calibrated TSC clock.\n", 0x0C);
+        else
+            term_print("Timer is periodic (100 Hz).\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "irqstat") == 0)
+    {
+        term_print("Interrupt lines (", 0x0F);
+        term_print(irq_chip()->name, 0x0F);
+        term_print("):\n", 0x0F);
+        for (uint8_t irq = 0; irq < IRQ_LINES; irq++)
+        {
+            // Snapshot: the 64-bit counters are two stores on i386
+            uint32_t flags = cpu_irq_save();
+            IrqStats st = *irq_stats(irq);
+            cpu_irq_restore(flags);
+
+            const IrqAction *a = irq_actions(irq);
+            if (!a && st.count == 0u && st.spurious == 0u)
+                continue;
+
+            term_print("  IRQ", 0x07);
+            term_print_dec(irq, 0x0B);
+            term_print(": count=", 0x07);
+            term_print_dec(st.count, 0x0E);
+            term_print(" spurious=", 0x07);
+            term_print_dec(st.spurious, st.spurious ? 0x0C : 0x0E);
+            term_print(" unhandled=", 0x07);
+            term_print_dec(st.unhandled, 0x0E);
+            term_print(" time=", 0x07);
+            term_print_dec(shell_cycles_to_us(st.cycles), 0x0E);
+            term_print(" us (max ", 0x07);
+            term_print_dec(shell_cycles_to_us(st.max_cycles), 0x0E);
+            term_print(")\n    ", 0x07);
+
+            if (!a)
+                term_print("(no handler)", 0x0C);
+            for (; a; a = a->next)
+            {
+                term_print(a->name, 0x0B);
+                term_print(": handled=", 0x07);
+                term_print_dec(a->handled, 0x0E);
+                term_print(" time=", 0x07);
+                term_print_dec(shell_cycles_to_us(a->cycles), 0x0E);
+                term_print(" us", 0x07);
+                if (a->next)
+                    term_print("; ", 0x07);
+            }
+            term_print("\n", 0x07);
+        }
+
+        const SoftirqInfo *si = softirq_info();
+        term_print("Softirqs: passes=", 0x0F);
+        term_print_dec(si->passes, 0x0E);
+        term_print(" restarts=", 0x07);
+        term_print_dec(si->restarts, 0x0E);
+        term_print(" deferred=", 0x07);
+        term_print_dec(si->deferred, 0x0E);
+        term_print("\n", 0x07);
+        for (uint32_t nr = 0; nr < SOFTIRQ_COUNT; nr++)
+        {
+            uint32_t flags = cpu_irq_save();
+            SoftirqStats ss = *softirq_stats(nr);
+            cpu_irq_restore(flags);
+
+            term_print("  ", 0x07);
+            term_print(softirq_name(nr), 0x0B);
+            term_print(": queued=", 0x07);
+            term_print_dec(ss.queued, 0x0E);
+            term_print(" runs=", 0x07);
+            term_print_dec(ss.runs, 0x0E);
+            term_print(" time=", 0x07);
+            term_print_dec(shell_cycles_to_us(ss.cycles), 0x0E);
+            term_print(" us (max ", 0x07);
+            term_print_dec(shell_cycles_to_us(ss.max_cycles), 0x0E);
+            term_print(")\n", 0x07);
+        }
+    }
+    else if (strcmp(cmd_buffer, "irqtrace") == 0)
+    {
+        // Snapshot with interrupts off: the handlers keep updating it
+        static IrqTraceInfo ti;
+        uint32_t flags = cpu_irq_save();
+        ti = *irqtrace_info();
+        cpu_irq_restore(flags);
+
+        term_print("IRQ trace: ", 0x07);
+        term_print(ti.enabled ? "on" : "off ('irqtrace on')", ti.enabled ? 0x0B : 0x0E);
+        term_print("; buckets in us, from the value shown\n", 0x07);
+
+        if (ti.spans)
+        {
+            term_print("IRQs-off spans: ", 0x0F);
+            shell_print_trace_hist(&ti.off);
+            for (uint32_t i = 0; i < IRQTRACE_WORST && ti.worst[i].ns; i++)
+            {
+                const IrqTraceSpan *sp = &ti.worst[i];
+                term_print("  ", 0x07);
+                term_print_dec(sp->ns / 1000u, 0x0E);
+                term_print(" us: ", 0x07);
+                if (sp->vector != IRQTRACE_NO_VECTOR)
+                {
+                    term_print("IRQ", 0x07);
+                    term_print_dec(sp->vector, 0x0B);
+                    term_print(" entry", 0x07);
+                }
+                else
+                {
+                    term_print("off@", 0x07);
+                    term_print_hex(sp->off_site, 0x0B);
+                }
+                if (sp->on_site)
+                {
+                    term_print(" -> on@", 0x07);
+                    term_print_hex(sp->on_site, 0x0B);
+                }
+                else
+                {
+                    term_print(" -> iret", 0x07);
+                }
+                term_print("\n", 0x07);
+            }
+        }
+        else
+        {
+            term_print("IRQs-off spans: not built in (make IRQTRACE=1)\n", 0x0E);
+        }
+
+        term_print("Service time per line (entry to iret):\n", 0x0F);
+        for (uint8_t irq = 0; irq < IRQ_LINES; irq++)
+        {
+            if (!ti.line[irq].count)
+                continue;
+            term_print("  IRQ", 0x07);
+            term_print_dec(irq, 0x0B);
+            term_print(": ", 0x07);
+            shell_print_trace_hist(&ti.line[irq]);
+        }
+
+        term_print("Timer one-shot lateness: ", 0x0F);
+        shell_print_trace_hist(&ti.wakeup);
+    }
+    else if (strcmp(cmd_buffer, "irqtrace on") == 0 || strcmp(cmd_buffer, "irqtrace off") == 0)
+    {
+        irqtrace_enable(cmd_buffer[10] == 'n');
+        term_print(irqtrace_info()->enabled ? "IRQ trace on.\n" : "IRQ trace off.\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "irqtrace reset") == 0)
+    {
+        irqtrace_reset();
+        term_print("IRQ trace cleared.\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "apic") == 0)
+    {
+        const AcpiInfo *acpi = acpi_info();
+        const ApicInfo *ai = apic_info();
+
+        term_print("Interrupt controller: ", 0x07);
+        term_print(irq_chip()->name, 0x0B);
+        term_print("\n", 0x07);
+
+        if (!acpi)
+        {
+            term_print("No ACPI MADT; the 8259 PIC is in charge.\n", 0x0E);
+        }
+        else
+        {
+            term_print("  ACPI: OEM ", 0x07);
+            term_print(acpi->oem_id, 0x0B);
+            term_print(" rev ", 0x07);
+            term_print_dec(acpi->revision, 0x0E);
+            term_print(" RSDP ", 0x07);
+            term_print_hex(acpi->rsdp_address, 0x0E);
+            term_print(" tables=", 0x07);
+            term_print_dec(acpi->tables, 0x0E);
+            term_print(acpi->madt_flags & ACPI_MADT_PCAT_COMPAT ? " (8259 present)\n" : "\n", 0x07);
+
+            term_print("  CPUs:", 0x07);
+            for (uint32_t i = 0; i < acpi->cpu_count; i++)
+            {
+                term_print(" apic", 0x07);
+                term_print_dec(acpi->cpu_apic_id[i], 0x0E);
+            }
+            term_print("\n", 0x07);
+        }
+
+        if (ai->active)
+        {
+            term_print("  LAPIC: id=", 0x07);
+            term_print_dec(ai->lapic_id, 0x0E);
+            term_print(" version=", 0x07);
+            term_print_hex(ai->lapic_version, 0x0E);
+            term_print(" lvts=", 0x07);
+            term_print_dec(ai->lvt_entries, 0x0E);
+            term_print(" at ", 0x07);
+            term_print_hex(ai->lapic_address, 0x0E);
+            term_print(" spurious=", 0x07);
+            term_print_dec(apic_spurious(), 0x0E);
+            term_print("\n  Timer: ", 0x07);
+            if (ai->timer_khz)
+            {
+                term_print_dec(ai->timer_khz, 0x0E);
+                term_print(" kHz", 0x07);
+            }
+            else
+            {
+                term_print("uncalibrated", 0x0E);
+            }
+            term_print("\n", 0x07);
+
+            for (uint32_t i = 0; i < ai->ioapic_count; i++)
+            {
+                term_print("  I/O APIC ", 0x07);
+                term_print_dec(acpi->ioapic[i].id, 0x0E);
+                term_print(": at ", 0x07);
+                term_print_hex(acpi->ioapic[i].address, 0x0E);
+                term_print(" GSI ", 0x07);
+                term_print_dec(acpi->ioapic[i].gsi_base, 0x0E);
+                term_print("-", 0x07);
+                term_print_dec(acpi->ioapic[i].gsi_base + ai->ioapic_pins[i] - 1u, 0x0E);
+                term_print("\n", 0x07);
+            }
+
+            term_print("  ISA routes:", 0x07);
+            for (uint8_t irq = 0; irq < IRQ_LINES; irq++)
+            {
+                const ApicRoute *r = apic_route(irq);
+                if (!r->routed)
+                    continue;
+
+                term_print(" ", 0x07);
+                term_print_dec(irq, 0x0B);
+                term_print("->", 0x07);
+                term_print_dec(r->gsi, 0x0E);
+                if (r->redir & (IOAPIC_REDIR_LEVEL | IOAPIC_REDIR_ACTIVE_LOW))
+                {
+                    term_print(r->redir & IOAPIC_REDIR_LEVEL ? "L" : "E", 0x07);
+                    term_print(r->redir & IOAPIC_REDIR_ACTIVE_LOW ? "lo" : "hi", 0x07);
+                }
+            }
+            term_print("\n", 0x07);
+        }
+    }
+    else if (strcmp(cmd_buffer, "cpus") == 0)
+    {
+        const SmpInfo *si = smp_info();
+
+        term_print("CPUs: ", 0x07);
+        term_print_dec(si->online, 0x0E);
+        term_print(" online of ", 0x07);
+        term_print_dec(si->present, 0x0E);
+        if (si->trampoline)
+        {
+            term_print(", trampoline at ", 0x07);
+            term_print_hex(si->trampoline, 0x0E);
+        }
+        if (si->rc != SMP_OK)
+        {
+            term_print(" (startup rc=", 0x07);
+            term_print_dec((uint32_t)si->rc, 0x0C);
+            term_print(")", 0x07);
+        }
+        term_print("\n", 0x07);
+
+        for (uint32_t id = 0; id < si->online; id++)
+        {
+            const PerCpu *c = smp_cpu(id);
+            term_print("  cpu", 0x07);
+            term_print_dec(c->id, 0x0B);
+            term_print(id == smp_cpu_id() ? "*" : " ", 0x0B);
+            term_print(" apic=", 0x07);
+            term_print_dec(c->apic_id, 0x0E);
+            term_print(" irqs=", 0x07);
+            term_print_dec(c->irqs, 0x0E);
+            term_print(" ipis=", 0x07);
+            term_print_dec(c->ipis, 0x0E);
+            term_print(" halts=", 0x07);
+            term_print_dec(c->halts, 0x0E);
+            term_print(" works=", 0x07);
+            term_print_dec(c->works, 0x0E);
+            term_print("\n", 0x07);
+        }
+
+        term_print("Spinlocks (acquired / contended):\n", 0x0F);
+        for (uint32_t i = 0; i < spinlock_count(); i++)
+        {
+            const Spinlock *l = spinlock_get(i);
+            term_print("  ", 0x07);
+            term_print(l->name, 0x0B);
+            term_print(": ", 0x07);
+            term_print_dec(l->acquired, 0x0E);
+            term_print(" / ", 0x07);
+            term_print_dec(l->contended, 0x0E);
+            term_print("\n", 0x07);
+        }
+    }
+    else if (strcmp(cmd_buffer, "threads") == 0)
+    {
+        static Thread list[THREADS_MAX_LISTED];
+        SchedInfo si;
+        uint32_t n = 0;
+
+        // Snapshot: threads may exit (and be joined) while printing.
+        uint32_t flags = cpu_irq_save();
+        si = *sched_info();
+        for (const Thread *t = sched_threads(); t && n < THREADS_MAX_LISTED; t = t->all_next)
+            list[n++] = *t;
+        const Thread *self = sched_current();
+        uint32_t self_tid = self ? self->tid : 0xFFFFFFFFu;
+        cpu_irq_restore(flags);
+
+        if (!si.running)
+        {
+            term_print("Scheduler not started.\n", 0x0C);
+            return;
+        }
+
+        term_print("Threads: ", 0x07);
+        term_print_dec(si.threads, 0x0E);
+        term_print(" switches=", 0x07);
+        term_print_dec(si.switches, 0x0E);
+        term_print(" preemptions=", 0x07);
+        term_print_dec(si.preemptions, 0x0E);
+        term_print(" idle halts=", 0x07);
+        term_print_dec(si.idle_halts, 0x0E);
+        term_print(" ready=", 0x07);
+        term_print_hex(si.ready_bitmap, 0x0E);
+        term_print("\n", 0x07);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const Thread *t = &list[i];
+            term_print("  ", 0x07);
+            term_print_dec(t->tid, 0x0B);
+            term_print(t->tid == self_tid ? "* " : "  ", 0x0B);
+            term_print(t->name, 0x0B);
+            term_print(" prio=", 0x07);
+            term_print_dec(t->priority, 0x0E);
+            term_print(" ", 0x07);
+            term_print(sched_state_name(t->state), 0x0E);
+            term_print(" switches=", 0x07);
+            term_print_dec(t->switches, 0x0E);
+            term_print(" preempted=", 0x07);
+            term_print_dec(t->preemptions, 0x0E);
+            if (t->wake_ns)
+                term_print(" (timed wait)", 0x07);
+            term_print("\n", 0x07);
+        }
     }
     else if (strcmp(cmd_buffer, "sleep") == 0)
     {
         term_print("Sleeping for 1 second...\n", 0x07);
+        uint64_t t0 = clock_monotonic_ns();
         timer_sleep(1000); // Sleep 1000ms
-        term_print("Done.\n", 0x07);
+        term_print("Done (", 0x07);
+        shell_print_ns(clock_monotonic_ns() - t0, 0x0E);
+        term_print(" s).\n", 0x07);
+    }
+    else if (strcmp(cmd_buffer, "sync") == 0)
+    {
+        if (block_sync_all() == BLOCK_SUCCESS)
+            term_print("All block devices synced.\n", 0x07);
+        else
+            term_print("Sync failed on one or more devices.\n", 0x0C);
     }
     else if (strcmp(cmd_buffer, "reboot") == 0)
     {
+        if (block_sync_all() != BLOCK_SUCCESS)
+            term_print("Warning: disk sync failed.\n", 0x0E);
+
         term_print("Rebooting...\n", 0x0C);
         // Pulse Keyboard Controller to reset CPU
         uint8_t good = 0x02;
@@ -223,8 +1377,9 @@ void execute_command(void)
             return;
         }
 
-        // Read Disk (Drive 0 = Master)
-        int ret = ata_read_sector(0, (uint32_t)lba, buf);
+        // Read Disk (disk0 through the block request queue)
+        BlockDevice *disk0 = block_get_by_name("disk0");
+        int ret = disk0 ? block_read(disk0, (uint32_t)lba, 1u, buf) : BLOCK_ERROR;
         if (ret != 0) {
             term_print("Disk Error (code: ", 0x0C);
             term_print_hex((uint32_t)ret, 0x0C);
@@ -0,0 +1,123 @@
+#include "softirq.h"
+
+#include "clock.h"
+#include "cpu.h"
+#include "timer.h"
+
+typedef struct
+{
+    SoftirqWork *first;
+    SoftirqWork **tail;
+} SoftirqQueue;
+
+static SoftirqQueue g_queue[SOFTIRQ_COUNT];
+static uint32_t g_pending;      /* Bit N = vector N has work */
+static bool g_active;           /* Inside softirq_run() */
+static SoftirqStats g_stats[SOFTIRQ_COUNT];
+static SoftirqInfo g_info;
+
+static const char *const g_names[SOFTIRQ_COUNT] = { "timer", "block", "input" };
+
+void softirq_queue(uint32_t nr, SoftirqWork *w)
+{
+    if (nr >= SOFTIRQ_COUNT || !w || w->queued)
+        return;
+
+    SoftirqQueue *q = &g_queue[nr];
+    if (!q->first)
+        q->tail = &q->first;
+
+    w->next = 0;
+    w->queued = true;
+    *q->tail = w;
+    q->tail = &w->next;
+
+    g_pending |= 1u << nr;
+    g_stats[nr].queued++;
+}
+
+/* Run the work queued on vector `nr` so far; work queued meanwhile waits for
+ * the next pass. Called and returns with interrupts off. */
+static void softirq_run_vector(uint32_t nr)
+{
+    SoftirqQueue *q = &g_queue[nr];
+    SoftirqStats *st = &g_stats[nr];
+    SoftirqWork *w = q->first;
+
+    q->first = 0;
+    g_pending &= ~(1u << nr);
+
+    while (w)
+    {
+        SoftirqWork *next = w->next;
+
+        // Dequeued first: the item may be queued again while it runs.
+        w->next = 0;
+        w->queued = false;
+
+        cpu_sti();
+        uint64_t start = cpu_rdtsc();
+        w->fn(w->arg);
+        uint64_t spent = cpu_rdtsc() - start;
+        cpu_cli();
+
+        st->runs++;
+        st->cycles += spent;
+        if (spent > st->max_cycles)
+            st->max_cycles = (spent >> 32) ? 0xFFFFFFFFu : (uint32_t)spent;
+
+        w = next;
+    }
+}
+
+void softirq_run(void)
+{
+    // Nested interrupt: the outer pass runs whatever it queued.
+    if (g_active || !g_pending)
+        return;
+
+    g_active = true;
+    g_info.passes++;
+
+    for (uint32_t pass = 0; g_pending; pass++)
+    {
+        if (pass == SOFTIRQ_MAX_RESTART)
+        {
+            // Left for the next interrupt exit rather than starving the
+            // interrupted context; in tickless mode make sure one comes.
+            g_info.deferred++;
+            timer_schedule_event(clock_monotonic_ns() + TIMER_TICK_NS);
+            break;
+        }
+        if (pass > 0u)
+            g_info.restarts++;
+
+        for (uint32_t nr = 0; nr < SOFTIRQ_COUNT; nr++)
+        {
+            if (g_pending & (1u << nr))
+                softirq_run_vector(nr);
+        }
+    }
+
+    g_active = false;
+}
+
+bool softirq_pending(void)
+{
+    return g_pending != 0u;
+}
+
+const SoftirqStats *softirq_stats(uint32_t nr)
+{
+    return (nr < SOFTIRQ_COUNT) ? &g_stats[nr] : 0;
+}
+
+const SoftirqInfo *softirq_info(void)
+{
+    return &g_info;
+}
+
+const char *softirq_name(uint32_t nr)
+{
+    return (nr < SOFTIRQ_COUNT) ? g_names[nr] : "?";
+}
@@ -0,0 +1,71 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Deferred interrupt work (bottom halves).
+ *
+ * A hardware interrupt handler only acknowledges its device and queues a
+ * SoftirqWork; after the EOI, the interrupt exit path runs the queued work
+ * with interrupts enabled, so other lines are serviced while it runs.
+ * Vectors run in order (timer callbacks, then block completions, then input),
+ * each in FIFO order. Softirq context never nests: interrupts taken while it
+ * runs only queue more work, which the running pass picks up.
+ *
+ * Exclusion: code that disables interrupts also keeps softirqs out (they only
+ * start on interrupt exit), so state shared between process context and a
+ * bottom half needs nothing beyond cpu_irq_save(). State a top half writes
+ * must still be read with interrupts off in the bottom half.
+ */
+
+#define SOFTIRQ_TIMER           0u      /* Expired kernel timers */
+#define SOFTIRQ_BLOCK           1u      /* Disk command completion */
+#define SOFTIRQ_INPUT           2u      /* Keyboard decoding */
+#define SOFTIRQ_COUNT           3u
+
+/* Passes over the vectors per interrupt exit before leaving work queued
+ * (picked up by a timer interrupt within a tick). */
+#define SOFTIRQ_MAX_RESTART     8u
+
+typedef void (*SoftirqFn)(void *arg);
+
+typedef struct SoftirqWork
+{
+    SoftirqFn fn;
+    void *arg;
+    struct SoftirqWork *next;
+    bool queued;
+} SoftirqWork;
+
+#define SOFTIRQ_WORK_INIT(f, a) { (f), (a), 0, false }
+
+typedef struct
+{
+    uint32_t queued;            /* Work items queued */
+    uint32_t runs;              /* Work items run */
+    uint64_t cycles;            /* Time in the vector's work */
+    uint32_t max_cycles;        /* Longest single item */
+} SoftirqStats;
+
+typedef struct
+{
+    uint32_t passes;            /* softirq_run() calls that found work */
+    uint32_t restarts;          /* Extra passes for work queued meanwhile */
+    uint32_t deferred;          /* Passes that hit SOFTIRQ_MAX_RESTART */
+} SoftirqInfo;
+
+/* Queue `w` on vector `nr` (no-op if already queued). Interrupts must be off. */
+void softirq_queue(uint32_t nr, SoftirqWork *w);
+
+/* Interrupt exit, after the EOI: run queued work with interrupts enabled. */
+void softirq_run(void);
+
+bool softirq_pending(void);
+
+const SoftirqStats *softirq_stats(uint32_t nr);
+const SoftirqInfo *softirq_info(void);
+const char *softirq_name(uint32_t nr);
+
+#endif /* SOFTIRQ_H */
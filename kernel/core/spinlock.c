@@ -0,0 +1,74 @@
+#include "spinlock.h"
+
+#include "cpu.h"
+
+static Spinlock *g_locks[SPINLOCK_MAX_REGISTERED];
+static uint32_t g_lock_count = 0u;
+static Spinlock g_registry_lock = SPINLOCK_INIT("spinlock");
+
+void spin_lock(Spinlock *lock)
+{
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1u, __ATOMIC_RELAXED);
+    bool waited = false;
+
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
+    {
+        waited = true;
+        asm volatile("pause" ::: "memory");
+    }
+
+    // Counters belong to the holder: no atomics needed.
+    lock->acquired++;
+    if (waited)
+        lock->contended++;
+}
+
+void spin_unlock(Spinlock *lock)
+{
+    // Only the holder writes owner.
+    __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1u), __ATOMIC_RELEASE);
+}
+
+bool spin_is_locked(const Spinlock *lock)
+{
+    return __atomic_load_n(&lock->owner, __ATOMIC_RELAXED) != __atomic_load_n(&lock->next, __ATOMIC_RELAXED);
+}
+
+uint32_t spin_lock_irqsave(Spinlock *lock)
+{
+    uint32_t flags = cpu_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(Spinlock *lock, uint32_t flags)
+{
+    spin_unlock(lock);
+    cpu_irq_restore(flags);
+}
+
+void spinlock_register(Spinlock *lock)
+{
+    uint32_t flags = spin_lock_irqsave(&g_registry_lock);
+
+    bool known = false;
+    for (uint32_t i = 0; i < g_lock_count; i++)
+    {
+        if (g_locks[i] == lock)
+            known = true;
+    }
+    if (!known && g_lock_count < SPINLOCK_MAX_REGISTERED)
+        g_locks[g_lock_count++] = lock;
+
+    spin_unlock_irqrestore(&g_registry_lock, flags);
+}
+
+uint32_t spinlock_count(void)
+{
+    return g_lock_count;
+}
+
+const Spinlock *spinlock_get(uint32_t index)
+{
+    return (index < g_lock_count) ? g_locks[index] : 0;
+}
@@ -0,0 +1,50 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Ticket spinlocks.
+ *
+ * A CPU takes a ticket (atomic increment of `next`) and spins, with `pause`,
+ * until `owner` reaches it: waiters are served in arrival order, so no CPU
+ * starves while the others keep re-taking the lock. The unlock is a plain
+ * release store by the holder.
+ *
+ * Every acquisition is counted, and so is every one that found the lock held
+ * and had to spin (`contended`); both are updated by the holder, under the
+ * lock. Registered locks are listed by the `cpus` shell command.
+ *
+ * The _irqsave variants also disable interrupts on the local CPU, for state
+ * that interrupt handlers touch too (a handler spinning on a lock its own CPU
+ * holds would never get it).
+ */
+
+#define SPINLOCK_MAX_REGISTERED 16u
+
+typedef struct
+{
+    volatile uint16_t next;     /* Next ticket to hand out */
+    volatile uint16_t owner;    /* Ticket being served */
+    uint32_t acquired;
+    uint32_t contended;         /* Acquisitions that had to wait */
+    const char *name;
+} Spinlock;
+
+#define SPINLOCK_INIT(lock_name) { 0u, 0u, 0u, 0u, (lock_name) }
+
+void spin_lock(Spinlock *lock);
+void spin_unlock(Spinlock *lock);
+bool spin_is_locked(const Spinlock *lock);
+
+/* Interrupts off, then lock; returns the EFLAGS for the unlock. */
+uint32_t spin_lock_irqsave(Spinlock *lock);
+void spin_unlock_irqrestore(Spinlock *lock, uint32_t flags);
+
+/* Statistics registry (registering twice is a no-op). */
+void spinlock_register(Spinlock *lock);
+uint32_t spinlock_count(void);
+const Spinlock *spinlock_get(uint32_t index);
+
+#endif /* SPINLOCK_H */
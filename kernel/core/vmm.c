@@ -10,6 +10,9 @@
 // The Kernel's Page Directory (Physical Address)
 static uint32_t *page_directory = 0;
 
+// Next free page of the MMIO window (mappings are never torn down)
+static uint32_t mmio_next = VMM_MMIO_BASE;
+
 // Helper: Get or Create Page Table for a Virtual Address
 static uint32_t *vmm_get_page_table(uint32_t vaddr, int create)
 {
@@ -71,6 +74,45 @@ int vmm_alloc_page(uint32_t vaddr)
     return 1;
 }
 
+// Map device registers (e.g. a PCI memory BAR) uncached; returns the virtual
+// address of `paddr`, which need not be page-aligned.
+void *vmm_map_mmio(uint32_t paddr, uint32_t size)
+{
+    uint32_t offset = paddr & (PAGE_SIZE - 1u);
+    uint32_t pages = (offset + size + (PAGE_SIZE - 1u)) / PAGE_SIZE;
+
+    if (size == 0u || pages > (VMM_MMIO_LIMIT - mmio_next) / PAGE_SIZE)
+        return 0;
+
+    uint32_t base = mmio_next;
+    for (uint32_t i = 0; i < pages; i++)
+    {
+        uint32_t vaddr = base + (i * PAGE_SIZE);
+        uint32_t *table = vmm_get_page_table(vaddr, 1);
+
+        table[(vaddr >> 12) & 0x3FFu] = ((paddr - offset) + (i * PAGE_SIZE)) | PTE_PRESENT | PTE_READ_WRITE |
+                                        PTE_WRITE_THROUGH | PTE_CACHE_DISABLE;
+        asm volatile("invlpg (%0)" ::"r"(vaddr) : "memory");
+    }
+
+    mmio_next += pages * PAGE_SIZE;
+    return (void *)(base + offset);
+}
+
+// Translate a Virtual Address (page tables live in identity-mapped low memory)
+uint32_t vmm_get_phys(uint32_t vaddr)
+{
+    uint32_t *table = vmm_get_page_table(vaddr, 0);
+    if (!table)
+        return 0;
+
+    uint32_t pte = table[(vaddr >> 12) & 0x3FFu];
+    if (!(pte & PTE_PRESENT))
+        return 0;
+
+    return (pte & PTE_FRAME) | (vaddr & (PAGE_SIZE - 1u));
+}
+
 void vmm_init(void)
 {
     // 1. Allocate a Page Directory (4KB) in identity-mapped low memory
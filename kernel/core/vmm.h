@@ -27,9 +27,15 @@
 #define PDE_ACCESSED 0x20
 #define PDE_FRAME 0xFFFFF000
 
+// Device register window (uncached mappings handed out by vmm_map_mmio)
+#define VMM_MMIO_BASE  0xF0000000u
+#define VMM_MMIO_LIMIT 0xF1000000u // 16 MiB
+
 // API
 void vmm_init(void);
 void vmm_map(uint32_t vaddr, uint32_t paddr);
 int vmm_alloc_page(uint32_t vaddr); // Allocates new PMM frame and maps it
+uint32_t vmm_get_phys(uint32_t vaddr); // Physical address behind vaddr (0 = not mapped)
+void *vmm_map_mmio(uint32_t paddr, uint32_t size); // Uncached device window (0 = window full)
 
 #endif
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include "acpi.h"
+
+#include "string.h"
+#include "vmm.h"
+
+typedef struct __attribute__((packed))
+{
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    /* Revision 2+ */
+    uint32_t length;
+    uint32_t xsdt_address_lo;
+    uint32_t xsdt_address_hi;
+    uint8_t ext_checksum;
+    uint8_t reserved[3];
+} AcpiRsdp;
+
+typedef struct __attribute__((packed))
+{
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} AcpiHeader;
+
+static AcpiInfo g_acpi;
+static bool g_acpi_ready = false;
+
+static uint8_t acpi_sum(const void *p, uint32_t len)
+{
+    const uint8_t *b = (const uint8_t *)p;
+    uint8_t sum = 0u;
+
+    for (uint32_t i = 0; i < len; i++)
+        sum = (uint8_t)(sum + b[i]);
+    return sum;
+}
+
+/* RSDP candidates sit on 16-byte boundaries (identity-mapped low memory). */
+static const AcpiRsdp *acpi_scan_rsdp(uint32_t start, uint32_t end)
+{
+    for (uint32_t a = start & ~0xFu; a + ACPI_RSDP_V1_LENGTH <= end; a += 16u)
+    {
+        const AcpiRsdp *r = (const AcpiRsdp *)(uintptr_t)a;
+        if (memcmp(r->signature, ACPI_RSDP_SIGNATURE, 8u) == 0 && acpi_sum(r, ACPI_RSDP_V1_LENGTH) == 0u)
+            return r;
+    }
+    return 0;
+}
+
+/* Whole table behind the mapped header `h` (0 if the window is full). */
+static const AcpiHeader *acpi_map_full(uint32_t phys, const AcpiHeader *h)
+{
+    // Inside the header's page(s) already: no second window needed.
+    if (h->length <= ACPI_HEADER_LENGTH || (phys & 0xFFFu) + h->length <= 0x1000u)
+        return h;
+
+    return (const AcpiHeader *)vmm_map_mmio(phys, h->length);
+}
+
+static const AcpiHeader *acpi_map_table(uint32_t phys)
+{
+    const AcpiHeader *h = (const AcpiHeader *)vmm_map_mmio(phys, ACPI_HEADER_LENGTH);
+    return h ? acpi_map_full(phys, h) : 0;
+}
+
+static void acpi_parse_madt(const AcpiHeader *madt)
+{
+    const uint8_t *base = (const uint8_t *)madt;
+    uint32_t lapic;
+    uint32_t flags;
+
+    memcpy(&lapic, base + ACPI_HEADER_LENGTH, 4u);
+    memcpy(&flags, base + ACPI_HEADER_LENGTH + 4u, 4u);
+    g_acpi.lapic_address = lapic;
+    g_acpi.madt_flags = flags;
+
+    for (uint32_t off = ACPI_MADT_ENTRIES; off + 2u <= madt->length;)
+    {
+        const uint8_t *e = base + off;
+        uint8_t type = e[0];
+        uint8_t len = e[1];
+
+        if (len < 2u || off + len > madt->length)
+            break;
+
+        if (type == ACPI_MADT_LAPIC && len >= 8u)
+        {
+            uint32_t lflags;
+            memcpy(&lflags, e + 4, 4u);
+
+            if ((lflags & (ACPI_LAPIC_ENABLED | ACPI_LAPIC_ONLINE_CAPABLE)) && g_acpi.cpu_count < ACPI_MAX_CPUS)
+                g_acpi.cpu_apic_id[g_acpi.cpu_count++] = e[3];
+        }
+        else if (type == ACPI_MADT_IOAPIC && len >= 12u && g_acpi.ioapic_count < ACPI_MAX_IOAPICS)
+        {
+            AcpiIoApic *io = &g_acpi.ioapic[g_acpi.ioapic_count++];
+            io->id = e[2];
+            memcpy(&io->address, e + 4, 4u);
+            memcpy(&io->gsi_base, e + 8, 4u);
+        }
+        else if (type == ACPI_MADT_OVERRIDE && len >= 10u && e[2] == 0u /* ISA */
+                 && g_acpi.override_count < ACPI_MAX_OVERRIDES)
+        {
+            AcpiIrqOverride *ov = &g_acpi.override[g_acpi.override_count++];
+            ov->source = e[3];
+            memcpy(&ov->gsi, e + 4, 4u);
+            memcpy(&ov->flags, e + 8, 2u);
+        }
+
+        off += len;
+    }
+}
+
+int acpi_init(void)
+{
+    memset(&g_acpi, 0, sizeof(g_acpi));
+    g_acpi_ready = false;
+
+    // EBDA first (its first KiB), then the BIOS read-only area.
+    const AcpiRsdp *rsdp = 0;
+    // The BDA lives in page 0, which GCC assumes is never dereferenced: hide
+    // the constant address from its bounds checks.
+    uintptr_t bda = ACPI_EBDA_SEGMENT_PTR;
+    asm("" : "+r"(bda));
+    uint32_t ebda = (uint32_t)(*(volatile uint16_t *)bda) << 4;
+    if (ebda >= 0x80000u && ebda < ACPI_BIOS_AREA_START)
+        rsdp = acpi_scan_rsdp(ebda, ebda + 1024u);
+    if (!rsdp)
+        rsdp = acpi_scan_rsdp(ACPI_BIOS_AREA_START, ACPI_BIOS_AREA_END);
+    if (!rsdp)
+        return ACPI_ERR_NO_RSDP;
+
+    g_acpi.rsdp_address = (uint32_t)(uintptr_t)rsdp;
+    g_acpi.revision = rsdp->revision;
+    memcpy(g_acpi.oem_id, rsdp->oem_id, 6u);
+    g_acpi.oem_id[6] = '\0';
+
+    // RSDT (32-bit entries); the XSDT only if there is no RSDT and it is
+    // reachable without PAE.
+    uint32_t root = rsdp->rsdt_address;
+    uint32_t entry_size = 4u;
+
+    if (!root && rsdp->revision >= 2u && rsdp->xsdt_address_hi == 0u)
+    {
+        if (acpi_sum(rsdp, rsdp->length) != 0u)
+            return ACPI_ERR_CHECKSUM;
+        root = rsdp->xsdt_address_lo;
+        entry_size = 8u;
+    }
+    if (!root)
+        return ACPI_ERR_NO_RSDP;
+
+    const AcpiHeader *sdt = acpi_map_table(root);
+    if (!sdt)
+        return ACPI_ERR_NO_MEMORY;
+    if (acpi_sum(sdt, sdt->length) != 0u)
+        return ACPI_ERR_CHECKSUM;
+
+    const uint8_t *entries = (const uint8_t *)sdt + ACPI_HEADER_LENGTH;
+    g_acpi.tables = (sdt->length - ACPI_HEADER_LENGTH) / entry_size;
+
+    for (uint32_t i = 0; i < g_acpi.tables; i++)
+    {
+        uint32_t addr;
+        uint32_t addr_hi = 0u;
+
+        memcpy(&addr, entries + (i * entry_size), 4u);
+        if (entry_size == 8u)
+            memcpy(&addr_hi, entries + (i * entry_size) + 4u, 4u);
+        if (addr_hi != 0u || addr == 0u)
+            continue;
+
+        const AcpiHeader *h = (const AcpiHeader *)vmm_map_mmio(addr, ACPI_HEADER_LENGTH);
+        if (!h)
+            return ACPI_ERR_NO_MEMORY;
+        if (memcmp(h->signature, ACPI_MADT_SIGNATURE, 4u) != 0)
+            continue;
+
+        const AcpiHeader *madt = acpi_map_full(addr, h);
+        if (!madt)
+            return ACPI_ERR_NO_MEMORY;
+        if (acpi_sum(madt, madt->length) != 0u)
+            return ACPI_ERR_CHECKSUM;
+
+        acpi_parse_madt(madt);
+        g_acpi_ready = true;
+        return ACPI_OK;
+    }
+
+    return ACPI_ERR_NO_MADT;
+}
+
+const AcpiInfo *acpi_info(void)
+{
+    return g_acpi_ready ? &g_acpi : 0;
+}
+
+void acpi_isa_irq(uint8_t irq, uint32_t *gsi, uint16_t *flags)
+{
+    *gsi = irq;
+    *flags = 0u;
+
+    for (uint32_t i = 0; g_acpi_ready && i < g_acpi.override_count; i++)
+    {
+        if (g_acpi.override[i].source == irq)
+        {
+            *gsi = g_acpi.override[i].gsi;
+            *flags = g_acpi.override[i].flags;
+            return;
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * ACPI table discovery, enough for interrupt routing and CPU enumeration.
+ *
+ * The RSDP is found in the EBDA or the BIOS area (0xE0000-0xFFFFF); the RSDT
+ * (or the XSDT, when only that is below 4 GiB) lists the tables, of which the
+ * MADT ("APIC") is parsed: local APIC address, processors, I/O APICs and the
+ * ISA interrupt source overrides. Tables live in high RAM, so they are read
+ * through vmm_map_mmio() windows.
+ */
+
+/* --------------------------------------------------------------------------
+ * Table layout
+ * -------------------------------------------------------------------------- */
+#define ACPI_RSDP_SIGNATURE     "RSD PTR "
+#define ACPI_MADT_SIGNATURE     "APIC"
+#define ACPI_EBDA_SEGMENT_PTR   0x40Eu          /* BDA word: EBDA segment */
+#define ACPI_BIOS_AREA_START    0xE0000u
+#define ACPI_BIOS_AREA_END      0x100000u
+#define ACPI_RSDP_V1_LENGTH     20u
+#define ACPI_HEADER_LENGTH      36u
+#define ACPI_MADT_ENTRIES       44u             /* Header + LAPIC address + flags */
+
+/* MADT entry types */
+#define ACPI_MADT_LAPIC         0u
+#define ACPI_MADT_IOAPIC        1u
+#define ACPI_MADT_OVERRIDE      2u
+#define ACPI_MADT_LAPIC_NMI     4u
+
+#define ACPI_MADT_PCAT_COMPAT   (1u << 0)       /* Dual 8259s present */
+#define ACPI_LAPIC_ENABLED      (1u << 0)
+#define ACPI_LAPIC_ONLINE_CAPABLE (1u << 1)
+
+/* MPS INTI flags (overrides): polarity bits 1:0, trigger mode bits 3:2 */
+#define ACPI_INTI_POLARITY_MASK 0x3u
+#define ACPI_INTI_ACTIVE_HIGH   0x1u
+#define ACPI_INTI_ACTIVE_LOW    0x3u
+#define ACPI_INTI_TRIGGER_MASK  0xCu
+#define ACPI_INTI_EDGE          0x4u
+#define ACPI_INTI_LEVEL         0xCu
+
+/* Limits */
+#define ACPI_MAX_CPUS           8u
+#define ACPI_MAX_IOAPICS        2u
+#define ACPI_MAX_OVERRIDES      16u
+
+/* Return codes (0 = success) */
+#define ACPI_OK                 0
+#define ACPI_ERR_NO_RSDP        1
+#define ACPI_ERR_CHECKSUM       2
+#define ACPI_ERR_NO_MADT        3
+#define ACPI_ERR_NO_MEMORY      4       /* MMIO window full */
+
+typedef struct
+{
+    uint8_t id;
+    uint32_t address;
+    uint32_t gsi_base;
+} AcpiIoApic;
+
+typedef struct
+{
+    uint8_t source;             /* ISA IRQ */
+    uint32_t gsi;
+    uint16_t flags;             /* ACPI_INTI_* */
+} AcpiIrqOverride;
+
+typedef struct
+{
+    uint32_t rsdp_address;
+    uint8_t revision;
+    char oem_id[7];
+    uint32_t tables;            /* Entries in the RSDT/XSDT */
+    uint32_t lapic_address;
+    uint32_t madt_flags;
+    uint32_t cpu_count;         /* Enabled or online-capable processors */
+    uint8_t cpu_apic_id[ACPI_MAX_CPUS];
+    uint32_t ioapic_count;
+    AcpiIoApic ioapic[ACPI_MAX_IOAPICS];
+    uint32_t override_count;
+    AcpiIrqOverride override[ACPI_MAX_OVERRIDES];
+} AcpiInfo;
+
+/* Find and parse the tables. Needs paging (vmm_init). */
+int acpi_init(void);
+
+/* 0 until acpi_init() succeeded. */
+const AcpiInfo *acpi_info(void);
+
+/* Route ISA IRQ `irq`: its GSI and ACPI_INTI_* flags (0 = bus default). */
+void acpi_isa_irq(uint8_t irq, uint32_t *gsi, uint16_t *flags);
+
+#endif /* ACPI_H */
@@ -0,0 +1,972 @@
+#include "ahci.h"
+
+#include "ata.h"
+#include "block.h"
+#include "cpu.h"
+#include "irq.h"
+#include "softirq.h"
+#include "pci.h"
+#include "sched.h"
+#include "pmm.h"
+#include "string.h"
+#include "timer.h"
+#include "vmm.h"
+
+/* --------------------------------------------------------------------------
+ * AHCI -> BlockDevice driver
+ *
+ * Each port owns one page holding its command list (32 headers) and FIS
+ * receive area, plus command tables (4 per page) for the slots it uses. Slot
+ * numbers double as block queue tags and, with NCQ, as the FPDMA tag in the
+ * FIS. Completions are found by comparing the slots we issued against
+ * PxSACT/PxCI, from the IRQ handler or from the waiter's polling loop.
+ * -------------------------------------------------------------------------- */
+
+/* Command lists, FIS areas and tables are addressed physically: keep them in
+ * identity-mapped low memory. */
+#define AHCI_LOWMEM_LIMIT       0x00400000u
+
+#define AHCI_FIS_AREA_OFFSET    0x400u
+#define AHCI_TABLES_PER_PAGE    (PMM_PAGE_SIZE / sizeof(AhciCmdTable))
+
+/* Register handshakes (ST/CR, FRE/FR, BSY): iterations before giving up. */
+#define AHCI_SPIN_LIMIT         1000000u
+
+/* Polling without interrupts: polls without progress before a command fails. */
+#define AHCI_POLL_LIMIT         5000000u
+
+/* Interrupt mode: no progress for this long -> poll; for much longer -> fail. */
+#define AHCI_IRQ_TIMEOUT_TICKS  100u
+#define AHCI_CMD_TIMEOUT_TICKS  1000u
+
+/* ahci_sync_cmd(): command still running. */
+#define AHCI_IN_PROGRESS        (-1)
+
+/* Not a block op: selects IDENTIFY DEVICE in ahci_sync_cmd(). */
+#define AHCI_OP_IDENTIFY        0xFFu
+
+#define AHCI_PX_IE_DEFAULT (AHCI_PX_IS_DHRS | AHCI_PX_IS_PSS | AHCI_PX_IS_SDBS | AHCI_PX_IS_ERRORS)
+
+typedef struct
+{
+    uint32_t dw0;           /* CFL, W, PRDTL */
+    volatile uint32_t prdbc;
+    uint32_t ctba;
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} AhciCmdHeader;
+
+typedef struct
+{
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;           /* Byte count - 1 (bit 0 must be set) */
+} AhciPrd;
+
+typedef struct
+{
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    AhciPrd prdt[AHCI_PRDT_ENTRIES];
+} AhciCmdTable;
+
+typedef struct
+{
+    volatile uint8_t *regs;     /* Port register block inside ABAR */
+    AhciCmdHeader *cl;
+    AhciCmdTable *table[AHCI_MAX_SLOTS];
+    uint32_t slots;             /* Slots with a command table */
+    uint32_t outstanding;       /* Slots issued and not yet reaped */
+    bool sync_busy;             /* A synchronous command owns the port */
+    uint32_t sync_mask;         /* Its slot once issued (0 = none) */
+    volatile int sync_rc;
+    uint32_t idle_polls;
+    uint64_t progress_tick;
+    uint32_t irq_is;            /* PxIS bits cleared by the IRQ handler, not yet handled */
+    WaitQueue waiters;          /* Threads in ahci_wait_event() */
+    BlockDevice dev;
+    AhciDiskInfo info;
+} AhciPort;
+
+static volatile uint8_t *g_ahci_abar = 0;
+static uint32_t g_ahci_cap = 0u;
+static uint8_t g_ahci_irq_line = 0xFFu;
+static bool g_ahci_irq_mode = false;
+static uint32_t g_ahci_irqs = 0u;
+
+static void ahci_softirq(void *arg);
+static SoftirqWork g_ahci_work = SOFTIRQ_WORK_INIT(ahci_softirq, 0);
+
+static AhciPort g_ahci_ports[AHCI_MAX_DISKS];
+static uint32_t g_ahci_port_count = 0u;
+
+static uint16_t g_ahci_ident[256];
+
+/* --------------------------------------------------------------------------
+ * Register access
+ * -------------------------------------------------------------------------- */
+
+static uint32_t ahci_hba_read(uint32_t reg)
+{
+    return *(volatile uint32_t *)(g_ahci_abar + reg);
+}
+
+static void ahci_hba_write(uint32_t reg, uint32_t value)
+{
+    *(volatile uint32_t *)(g_ahci_abar + reg) = value;
+}
+
+static uint32_t ahci_read(const AhciPort *p, uint32_t reg)
+{
+    return *(volatile uint32_t *)(p->regs + reg);
+}
+
+static void ahci_write(AhciPort *p, uint32_t reg, uint32_t value)
+{
+    *(volatile uint32_t *)(p->regs + reg) = value;
+}
+
+/* Wait until (reg & mask) == 0. */
+static bool ahci_wait_clear(AhciPort *p, uint32_t reg, uint32_t mask)
+{
+    for (uint32_t i = 0; i < AHCI_SPIN_LIMIT; i++)
+    {
+        if ((ahci_read(p, reg) & mask) == 0u)
+            return true;
+    }
+
+    return false;
+}
+
+/* --------------------------------------------------------------------------
+ * Port engine
+ * -------------------------------------------------------------------------- */
+
+static bool ahci_port_stop(AhciPort *p)
+{
+    ahci_write(p, AHCI_PX_CMD, ahci_read(p, AHCI_PX_CMD) & ~AHCI_PX_CMD_ST);
+    if (!ahci_wait_clear(p, AHCI_PX_CMD, AHCI_PX_CMD_CR))
+        return false;
+
+    ahci_write(p, AHCI_PX_CMD, ahci_read(p, AHCI_PX_CMD) & ~AHCI_PX_CMD_FRE);
+    return ahci_wait_clear(p, AHCI_PX_CMD, AHCI_PX_CMD_FR);
+}
+
+static bool ahci_port_start(AhciPort *p)
+{
+    ahci_write(p, AHCI_PX_CMD, ahci_read(p, AHCI_PX_CMD) | AHCI_PX_CMD_FRE);
+
+    /* ST may only be set once the device has posted its signature / gone idle. */
+    if (!ahci_wait_clear(p, AHCI_PX_TFD, AHCI_TFD_BSY | AHCI_TFD_DRQ))
+        return false;
+
+    ahci_write(p, AHCI_PX_CMD, ahci_read(p, AHCI_PX_CMD) | AHCI_PX_CMD_ST);
+    return true;
+}
+
+/* COMRESET: for a device stuck with BSY/DRQ set after an error. */
+static void ahci_port_comreset(AhciPort *p)
+{
+    ahci_write(p, AHCI_PX_SCTL, (ahci_read(p, AHCI_PX_SCTL) & ~0x0Fu) | AHCI_SCTL_DET_COMRESET);
+
+    /* DET=1 must be held for at least 1 ms. */
+    uint64_t start = timer_get_ticks();
+    for (uint32_t i = 0; i < AHCI_SPIN_LIMIT && timer_get_ticks() - start < 2u; i++)
+        (void)ahci_read(p, AHCI_PX_SCTL);
+
+    ahci_write(p, AHCI_PX_SCTL, ahci_read(p, AHCI_PX_SCTL) & ~0x0Fu);
+
+    for (uint32_t i = 0; i < AHCI_SPIN_LIMIT; i++)
+    {
+        if ((ahci_read(p, AHCI_PX_SSTS) & AHCI_SSTS_DET_MASK) == AHCI_SSTS_DET_PRESENT)
+            break;
+    }
+
+    ahci_write(p, AHCI_PX_SERR, 0xFFFFFFFFu);
+}
+
+/*
+ * Error recovery (task file error, host bus / interface error, timeout):
+ * restart the command engine and fail every command that was in flight.
+ * Interrupts are off.
+ */
+static void ahci_port_recover(AhciPort *p)
+{
+    (void)ahci_port_stop(p);
+
+    ahci_write(p, AHCI_PX_SERR, 0xFFFFFFFFu);
+    ahci_write(p, AHCI_PX_IS, 0xFFFFFFFFu);
+
+    if (ahci_read(p, AHCI_PX_TFD) & (AHCI_TFD_BSY | AHCI_TFD_DRQ))
+        ahci_port_comreset(p);
+
+    (void)ahci_port_start(p);
+
+    uint32_t failed = p->outstanding;
+    p->outstanding = 0u;
+    p->idle_polls = 0u;
+    p->progress_tick = timer_get_ticks();
+    p->info.errors++;
+
+    for (uint32_t slot = 0; slot < AHCI_MAX_SLOTS; slot++)
+    {
+        if (!(failed & (1u << slot)))
+            continue;
+
+        if (p->sync_mask & (1u << slot))
+        {
+            p->sync_mask = 0u;
+            p->sync_rc = AHCI_ERR_DEVICE;
+        }
+        else
+        {
+            block_complete(&p->dev, slot, BLOCK_ERROR);
+        }
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Command construction
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Describe `bytes` at virtual address `buf` with PRD entries, merging
+ * physically contiguous pages. Returns the entry count, or 0 if the buffer is
+ * unmapped, not word-aligned or too fragmented.
+ */
+static uint32_t ahci_build_prdt(AhciCmdTable *t, uint8_t *buf, uint32_t bytes)
+{
+    uint32_t vaddr = (uint32_t)(uintptr_t)buf;
+    uint32_t entries = 0u;
+
+    if ((vaddr & 1u) || (bytes & 1u))
+        return 0u;
+
+    while (bytes > 0u)
+    {
+        uint32_t phys = vmm_get_phys(vaddr);
+        if (!phys)
+            return 0u;
+
+        uint32_t chunk = PAGE_SIZE - (vaddr & (PAGE_SIZE - 1u));
+        if (chunk > bytes)
+            chunk = bytes;
+
+        AhciPrd *last = (entries > 0u) ? &t->prdt[entries - 1u] : 0;
+        uint32_t last_len = last ? (last->dbc & 0x3FFFFFu) + 1u : 0u;
+
+        if (last && last->dba + last_len == phys && last_len + chunk <= AHCI_PRD_MAX_BYTES)
+        {
+            last->dbc = (last_len + chunk) - 1u;
+        }
+        else
+        {
+            if (entries == AHCI_PRDT_ENTRIES)
+                return 0u;
+
+            AhciPrd *prd = &t->prdt[entries++];
+            prd->dba = phys;
+            prd->dbau = 0u;
+            prd->reserved = 0u;
+            prd->dbc = chunk - 1u;
+        }
+
+        vaddr += chunk;
+        bytes -= chunk;
+    }
+
+    return entries;
+}
+
+/* Start an H2D register FIS for `command` in the slot's table. */
+static uint8_t *ahci_fis_init(AhciPort *p, uint32_t slot, uint8_t command)
+{
+    uint8_t *fis = p->table[slot]->cfis;
+
+    memset(fis, 0, sizeof(p->table[slot]->cfis));
+    fis[0] = AHCI_FIS_TYPE_REG_H2D;
+    fis[1] = AHCI_FIS_H2D_COMMAND;
+    fis[2] = command;
+    return fis;
+}
+
+static void ahci_fis_set_lba(uint8_t *fis, uint64_t lba, bool lba48)
+{
+    fis[4] = (uint8_t)lba;
+    fis[5] = (uint8_t)(lba >> 8);
+    fis[6] = (uint8_t)(lba >> 16);
+
+    if (lba48)
+    {
+        fis[8] = (uint8_t)(lba >> 24);
+        fis[9] = (uint8_t)(lba >> 32);
+        fis[10] = (uint8_t)(lba >> 40);
+        fis[7] = AHCI_FIS_DEVICE_LBA;
+    }
+    else
+    {
+        fis[7] = (uint8_t)(AHCI_FIS_DEVICE_LBA | ((lba >> 24) & 0x0Fu));
+    }
+}
+
+/* Fill the command header; the FIS is already in the slot's table. */
+static int ahci_finish_slot(AhciPort *p, uint32_t slot, bool write, uint8_t *buf, uint32_t bytes)
+{
+    uint32_t prdtl = 0u;
+
+    if (bytes > 0u)
+    {
+        prdtl = ahci_build_prdt(p->table[slot], buf, bytes);
+        if (prdtl == 0u)
+            return AHCI_ERR_INVALID;
+    }
+
+    AhciCmdHeader *h = &p->cl[slot];
+    h->dw0 = AHCI_CMDH_CFL_H2D | (write ? AHCI_CMDH_WRITE : 0u) | (prdtl << AHCI_CMDH_PRDTL_SHIFT);
+    h->prdbc = 0u;
+    h->ctba = (uint32_t)(uintptr_t)p->table[slot];
+    h->ctbau = 0u;
+    return AHCI_OK;
+}
+
+/*
+ * READ/WRITE FPDMA QUEUED if `queued`, else READ/WRITE DMA (EXT). `fua` writes
+ * bypass the drive's cache: the FPDMA FUA bit, or WRITE DMA FUA EXT.
+ */
+static int ahci_setup_rw(AhciPort *p, uint32_t slot, bool queued, bool write, bool fua, uint32_t lba, uint32_t count, uint8_t *buf)
+{
+    if (count == 0u || count > AHCI_MAX_SECTORS_PER_CMD)
+        return AHCI_ERR_INVALID;
+
+    uint8_t *fis;
+
+    if (queued)
+    {
+        /* Sector count goes in FEATURES; COUNT carries the tag. */
+        fis = ahci_fis_init(p, slot, write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED);
+        fis[3] = (uint8_t)count;
+        fis[11] = (uint8_t)(count >> 8);
+        fis[12] = (uint8_t)(slot << 3);
+        ahci_fis_set_lba(fis, lba, true);
+        if (write && fua)
+            fis[7] |= AHCI_FIS_DEVICE_FUA;
+    }
+    else if (p->info.lba48)
+    {
+        uint8_t command = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+        if (write && fua)
+            command = ATA_CMD_WRITE_DMA_FUA_EXT;
+
+        fis = ahci_fis_init(p, slot, command);
+        fis[12] = (uint8_t)count;
+        fis[13] = (uint8_t)(count >> 8);
+        ahci_fis_set_lba(fis, lba, true);
+    }
+    else
+    {
+        if (fua || lba > 0x0FFFFFFFu || count > 0x0FFFFFFFu - lba + 1u)
+            return AHCI_ERR_INVALID;
+
+        fis = ahci_fis_init(p, slot, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+        fis[12] = (uint8_t)count; /* 256 encodes as 0 */
+        ahci_fis_set_lba(fis, lba, false);
+    }
+
+    return ahci_finish_slot(p, slot, write, buf, count * AHCI_SECTOR_SIZE);
+}
+
+/* Non-queued FLUSH CACHE (EXT): needs the port to itself. */
+static int ahci_setup_flush(AhciPort *p, uint32_t slot)
+{
+    (void)ahci_fis_init(p, slot, p->info.flush_ext ? ATA_CMD_CACHE_FLUSH_EXT : ATA_CMD_CACHE_FLUSH);
+    return ahci_finish_slot(p, slot, false, 0, 0u);
+}
+
+/* Hand a prepared slot to the HBA. Interrupts are off. */
+static void ahci_issue(AhciPort *p, uint32_t slot, bool queued)
+{
+    uint32_t bit = 1u << slot;
+
+    if (p->outstanding == 0u)
+    {
+        p->progress_tick = timer_get_ticks();
+        p->idle_polls = 0u;
+    }
+
+    p->outstanding |= bit;
+
+    /* Command table stores must be visible before the doorbell. */
+    __asm__ volatile("" ::: "memory");
+
+    if (queued)
+        ahci_write(p, AHCI_PX_SACT, bit);
+    ahci_write(p, AHCI_PX_CI, bit);
+
+    uint32_t n = 0u;
+    for (uint32_t v = p->outstanding; v; v &= v - 1u)
+        n++;
+    if (n > p->info.max_outstanding)
+        p->info.max_outstanding = n;
+}
+
+/* --------------------------------------------------------------------------
+ * Completion
+ * -------------------------------------------------------------------------- */
+
+/* Reap finished slots (or recover from an error). Interrupts are off, or
+ * softirq context. */
+static void ahci_port_event(AhciPort *p)
+{
+    /* The IRQ handler may latch more status meanwhile: take it atomically. */
+    uint32_t flags = cpu_irq_save();
+    uint32_t is = ahci_read(p, AHCI_PX_IS);
+    ahci_write(p, AHCI_PX_IS, is);
+    is |= p->irq_is;
+    p->irq_is = 0u;
+    cpu_irq_restore(flags);
+
+    if (p->outstanding == 0u)
+        return;
+
+    if (is & AHCI_PX_IS_ERRORS)
+    {
+        ahci_port_recover(p);
+        return;
+    }
+
+    uint32_t done = p->outstanding & ~(ahci_read(p, AHCI_PX_SACT) | ahci_read(p, AHCI_PX_CI));
+    if (done == 0u)
+    {
+        p->idle_polls++;
+        return;
+    }
+
+    p->idle_polls = 0u;
+    p->progress_tick = timer_get_ticks();
+
+    for (uint32_t slot = 0; slot < AHCI_MAX_SLOTS; slot++)
+    {
+        uint32_t bit = 1u << slot;
+        if (!(done & bit))
+            continue;
+
+        /* Release first: completion may reuse the slot for the next unit. */
+        p->outstanding &= ~bit;
+
+        if (p->sync_mask & bit)
+        {
+            p->sync_mask = 0u;
+            p->sync_rc = AHCI_OK;
+        }
+        else
+        {
+            block_complete(&p->dev, slot, BLOCK_SUCCESS);
+        }
+    }
+}
+
+/*
+ * Wait for the port to make progress: sleep until its interrupt is handled
+ * when possible (other threads run meanwhile), otherwise poll. Commands that
+ * stop making progress are failed.
+ */
+static void ahci_wait_event(AhciPort *p)
+{
+    uint32_t flags = cpu_irq_save();
+
+    if (p->outstanding != 0u)
+    {
+        uint64_t idle = timer_get_ticks() - p->progress_tick;
+
+        if (g_ahci_irq_mode && (flags & CPU_EFLAGS_IF) && idle <= AHCI_IRQ_TIMEOUT_TICKS)
+        {
+            /* Until the interrupt, or the stall deadline if it is lost. */
+            wait_queue_sleep(&p->waiters, (p->progress_tick + AHCI_IRQ_TIMEOUT_TICKS + 1u) * TIMER_TICK_NS);
+        }
+        else
+        {
+            ahci_port_event(p);
+
+            if (p->outstanding != 0u && (idle > AHCI_CMD_TIMEOUT_TICKS || p->idle_polls > AHCI_POLL_LIMIT))
+                ahci_port_recover(p);
+        }
+    }
+
+    cpu_irq_restore(flags);
+}
+
+/*
+ * Synchronous command on slot 0 (never queued): claim the port so new async
+ * units are refused, let in-flight commands drain, then issue and wait.
+ * `op` is BLOCK_OP_READ/WRITE/FLUSH or AHCI_OP_IDENTIFY.
+ */
+static int ahci_sync_cmd(AhciPort *p, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buf)
+{
+    uint32_t flags = cpu_irq_save();
+    if (p->sync_busy)
+    {
+        cpu_irq_restore(flags);
+        return AHCI_ERR_BUSY;
+    }
+    p->sync_busy = true;
+    cpu_irq_restore(flags);
+
+    while (p->outstanding != 0u)
+        ahci_wait_event(p);
+
+    int rc;
+    flags = cpu_irq_save();
+
+    if (op == BLOCK_OP_READ || op == BLOCK_OP_WRITE)
+    {
+        rc = ahci_setup_rw(p, 0u, false, op == BLOCK_OP_WRITE, false, lba, count, buf);
+    }
+    else if (op == BLOCK_OP_FLUSH)
+    {
+        rc = ahci_setup_flush(p, 0u);
+    }
+    else
+    {
+        (void)ahci_fis_init(p, 0u, ATA_CMD_IDENTIFY);
+        rc = ahci_finish_slot(p, 0u, false, buf, AHCI_SECTOR_SIZE);
+    }
+
+    if (rc == AHCI_OK)
+    {
+        p->sync_rc = AHCI_IN_PROGRESS;
+        p->sync_mask = 1u;
+        ahci_issue(p, 0u, false);
+    }
+
+    cpu_irq_restore(flags);
+
+    if (rc == AHCI_OK)
+    {
+        while (p->sync_rc == AHCI_IN_PROGRESS)
+            ahci_wait_event(p);
+        rc = p->sync_rc;
+    }
+
+    p->sync_busy = false;
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+ * BlockDevice operations
+ * -------------------------------------------------------------------------- */
+
+static int ahci_block_io(BlockDevice *dev, bool write, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !dev->ctx || !buffer)
+        return BLOCK_ERROR;
+
+    AhciPort *p = (AhciPort *)dev->ctx;
+    if (lba >= dev->sector_count || count > dev->sector_count - lba)
+        return BLOCK_ERROR;
+
+    while (count > 0u)
+    {
+        uint32_t n = (count > AHCI_MAX_SECTORS_PER_CMD) ? AHCI_MAX_SECTORS_PER_CMD : count;
+
+        if (ahci_sync_cmd(p, write ? BLOCK_OP_WRITE : BLOCK_OP_READ, lba, n, buffer) != AHCI_OK)
+            return BLOCK_ERROR;
+
+        p->info.commands++;
+        lba += n;
+        count -= n;
+        buffer += n * AHCI_SECTOR_SIZE;
+    }
+
+    return BLOCK_SUCCESS;
+}
+
+static int ahci_block_read(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return ahci_block_io(dev, false, lba, 1u, buffer);
+}
+
+static int ahci_block_write(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return ahci_block_io(dev, true, lba, 1u, buffer);
+}
+
+static int ahci_block_read_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return ahci_block_io(dev, false, lba, count, buffer);
+}
+
+static int ahci_block_write_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return ahci_block_io(dev, true, lba, count, buffer);
+}
+
+static int ahci_block_flush(BlockDevice *dev)
+{
+    if (!dev || !dev->ctx)
+        return BLOCK_ERROR;
+
+    return (ahci_sync_cmd((AhciPort *)dev->ctx, BLOCK_OP_FLUSH, 0u, 0u, 0) == AHCI_OK) ? BLOCK_SUCCESS : BLOCK_ERROR;
+}
+
+/* Called by the block queue with interrupts disabled; `tag` is the slot. */
+static int ahci_block_submit(BlockDevice *dev, uint32_t tag, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !dev->ctx || (!buffer && op != BLOCK_OP_FLUSH))
+        return BLOCK_ERROR;
+
+    AhciPort *p = (AhciPort *)dev->ctx;
+
+    if (op == BLOCK_OP_FLUSH)
+    {
+        if (tag >= p->info.queue_depth)
+            return BLOCK_ERROR;
+
+        /* Not an NCQ command: the queue must be empty (the block queue only
+         * flushes once its own units are done; a sync command may still run). */
+        if (p->sync_busy || p->outstanding != 0u)
+            return BLOCK_BUSY;
+
+        if (ahci_setup_flush(p, tag) != AHCI_OK)
+            return BLOCK_ERROR;
+
+        ahci_issue(p, tag, false);
+        return BLOCK_SUCCESS;
+    }
+
+    if (tag >= p->info.queue_depth || lba >= dev->sector_count || count > dev->sector_count - lba)
+        return BLOCK_ERROR;
+
+    /* A synchronous command owns the port, or (without NCQ) one is running. */
+    if (p->sync_busy || (p->outstanding & (1u << tag)) || (!p->info.ncq && p->outstanding != 0u))
+        return BLOCK_BUSY;
+
+    bool write = (op == BLOCK_OP_WRITE || op == BLOCK_OP_WRITE_FUA);
+    if (ahci_setup_rw(p, tag, p->info.ncq, write, op == BLOCK_OP_WRITE_FUA, lba, count, buffer) != AHCI_OK)
+        return BLOCK_ERROR;
+
+    p->info.commands++;
+    ahci_issue(p, tag, p->info.ncq);
+    return BLOCK_SUCCESS;
+}
+
+static void ahci_block_poll(BlockDevice *dev)
+{
+    if (dev && dev->ctx)
+        ahci_wait_event((AhciPort *)dev->ctx);
+}
+
+/* Hybrid polling: check the port once, never sleep. */
+static void ahci_block_reap(BlockDevice *dev)
+{
+    if (!dev || !dev->ctx)
+        return;
+
+    uint32_t flags = cpu_irq_save();
+    ahci_port_event((AhciPort *)dev->ctx);
+    cpu_irq_restore(flags);
+}
+
+/* --------------------------------------------------------------------------
+ * Interrupts
+ * -------------------------------------------------------------------------- */
+
+/*
+ * The INTx line may be shared: IS = 0 means another device raised it. Port
+ * status is cleared here so the (level-triggered) line drops before the EOI;
+ * the slots are reaped by the block softirq.
+ */
+static int ahci_irq(uint8_t irq, void *ctx)
+{
+    (void)irq;
+    (void)ctx;
+
+    uint32_t is = ahci_hba_read(AHCI_REG_IS);
+    if (!is)
+        return IRQ_NONE;
+
+    g_ahci_irqs++;
+
+    for (uint32_t i = 0; i < g_ahci_port_count; i++)
+    {
+        AhciPort *p = &g_ahci_ports[i];
+        if (!(is & (1u << p->info.port)))
+            continue;
+
+        uint32_t pis = ahci_read(p, AHCI_PX_IS);
+        ahci_write(p, AHCI_PX_IS, pis);
+        p->irq_is |= pis;
+    }
+
+    /* Port status is clear: now the HBA-level bits. */
+    ahci_hba_write(AHCI_REG_IS, is);
+
+    softirq_queue(SOFTIRQ_BLOCK, &g_ahci_work);
+    return IRQ_HANDLED;
+}
+
+static void ahci_softirq(void *arg)
+{
+    (void)arg;
+
+    for (uint32_t i = 0; i < g_ahci_port_count; i++)
+    {
+        ahci_port_event(&g_ahci_ports[i]);
+        wait_queue_wake_all(&g_ahci_ports[i].waiters);
+    }
+}
+
+void ahci_set_irq_mode(bool enabled)
+{
+    if (!g_ahci_abar)
+        return;
+
+    uint32_t flags = cpu_irq_save();
+
+    g_ahci_irq_mode = enabled && g_ahci_irq_line < 16u;
+
+    for (uint32_t i = 0; i < g_ahci_port_count; i++)
+    {
+        AhciPort *p = &g_ahci_ports[i];
+        ahci_write(p, AHCI_PX_IS, 0xFFFFFFFFu);
+        ahci_write(p, AHCI_PX_IE, g_ahci_irq_mode ? AHCI_PX_IE_DEFAULT : 0u);
+    }
+
+    uint32_t ghc = ahci_hba_read(AHCI_REG_GHC);
+    ahci_hba_write(AHCI_REG_GHC, g_ahci_irq_mode ? (ghc | AHCI_GHC_IE) : (ghc & ~AHCI_GHC_IE));
+
+    cpu_irq_restore(flags);
+}
+
+uint8_t ahci_irq_line(void)
+{
+    return g_ahci_irq_line;
+}
+
+uint32_t ahci_irq_count(void)
+{
+    return g_ahci_irqs;
+}
+
+/* --------------------------------------------------------------------------
+ * Discovery
+ * -------------------------------------------------------------------------- */
+
+/* Give slots [p->slots, want) command tables; stops early when out of memory. */
+static void ahci_alloc_tables(AhciPort *p, uint32_t want)
+{
+    while (p->slots < want)
+    {
+        AhciCmdTable *page = (AhciCmdTable *)pmm_alloc_page_low(AHCI_LOWMEM_LIMIT);
+        if (!page)
+            return;
+
+        memset(page, 0, PMM_PAGE_SIZE);
+
+        for (uint32_t i = 0; i < AHCI_TABLES_PER_PAGE && p->slots < want; i++)
+            p->table[p->slots++] = &page[i];
+    }
+}
+
+static void ahci_parse_identify(AhciDiskInfo *info, const uint16_t ident[256])
+{
+    uint32_t lba28 = (uint32_t)ident[ATA_IDENT_LBA28_SECTORS] | ((uint32_t)ident[ATA_IDENT_LBA28_SECTORS + 1u] << 16);
+
+    info->lba48 = (ident[ATA_IDENT_COMMAND_SET_2] & ATA_IDENT_CMDSET2_LBA48) != 0u;
+    info->sectors = lba28;
+
+    /* Words 82-85 are valid when word 83 carries its 01b signature. */
+    if ((ident[ATA_IDENT_COMMAND_SET_2] & 0xC000u) == 0x4000u)
+    {
+        info->write_cache = (ident[ATA_IDENT_COMMAND_SET_1] & ATA_IDENT_CMDSET1_WCACHE) != 0u
+            && (ident[ATA_IDENT_CMDSET_ENABLED_1] & ATA_IDENT_CMDSET1_WCACHE) != 0u;
+        info->flush_ext = info->lba48 && (ident[ATA_IDENT_COMMAND_SET_2] & ATA_IDENT_CMDSET2_FLUSH_EXT) != 0u;
+        info->fua = info->lba48 && (ident[ATA_IDENT_COMMAND_SET_EXT] & ATA_IDENT_CMDSETX_FUA) != 0u;
+    }
+    else
+    {
+        info->write_cache = true;
+    }
+
+    if (info->lba48)
+    {
+        uint64_t lba48 = (uint64_t)ident[ATA_IDENT_LBA48_SECTORS]
+            | ((uint64_t)ident[ATA_IDENT_LBA48_SECTORS + 1u] << 16)
+            | ((uint64_t)ident[ATA_IDENT_LBA48_SECTORS + 2u] << 32)
+            | ((uint64_t)ident[ATA_IDENT_LBA48_SECTORS + 3u] << 48);
+        if (lba48 != 0u)
+            info->sectors = lba48;
+    }
+
+    for (uint32_t i = 0; i < 20u; i++)
+    {
+        uint16_t w = ident[ATA_IDENT_MODEL + i];
+        info->model[i * 2u] = (char)(w >> 8);
+        info->model[(i * 2u) + 1u] = (char)(w & 0xFFu);
+    }
+
+    int end = 40;
+    while (end > 0 && (info->model[end - 1] == ' ' || info->model[end - 1] == '\0'))
+        end--;
+    info->model[end] = '\0';
+}
+
+/* Bring up one port with a SATA disk and register it. */
+static int ahci_port_init(uint32_t port, uint32_t hba_slots)
+{
+    AhciPort *p = &g_ahci_ports[g_ahci_port_count];
+    memset(p, 0, sizeof(*p));
+    p->regs = g_ahci_abar + AHCI_PORT_BASE + (port * AHCI_PORT_STRIDE);
+    p->info.port = (uint8_t)port;
+
+    uint8_t *page = (uint8_t *)pmm_alloc_page_low(AHCI_LOWMEM_LIMIT);
+    if (!page)
+        return AHCI_ERR_NO_MEMORY;
+    memset(page, 0, PMM_PAGE_SIZE);
+
+    p->cl = (AhciCmdHeader *)page;
+
+    if (!ahci_port_stop(p))
+    {
+        pmm_free_page(page);
+        return AHCI_ERR_TIMEOUT;
+    }
+
+    ahci_write(p, AHCI_PX_CLB, (uint32_t)(uintptr_t)page);
+    ahci_write(p, AHCI_PX_CLBU, 0u);
+    ahci_write(p, AHCI_PX_FB, (uint32_t)(uintptr_t)(page + AHCI_FIS_AREA_OFFSET));
+    ahci_write(p, AHCI_PX_FBU, 0u);
+    ahci_write(p, AHCI_PX_SERR, 0xFFFFFFFFu);
+    ahci_write(p, AHCI_PX_IE, 0u);
+    ahci_write(p, AHCI_PX_IS, 0xFFFFFFFFu);
+
+    /* One table page (slots 0-3) is enough for IDENTIFY. */
+    ahci_alloc_tables(p, 1u);
+    if (p->slots == 0u || !ahci_port_start(p))
+        return AHCI_ERR_TIMEOUT;
+
+    int rc = ahci_sync_cmd(p, AHCI_OP_IDENTIFY, 0u, 0u, (uint8_t *)g_ahci_ident);
+    if (rc != AHCI_OK)
+    {
+        (void)ahci_port_stop(p);
+        return rc;
+    }
+
+    ahci_parse_identify(&p->info, g_ahci_ident);
+
+    /* NCQ needs both ends; the depth is the smaller of the two queues. */
+    uint32_t depth = 1u;
+    if ((g_ahci_cap & AHCI_CAP_SNCQ) && (g_ahci_ident[ATA_IDENT_SATA_CAPABILITIES] & ATA_IDENT_SATA_CAP_NCQ))
+    {
+        p->info.ncq = true;
+        depth = (g_ahci_ident[ATA_IDENT_QUEUE_DEPTH] & 0x1Fu) + 1u;
+        if (depth > hba_slots)
+            depth = hba_slots;
+        if (depth > BLOCK_QUEUE_MAX_TAGS)
+            depth = BLOCK_QUEUE_MAX_TAGS;
+
+        /* FUA is part of the FPDMA command format. */
+        p->info.fua = true;
+    }
+
+    ahci_alloc_tables(p, depth);
+    p->info.queue_depth = (p->slots < depth) ? p->slots : depth;
+
+    BlockDevice *dev = &p->dev;
+    dev->name[0] = 's';
+    dev->name[1] = 'a';
+    dev->name[2] = 't';
+    dev->name[3] = 'a';
+    dev->name[4] = (char)('0' + (char)g_ahci_port_count);
+    dev->name[5] = '\0';
+
+    dev->sector_size = AHCI_SECTOR_SIZE;
+    dev->sector_count = (p->info.sectors > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)p->info.sectors;
+    dev->max_sectors = AHCI_MAX_SECTORS_PER_CMD;
+    dev->queue_depth = p->info.queue_depth;
+    dev->ctx = p;
+    dev->read = ahci_block_read;
+    dev->write = ahci_block_write;
+    dev->read_sectors = ahci_block_read_sectors;
+    dev->write_sectors = ahci_block_write_sectors;
+    dev->submit = ahci_block_submit;
+    dev->reap = ahci_block_reap;
+    dev->poll = ahci_block_poll;
+    dev->flush = ahci_block_flush;
+    dev->write_cache = p->info.write_cache;
+    dev->fua = p->info.fua;
+
+    if (block_register(dev) != BLOCK_SUCCESS)
+        return AHCI_ERR_NO_MEMORY;
+
+    g_ahci_port_count++;
+    return AHCI_OK;
+}
+
+int ahci_register_devices(void)
+{
+    PciDevice *pdev = pci_find_class(PCI_CLASS_STORAGE, AHCI_PCI_SUBCLASS, AHCI_PCI_PROG_IF);
+    if (!pdev || pci_bar_is_io(pdev, AHCI_PCI_ABAR))
+        return AHCI_ERR_NO_DEVICE;
+
+    uint32_t abar = pci_bar_address(pdev, AHCI_PCI_ABAR);
+    if (!abar)
+        return AHCI_ERR_NO_DEVICE;
+
+    g_ahci_abar = (volatile uint8_t *)vmm_map_mmio(abar, AHCI_PORT_BASE + (AHCI_MAX_PORTS * AHCI_PORT_STRIDE));
+    if (!g_ahci_abar)
+        return AHCI_ERR_NO_MEMORY;
+
+    pci_enable(pdev, PCI_CMD_MEM_SPACE | PCI_CMD_BUS_MASTER);
+
+    /* AHCI mode, interrupts off until ahci_set_irq_mode(). */
+    ahci_hba_write(AHCI_REG_GHC, (ahci_hba_read(AHCI_REG_GHC) | AHCI_GHC_AE) & ~AHCI_GHC_IE);
+
+    g_ahci_cap = ahci_hba_read(AHCI_REG_CAP);
+    g_ahci_irq_line = pdev->irq_line;
+
+    uint32_t hba_slots = ((g_ahci_cap >> AHCI_CAP_NCS_SHIFT) & AHCI_CAP_NCS_MASK) + 1u;
+    uint32_t pi = ahci_hba_read(AHCI_REG_PI);
+
+    for (uint32_t port = 0; port < AHCI_MAX_PORTS && g_ahci_port_count < AHCI_MAX_DISKS; port++)
+    {
+        if (!(pi & (1u << port)))
+            continue;
+
+        volatile uint8_t *regs = g_ahci_abar + AHCI_PORT_BASE + (port * AHCI_PORT_STRIDE);
+        uint32_t ssts = *(volatile uint32_t *)(regs + AHCI_PX_SSTS);
+        uint32_t sig = *(volatile uint32_t *)(regs + AHCI_PX_SIG);
+
+        /* Disks only: skip empty ports, ATAPI, port multipliers, SEMB. */
+        if ((ssts & AHCI_SSTS_DET_MASK) != AHCI_SSTS_DET_PRESENT
+            || ((ssts >> AHCI_SSTS_IPM_SHIFT) & 0x0Fu) != AHCI_SSTS_IPM_ACTIVE
+            || sig != AHCI_SIG_ATA)
+            continue;
+
+        (void)ahci_port_init(port, hba_slots);
+    }
+
+    if (g_ahci_port_count == 0u)
+        return AHCI_ERR_NO_DEVICE;
+
+    if (g_ahci_irq_line < 16u)
+        irq_register(g_ahci_irq_line, ahci_irq, 0, "ahci");
+
+    return AHCI_OK;
+}
+
+uint32_t ahci_disk_count(void)
+{
+    return g_ahci_port_count;
+}
+
+const AhciDiskInfo *ahci_disk_info(uint32_t index)
+{
+    return (index < g_ahci_port_count) ? &g_ahci_ports[index].info : 0;
+}
+
+uint32_t ahci_hba_cap(void)
+{
+    return g_ahci_cap;
+}
@@ -0,0 +1,170 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * AHCI (Serial ATA) host controller driver.
+ *
+ * The controller is found on the PCI bus (class 01h, subclass 06h, prog_if
+ * 01h) and driven through its ABAR registers (BAR5). Every port with an
+ * attached SATA disk gets a command list, a FIS receive area and one command
+ * table per slot, and is registered as block device "sata<N>".
+ *
+ * When both the HBA (CAP.SNCQ) and the drive (IDENTIFY word 76) support
+ * Native Command Queuing, block queue tags map 1:1 onto command slots and up
+ * to BlockDevice.queue_depth READ/WRITE FPDMA QUEUED commands are in flight;
+ * otherwise each port runs one READ/WRITE DMA (EXT) command at a time.
+ */
+
+/* --------------------------------------------------------------------------
+ * PCI identification
+ * -------------------------------------------------------------------------- */
+#define AHCI_PCI_SUBCLASS   0x06u
+#define AHCI_PCI_PROG_IF    0x01u
+#define AHCI_PCI_ABAR       5u
+
+/* --------------------------------------------------------------------------
+ * HBA generic host control registers (offsets into ABAR)
+ * -------------------------------------------------------------------------- */
+#define AHCI_REG_CAP        0x00u
+#define AHCI_REG_GHC        0x04u
+#define AHCI_REG_IS         0x08u
+#define AHCI_REG_PI         0x0Cu
+#define AHCI_REG_VS         0x10u
+
+#define AHCI_CAP_NCS_SHIFT  8u      /* Command slots - 1 (bits 12:8) */
+#define AHCI_CAP_NCS_MASK   0x1Fu
+#define AHCI_CAP_SNCQ       (1u << 30)
+
+#define AHCI_GHC_IE         (1u << 1)
+#define AHCI_GHC_AE         (1u << 31)
+
+/* --------------------------------------------------------------------------
+ * Port registers (offsets from AHCI_PORT_BASE + port * AHCI_PORT_STRIDE)
+ * -------------------------------------------------------------------------- */
+#define AHCI_PORT_BASE      0x100u
+#define AHCI_PORT_STRIDE    0x80u
+
+#define AHCI_PX_CLB         0x00u
+#define AHCI_PX_CLBU        0x04u
+#define AHCI_PX_FB          0x08u
+#define AHCI_PX_FBU         0x0Cu
+#define AHCI_PX_IS          0x10u
+#define AHCI_PX_IE          0x14u
+#define AHCI_PX_CMD         0x18u
+#define AHCI_PX_TFD         0x20u
+#define AHCI_PX_SIG         0x24u
+#define AHCI_PX_SSTS        0x28u
+#define AHCI_PX_SCTL        0x2Cu
+#define AHCI_PX_SERR        0x30u
+#define AHCI_PX_SACT        0x34u
+#define AHCI_PX_CI          0x38u
+
+/* PxCMD */
+#define AHCI_PX_CMD_ST      (1u << 0)
+#define AHCI_PX_CMD_FRE     (1u << 4)
+#define AHCI_PX_CMD_FR      (1u << 14)
+#define AHCI_PX_CMD_CR      (1u << 15)
+
+/* PxIS / PxIE */
+#define AHCI_PX_IS_DHRS     (1u << 0)   /* D2H Register FIS received */
+#define AHCI_PX_IS_PSS      (1u << 1)   /* PIO Setup FIS received */
+#define AHCI_PX_IS_SDBS     (1u << 3)   /* Set Device Bits FIS (NCQ completion) */
+#define AHCI_PX_IS_IFS      (1u << 27)
+#define AHCI_PX_IS_HBDS     (1u << 28)
+#define AHCI_PX_IS_HBFS     (1u << 29)
+#define AHCI_PX_IS_TFES     (1u << 30)
+#define AHCI_PX_IS_ERRORS   (AHCI_PX_IS_IFS | AHCI_PX_IS_HBDS | AHCI_PX_IS_HBFS | AHCI_PX_IS_TFES)
+
+/* PxTFD (shadow of the ATA status register) */
+#define AHCI_TFD_ERR        0x01u
+#define AHCI_TFD_DRQ        0x08u
+#define AHCI_TFD_BSY        0x80u
+
+/* PxSSTS: device detection + interface power state */
+#define AHCI_SSTS_DET_MASK      0x0Fu
+#define AHCI_SSTS_DET_PRESENT   0x03u
+#define AHCI_SSTS_IPM_SHIFT     8u
+#define AHCI_SSTS_IPM_ACTIVE    0x01u
+
+/* PxSCTL.DET = 1 sends COMRESET */
+#define AHCI_SCTL_DET_COMRESET  0x01u
+
+#define AHCI_SIG_ATA        0x00000101u
+
+/* --------------------------------------------------------------------------
+ * Command structures
+ * -------------------------------------------------------------------------- */
+#define AHCI_FIS_TYPE_REG_H2D   0x27u
+#define AHCI_FIS_H2D_COMMAND    0x80u   /* C bit: the FIS carries a command */
+
+/* Command header DW0 */
+#define AHCI_CMDH_CFL_H2D       5u      /* H2D register FIS length (dwords) */
+#define AHCI_CMDH_WRITE         (1u << 6)
+#define AHCI_CMDH_PRDTL_SHIFT   16u
+
+#define AHCI_PRD_MAX_BYTES      0x400000u   /* 4 MiB per PRD entry */
+
+/* FIS device register: LBA addressing (commands come from ata.h); FUA bit of
+ * WRITE FPDMA QUEUED */
+#define AHCI_FIS_DEVICE_LBA     0x40u
+#define AHCI_FIS_DEVICE_FUA     0x80u
+
+/* --------------------------------------------------------------------------
+ * Driver limits
+ * -------------------------------------------------------------------------- */
+#define AHCI_MAX_PORTS          32u
+#define AHCI_MAX_DISKS          4u      /* sata0..sata3 */
+#define AHCI_MAX_SLOTS          32u
+#define AHCI_SECTOR_SIZE        512u
+#define AHCI_MAX_SECTORS_PER_CMD 256u   /* 128 KiB: at most 33 PRD entries */
+#define AHCI_PRDT_ENTRIES       56u     /* Command table = 1 KiB */
+
+/* Return codes (0 = success) */
+#define AHCI_OK                 0
+#define AHCI_ERR_NO_DEVICE      1
+#define AHCI_ERR_TIMEOUT        2
+#define AHCI_ERR_DEVICE         3
+#define AHCI_ERR_NO_MEMORY      4
+#define AHCI_ERR_INVALID        5
+#define AHCI_ERR_BUSY           6
+
+typedef struct
+{
+    uint8_t port;           /* HBA port number */
+    bool ncq;               /* Commands use READ/WRITE FPDMA QUEUED */
+    bool lba48;
+    bool write_cache;       /* Volatile write cache enabled */
+    bool flush_ext;         /* FLUSH CACHE EXT supported */
+    bool fua;               /* Writes can bypass the cache (FPDMA FUA bit / WRITE DMA FUA EXT) */
+    uint32_t queue_depth;   /* Tags usable by the block queue */
+    uint64_t sectors;
+    char model[41];
+    uint32_t commands;      /* Data commands issued */
+    uint32_t max_outstanding;
+    uint32_t errors;
+} AhciDiskInfo;
+
+/*
+ * Probe the controller, bring up every port with a disk and register the
+ * disks as block devices. Returns AHCI_OK, or AHCI_ERR_NO_DEVICE without an
+ * AHCI controller / disk.
+ */
+int ahci_register_devices(void);
+
+uint32_t ahci_disk_count(void);
+const AhciDiskInfo *ahci_disk_info(uint32_t index);
+
+/* Controller capabilities (CAP), 0 if no controller was found. */
+uint32_t ahci_hba_cap(void);
+
+/* Legacy PIC line of the controller's INTx, or 0xFF if none. */
+uint8_t ahci_irq_line(void);
+uint32_t ahci_irq_count(void);
+
+/* Interrupt mode: waiters sleep until the HBA interrupts (else they poll). */
+void ahci_set_irq_mode(bool enabled);
+
+#endif /* AHCI_H */
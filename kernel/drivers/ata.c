@@ -1,5 +1,9 @@
 #include "ata.h"
 #include "io.h"
+#include "pci.h"
+#include "pmm.h"
+#include "string.h"
+#include "vmm.h"
 
 /* --------------------------------------------------------------------------
  * ATA Hardening Notes
@@ -11,49 +15,120 @@
 /* Poll iteration bound (tuned for QEMU; still bounded for real HW). */
 #define ATA_PIO_TIMEOUT 200000u
 
+static AtaDriveInfo g_ata_drive[ATA_DRIVE_COUNT];
+
+/* Non-blocking command in flight (see ata_cmd_start()). */
+typedef struct
+{
+    bool active;
+    bool write;
+    bool dma;               /* Data moved by the bus-master engine. */
+    uint32_t block;         /* Sectors per DRQ block. */
+    uint32_t remaining;     /* Sectors still to move through the data port. */
+    uint8_t *buffer;        /* Next sector's data. */
+    uint32_t polls;         /* Status polls without progress (timeout). */
+    uint32_t poll_limit;    /* DMA: scaled with the transfer size. */
+} AtaCmd;
+
+/* PRD table entry (physical region descriptor). */
+typedef struct __attribute__((packed))
+{
+    uint32_t phys;
+    uint16_t bytes;
+    uint16_t flags;
+} AtaPrd;
+
+/* The PRD table must be physically addressable: keep it identity-mapped. */
+#define ATA_DMA_LOWMEM_LIMIT 0x00400000u
+
+typedef struct
+{
+    bool available;         /* Controller found, PRD table allocated. */
+    uint16_t bmide;         /* Bus-master register base of this channel. */
+    AtaPrd *prdt;           /* Identity-mapped: virtual == physical. */
+    uint32_t transfers;
+    uint32_t fallbacks;
+} AtaDmaState;
+
+/*
+ * One IDE channel: its own ports, IRQ line, command slot and DMA engine.
+ * Channels share nothing, so each can have a command in flight at once.
+ */
 typedef struct
 {
-    bool present;
-    uint32_t lba28_sectors;
-} AtaDriveState;
+    uint16_t io;            /* Command block base (data ... status/command). */
+    uint16_t ctrl;          /* Control block (alternate status / device control). */
+    uint8_t irq;
+    AtaCmd cmd;
+    AtaDmaState dma;
+} AtaChannel;
+
+static AtaChannel g_ata_channel[ATA_CHANNEL_COUNT] = {
+    { .io = ATA_PRIMARY_IO,   .ctrl = ATA_PRIMARY_CTRL,   .irq = ATA_PRIMARY_IRQ },
+    { .io = ATA_SECONDARY_IO, .ctrl = ATA_SECONDARY_CTRL, .irq = ATA_SECONDARY_IRQ },
+};
 
-static AtaDriveState g_ata_drive[2];
+/* Policy switch (ata_dma_set_enabled), applies to every channel. */
+static bool g_ata_dma_enabled = false;
+
+static AtaChannel *ata_drive_channel(int drive)
+{
+    return &g_ata_channel[drive >> 1];
+}
+
+static uint16_t ata_reg(const AtaChannel *ch, uint16_t reg)
+{
+    return (uint16_t)(ch->io + reg);
+}
 
 /* 400ns delay after certain ATA register writes (spec requirement). */
-static void ata_400ns_delay(void)
+static void ata_400ns_delay(const AtaChannel *ch)
 {
     /* Reading alternate status is ideal; status read is usually acceptable. */
-    (void)inb(ATA_ALT_STATUS);
-    (void)inb(ATA_ALT_STATUS);
-    (void)inb(ATA_ALT_STATUS);
-    (void)inb(ATA_ALT_STATUS);
+    (void)inb(ch->ctrl);
+    (void)inb(ch->ctrl);
+    (void)inb(ch->ctrl);
+    (void)inb(ch->ctrl);
 }
 
 static bool ata_valid_drive(int drive)
 {
-    return (drive == ATA_DRIVE_MASTER) || (drive == ATA_DRIVE_SLAVE);
+    return drive >= 0 && drive < (int)ATA_DRIVE_COUNT;
+}
+
+static bool ata_valid_channel(int channel)
+{
+    return channel >= 0 && channel < (int)ATA_CHANNEL_COUNT;
+}
+
+/* Position on the cable: master or slave. */
+static bool ata_drive_is_master(int drive)
+{
+    return (drive & 1) == ATA_DRIVE_MASTER;
 }
 
 static uint8_t ata_drive_select_value(int drive, bool lba)
 {
     if (lba)
-        return (drive == ATA_DRIVE_MASTER) ? ATA_DRIVE_LBA_MASTER : ATA_DRIVE_LBA_SLAVE;
+        return ata_drive_is_master(drive) ? ATA_DRIVE_LBA_MASTER : ATA_DRIVE_LBA_SLAVE;
 
-    return (drive == ATA_DRIVE_MASTER) ? ATA_DRIVE_SELECT_MASTER : ATA_DRIVE_SELECT_SLAVE;
+    return ata_drive_is_master(drive) ? ATA_DRIVE_SELECT_MASTER : ATA_DRIVE_SELECT_SLAVE;
 }
 
 static void ata_select_drive(int drive, bool lba)
 {
-    outb(ATA_DRIVE_HEAD, ata_drive_select_value(drive, lba));
-    ata_400ns_delay();
+    AtaChannel *ch = ata_drive_channel(drive);
+
+    outb(ata_reg(ch, ATA_REG_DRIVE_HEAD), ata_drive_select_value(drive, lba));
+    ata_400ns_delay(ch);
 }
 
 /* Wait for BSY to clear. Also treat DF/ERR as immediate failure. */
-static int ata_wait_not_busy(void)
+static int ata_wait_not_busy(const AtaChannel *ch)
 {
     for (uint32_t i = 0; i < ATA_PIO_TIMEOUT; i++)
     {
-        uint8_t status = inb(ATA_STATUS);
+        uint8_t status = inb(ata_reg(ch, ATA_REG_STATUS));
 
         if (status & ATA_SR_ERR)
             return ATA_ERR_DEVICE;
@@ -69,11 +144,11 @@ static int ata_wait_not_busy(void)
 }
 
 /* Wait for DRQ to set (data ready). Also treat DF/ERR as immediate failure. */
-static int ata_wait_drq(void)
+static int ata_wait_drq(const AtaChannel *ch)
 {
     for (uint32_t i = 0; i < ATA_PIO_TIMEOUT; i++)
     {
-        uint8_t status = inb(ATA_STATUS);
+        uint8_t status = inb(ata_reg(ch, ATA_REG_STATUS));
 
         if (status & ATA_SR_ERR)
             return ATA_ERR_DEVICE;
@@ -94,71 +169,156 @@ static int ata_identify_pio(int drive, uint16_t out_ident[256])
     if (!ata_valid_drive(drive) || !out_ident)
         return ATA_ERR_INVALID_PARAM;
 
+    AtaChannel *ch = ata_drive_channel(drive);
+
     /* Select drive, CHS for IDENTIFY (doesn't matter much, but keep spec-friendly). */
     ata_select_drive(drive, false);
 
     /* Clear regs per spec for IDENTIFY. */
-    outb(ATA_SECTOR_CNT, 0u);
-    outb(ATA_LBA_LO, 0u);
-    outb(ATA_LBA_MID, 0u);
-    outb(ATA_LBA_HI, 0u);
+    outb(ata_reg(ch, ATA_REG_SECTOR_CNT), 0u);
+    outb(ata_reg(ch, ATA_REG_LBA_LO), 0u);
+    outb(ata_reg(ch, ATA_REG_LBA_MID), 0u);
+    outb(ata_reg(ch, ATA_REG_LBA_HI), 0u);
 
-    outb(ATA_COMMAND, ATA_CMD_IDENTIFY);
-    ata_400ns_delay();
+    outb(ata_reg(ch, ATA_REG_COMMAND), ATA_CMD_IDENTIFY);
+    ata_400ns_delay(ch);
 
     /* If status is 0, drive does not exist on this bus. */
-    uint8_t status = inb(ATA_STATUS);
+    uint8_t status = inb(ata_reg(ch, ATA_REG_STATUS));
     if (status == 0u)
         return ATA_ERR_NO_DEVICE;
 
-    int rc = ata_wait_not_busy();
+    int rc = ata_wait_not_busy(ch);
     if (rc != ATA_OK)
         return rc;
 
     /* ATAPI signature check: if LBA_MID/LBA_HI non-zero, not ATA. */
     {
-        uint8_t mid = inb(ATA_LBA_MID);
-        uint8_t hi  = inb(ATA_LBA_HI);
+        uint8_t mid = inb(ata_reg(ch, ATA_REG_LBA_MID));
+        uint8_t hi  = inb(ata_reg(ch, ATA_REG_LBA_HI));
         if ((mid != 0u) || (hi != 0u))
             return ATA_ERR_UNSUPPORTED;
     }
 
-    rc = ata_wait_drq();
+    rc = ata_wait_drq(ch);
     if (rc != ATA_OK)
         return rc;
 
-    insw(ATA_DATA, out_ident, 256u);
-    (void)inb(ATA_STATUS);
+    insw(ata_reg(ch, ATA_REG_DATA), out_ident, 256u);
+    (void)inb(ata_reg(ch, ATA_REG_STATUS));
 
     return ATA_OK;
 }
 
-void ata_init(void)
+/* Parse the IDENTIFY fields the driver cares about. */
+static void ata_parse_identify(AtaDriveInfo *info, const uint16_t ident[256])
 {
-    for (int d = 0; d < 2; d++)
+    memset(info, 0, sizeof(*info));
+    info->present = true;
+
+    info->lba28_sectors = (uint32_t)ident[ATA_IDENT_LBA28_SECTORS]
+        | ((uint32_t)ident[ATA_IDENT_LBA28_SECTORS + 1u] << 16);
+
+    info->max_multiple = (uint8_t)(ident[ATA_IDENT_MAX_MULTIPLE] & 0xFFu);
+    info->dma = (ident[ATA_IDENT_CAPABILITIES] & ATA_IDENT_CAP_DMA) != 0u;
+    info->mwdma_modes = (uint8_t)(ident[ATA_IDENT_MWDMA] & 0x07u);
+    info->udma_modes = (uint8_t)(ident[ATA_IDENT_UDMA] & 0xFFu);
+
+    if (ident[ATA_IDENT_COMMAND_SET_2] & ATA_IDENT_CMDSET2_LBA48)
     {
-        g_ata_drive[d].present = false;
-        g_ata_drive[d].lba28_sectors = 0u;
+        info->lba48 = true;
+        info->lba48_sectors = (uint64_t)ident[ATA_IDENT_LBA48_SECTORS]
+            | ((uint64_t)ident[ATA_IDENT_LBA48_SECTORS + 1u] << 16)
+            | ((uint64_t)ident[ATA_IDENT_LBA48_SECTORS + 2u] << 32)
+            | ((uint64_t)ident[ATA_IDENT_LBA48_SECTORS + 3u] << 48);
     }
 
-    /* Probe master + slave on the primary bus. */
-    for (int d = 0; d < 2; d++)
+    /* Words 82-85 are only meaningful when word 83 carries its 01b signature. */
+    if ((ident[ATA_IDENT_COMMAND_SET_2] & 0xC000u) == 0x4000u)
     {
-        uint16_t ident[256];
-        int rc = ata_identify_pio(d, ident);
-        if (rc == ATA_OK)
-        {
-            /* Words 60-61: total number of user-addressable LBA28 sectors. */
-            uint32_t sectors = (uint32_t)ident[60] | ((uint32_t)ident[61] << 16);
+        info->write_cache = (ident[ATA_IDENT_COMMAND_SET_1] & ATA_IDENT_CMDSET1_WCACHE) != 0u
+            && (ident[ATA_IDENT_CMDSET_ENABLED_1] & ATA_IDENT_CMDSET1_WCACHE) != 0u;
+        info->flush_ext = info->lba48 && (ident[ATA_IDENT_COMMAND_SET_2] & ATA_IDENT_CMDSET2_FLUSH_EXT) != 0u;
+    }
+    else
+    {
+        /* Pre-ATA-4 drive: no way to tell, assume a cache. */
+        info->write_cache = true;
+    }
 
-            g_ata_drive[d].present = true;
-            g_ata_drive[d].lba28_sectors = sectors;
-        }
-        else
+    /* Some drives leave words 100-103 zero although they set the feature bit. */
+    info->sectors = (info->lba48 && info->lba48_sectors != 0u) ? info->lba48_sectors : info->lba28_sectors;
+
+    /* Model string: two ASCII chars per word, high byte first. */
+    for (uint32_t i = 0; i < 20u; i++)
+    {
+        uint16_t w = ident[ATA_IDENT_MODEL + i];
+        info->model[i * 2u] = (char)(w >> 8);
+        info->model[(i * 2u) + 1u] = (char)(w & 0xFFu);
+    }
+
+    /* Trim the space padding. */
+    int end = 40;
+    while (end > 0 && (info->model[end - 1] == ' ' || info->model[end - 1] == '\0'))
+        end--;
+    info->model[end] = '\0';
+}
+
+/*
+ * SET MULTIPLE MODE: use the largest power-of-two block size the drive allows.
+ * Leaves `multiple` at 0 (single-sector commands) if unsupported or rejected.
+ */
+static void ata_enable_multiple(int drive)
+{
+    AtaDriveInfo *info = &g_ata_drive[drive];
+    AtaChannel *ch = ata_drive_channel(drive);
+    uint32_t block = 1u;
+
+    info->multiple = 0u;
+
+    if (info->max_multiple < 2u)
+        return;
+
+    while ((block << 1) <= info->max_multiple)
+        block <<= 1;
+
+    ata_select_drive(drive, true);
+
+    outb(ata_reg(ch, ATA_REG_SECTOR_CNT), (uint8_t)block);
+    outb(ata_reg(ch, ATA_REG_COMMAND), ATA_CMD_SET_MULTIPLE);
+    ata_400ns_delay(ch);
+
+    if (ata_wait_not_busy(ch) == ATA_OK)
+        info->multiple = (uint8_t)block;
+}
+
+void ata_init(void)
+{
+    for (int c = 0; c < (int)ATA_CHANNEL_COUNT; c++)
+    {
+        AtaChannel *ch = &g_ata_channel[c];
+
+        /* Never re-probe underneath a command in flight. */
+        if (ch->cmd.active)
+            continue;
+
+        memset(&g_ata_drive[c * 2], 0, 2u * sizeof(AtaDriveInfo));
+
+        /* Floating bus (no controller / no drives): all status bits read 1. */
+        if (inb(ata_reg(ch, ATA_REG_STATUS)) == 0xFFu)
+            continue;
+
+        /* Probe master + slave on this channel. */
+        for (int d = c * 2; d < (c * 2) + 2; d++)
         {
-            /* Not fatal here; leave drive marked absent. */
-            g_ata_drive[d].present = false;
-            g_ata_drive[d].lba28_sectors = 0u;
+            uint16_t ident[256];
+            int rc = ata_identify_pio(d, ident);
+            if (rc == ATA_OK)
+            {
+                ata_parse_identify(&g_ata_drive[d], ident);
+                ata_enable_multiple(d);
+            }
+            /* Otherwise not fatal; leave the drive marked absent. */
         }
     }
 }
@@ -179,7 +339,76 @@ uint32_t ata_get_lba28_sectors(int drive)
     return g_ata_drive[drive].lba28_sectors;
 }
 
-int ata_read_sector(int drive, uint32_t lba, uint8_t *buffer)
+uint64_t ata_get_sectors(int drive)
+{
+    if (!ata_valid_drive(drive))
+        return 0u;
+
+    return g_ata_drive[drive].sectors;
+}
+
+uint32_t ata_max_sectors(int drive)
+{
+    if (!ata_valid_drive(drive) || !g_ata_drive[drive].present)
+        return 0u;
+
+    return g_ata_drive[drive].lba48 ? ATA_LBA48_MAX_SECTORS_PER_CMD : ATA_MAX_SECTORS_PER_CMD;
+}
+
+const AtaDriveInfo *ata_get_info(int drive)
+{
+    if (!ata_valid_drive(drive))
+        return 0;
+
+    return &g_ata_drive[drive];
+}
+
+int ata_drive_channel_index(int drive)
+{
+    if (!ata_valid_drive(drive))
+        return -1;
+
+    return drive >> 1;
+}
+
+uint8_t ata_channel_irq(int channel)
+{
+    if (!ata_valid_channel(channel))
+        return 0u;
+
+    return g_ata_channel[channel].irq;
+}
+
+/* Sectors moved per DRQ block for the current command. */
+static uint32_t ata_block_sectors(int drive)
+{
+    return (g_ata_drive[drive].multiple != 0u) ? g_ata_drive[drive].multiple : 1u;
+}
+
+/* EXT commands only when the request needs them (LBA28 is shorter to issue). */
+static bool ata_needs_lba48(uint32_t lba, uint32_t count)
+{
+    return count > ATA_MAX_SECTORS_PER_CMD || (uint64_t)lba + count - 1u > ATA_LBA28_MAX;
+}
+
+static uint8_t ata_transfer_command(int drive, bool write, bool lba48)
+{
+    if (g_ata_drive[drive].multiple != 0u)
+    {
+        if (lba48)
+            return write ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE_EXT;
+
+        return write ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_READ_MULTIPLE;
+    }
+
+    if (lba48)
+        return write ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_READ_PIO_EXT;
+
+    return write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO;
+}
+
+/* Shared argument / range validation for read/write transfers. */
+static int ata_check_transfer(int drive, uint32_t lba, uint32_t count, const uint8_t *buffer)
 {
     if (!buffer)
         return ATA_ERR_INVALID_PARAM;
@@ -190,50 +419,620 @@ int ata_read_sector(int drive, uint32_t lba, uint8_t *buffer)
     if (!g_ata_drive[drive].present)
         return ATA_ERR_NO_DEVICE;
 
-    /* LBA28 supports 28-bit addressing. */
-    if (lba > ATA_LBA28_MAX)
+    if (count == 0u || count > ata_max_sectors(drive))
+        return ATA_ERR_INVALID_PARAM;
+
+    if (ata_drive_channel(drive)->cmd.active)
+        return ATA_ERR_BUSY;
+
+    /* Without LBA48 only 28-bit addresses exist (last sector included). */
+    if (!g_ata_drive[drive].lba48 && (lba > ATA_LBA28_MAX || count > (ATA_LBA28_MAX - lba) + 1u))
         return ATA_ERR_LBA_RANGE;
 
     /* If IDENTIFY gave us a size, enforce it. */
-    if (g_ata_drive[drive].lba28_sectors != 0u)
-    {
-        if (lba >= g_ata_drive[drive].lba28_sectors)
-            return ATA_ERR_LBA_RANGE;
-    }
+    uint64_t sectors = g_ata_drive[drive].sectors;
+    if (sectors != 0u && (uint64_t)lba + count > sectors)
+        return ATA_ERR_LBA_RANGE;
+
+    return ATA_OK;
+}
+
+/* Program the task file for an LBA28 command and issue it. */
+static void ata_issue_lba28(int drive, uint32_t lba, uint32_t count, uint8_t command)
+{
+    AtaChannel *ch = ata_drive_channel(drive);
 
     /* 1) Select Drive + LBA mode and set top 4 bits of LBA (bits 24-27). */
-    outb(ATA_DRIVE_HEAD, (uint8_t)(ata_drive_select_value(drive, true) | ((lba >> 24) & 0x0Fu)));
-    ata_400ns_delay();
+    outb(ata_reg(ch, ATA_REG_DRIVE_HEAD), (uint8_t)(ata_drive_select_value(drive, true) | ((lba >> 24) & 0x0Fu)));
+    ata_400ns_delay(ch);
 
     /* 2) Features */
-    outb(ATA_FEATURES, 0x00u);
+    outb(ata_reg(ch, ATA_REG_FEATURES), 0x00u);
 
-    /* 3) Sector Count (1 sector) */
-    outb(ATA_SECTOR_CNT, 1u);
+    /* 3) Sector Count (0 encodes 256 sectors) */
+    outb(ata_reg(ch, ATA_REG_SECTOR_CNT), (uint8_t)(count & 0xFFu));
 
     /* 4) LBA Address (low/mid/high) */
-    outb(ATA_LBA_LO,  (uint8_t)(lba & 0xFFu));
-    outb(ATA_LBA_MID, (uint8_t)((lba >> 8) & 0xFFu));
-    outb(ATA_LBA_HI,  (uint8_t)((lba >> 16) & 0xFFu));
+    outb(ata_reg(ch, ATA_REG_LBA_LO),  (uint8_t)(lba & 0xFFu));
+    outb(ata_reg(ch, ATA_REG_LBA_MID), (uint8_t)((lba >> 8) & 0xFFu));
+    outb(ata_reg(ch, ATA_REG_LBA_HI),  (uint8_t)((lba >> 16) & 0xFFu));
+
+    /* 5) Command: one command for the whole run of sectors. */
+    outb(ata_reg(ch, ATA_REG_COMMAND), command);
+    ata_400ns_delay(ch);
+}
+
+/*
+ * Program the task file for an LBA48 (EXT) command and issue it. Each
+ * register is a two-deep FIFO: write the high-order bytes first.
+ */
+static void ata_issue_lba48(int drive, uint32_t lba, uint32_t count, uint8_t command)
+{
+    AtaChannel *ch = ata_drive_channel(drive);
+
+    outb(ata_reg(ch, ATA_REG_DRIVE_HEAD), ata_drive_is_master(drive) ? ATA_DRIVE_LBA48_MASTER : ATA_DRIVE_LBA48_SLAVE);
+    ata_400ns_delay(ch);
+
+    /* Sector count 65536 encodes as 0x0000. LBA bits 32-47 are always 0 here. */
+    outb(ata_reg(ch, ATA_REG_SECTOR_CNT), (uint8_t)((count >> 8) & 0xFFu));
+    outb(ata_reg(ch, ATA_REG_LBA_LO),  (uint8_t)((lba >> 24) & 0xFFu));
+    outb(ata_reg(ch, ATA_REG_LBA_MID), 0x00u);
+    outb(ata_reg(ch, ATA_REG_LBA_HI),  0x00u);
+
+    outb(ata_reg(ch, ATA_REG_SECTOR_CNT), (uint8_t)(count & 0xFFu));
+    outb(ata_reg(ch, ATA_REG_LBA_LO),  (uint8_t)(lba & 0xFFu));
+    outb(ata_reg(ch, ATA_REG_LBA_MID), (uint8_t)((lba >> 8) & 0xFFu));
+    outb(ata_reg(ch, ATA_REG_LBA_HI),  (uint8_t)((lba >> 16) & 0xFFu));
+
+    outb(ata_reg(ch, ATA_REG_COMMAND), command);
+    ata_400ns_delay(ch);
+}
+
+/* Issue a PIO read/write, picking LBA28 or LBA48 for this request. */
+static void ata_issue_pio(int drive, bool write, uint32_t lba, uint32_t count)
+{
+    bool lba48 = ata_needs_lba48(lba, count);
+    uint8_t command = ata_transfer_command(drive, write, lba48);
+
+    if (lba48)
+        ata_issue_lba48(drive, lba, count, command);
+    else
+        ata_issue_lba28(drive, lba, count, command);
+}
+
+/*
+ * Blocking transfer: one command, then one DRQ handshake per block of
+ * `ata_block_sectors()` sectors (the last block may be shorter).
+ */
+static int ata_pio_transfer(int drive, bool write, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    int rc = ata_check_transfer(drive, lba, count, buffer);
+    if (rc != ATA_OK)
+        return rc;
+
+    AtaChannel *ch = ata_drive_channel(drive);
+    uint32_t block = ata_block_sectors(drive);
+
+    ata_issue_pio(drive, write, lba, count);
+
+    while (count > 0u)
+    {
+        uint32_t n = (count < block) ? count : block;
+
+        /* 6) Wait for drive (one DRQ block per `block` sectors) */
+        rc = ata_wait_not_busy(ch);
+        if (rc != ATA_OK)
+            return rc;
+
+        rc = ata_wait_drq(ch);
+        if (rc != ATA_OK)
+            return rc;
+
+        /* 7) Move the whole block (256 words per sector) */
+        if (write)
+            outsw(ata_reg(ch, ATA_REG_DATA), buffer, n * 256u);
+        else
+            insw(ata_reg(ch, ATA_REG_DATA), buffer, n * 256u);
+
+        buffer += n * ATA_SECTOR_SIZE;
+        count -= n;
+
+        /* Let BSY re-assert before polling for the next block. */
+        ata_400ns_delay(ch);
+    }
+
+    /* 8) Writes: wait for the last block to be accepted. Reads: flush status. */
+    if (write)
+        return ata_wait_not_busy(ch);
+
+    (void)inb(ata_reg(ch, ATA_REG_STATUS));
+    return ATA_OK;
+}
+
+int ata_read_sectors(int drive, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return ata_pio_transfer(drive, false, lba, count, buffer);
+}
+
+int ata_read_sector(int drive, uint32_t lba, uint8_t *buffer)
+{
+    return ata_read_sectors(drive, lba, 1u, buffer);
+}
+
+int ata_write_sectors(int drive, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return ata_pio_transfer(drive, true, lba, count, buffer);
+}
+
+int ata_write_sector(int drive, uint32_t lba, uint8_t *buffer)
+{
+    return ata_write_sectors(drive, lba, 1u, buffer);
+}
+
+int ata_flush_cache(int drive)
+{
+    if (!ata_valid_drive(drive))
+        return ATA_ERR_INVALID_PARAM;
+
+    if (!g_ata_drive[drive].present)
+        return ATA_ERR_NO_DEVICE;
+
+    AtaChannel *ch = ata_drive_channel(drive);
+    if (ch->cmd.active)
+        return ATA_ERR_BUSY;
+
+    ata_select_drive(drive, true);
+
+    outb(ata_reg(ch, ATA_REG_COMMAND), g_ata_drive[drive].flush_ext ? ATA_CMD_CACHE_FLUSH_EXT : ATA_CMD_CACHE_FLUSH);
+    ata_400ns_delay(ch);
+
+    /* Flushing can take a while on real disks; BSY covers the whole operation. */
+    return ata_wait_not_busy(ch);
+}
+
+/* --------------------------------------------------------------------------
+ * Bus-master DMA
+ * -------------------------------------------------------------------------- */
+
+/* SET FEATURES / transfer mode: highest Ultra DMA mode, else multiword DMA. */
+static void ata_dma_set_xfer_mode(int drive)
+{
+    const AtaDriveInfo *info = &g_ata_drive[drive];
+    AtaChannel *ch = ata_drive_channel(drive);
+    uint8_t mode;
+
+    if (info->udma_modes != 0u)
+        mode = (uint8_t)ATA_XFER_UDMA(31u - (uint32_t)__builtin_clz(info->udma_modes));
+    else if (info->mwdma_modes != 0u)
+        mode = (uint8_t)ATA_XFER_MWDMA(31u - (uint32_t)__builtin_clz(info->mwdma_modes));
+    else
+        return;
+
+    ata_select_drive(drive, true);
+
+    outb(ata_reg(ch, ATA_REG_FEATURES), ATA_FEATURE_XFER_MODE);
+    outb(ata_reg(ch, ATA_REG_SECTOR_CNT), mode);
+    outb(ata_reg(ch, ATA_REG_COMMAND), ATA_CMD_SET_FEATURES);
+    ata_400ns_delay(ch);
+
+    (void)ata_wait_not_busy(ch);
+}
 
-    /* 5) Command */
-    outb(ATA_COMMAND, ATA_CMD_READ_PIO);
-    ata_400ns_delay();
+/* Bring up one channel's engine (legacy-port channels only). */
+static int ata_dma_init_channel(int c, const PciDevice *ide, uint16_t bmide)
+{
+    AtaChannel *ch = &g_ata_channel[c];
+    uint8_t native = (c == ATA_CHANNEL_PRIMARY) ? ATA_PROGIF_PRIMARY_NATIVE : ATA_PROGIF_SECONDARY_NATIVE;
+
+    if ((ide->prog_if & native) != 0u)
+        return ATA_ERR_UNSUPPORTED;
+
+    if (ch->cmd.active)
+        return ATA_ERR_BUSY;
+
+    if (!ch->dma.prdt)
+    {
+        ch->dma.prdt = (AtaPrd *)pmm_alloc_page_low(ATA_DMA_LOWMEM_LIMIT);
+        if (!ch->dma.prdt)
+            return ATA_ERR_UNSUPPORTED;
+    }
+
+    ch->dma.bmide = (uint16_t)(bmide + ((uint32_t)c * ATA_BM_CHANNEL_STRIDE));
+
+    /* Controller timing registers are left as the BIOS programmed them. */
+    uint8_t bm_status = inb((uint16_t)(ch->dma.bmide + ATA_BM_STATUS));
+    for (int d = c * 2; d < (c * 2) + 2; d++)
+    {
+        if (!g_ata_drive[d].present || !g_ata_drive[d].dma)
+            continue;
+
+        ata_dma_set_xfer_mode(d);
+        bm_status |= ata_drive_is_master(d) ? ATA_BM_SR_DRV0_DMA : ATA_BM_SR_DRV1_DMA;
+    }
+
+    outb((uint16_t)(ch->dma.bmide + ATA_BM_COMMAND), 0x00u);
+    outb((uint16_t)(ch->dma.bmide + ATA_BM_STATUS), (uint8_t)(bm_status | ATA_BM_SR_ERR | ATA_BM_SR_IRQ));
+
+    ch->dma.available = true;
+    return ATA_OK;
+}
+
+int ata_dma_init(void)
+{
+    PciDevice *ide = pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, 0xFFu);
+    if (!ide)
+        return ATA_ERR_NO_DEVICE;
+
+    /* Bus mastering needs the prog-if capability bit and an I/O BAR4. */
+    if ((ide->prog_if & ATA_PROGIF_BUS_MASTER) == 0u)
+        return ATA_ERR_UNSUPPORTED;
+
+    if (!pci_bar_is_io(ide, 4u) || pci_bar_address(ide, 4u) == 0u)
+        return ATA_ERR_UNSUPPORTED;
+
+    pci_enable(ide, PCI_CMD_IO_SPACE | PCI_CMD_BUS_MASTER);
+
+    int rc = ATA_ERR_UNSUPPORTED;
+    for (int c = 0; c < (int)ATA_CHANNEL_COUNT; c++)
+    {
+        if (ata_dma_init_channel(c, ide, (uint16_t)pci_bar_address(ide, 4u)) == ATA_OK)
+            rc = ATA_OK;
+    }
+
+    if (rc == ATA_OK)
+        g_ata_dma_enabled = true;
+
+    return rc;
+}
+
+bool ata_dma_available(void)
+{
+    for (int c = 0; c < (int)ATA_CHANNEL_COUNT; c++)
+    {
+        if (g_ata_channel[c].dma.available)
+            return true;
+    }
+
+    return false;
+}
+
+void ata_dma_set_enabled(bool enabled)
+{
+    g_ata_dma_enabled = enabled;
+}
+
+bool ata_dma_enabled(void)
+{
+    return g_ata_dma_enabled && ata_dma_available();
+}
+
+uint32_t ata_dma_transfers(uint32_t *out_fallbacks)
+{
+    uint32_t transfers = 0u;
+    uint32_t fallbacks = 0u;
+
+    for (int c = 0; c < (int)ATA_CHANNEL_COUNT; c++)
+    {
+        transfers += g_ata_channel[c].dma.transfers;
+        fallbacks += g_ata_channel[c].dma.fallbacks;
+    }
 
-    /* 6) Wait for drive */
-    int rc = ata_wait_not_busy();
+    if (out_fallbacks)
+        *out_fallbacks = fallbacks;
+
+    return transfers;
+}
+
+/*
+ * Describe `bytes` at virtual `buffer` as physical regions, one per page (or
+ * less at 64 KiB boundaries), merging physically contiguous neighbours.
+ */
+static int ata_dma_build_prdt(AtaPrd *prdt, const uint8_t *buffer, uint32_t bytes)
+{
+    uint32_t vaddr = (uint32_t)(uintptr_t)buffer;
+    uint32_t n = 0u;
+    uint32_t len = 0u;      /* Bytes in entry n (may reach 64 KiB). */
+
+    if ((vaddr & 1u) != 0u)
+        return ATA_ERR_INVALID_PARAM;
+
+    while (bytes > 0u)
+    {
+        uint32_t phys = vmm_get_phys(vaddr);
+        if (phys == 0u)
+            return ATA_ERR_INVALID_PARAM;
+
+        uint32_t piece = PAGE_SIZE - (vaddr & (PAGE_SIZE - 1u));
+        uint32_t to_boundary = ATA_PRD_BOUNDARY - (phys & (ATA_PRD_BOUNDARY - 1u));
+
+        if (piece > to_boundary)
+            piece = to_boundary;
+        if (piece > bytes)
+            piece = bytes;
+
+        /* Extend the current entry when contiguous and within one 64 KiB window. */
+        if (len != 0u && prdt[n].phys + len == phys && (phys & (ATA_PRD_BOUNDARY - 1u)) != 0u)
+        {
+            len += piece;
+        }
+        else
+        {
+            if (len != 0u)
+            {
+                prdt[n].bytes = (uint16_t)len; /* 64 KiB wraps to 0, as required. */
+                n++;
+            }
+
+            if (n >= ATA_PRD_MAX)
+                return ATA_ERR_INVALID_PARAM;
+
+            prdt[n].phys = phys;
+            prdt[n].flags = 0u;
+            len = piece;
+        }
+
+        vaddr += piece;
+        bytes -= piece;
+    }
+
+    prdt[n].bytes = (uint16_t)len;
+    prdt[n].flags = ATA_PRD_EOT;
+    return ATA_OK;
+}
+
+static int ata_dma_start(int drive, bool write, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    AtaChannel *ch = ata_drive_channel(drive);
+
+    int rc = ata_dma_build_prdt(ch->dma.prdt, buffer, count * ATA_SECTOR_SIZE);
     if (rc != ATA_OK)
         return rc;
 
-    rc = ata_wait_drq();
+    uint16_t bm = ch->dma.bmide;
+    uint8_t dir = write ? 0x00u : ATA_BM_CMD_READ;
+
+    /* Stop, load the table, clear stale status, set direction. */
+    outb((uint16_t)(bm + ATA_BM_COMMAND), 0x00u);
+    outl((uint16_t)(bm + ATA_BM_PRDT), (uint32_t)(uintptr_t)ch->dma.prdt);
+    outb((uint16_t)(bm + ATA_BM_STATUS), (uint8_t)(inb((uint16_t)(bm + ATA_BM_STATUS)) | ATA_BM_SR_ERR | ATA_BM_SR_IRQ));
+    outb((uint16_t)(bm + ATA_BM_COMMAND), dir);
+
+    if (ata_needs_lba48(lba, count))
+        ata_issue_lba48(drive, lba, count, write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT);
+    else
+        ata_issue_lba28(drive, lba, count, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+
+    outb((uint16_t)(bm + ATA_BM_COMMAND), (uint8_t)(dir | ATA_BM_CMD_START));
+    return ATA_OK;
+}
+
+/* --------------------------------------------------------------------------
+ * Non-blocking commands
+ * -------------------------------------------------------------------------- */
+
+static int ata_cmd_finish(AtaChannel *ch, int rc)
+{
+    ch->cmd.active = false;
+    return rc;
+}
+
+/* Stop the engine and report the command's outcome. */
+static int ata_dma_finish(AtaChannel *ch, uint8_t bm_status, uint8_t status, int rc)
+{
+    uint16_t bm = ch->dma.bmide;
+
+    outb((uint16_t)(bm + ATA_BM_COMMAND), 0x00u);
+    outb((uint16_t)(bm + ATA_BM_STATUS), (uint8_t)(bm_status | ATA_BM_SR_ERR | ATA_BM_SR_IRQ));
+
+    if (rc == ATA_OK && ((bm_status & ATA_BM_SR_ERR) || (status & (ATA_SR_ERR | ATA_SR_DF))))
+        rc = ATA_ERR_DEVICE;
+
+    if (rc == ATA_OK)
+        ch->dma.transfers++;
+
+    return ata_cmd_finish(ch, rc);
+}
+
+static int ata_dma_poll(AtaChannel *ch)
+{
+    uint8_t bm_status = inb((uint16_t)(ch->dma.bmide + ATA_BM_STATUS));
+
+    /* Engine still moving data and the drive has not interrupted yet. */
+    if ((bm_status & (ATA_BM_SR_IRQ | ATA_BM_SR_ERR)) == 0u && (bm_status & ATA_BM_SR_ACTIVE))
+    {
+        if (++ch->cmd.polls >= ch->cmd.poll_limit)
+            return ata_dma_finish(ch, bm_status, 0u, ATA_ERR_TIMEOUT_DRQ);
+        return ATA_IN_PROGRESS;
+    }
+
+    /* Reading the status register also acknowledges INTRQ. */
+    uint8_t status = inb(ata_reg(ch, ATA_REG_STATUS));
+    if (status & ATA_SR_BSY)
+    {
+        if (++ch->cmd.polls >= ch->cmd.poll_limit)
+            return ata_dma_finish(ch, bm_status, status, ATA_ERR_TIMEOUT_BSY);
+        return ATA_IN_PROGRESS;
+    }
+
+    return ata_dma_finish(ch, bm_status, status, ATA_OK);
+}
+
+/* Move one DRQ block (the last one may be short). */
+static void ata_pio_move_block(AtaChannel *ch)
+{
+    AtaCmd *cmd = &ch->cmd;
+    uint32_t n = (cmd->remaining < cmd->block) ? cmd->remaining : cmd->block;
+
+    if (cmd->write)
+        outsw(ata_reg(ch, ATA_REG_DATA), cmd->buffer, n * 256u);
+    else
+        insw(ata_reg(ch, ATA_REG_DATA), cmd->buffer, n * 256u);
+
+    cmd->buffer += n * ATA_SECTOR_SIZE;
+    cmd->remaining -= n;
+    cmd->polls = 0u;
+
+    /* Let BSY re-assert before looking at the next block. */
+    ata_400ns_delay(ch);
+}
+
+int ata_cmd_start(int drive, bool write, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    int rc = ata_check_transfer(drive, lba, count, buffer);
     if (rc != ATA_OK)
         return rc;
 
-    /* 7) Read Data (256 words = 512 bytes) */
-    insw(ATA_DATA, buffer, 256u);
+    AtaChannel *ch = ata_drive_channel(drive);
+    AtaCmd *cmd = &ch->cmd;
+
+    cmd->active = true;
+    cmd->write = write;
+    cmd->dma = false;
+    cmd->block = ata_block_sectors(drive);
+    cmd->remaining = count;
+    cmd->buffer = buffer;
+    cmd->polls = 0u;
+
+    if (ch->dma.available && g_ata_dma_enabled && g_ata_drive[drive].dma)
+    {
+        if (ata_dma_start(drive, write, lba, count, buffer) == ATA_OK)
+        {
+            /* No per-block progress to reset the count: allow for the length. */
+            cmd->dma = true;
+            cmd->poll_limit = ATA_PIO_TIMEOUT * (1u + (count / ATA_MAX_SECTORS_PER_CMD));
+            return ATA_OK;
+        }
+
+        ch->dma.fallbacks++;
+    }
+
+    ata_issue_pio(drive, write, lba, count);
+
+    if (write)
+    {
+        /* PIO data-out: the first block is sent on DRQ, without an interrupt. */
+        rc = ata_wait_not_busy(ch);
+        if (rc == ATA_OK)
+            rc = ata_wait_drq(ch);
+        if (rc != ATA_OK)
+            return ata_cmd_finish(ch, rc);
+
+        ata_pio_move_block(ch);
+    }
+
+    return ATA_OK;
+}
+
+int ata_cmd_start_flush(int drive)
+{
+    if (!ata_valid_drive(drive))
+        return ATA_ERR_INVALID_PARAM;
+
+    if (!g_ata_drive[drive].present)
+        return ATA_ERR_NO_DEVICE;
+
+    AtaChannel *ch = ata_drive_channel(drive);
+    if (ch->cmd.active)
+        return ATA_ERR_BUSY;
+
+    ata_select_drive(drive, true);
 
-    /* 8) Flush status */
-    (void)inb(ATA_STATUS);
+    outb(ata_reg(ch, ATA_REG_COMMAND), g_ata_drive[drive].flush_ext ? ATA_CMD_CACHE_FLUSH_EXT : ATA_CMD_CACHE_FLUSH);
+    ata_400ns_delay(ch);
+
+    /* Non-data command: finished once BSY clears (interrupts on completion). */
+    ch->cmd.active = true;
+    ch->cmd.write = true;
+    ch->cmd.dma = false;
+    ch->cmd.block = 1u;
+    ch->cmd.remaining = 0u;
+    ch->cmd.buffer = 0;
+    ch->cmd.polls = 0u;
 
     return ATA_OK;
-}
\ No newline at end of file
+}
+
+int ata_cmd_poll(int channel)
+{
+    if (!ata_valid_channel(channel))
+        return ATA_ERR_INVALID_PARAM;
+
+    AtaChannel *ch = &g_ata_channel[channel];
+    AtaCmd *cmd = &ch->cmd;
+
+    if (!cmd->active)
+        return ATA_ERR_INVALID_PARAM;
+
+    if (cmd->dma)
+        return ata_dma_poll(ch);
+
+    for (;;)
+    {
+        uint8_t status = inb(ata_reg(ch, ATA_REG_STATUS));
+
+        if (status & ATA_SR_BSY)
+        {
+            if (++cmd->polls >= ATA_PIO_TIMEOUT)
+                return ata_cmd_finish(ch, ATA_ERR_TIMEOUT_BSY);
+            return ATA_IN_PROGRESS;
+        }
+
+        if (status & (ATA_SR_ERR | ATA_SR_DF))
+            return ata_cmd_finish(ch, ATA_ERR_DEVICE);
+
+        /* Writes (and FLUSH) end once BSY clears after the last block. */
+        if (cmd->remaining == 0u)
+            return ata_cmd_finish(ch, ATA_OK);
+
+        if ((status & ATA_SR_DRQ) == 0u)
+        {
+            if (++cmd->polls >= ATA_PIO_TIMEOUT)
+                return ata_cmd_finish(ch, ATA_ERR_TIMEOUT_DRQ);
+            return ATA_IN_PROGRESS;
+        }
+
+        ata_pio_move_block(ch);
+
+        if (!cmd->write && cmd->remaining == 0u)
+        {
+            (void)inb(ata_reg(ch, ATA_REG_STATUS));
+            return ata_cmd_finish(ch, ATA_OK);
+        }
+    }
+}
+
+bool ata_cmd_busy(int channel)
+{
+    if (!ata_valid_channel(channel))
+        return false;
+
+    return g_ata_channel[channel].cmd.active;
+}
+
+uint32_t ata_cmd_remaining(int channel)
+{
+    if (!ata_valid_channel(channel))
+        return 0u;
+
+    const AtaCmd *cmd = &g_ata_channel[channel].cmd;
+    return (cmd->active && !cmd->dma) ? cmd->remaining : 0u;
+}
+
+void ata_set_irq_enabled(int channel, bool enabled)
+{
+    if (!ata_valid_channel(channel))
+        return;
+
+    AtaChannel *ch = &g_ata_channel[channel];
+
+    outb(ch->ctrl, enabled ? 0x00u : ATA_CTRL_NIEN);
+    ata_400ns_delay(ch);
+}
+
+void ata_irq_ack(int channel)
+{
+    if (!ata_valid_channel(channel))
+        return;
+
+    (void)inb(ata_reg(&g_ata_channel[channel], ATA_REG_STATUS));
+}
@@ -5,22 +5,34 @@
 #include <stdint.h>
 
 /* --------------------------------------------------------------------------
- * ATA Bus I/O Ports (Primary Bus, legacy ISA)
+ * ATA Channels (legacy ISA ports)
  * -------------------------------------------------------------------------- */
-#define ATA_DATA        0x1F0u
-#define ATA_ERROR       0x1F1u
-#define ATA_FEATURES    0x1F1u
-#define ATA_SECTOR_CNT  0x1F2u
-#define ATA_LBA_LO      0x1F3u
-#define ATA_LBA_MID     0x1F4u
-#define ATA_LBA_HI      0x1F5u
-#define ATA_DRIVE_HEAD  0x1F6u
-#define ATA_STATUS      0x1F7u
-#define ATA_COMMAND     0x1F7u
-
-/* Control / Alternate Status (Primary) */
-#define ATA_ALT_STATUS  0x3F6u
-#define ATA_DEV_CTRL    0x3F6u
+#define ATA_PRIMARY_IO      0x1F0u
+#define ATA_PRIMARY_CTRL    0x3F6u   /* Alternate Status / Device Control */
+#define ATA_PRIMARY_IRQ     14u
+
+#define ATA_SECONDARY_IO    0x170u
+#define ATA_SECONDARY_CTRL  0x376u
+#define ATA_SECONDARY_IRQ   15u
+
+#define ATA_CHANNEL_PRIMARY     0
+#define ATA_CHANNEL_SECONDARY   1
+#define ATA_CHANNEL_COUNT       2u
+
+/* Command block registers (offset from the channel's I/O base) */
+#define ATA_REG_DATA        0x00u
+#define ATA_REG_ERROR       0x01u
+#define ATA_REG_FEATURES    0x01u
+#define ATA_REG_SECTOR_CNT  0x02u
+#define ATA_REG_LBA_LO      0x03u
+#define ATA_REG_LBA_MID     0x04u
+#define ATA_REG_LBA_HI      0x05u
+#define ATA_REG_DRIVE_HEAD  0x06u
+#define ATA_REG_STATUS      0x07u
+#define ATA_REG_COMMAND     0x07u
+
+/* Device Control bits */
+#define ATA_CTRL_NIEN   0x02u    /* 1 = drive does not assert INTRQ */
 
 /* --------------------------------------------------------------------------
  * Status Bits
@@ -36,13 +48,94 @@
  * -------------------------------------------------------------------------- */
 #define ATA_CMD_READ_PIO     0x20u
 #define ATA_CMD_WRITE_PIO    0x30u
+#define ATA_CMD_READ_DMA     0xC8u
+#define ATA_CMD_WRITE_DMA    0xCAu
+#define ATA_CMD_SET_FEATURES 0xEFu
+#define ATA_CMD_READ_MULTIPLE   0xC4u
+#define ATA_CMD_WRITE_MULTIPLE  0xC5u
+#define ATA_CMD_SET_MULTIPLE    0xC6u
+#define ATA_CMD_CACHE_FLUSH  0xE7u
 #define ATA_CMD_IDENTIFY     0xECu
 
+/* 48-bit address feature set (EXT) variants */
+#define ATA_CMD_READ_PIO_EXT        0x24u
+#define ATA_CMD_WRITE_PIO_EXT       0x34u
+#define ATA_CMD_READ_DMA_EXT        0x25u
+#define ATA_CMD_WRITE_DMA_EXT       0x35u
+#define ATA_CMD_READ_MULTIPLE_EXT   0x29u
+#define ATA_CMD_WRITE_MULTIPLE_EXT  0x39u
+#define ATA_CMD_CACHE_FLUSH_EXT     0xEAu
+#define ATA_CMD_WRITE_DMA_FUA_EXT   0x3Du  /* Write through the cache (IDENTIFY word 84 bit 6) */
+
+/* Native Command Queuing (SATA, issued through AHCI) */
+#define ATA_CMD_READ_FPDMA_QUEUED   0x60u
+#define ATA_CMD_WRITE_FPDMA_QUEUED  0x61u
+
 /* --------------------------------------------------------------------------
- * Drive Select
+ * IDENTIFY DEVICE words used by the driver
  * -------------------------------------------------------------------------- */
-#define ATA_DRIVE_MASTER 0
-#define ATA_DRIVE_SLAVE  1
+#define ATA_IDENT_MODEL             27u  /* 27-46: model string (40 chars) */
+#define ATA_IDENT_MAX_MULTIPLE      47u  /* bits 0-7: max sectors per DRQ block */
+#define ATA_IDENT_CAPABILITIES      49u  /* bit 8: DMA supported */
+#define ATA_IDENT_LBA28_SECTORS     60u  /* 60-61 */
+#define ATA_IDENT_MWDMA             63u  /* bits 0-2: multiword DMA modes */
+#define ATA_IDENT_QUEUE_DEPTH       75u  /* bits 0-4: NCQ queue depth - 1 */
+#define ATA_IDENT_SATA_CAPABILITIES 76u  /* bit 8: NCQ supported */
+#define ATA_IDENT_COMMAND_SET_1     82u  /* bit 5: volatile write cache supported */
+#define ATA_IDENT_COMMAND_SET_2     83u  /* bit 10: 48-bit address, bit 13: FLUSH CACHE EXT */
+#define ATA_IDENT_COMMAND_SET_EXT   84u  /* bit 6: WRITE DMA FUA EXT supported */
+#define ATA_IDENT_CMDSET_ENABLED_1  85u  /* bit 5: volatile write cache enabled */
+#define ATA_IDENT_UDMA              88u  /* bits 0-7: Ultra DMA modes */
+#define ATA_IDENT_LBA48_SECTORS     100u /* 100-103 */
+
+#define ATA_IDENT_CAP_DMA           0x0100u
+#define ATA_IDENT_CMDSET1_WCACHE    0x0020u
+#define ATA_IDENT_CMDSET2_LBA48     0x0400u
+#define ATA_IDENT_CMDSET2_FLUSH_EXT 0x2000u
+#define ATA_IDENT_CMDSETX_FUA       0x0040u
+#define ATA_IDENT_SATA_CAP_NCQ      0x0100u
+
+/* SET FEATURES subcommand + transfer mode values (sector count register) */
+#define ATA_FEATURE_XFER_MODE   0x03u
+#define ATA_XFER_MWDMA(n)       (0x20u | (n))
+#define ATA_XFER_UDMA(n)        (0x40u | (n))
+
+/* --------------------------------------------------------------------------
+ * PCI bus-master IDE (SFF-8038i): primary channel at BAR4 + 0, secondary at + 8
+ * -------------------------------------------------------------------------- */
+#define ATA_BM_CHANNEL_STRIDE 0x08u
+#define ATA_BM_COMMAND      0x00u
+#define ATA_BM_STATUS       0x02u
+#define ATA_BM_PRDT         0x04u
+
+#define ATA_BM_CMD_START    0x01u
+#define ATA_BM_CMD_READ     0x08u    /* Direction: device -> memory */
+
+#define ATA_BM_SR_ACTIVE    0x01u
+#define ATA_BM_SR_ERR       0x02u    /* Write 1 to clear */
+#define ATA_BM_SR_IRQ       0x04u    /* Write 1 to clear */
+#define ATA_BM_SR_DRV0_DMA  0x20u
+#define ATA_BM_SR_DRV1_DMA  0x40u
+
+/* IDE prog-if bits */
+#define ATA_PROGIF_PRIMARY_NATIVE 0x01u
+#define ATA_PROGIF_SECONDARY_NATIVE 0x04u
+#define ATA_PROGIF_BUS_MASTER     0x80u
+
+/* PRD table (one page): entries may not cross a 64 KiB boundary; 0 bytes
+ * encodes 64 KiB. 512 contiguous 64 KiB entries cover a full LBA48 command. */
+#define ATA_PRD_EOT         0x8000u
+#define ATA_PRD_MAX         512u
+#define ATA_PRD_BOUNDARY    0x10000u
+
+/* --------------------------------------------------------------------------
+ * Drives: index = channel * 2 + position (master 0, slave 1)
+ * -------------------------------------------------------------------------- */
+#define ATA_DRIVE_MASTER            0
+#define ATA_DRIVE_SLAVE             1
+#define ATA_DRIVE_SECONDARY_MASTER  2
+#define ATA_DRIVE_SECONDARY_SLAVE   3
+#define ATA_DRIVE_COUNT             4u
 
 #define ATA_DRIVE_SELECT_MASTER 0xA0u
 #define ATA_DRIVE_SELECT_SLAVE  0xB0u
@@ -55,6 +148,14 @@
 /* ATA sector size (PIO) */
 #define ATA_SECTOR_SIZE         512u
 
+/* LBA28 sector count register: 8 bits, 0 encodes 256. */
+#define ATA_MAX_SECTORS_PER_CMD 256u
+
+/* LBA48: 16-bit sector count (0 encodes 65536), 48-bit address. */
+#define ATA_LBA48_MAX_SECTORS_PER_CMD 65536u
+#define ATA_DRIVE_LBA48_MASTER  0x40u
+#define ATA_DRIVE_LBA48_SLAVE   0x50u
+
 /* --------------------------------------------------------------------------
  * Return codes (0 = success)
  * -------------------------------------------------------------------------- */
@@ -66,14 +167,107 @@
 #define ATA_ERR_LBA_RANGE       5
 #define ATA_ERR_NO_DEVICE       6
 #define ATA_ERR_UNSUPPORTED     7
+#define ATA_ERR_BUSY            8    /* Channel has a command in flight. */
+#define ATA_IN_PROGRESS         9    /* ata_cmd_poll(): not finished yet. */
+
+/* Drive capabilities (parsed from IDENTIFY by ata_init). */
+typedef struct
+{
+    bool present;
+    bool lba48;              /* 48-bit address feature set supported. */
+    bool dma;                /* DMA supported. */
+    bool write_cache;        /* Volatile write cache enabled: writes need FLUSH CACHE. */
+    bool flush_ext;          /* FLUSH CACHE EXT supported (else FLUSH CACHE). */
+    uint8_t max_multiple;    /* Max sectors per DRQ block (0 = no READ/WRITE MULTIPLE). */
+    uint8_t multiple;        /* Sectors per DRQ block in use (0 = single-sector PIO). */
+    uint8_t mwdma_modes;     /* Supported multiword DMA modes (bit N = mode N). */
+    uint8_t udma_modes;      /* Supported Ultra DMA modes (bit N = mode N). */
+    uint32_t lba28_sectors;
+    uint64_t lba48_sectors;
+    uint64_t sectors;        /* Addressable capacity (LBA48 size when supported). */
+    char model[41];
+} AtaDriveInfo;
 
+/* Probe all drives on both channels, parse IDENTIFY and enable READ/WRITE
+ * MULTIPLE where supported (SET MULTIPLE MODE). */
 void ata_init(void);
 
-/* LBA28 PIO read (1 sector). drive: ATA_DRIVE_MASTER / ATA_DRIVE_SLAVE */
+/*
+ * Addressing: LBA28 commands are used while they suffice; requests beyond
+ * sector 2^28 or longer than 256 sectors switch to the EXT (LBA48) commands
+ * on drives that support them. LBAs are 32-bit (the block layer's range).
+ */
+
+/* PIO read (1 sector). drive: ATA_DRIVE_MASTER .. ATA_DRIVE_SECONDARY_SLAVE */
 int ata_read_sector(int drive, uint32_t lba, uint8_t *buffer);
 
+/* PIO read of `count` consecutive sectors (1..ata_max_sectors()) issued as a
+ * single command. */
+int ata_read_sectors(int drive, uint32_t lba, uint32_t count, uint8_t *buffer);
+
+/* PIO write (1 sector / `count` sectors in one command). Data may sit in
+ * the drive's volatile write cache until ata_flush_cache(). */
+int ata_write_sector(int drive, uint32_t lba, uint8_t *buffer);
+int ata_write_sectors(int drive, uint32_t lba, uint32_t count, uint8_t *buffer);
+
+/* FLUSH CACHE (FLUSH CACHE EXT where supported): returns once the drive's
+ * write cache is on the media. */
+int ata_flush_cache(int drive);
+
+/*
+ * Non-blocking commands (one in flight per channel; the two channels run
+ * independently, so drives on different channels transfer concurrently).
+ * ata_cmd_start() issues the read/write command and returns at once. It uses
+ * bus-master DMA straight into/out of `buffer` when available (see
+ * ata_dma_init()), otherwise PIO (writes first push the initial DRQ block,
+ * which the protocol never interrupts for). ata_cmd_poll() advances the
+ * command (PIO: moves every DRQ block the drive has ready) and returns
+ * ATA_IN_PROGRESS until it finishes, then its final status. It is called
+ * either in a polling loop or from the IRQ handler (reading the status
+ * register also acknowledges the drive's interrupt). The blocking calls above
+ * return ATA_ERR_BUSY while a non-blocking command is in flight.
+ */
+int ata_cmd_start(int drive, bool write, uint32_t lba, uint32_t count, uint8_t *buffer);
+int ata_cmd_start_flush(int drive);
+int ata_cmd_poll(int channel);
+bool ata_cmd_busy(int channel);
+
+/* Sectors the in-flight PIO command has yet to move (0 for DMA and FLUSH). */
+uint32_t ata_cmd_remaining(int channel);
+
+/* Channel interrupt line on/off (Device Control nIEN) and acknowledge (status read). */
+void ata_set_irq_enabled(int channel, bool enabled);
+void ata_irq_ack(int channel);
+
+/*
+ * Bus-master DMA. ata_dma_init() locates the IDE controller via PCI (call
+ * after pci_init() and ata_init()), enables bus mastering, allocates a PRD
+ * table per legacy-mode channel and selects each drive's best DMA mode. Buffers are described to the
+ * controller page by page (scatter/gather), so no bounce copy is needed; odd
+ * addresses or unmapped pages fall back to PIO.
+ */
+int ata_dma_init(void);
+bool ata_dma_available(void);
+void ata_dma_set_enabled(bool enabled);
+bool ata_dma_enabled(void);
+
+/* Commands completed by DMA, and DMA-eligible commands that fell back to PIO
+ * (both channels). */
+uint32_t ata_dma_transfers(uint32_t *out_fallbacks);
+
 /* Query helpers (valid after ata_init). */
 bool ata_is_present(int drive);
 uint32_t ata_get_lba28_sectors(int drive);
+uint64_t ata_get_sectors(int drive);
+
+/* Largest `count` one command accepts (65536 with LBA48, else 256; 0 = absent). */
+uint32_t ata_max_sectors(int drive);
+
+/* Returns 0 when `drive` is invalid (absent drives report present = false). */
+const AtaDriveInfo *ata_get_info(int drive);
+
+/* Channel a drive sits on (-1 if invalid), and the channel's legacy IRQ line. */
+int ata_drive_channel_index(int drive);
+uint8_t ata_channel_irq(int channel);
 
 #endif /* ATA_H */
\ No newline at end of file
@@ -2,48 +2,386 @@
 
 #include "ata.h"
 #include "block.h"
+#include "cpu.h"
+#include "irq.h"
+#include "sched.h"
+#include "softirq.h"
+#include "string.h"
+#include "timer.h"
 
 /* --------------------------------------------------------------------------
  * ATA -> BlockDevice bridge
+ *
+ * The two drives of a channel share it, so one command is in flight per
+ * channel; the primary and secondary channels run independently. A command
+ * is advanced by ata_cmd_poll(), called either from the channel's block
+ * softirq (interrupt mode: the IRQ handler only deasserts INTRQ) or from the
+ * waiter's polling loop (early boot, selftests, or while interrupts are
+ * disabled).
  * -------------------------------------------------------------------------- */
 
+/* Per-channel completion state (guarded by disabling interrupts). */
+typedef struct
+{
+    BlockDevice *owner;         /* Async command's device (0 = sync op). */
+    uint32_t owner_tag;         /* Its block queue tag. */
+    uint32_t deferred;          /* Bit i: g_disks[i]'s queue was refused the channel */
+    volatile int *sync_rc;      /* Sync command's result slot (on its caller's stack). */
+    uint32_t irqs;
+    uint32_t irqs_spurious;
+    uint32_t stalls;            /* Commands that fell back to polling */
+    uint64_t progress_tick;     /* Last interrupt, DRQ block or command start */
+    bool stalled;               /* Interrupt lost: poll this command to the end */
+    SoftirqWork work;           /* Bottom half: ata_block_channel_event() */
+    WaitQueue waiters;          /* Threads in ata_block_wait_event() */
+} AtaBlockChannel;
+
+static AtaBlockChannel g_ata_chan[ATA_CHANNEL_COUNT];
+static BlockDevice g_disks[ATA_DRIVE_COUNT];
+static bool g_ata_irq_mode = false;
+
+/* Commands started while the other channel already had one in flight. */
+static uint32_t g_ata_overlapped = 0u;
+
+static int ata_block_drive(const BlockDevice *dev)
+{
+    return (int)(uint32_t)(uintptr_t)dev->ctx;
+}
+
+static int ata_block_channel(const BlockDevice *dev)
+{
+    return ata_drive_channel_index(ata_block_drive(dev));
+}
+
+/* Bookkeeping once a command is on the wire: an async one completes its
+ * block queue tag, a sync one its caller's `sync_rc`. Interrupts are off. */
+static void ata_block_started(int channel, BlockDevice *owner, uint32_t tag, volatile int *sync_rc)
+{
+    AtaBlockChannel *st = &g_ata_chan[channel];
+
+    st->owner = owner;
+    st->owner_tag = tag;
+    st->sync_rc = sync_rc;
+    st->progress_tick = timer_get_ticks();
+    st->stalled = false;
+
+    for (int c = 0; c < (int)ATA_CHANNEL_COUNT; c++)
+    {
+        if (c != channel && ata_cmd_busy(c))
+        {
+            g_ata_overlapped++;
+            break;
+        }
+    }
+}
+
+/* Advance the channel's command; complete it when done. Interrupts are off,
+ * or softirq context. */
+static void ata_block_channel_event(int channel)
+{
+    AtaBlockChannel *st = &g_ata_chan[channel];
+
+    if (!ata_cmd_busy(channel))
+        return;
+
+    /* Only a moved DRQ block counts as progress; a poll that finds the
+     * drive busy must not push the stall deadline out. */
+    uint32_t remaining = ata_cmd_remaining(channel);
+
+    int rc = ata_cmd_poll(channel);
+    if (rc == ATA_IN_PROGRESS)
+    {
+        if (ata_cmd_remaining(channel) != remaining)
+            st->progress_tick = timer_get_ticks();
+        return;
+    }
+
+    /* Release first: completion may start the owner's next command. */
+    BlockDevice *owner = st->owner;
+    volatile int *sync_rc = st->sync_rc;
+    st->owner = 0;
+    st->sync_rc = 0;
+
+    /* The other drive's queue was turned away while the channel was busy:
+     * give it the channel before the owner's completion starts its next
+     * command, or nothing would retry it until someone waits on that disk. */
+    uint32_t deferred = st->deferred;
+    st->deferred = 0u;
+
+    for (uint32_t i = 0; deferred != 0u; i++, deferred >>= 1)
+    {
+        if (deferred & 1u)
+            block_queue_kick(&g_disks[i]);
+    }
+
+    if (owner)
+        block_complete(owner, st->owner_tag, (rc == ATA_OK) ? BLOCK_SUCCESS : BLOCK_ERROR);
+    else if (sync_rc)
+        *sync_rc = rc;
+}
+
+/*
+ * Wait for the channel to make progress. With interrupts usable the thread
+ * sleeps until the channel's bottom half runs (or the stall deadline passes)
+ * while other threads use the CPU; otherwise, or if the drive stops sending
+ * interrupts, the command is polled.
+ */
+static void ata_block_wait_event(int channel)
+{
+    uint32_t flags = cpu_irq_save();
+
+    if (ata_cmd_busy(channel))
+    {
+        AtaBlockChannel *st = &g_ata_chan[channel];
+
+        /* Once the drive missed an interrupt, stop relying on the next one
+         * for this command: every later wait polls. */
+        if (!st->stalled && (timer_get_ticks() - st->progress_tick) > ATA_BLOCK_IRQ_TIMEOUT_TICKS)
+        {
+            st->stalled = true;
+            st->stalls++;
+        }
+
+        if (g_ata_irq_mode && (flags & CPU_EFLAGS_IF) && !st->stalled)
+        {
+            /* Until the interrupt, or the stall deadline if it is lost. */
+            wait_queue_sleep(&st->waiters, (st->progress_tick + ATA_BLOCK_IRQ_TIMEOUT_TICKS + 1u) * TIMER_TICK_NS);
+        }
+        else
+            ata_block_channel_event(channel);
+    }
+
+    cpu_irq_restore(flags);
+}
+
+/*
+ * Synchronous command (used by the 1-sector ops, partitions and fallbacks):
+ * wait for the channel, start the command, then wait for it to finish.
+ * `kind` is BLOCK_OP_READ, BLOCK_OP_WRITE or BLOCK_OP_FLUSH.
+ */
+static int ata_block_sync_io(BlockDevice *dev, int kind, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    int drive = ata_block_drive(dev);
+    int channel = ata_drive_channel_index(drive);
+    volatile int result = ATA_IN_PROGRESS;
+    int rc;
+
+    if (channel < 0)
+        return BLOCK_ERROR;
+
+    for (;;)
+    {
+        uint32_t flags = cpu_irq_save();
+
+        if (kind == BLOCK_OP_READ || kind == BLOCK_OP_WRITE)
+            rc = ata_cmd_start(drive, kind == BLOCK_OP_WRITE, lba, count, buffer);
+        else
+            rc = ata_cmd_start_flush(drive);
+
+        if (rc == ATA_OK)
+            ata_block_started(channel, 0, 0u, &result);
+
+        cpu_irq_restore(flags);
+
+        if (rc != ATA_ERR_BUSY)
+            break;
+
+        /* The other drive's async command owns the channel. */
+        ata_block_wait_event(channel);
+    }
+
+    if (rc != ATA_OK)
+        return BLOCK_ERROR;
+
+    /* The channel may already run someone else's command by the time this
+     * thread looks: only its own slot says whether its command is done. */
+    while (result == ATA_IN_PROGRESS)
+        ata_block_wait_event(channel);
+
+    return (result == ATA_OK) ? BLOCK_SUCCESS : BLOCK_ERROR;
+}
+
 static int ata_block_read(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
 {
     if (!dev || !buffer)
         return BLOCK_ERROR;
 
-    /* ctx stores drive number (ATA_DRIVE_MASTER / ATA_DRIVE_SLAVE). */
-    uint32_t drive = (uint32_t)(uintptr_t)dev->ctx;
+    return ata_block_sync_io(dev, BLOCK_OP_READ, lba, 1u, buffer);
+}
 
-    int rc = ata_read_sector((int)drive, lba, buffer);
-    return (rc == ATA_OK) ? BLOCK_SUCCESS : BLOCK_ERROR;
+static int ata_block_read_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !buffer)
+        return BLOCK_ERROR;
+
+    return ata_block_sync_io(dev, BLOCK_OP_READ, lba, count, buffer);
 }
 
 static int ata_block_write(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
 {
-    (void)dev;
-    (void)lba;
-    (void)buffer;
+    if (!dev || !buffer)
+        return BLOCK_ERROR;
+
+    return ata_block_sync_io(dev, BLOCK_OP_WRITE, lba, 1u, buffer);
+}
+
+static int ata_block_write_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !buffer)
+        return BLOCK_ERROR;
+
+    return ata_block_sync_io(dev, BLOCK_OP_WRITE, lba, count, buffer);
+}
+
+static int ata_block_flush(BlockDevice *dev)
+{
+    if (!dev)
+        return BLOCK_ERROR;
+
+    return ata_block_sync_io(dev, BLOCK_OP_FLUSH, 0u, 0u, 0);
+}
+
+/*
+ * Called by the block queue with interrupts disabled. ATA has no FUA write
+ * outside NCQ, so the queue follows BLOCK_RQ_FUA writes with a flush.
+ */
+static int ata_block_submit(BlockDevice *dev, uint32_t tag, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || (!buffer && op != BLOCK_OP_FLUSH))
+        return BLOCK_ERROR;
+
+    int channel = ata_block_channel(dev);
+    if (channel < 0)
+        return BLOCK_ERROR;
+
+    /* The other drive's command owns the channel: retried on its completion. */
+    uint32_t self = 1u << (uint32_t)(dev - g_disks);
+
+    if (ata_cmd_busy(channel))
+    {
+        g_ata_chan[channel].deferred |= self;
+        return BLOCK_BUSY;
+    }
+
+    int rc;
+    if (op == BLOCK_OP_FLUSH)
+        rc = ata_cmd_start_flush(ata_block_drive(dev));
+    else
+        rc = ata_cmd_start(ata_block_drive(dev), op == BLOCK_OP_WRITE, lba, count, buffer);
+
+    if (rc == ATA_ERR_BUSY)
+    {
+        g_ata_chan[channel].deferred |= self;
+        return BLOCK_BUSY;
+    }
+    if (rc != ATA_OK)
+        return BLOCK_ERROR;
+
+    ata_block_started(channel, dev, tag, 0);
+    return BLOCK_SUCCESS;
+}
+
+static void ata_block_poll(BlockDevice *dev)
+{
+    int channel = dev ? ata_block_channel(dev) : -1;
+    if (channel < 0)
+        return;
+
+    /* Waiting on either drive advances whichever command owns the channel. */
+    ata_block_wait_event(channel);
+}
+
+/* Hybrid polling: check the channel once, never sleep. */
+static void ata_block_reap(BlockDevice *dev)
+{
+    int channel = dev ? ata_block_channel(dev) : -1;
+    if (channel < 0)
+        return;
+
+    uint32_t flags = cpu_irq_save();
+    ata_block_channel_event(channel);
+    cpu_irq_restore(flags);
+}
+
+/* IRQ14 / IRQ15: ctx = ATA_CHANNEL_PRIMARY / ATA_CHANNEL_SECONDARY. */
+static int ata_block_irq(uint8_t irq, void *ctx)
+{
+    int channel = (int)(uintptr_t)ctx;
+    (void)irq;
+
+    AtaBlockChannel *st = &g_ata_chan[channel];
+    st->irqs++;
+
+    /* Reading status deasserts INTRQ; the softirq re-reads it to advance. */
+    ata_irq_ack(channel);
+
+    if (!ata_cmd_busy(channel))
+    {
+        /* Spurious / late interrupt. */
+        st->irqs_spurious++;
+        return IRQ_NONE;
+    }
+
+    st->progress_tick = timer_get_ticks();
+    softirq_queue(SOFTIRQ_BLOCK, &st->work);
+    return IRQ_HANDLED;
+}
+
+static void ata_block_softirq(void *arg)
+{
+    int channel = (int)(uintptr_t)arg;
+
+    ata_block_channel_event(channel);
+    wait_queue_wake_all(&g_ata_chan[channel].waiters);
+}
+
+bool ata_block_irq_mode(void)
+{
+    return g_ata_irq_mode;
+}
+
+uint32_t ata_block_irq_count(int channel, uint32_t *out_spurious)
+{
+    if (channel < 0 || channel >= (int)ATA_CHANNEL_COUNT)
+        return 0u;
+
+    if (out_spurious)
+        *out_spurious = g_ata_chan[channel].irqs_spurious;
+
+    return g_ata_chan[channel].irqs;
+}
+
+uint32_t ata_block_stalls(int channel)
+{
+    if (channel < 0 || channel >= (int)ATA_CHANNEL_COUNT)
+        return 0u;
+
+    return g_ata_chan[channel].stalls;
+}
+
+uint32_t ata_block_overlapped(void)
+{
+    return g_ata_overlapped;
+}
+
+void ata_block_set_irq_mode(bool enabled)
+{
+    uint32_t flags = cpu_irq_save();
+
+    g_ata_irq_mode = enabled;
+    for (int c = 0; c < (int)ATA_CHANNEL_COUNT; c++)
+        ata_set_irq_enabled(c, enabled);
 
-    /* Read-only for now. */
-    return BLOCK_ERROR;
+    cpu_irq_restore(flags);
 }
 
-static BlockDevice g_disk0 = {
-    .name = "disk0",
-    .sector_size = ATA_SECTOR_SIZE,
-    .ctx = (void *)(uintptr_t)ATA_DRIVE_MASTER,
-    .read = ata_block_read,
-    .write = ata_block_write,
-};
+/* Block devices address 32-bit LBAs: expose at most the first 2^32 - 1 sectors. */
+static uint32_t ata_block_capacity(int drive)
+{
+    uint64_t sectors = ata_get_sectors(drive);
 
-static BlockDevice g_disk1 = {
-    .name = "disk1",
-    .sector_size = ATA_SECTOR_SIZE,
-    .ctx = (void *)(uintptr_t)ATA_DRIVE_SLAVE,
-    .read = ata_block_read,
-    .write = ata_block_write,
-};
+    return (sectors > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)sectors;
+}
 
 int ata_block_register_devices(void)
 {
@@ -53,37 +391,60 @@ int ata_block_register_devices(void)
      */
     ata_init();
 
-    bool master = ata_is_present(ATA_DRIVE_MASTER);
-    bool slave = ata_is_present(ATA_DRIVE_SLAVE);
+    /* Bus-master DMA is optional: without it every command stays on PIO. */
+    (void)ata_dma_init();
 
-    if (!master && !slave)
-        return BLOCK_ERROR;
+    /* Both legacy lines belong to the channels; interrupt mode decides use. */
+    for (uint32_t c = 0; c < ATA_CHANNEL_COUNT; c++)
+    {
+        g_ata_chan[c].work.fn = ata_block_softirq;
+        g_ata_chan[c].work.arg = (void *)(uintptr_t)c;
+    }
+    irq_register(ATA_PRIMARY_IRQ, ata_block_irq, (void *)(uintptr_t)ATA_CHANNEL_PRIMARY, "ata0");
+    irq_register(ATA_SECONDARY_IRQ, ata_block_irq, (void *)(uintptr_t)ATA_CHANNEL_SECONDARY, "ata1");
 
     /*
-     * Naming policy:
-     * - Prefer master as disk0
-     * - If master missing but slave exists, expose slave as disk0 (so the system
-     *   still has a canonical "disk0" for early FS bring-up).
-     * - If both exist, expose slave as disk1.
+     * Naming policy: present drives are numbered in probe order (primary
+     * master, primary slave, secondary master, secondary slave), so the first
+     * drive found is always the canonical "disk0" for early FS bring-up.
      */
-    if (master)
+    uint32_t registered = 0u;
+
+    for (int d = 0; d < (int)ATA_DRIVE_COUNT; d++)
     {
-        g_disk0.ctx = (void *)(uintptr_t)ATA_DRIVE_MASTER;
-        int rc = block_register(&g_disk0);
+        if (!ata_is_present(d))
+            continue;
+
+        BlockDevice *dev = &g_disks[registered];
+        memset(dev, 0, sizeof(BlockDevice));
+
+        dev->name[0] = 'd';
+        dev->name[1] = 'i';
+        dev->name[2] = 's';
+        dev->name[3] = 'k';
+        dev->name[4] = (char)('0' + (char)registered);
+        dev->name[5] = '\0';
+
+        dev->sector_size = ATA_SECTOR_SIZE;
+        dev->sector_count = ata_block_capacity(d);
+        dev->max_sectors = ata_max_sectors(d);
+        dev->ctx = (void *)(uintptr_t)d;
+        dev->read = ata_block_read;
+        dev->write = ata_block_write;
+        dev->read_sectors = ata_block_read_sectors;
+        dev->write_sectors = ata_block_write_sectors;
+        dev->submit = ata_block_submit;
+        dev->reap = ata_block_reap;
+        dev->poll = ata_block_poll;
+        dev->flush = ata_block_flush;
+        dev->write_cache = ata_get_info(d)->write_cache;
+
+        int rc = block_register(dev);
         if (rc != BLOCK_SUCCESS)
             return rc;
 
-        if (slave)
-        {
-            rc = block_register(&g_disk1);
-            if (rc != BLOCK_SUCCESS)
-                return rc;
-        }
-
-        return BLOCK_SUCCESS;
+        registered++;
     }
 
-    /* master absent, slave present */
-    g_disk0.ctx = (void *)(uintptr_t)ATA_DRIVE_SLAVE;
-    return block_register(&g_disk0);
-}
\ No newline at end of file
+    return (registered > 0u) ? BLOCK_SUCCESS : BLOCK_ERROR;
+}
@@ -1,9 +1,36 @@
 #ifndef ATA_BLOCK_H
 #define ATA_BLOCK_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
-/* Register ATA PIO drives as generic block devices (e.g., "disk0"). */
+/*
+ * Register ATA drives on both channels as generic block devices ("disk0".."disk3")
+ * and attach the channel handlers to IRQ14 / IRQ15.
+ */
 int ata_block_register_devices(void);
 
+/*
+ * Completion mode. Off (default): commands are polled. On: waiters sleep until
+ * the channel's IRQ (14/15) while interrupts are enabled, falling back to
+ * polling when they are disabled or the drive stops interrupting. The caller
+ * unmasks the IRQ lines.
+ */
+void ata_block_set_irq_mode(bool enabled);
+
+/* Interrupt mode: a command makes no progress (no interrupt, no DRQ block)
+ * for this long -> it is polled to completion. */
+#define ATA_BLOCK_IRQ_TIMEOUT_TICKS 100u
+
+bool ata_block_irq_mode(void);
+
+/* Interrupts handled on `channel` so far (and how many found no command in flight). */
+uint32_t ata_block_irq_count(int channel, uint32_t *out_spurious);
+
+/* Commands on `channel` that missed an interrupt and were polled to completion. */
+uint32_t ata_block_stalls(int channel);
+
+/* Commands started while the other channel had one in flight (parallel I/O). */
+uint32_t ata_block_overlapped(void);
+
 #endif /* ATA_BLOCK_H */
\ No newline at end of file
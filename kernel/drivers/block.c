@@ -1,9 +1,19 @@
 #include "block.h"
 
+#include "cpu.h"
+#include "heap.h"
+#include "sched.h"
+#include "spinlock.h"
 #include "string.h"
+#include "timer.h"
 
 static BlockDevice *g_devices[BLOCK_MAX_DEVICES];
 static uint32_t g_device_count = 0u;
+static bool g_hybrid_poll = true;
+
+/* Device table. Entries are only ever appended, so readers that index below
+ * a count they loaded earlier need no lock. */
+static Spinlock g_devices_lock = SPINLOCK_INIT("block");
 
 void block_init(void)
 {
@@ -11,6 +21,7 @@ void block_init(void)
         g_devices[i] = 0;
 
     g_device_count = 0u;
+    spinlock_register(&g_devices_lock);
 }
 
 int block_register(BlockDevice *dev)
@@ -27,30 +38,44 @@ int block_register(BlockDevice *dev)
     if (!dev->read)
         return BLOCK_ERROR;
 
+    uint32_t flags = spin_lock_irqsave(&g_devices_lock);
+
     if (g_device_count >= BLOCK_MAX_DEVICES)
+    {
+        spin_unlock_irqrestore(&g_devices_lock, flags);
         return BLOCK_BUSY;
+    }
 
     /* Reject duplicate names to keep lookups deterministic. */
     for (uint32_t i = 0; i < g_device_count; i++)
     {
         if (g_devices[i] && strcmp(g_devices[i]->name, dev->name) == 0)
+        {
+            spin_unlock_irqrestore(&g_devices_lock, flags);
             return BLOCK_ERROR;
+        }
     }
 
+    block_queue_init(&dev->queue);
+    block_stats_reset(dev);
+    memset(&dev->wb, 0, sizeof(BlockWriteBehind));
+
+    /* Publish the slot before the count that makes it visible. */
     g_devices[g_device_count] = dev;
-    g_device_count++;
+    __atomic_store_n(&g_device_count, g_device_count + 1u, __ATOMIC_RELEASE);
 
+    spin_unlock_irqrestore(&g_devices_lock, flags);
     return BLOCK_SUCCESS;
 }
 
 uint32_t block_count(void)
 {
-    return g_device_count;
+    return __atomic_load_n(&g_device_count, __ATOMIC_ACQUIRE);
 }
 
 BlockDevice *block_get(uint32_t index)
 {
-    if (index >= g_device_count)
+    if (index >= block_count())
         return 0;
 
     return g_devices[index];
@@ -61,7 +86,8 @@ BlockDevice *block_get_by_name(const char *name)
     if (!name)
         return 0;
 
-    for (uint32_t i = 0; i < g_device_count; i++)
+    uint32_t count = block_count();
+    for (uint32_t i = 0; i < count; i++)
     {
         if (!g_devices[i])
             continue;
@@ -71,4 +97,578 @@ BlockDevice *block_get_by_name(const char *name)
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+uint32_t block_max_sectors(const BlockDevice *dev)
+{
+    if (!dev || dev->max_sectors < BLOCK_QUEUE_MAX_SECTORS)
+        return BLOCK_QUEUE_MAX_SECTORS;
+
+    return dev->max_sectors;
+}
+
+int block_submit(BlockDevice *dev, BlockRequest *rq)
+{
+    if (!dev || !rq)
+        return BLOCK_ERROR;
+
+    int rc = block_queue_submit(dev, rq);
+    if (rc != BLOCK_SUCCESS)
+        return rc;
+
+    block_queue_kick(dev);
+    return BLOCK_SUCCESS;
+}
+
+void block_poll(BlockDevice *dev)
+{
+    if (!dev)
+        return;
+
+    if (dev->queue.active_count != 0u)
+    {
+        if (dev->poll)
+            dev->poll(dev);
+        else if (!dev->submit)
+            sched_yield(); /* Another thread is inside a synchronous transfer. */
+    }
+
+    /* Start pending work (also retries units the driver refused as busy). */
+    block_queue_kick(dev);
+}
+
+/* Busy-poll only if `rq` is expected to finish within the threshold. */
+static bool block_wait_should_poll(const BlockDevice *dev, const BlockRequest *rq)
+{
+    uint64_t expected = dev->stats.lat_ewma;
+
+    /* No history yet: learn on the interrupt path first. */
+    if (!g_hybrid_poll || !dev->reap || expected == 0u)
+        return false;
+
+    uint64_t elapsed = cpu_rdtsc() - rq->submit_tsc;
+    uint64_t remaining = (expected > elapsed) ? (expected - elapsed) : 0u;
+
+    return remaining <= BLOCK_POLL_THRESHOLD_CYCLES;
+}
+
+int block_wait(BlockDevice *dev, BlockRequest *rq)
+{
+    if (!dev || !rq || rq->state == BLOCK_RQ_IDLE)
+        return BLOCK_ERROR;
+
+    if (rq->state == BLOCK_RQ_DONE)
+        return rq->status;
+
+    BlockStats *st = &dev->stats;
+    uint64_t start = cpu_rdtsc();
+
+    if (block_wait_should_poll(dev, rq))
+    {
+        uint64_t now = start;
+
+        st->poll_waits++;
+        while (rq->state != BLOCK_RQ_DONE && (now - start) < BLOCK_POLL_BUDGET_CYCLES)
+        {
+            dev->reap(dev);
+            block_queue_kick(dev);
+            now = cpu_rdtsc();
+        }
+
+        st->poll_cycles += now - start;
+        if (rq->state == BLOCK_RQ_DONE)
+            return rq->status;
+
+        /* Slower than history suggested: stop burning the CPU. */
+        st->poll_misses++;
+        start = now;
+    }
+
+    st->irq_waits++;
+    while (rq->state != BLOCK_RQ_DONE)
+        block_poll(dev);
+    st->irq_cycles += cpu_rdtsc() - start;
+
+    return rq->status;
+}
+
+void block_set_hybrid_poll(bool enabled)
+{
+    g_hybrid_poll = enabled;
+}
+
+bool block_hybrid_poll(void)
+{
+    return g_hybrid_poll;
+}
+
+/* Requests submitted per dispatch batch by block_read()/block_write(). */
+#define BLOCK_IO_BATCH 8u
+
+static int block_io(BlockDevice *dev, uint32_t op, uint32_t flags, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !buffer || count == 0u)
+        return BLOCK_ERROR;
+
+    BlockRequest rqs[BLOCK_IO_BATCH];
+    uint32_t max = block_max_sectors(dev);
+    int result = BLOCK_SUCCESS;
+
+    while (count > 0u)
+    {
+        uint32_t n = 0u;
+
+        /* Queue one batch (so it can merge), then start it and wait. */
+        while (count > 0u && n < BLOCK_IO_BATCH)
+        {
+            uint32_t chunk = (count > max) ? max : count;
+
+            block_request_init(&rqs[n], op, lba, chunk, buffer);
+            rqs[n].flags = flags;
+            if (block_queue_submit(dev, &rqs[n]) != BLOCK_SUCCESS)
+            {
+                count = 0u;
+                result = BLOCK_ERROR;
+                break;
+            }
+
+            lba += chunk;
+            count -= chunk;
+            buffer += chunk * dev->sector_size;
+            n++;
+        }
+
+        block_queue_kick(dev);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (block_wait(dev, &rqs[i]) != BLOCK_SUCCESS)
+                result = BLOCK_ERROR;
+        }
+
+        if (result != BLOCK_SUCCESS)
+            break;
+    }
+
+    return result;
+}
+
+int block_read(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return block_io(dev, BLOCK_OP_READ, 0u, lba, count, buffer);
+}
+
+int block_write(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return block_io(dev, BLOCK_OP_WRITE, 0u, lba, count, buffer);
+}
+
+int block_write_fua(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return block_io(dev, BLOCK_OP_WRITE, BLOCK_RQ_FUA, lba, count, buffer);
+}
+
+int block_flush(BlockDevice *dev)
+{
+    BlockRequest rq;
+
+    block_request_init(&rq, BLOCK_OP_FLUSH, 0u, 0u, 0);
+    if (block_submit(dev, &rq) != BLOCK_SUCCESS)
+        return BLOCK_ERROR;
+
+    return block_wait(dev, &rq);
+}
+
+/* --------------------------------------------------------------------------
+ * Write-behind
+ * -------------------------------------------------------------------------- */
+
+/* A staged write owns a private copy of its data (allocated inline). */
+typedef struct BlockWbEntry
+{
+    BlockRequest rq;
+    struct BlockWbEntry *next;
+    uint8_t data[];
+} BlockWbEntry;
+
+/* Free staged writes the queue has completed, latching any error. */
+static void block_wb_reap(BlockDevice *dev)
+{
+    BlockWriteBehind *wb = &dev->wb;
+    BlockWbEntry **link = &wb->entries;
+
+    while (*link)
+    {
+        BlockWbEntry *e = *link;
+
+        if (e->rq.state != BLOCK_RQ_DONE)
+        {
+            link = &e->next;
+            continue;
+        }
+
+        if (e->rq.status != BLOCK_SUCCESS)
+            wb->error = BLOCK_ERROR;
+
+        wb->dirty_sectors -= e->rq.count;
+        *link = e->next;
+        kfree(e);
+    }
+}
+
+static WaitQueue g_wb_waiters = WAIT_QUEUE_INIT; /* The writeback thread */
+
+/* Writeback timer: start staged writes nobody has synced (deferred timer context). */
+static void block_wb_expire(void *arg)
+{
+    BlockDevice *dev = (BlockDevice *)arg;
+
+    dev->wb.expired++;
+
+    /* An asynchronous driver only queues the commands; a synchronous one
+     * would run the whole transfer in the softirq. */
+    if (dev->submit)
+    {
+        block_queue_kick(dev);
+        return;
+    }
+
+    dev->wb.expire_pending = true;
+    wait_queue_wake_one(&g_wb_waiters);
+}
+
+/* Next device whose expired staged data waits for the thread (interrupts off). */
+static BlockDevice *block_wb_take_expired(void)
+{
+    uint32_t count = block_count();
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        BlockDevice *dev = g_devices[i];
+        if (dev && dev->wb.expire_pending)
+        {
+            dev->wb.expire_pending = false;
+            return dev;
+        }
+    }
+
+    return 0;
+}
+
+static void block_writeback_thread(void *arg)
+{
+    (void)arg;
+
+    for (;;)
+    {
+        uint32_t flags = cpu_irq_save();
+        BlockDevice *dev = block_wb_take_expired();
+        if (!dev)
+            (void)wait_queue_sleep(&g_wb_waiters, 0);
+        cpu_irq_restore(flags);
+
+        if (dev)
+            block_queue_kick(dev);
+    }
+}
+
+int block_writeback_start(void)
+{
+    return (sched_spawn("blkwb", block_writeback_thread, 0, SCHED_PRIO_NORMAL, 0) == SCHED_OK) ? BLOCK_SUCCESS : BLOCK_ERROR;
+}
+
+int block_write_behind(BlockDevice *dev, uint32_t lba, uint32_t count, const uint8_t *buffer)
+{
+    if (!dev || !buffer || count == 0u)
+        return BLOCK_ERROR;
+
+    if (!dev->write && !dev->write_sectors)
+        return BLOCK_ERROR;
+
+    BlockWriteBehind *wb = &dev->wb;
+
+    /* Expired while no writeback thread ran: start it now. */
+    if (wb->expire_pending)
+    {
+        wb->expire_pending = false;
+        block_queue_kick(dev);
+    }
+
+    while (count > 0u)
+    {
+        uint32_t chunk = (count > BLOCK_QUEUE_MAX_SECTORS) ? BLOCK_QUEUE_MAX_SECTORS : count;
+        uint32_t bytes = chunk * dev->sector_size;
+
+        BlockWbEntry *e = (BlockWbEntry *)kmalloc(sizeof(BlockWbEntry) + bytes);
+        if (!e)
+        {
+            /* Out of staging memory: write this chunk through instead. */
+            if (block_write(dev, lba, chunk, (uint8_t *)buffer) != BLOCK_SUCCESS)
+                return BLOCK_ERROR;
+        }
+        else
+        {
+            memcpy(e->data, buffer, bytes);
+            block_request_init(&e->rq, BLOCK_OP_WRITE, lba, chunk, e->data);
+
+            if (block_queue_submit(dev, &e->rq) != BLOCK_SUCCESS)
+            {
+                kfree(e);
+                return BLOCK_ERROR;
+            }
+
+            e->next = wb->entries;
+            wb->entries = e;
+            wb->dirty_sectors += chunk;
+            wb->staged++;
+        }
+
+        lba += chunk;
+        count -= chunk;
+        buffer += bytes;
+    }
+
+    /* Submission may have drained the queue (hazards); drop finished entries. */
+    block_wb_reap(dev);
+
+    if (wb->dirty_sectors >= BLOCK_WB_MAX_DIRTY)
+    {
+        block_queue_run(dev);
+        block_wb_reap(dev);
+    }
+
+    if (wb->dirty_sectors != 0u && !timer_pending(&wb->timer))
+        timer_add(&wb->timer, block_wb_expire, dev, timer_get_ticks() + BLOCK_WB_EXPIRE_TICKS);
+
+    return BLOCK_SUCCESS;
+}
+
+int block_sync(BlockDevice *dev)
+{
+    if (!dev)
+        return BLOCK_ERROR;
+
+    BlockWriteBehind *wb = &dev->wb;
+
+    (void)timer_cancel(&wb->timer);
+    wb->expire_pending = false;
+    block_queue_run(dev);
+    block_wb_reap(dev);
+    wb->syncs++;
+
+    int rc = (wb->error != BLOCK_SUCCESS) ? BLOCK_ERROR : BLOCK_SUCCESS;
+    wb->error = BLOCK_SUCCESS;
+
+    if (block_flush(dev) != BLOCK_SUCCESS)
+        rc = BLOCK_ERROR;
+
+    return rc;
+}
+
+int block_sync_all(void)
+{
+    int rc = BLOCK_SUCCESS;
+    uint32_t count = block_count();
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (g_devices[i] && block_sync(g_devices[i]) != BLOCK_SUCCESS)
+            rc = BLOCK_ERROR;
+    }
+
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+ * Statistics
+ * -------------------------------------------------------------------------- */
+
+void block_stats_reset(BlockDevice *dev)
+{
+    if (!dev)
+        return;
+
+    /* Keep requests that are still queued accounted for. */
+    uint32_t in_flight = dev->stats.in_flight;
+    memset(&dev->stats, 0, sizeof(BlockStats));
+    dev->stats.in_flight = (dev->queue.depth != 0u) ? in_flight : 0u;
+}
+
+uint32_t block_lat_bucket(uint64_t v)
+{
+    uint32_t hi = (uint32_t)(v >> 32);
+    uint32_t lo = (uint32_t)v;
+    uint32_t log2;
+
+    /* Split into halves: avoids libgcc's 64-bit helpers. */
+    if (hi != 0u)
+        log2 = 63u - (uint32_t)__builtin_clz(hi);
+    else if (lo != 0u)
+        log2 = 31u - (uint32_t)__builtin_clz(lo);
+    else
+        log2 = 0u;
+
+    return (log2 < BLOCK_LAT_BUCKETS) ? log2 : (BLOCK_LAT_BUCKETS - 1u);
+}
+
+void block_account_submit(BlockDevice *dev, BlockRequest *rq)
+{
+    BlockStats *st = &dev->stats;
+
+    rq->submit_tsc = cpu_rdtsc();
+
+    st->in_flight++;
+    if (st->in_flight > st->max_in_flight)
+        st->max_in_flight = st->in_flight;
+}
+
+void block_account_complete(BlockDevice *dev, BlockRequest *rq)
+{
+    BlockStats *st = &dev->stats;
+    uint64_t now = cpu_rdtsc();
+    uint64_t lat = (now > rq->submit_tsc) ? (now - rq->submit_tsc) : 0u;
+
+    if (st->in_flight > 0u)
+        st->in_flight--;
+
+    if (rq->status != BLOCK_SUCCESS)
+        st->errors++;
+
+    /* Flushes are timed by block_account_flush(), and would skew the
+     * read/write latency the completion policy predicts from. */
+    if (rq->op == BLOCK_OP_FLUSH)
+    {
+        st->flush_requests++;
+        return;
+    }
+
+    /* Shift-only moving average: no 64-bit division. */
+    if (st->lat_ewma == 0u)
+        st->lat_ewma = lat;
+    else
+        st->lat_ewma = st->lat_ewma - (st->lat_ewma >> 3) + (lat >> 3);
+
+    if (rq->op == BLOCK_OP_READ)
+    {
+        st->reads++;
+        if (rq->status == BLOCK_SUCCESS)
+            st->sectors_read += rq->count;
+        st->read_cycles += lat;
+        st->read_lat[block_lat_bucket(lat)]++;
+    }
+    else
+    {
+        st->writes++;
+        if (rq->flags & BLOCK_RQ_FUA)
+            st->fua_writes++;
+        if (rq->status == BLOCK_SUCCESS)
+            st->sectors_written += rq->count;
+        st->write_cycles += lat;
+        st->write_lat[block_lat_bucket(lat)]++;
+    }
+}
+
+void block_account_flush(BlockDevice *dev, uint64_t cycles)
+{
+    BlockStats *st = &dev->stats;
+
+    st->flushes++;
+    st->flush_cycles += cycles;
+    st->flush_lat[block_lat_bucket(cycles)]++;
+}
+
+/* Bounded text builder for block_stats_format(). */
+typedef struct
+{
+    char *buf;
+    uint32_t size;
+    uint32_t len;
+} BlockText;
+
+static void block_text_str(BlockText *t, const char *s)
+{
+    while (*s && t->len + 1u < t->size)
+        t->buf[t->len++] = *s++;
+
+    t->buf[t->len] = '\0';
+}
+
+static void block_text_u32(BlockText *t, const char *label, uint32_t v)
+{
+    char num[11];
+
+    block_text_str(t, label);
+    block_text_str(t, utoa(v, num, 10u));
+}
+
+static void block_text_hist(BlockText *t, const char *label, const uint32_t *hist)
+{
+    char num[11];
+
+    block_text_str(t, label);
+    for (uint32_t b = 0; b < BLOCK_LAT_BUCKETS; b++)
+    {
+        if (hist[b] == 0u)
+            continue;
+
+        block_text_str(t, " ");
+        block_text_str(t, utoa(b, num, 10u));
+        block_text_str(t, ":");
+        block_text_str(t, utoa(hist[b], num, 10u));
+    }
+    block_text_str(t, "\n");
+}
+
+uint32_t block_stats_format(char *buf, uint32_t size)
+{
+    if (!buf || size == 0u)
+        return 0u;
+
+    BlockText t = { buf, size, 0u };
+    buf[0] = '\0';
+
+    block_text_str(&t, "# latency histograms: bucket N = [2^N, 2^(N+1)) TSC cycles\n");
+
+    uint32_t count = block_count();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        BlockDevice *dev = g_devices[i];
+        if (!dev)
+            continue;
+
+        const BlockStats *st = &dev->stats;
+
+        block_text_str(&t, dev->name);
+        block_text_u32(&t, " reads=", st->reads);
+        block_text_u32(&t, " writes=", st->writes);
+        block_text_u32(&t, " rsect=", st->sectors_read);
+        block_text_u32(&t, " wsect=", st->sectors_written);
+        block_text_u32(&t, " errors=", st->errors);
+        block_text_u32(&t, " inflight=", st->in_flight);
+        block_text_u32(&t, " max_inflight=", st->max_in_flight);
+        block_text_str(&t, "\n");
+
+        /* Cycle totals in units of 1024 (utoa is 32-bit). */
+        block_text_u32(&t, "  poll_waits=", st->poll_waits);
+        block_text_u32(&t, " poll_misses=", st->poll_misses);
+        block_text_u32(&t, " irq_waits=", st->irq_waits);
+        block_text_u32(&t, " poll_kcyc=", (uint32_t)(st->poll_cycles >> 10));
+        block_text_u32(&t, " irq_kcyc=", (uint32_t)(st->irq_cycles >> 10));
+        block_text_u32(&t, " lat_ewma=", (st->lat_ewma >> 32) ? 0xFFFFFFFFu : (uint32_t)st->lat_ewma);
+        block_text_str(&t, "\n");
+
+        block_text_str(&t, "  write_cache=");
+        block_text_str(&t, dev->write_cache ? (dev->fua ? "fua" : "yes") : "no");
+        block_text_u32(&t, " flush_rqs=", st->flush_requests);
+        block_text_u32(&t, " fua_writes=", st->fua_writes);
+        block_text_u32(&t, " flushes=", st->flushes);
+        block_text_u32(&t, " flush_kcyc=", (uint32_t)(st->flush_cycles >> 10));
+        block_text_str(&t, "\n");
+
+        block_text_hist(&t, "  rd_lat", st->read_lat);
+        block_text_hist(&t, "  wr_lat", st->write_lat);
+        block_text_hist(&t, "  fl_lat", st->flush_lat);
+    }
+
+    return t.len;
+}
@@ -1,8 +1,12 @@
 #ifndef BLOCK_H
 #define BLOCK_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "block_queue.h"
+#include "timer_wheel.h"
+
 /* --------------------------------------------------------------------------
  * Block device return codes
  * 0 = success; non-zero = error
@@ -14,21 +18,159 @@
 /* --------------------------------------------------------------------------
  * Block device registry limits
  * -------------------------------------------------------------------------- */
-#define BLOCK_MAX_DEVICES 8u
+#define BLOCK_MAX_DEVICES 16u
 #define BLOCK_NAME_MAX    32u
 
+/* --------------------------------------------------------------------------
+ * Per-device I/O statistics (maintained by the block layer for every driver)
+ *
+ * Latency is measured per request, from submission to completion, with the
+ * CPU time stamp counter. Histogram bucket N counts requests that took
+ * [2^N, 2^(N+1)) cycles; the last bucket also takes everything above.
+ * -------------------------------------------------------------------------- */
+#define BLOCK_LAT_BUCKETS 32u
+
+typedef struct
+{
+    uint32_t reads;             /* Completed read requests. */
+    uint32_t writes;            /* Completed write requests. */
+    uint32_t sectors_read;
+    uint32_t sectors_written;
+    uint32_t errors;            /* Requests completed with an error. */
+    uint32_t in_flight;         /* Submitted, not yet completed. */
+    uint32_t max_in_flight;
+    uint64_t read_cycles;       /* Sum of read latencies. */
+    uint64_t write_cycles;      /* Sum of write latencies. */
+    uint32_t read_lat[BLOCK_LAT_BUCKETS];
+    uint32_t write_lat[BLOCK_LAT_BUCKETS];
+
+    /* Completion policy (see block_wait()). */
+    uint64_t lat_ewma;          /* Recent request latency (cycles, 1/8 weight per request). */
+    uint32_t poll_waits;        /* Waits that busy-polled the driver (`reap`). */
+    uint32_t poll_misses;       /* ... of which ran out of budget and slept after all. */
+    uint32_t irq_waits;         /* Waits that went to the interrupt path (`poll`). */
+    uint64_t poll_cycles;       /* CPU time spent busy-polling. */
+    uint64_t irq_cycles;        /* Time waited on the interrupt path: CPU time not spent spinning. */
+
+    /* Write cache (see block_flush()). Flush latency is the device command
+     * alone, from dispatch to completion. */
+    uint32_t flush_requests;    /* Completed BLOCK_OP_FLUSH requests. */
+    uint32_t fua_writes;        /* Completed BLOCK_RQ_FUA write requests. */
+    uint32_t flushes;           /* Cache flushes the device executed (incl. FUA emulation). */
+    uint64_t flush_cycles;
+    uint32_t flush_lat[BLOCK_LAT_BUCKETS];
+} BlockStats;
+
+/* --------------------------------------------------------------------------
+ * Hybrid completion polling
+ *
+ * block_wait() busy-polls (BlockDevice.reap) when the device's recent latency
+ * says the request should finish within BLOCK_POLL_THRESHOLD_CYCLES, which is
+ * cheaper than an interrupt round trip and a HLT wakeup. Slower requests, and
+ * polls that run past BLOCK_POLL_BUDGET_CYCLES, wait on the interrupt path
+ * (BlockDevice.poll) and leave the CPU idle.
+ * -------------------------------------------------------------------------- */
+#define BLOCK_POLL_THRESHOLD_CYCLES 100000u
+#define BLOCK_POLL_BUDGET_CYCLES    (2u * BLOCK_POLL_THRESHOLD_CYCLES)
+
+/* --------------------------------------------------------------------------
+ * Write-behind staging (see block_write_behind())
+ * -------------------------------------------------------------------------- */
+
+/* Dirty sectors staged per device before the queue is forced out. */
+#define BLOCK_WB_MAX_DIRTY 256u
+
+/* Staged data is started by a timer after this long without a sync (ticks). */
+#define BLOCK_WB_EXPIRE_TICKS 500u
+
+struct BlockWbEntry;
+
+typedef struct
+{
+    struct BlockWbEntry *entries; /* Staged writes (queued or completed, not yet reaped). */
+    uint32_t dirty_sectors;       /* Sectors staged but not yet written. */
+    uint32_t staged;              /* Writes accepted by block_write_behind(). */
+    uint32_t syncs;               /* block_sync() calls. */
+    uint32_t expired;             /* Writeback timer runs (staged data started unasked). */
+    int error;                    /* Sticky: a staged write failed since the last sync. */
+    bool expire_pending;          /* Timer ran on a synchronous driver: left to the writeback thread. */
+    Timer timer;                  /* Armed while data is staged. */
+} BlockWriteBehind;
+
 /* Generic Block Device Structure */
 typedef struct BlockDevice
 {
     char name[BLOCK_NAME_MAX];
     uint32_t sector_size;
 
+    /* Device size in sectors (0 = unknown). */
+    uint32_t sector_count;
+
+    /*
+     * Largest request the driver takes in one command (0 = the default,
+     * BLOCK_QUEUE_MAX_SECTORS). Merged units stay within the default; a single
+     * large request up to this size is handed to the driver as is.
+     */
+    uint32_t max_sectors;
+
     /* Optional per-device context pointer (driver-specific). */
     void *ctx;
 
-    /* Function pointers (1 sector operations for now). */
+    /* Function pointers (1 sector operations). */
     int (*read)(struct BlockDevice *dev, uint32_t lba, uint8_t *buffer);
     int (*write)(struct BlockDevice *dev, uint32_t lba, uint8_t *buffer);
+
+    /*
+     * Optional multi-sector operations (count <= block_max_sectors(dev)).
+     * When absent, the request queue falls back to the 1-sector ops above.
+     */
+    int (*read_sectors)(struct BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer);
+    int (*write_sectors)(struct BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer);
+
+    /*
+     * Optional asynchronous interface. `submit` starts one command under `tag`
+     * (0 .. queue_depth-1, never one still in flight) and returns BLOCK_SUCCESS
+     * (in flight), BLOCK_BUSY (try again later) or BLOCK_ERROR; the driver then
+     * reports the result with block_complete(dev, tag, ...), either from its
+     * interrupt bottom half (block softirq) or from `poll`, which the block
+     * layer calls while waiting.
+     * The synchronous ops above remain mandatory (fallback paths use them).
+     */
+    int (*submit)(struct BlockDevice *dev, uint32_t tag, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer);
+    void (*poll)(struct BlockDevice *dev);
+
+    /* Commands `submit` accepts at once (0 = 1; at most BLOCK_QUEUE_MAX_TAGS). */
+    uint32_t queue_depth;
+
+    /*
+     * Optional: called with interrupts disabled at the end of a dispatch pass
+     * that started commands with `submit`. Drivers may defer telling the
+     * hardware about new commands until here (e.g. one doorbell write per batch).
+     */
+    void (*commit)(struct BlockDevice *dev);
+
+    /*
+     * Optional: collect finished commands (block_complete()) without sleeping.
+     * Lets block_wait() busy-poll fast devices; `poll` may halt the CPU instead.
+     */
+    void (*reap)(struct BlockDevice *dev);
+
+    /* Optional: commit the device's volatile write cache to stable media. */
+    int (*flush)(struct BlockDevice *dev);
+
+    /*
+     * Write cache model. `write_cache`: completed writes may still be volatile,
+     * so BLOCK_OP_FLUSH reaches the driver (`submit` with op BLOCK_OP_FLUSH,
+     * else `flush`); without it flushes complete at once. `fua`: `submit`
+     * takes BLOCK_OP_WRITE_FUA, otherwise FUA writes are followed by a flush.
+     */
+    bool write_cache;
+    bool fua;
+
+    /* Request queue, statistics and write-behind state (initialized by block_register()). */
+    BlockQueue queue;
+    BlockStats stats;
+    BlockWriteBehind wb;
 } BlockDevice;
 
 /* --------------------------------------------------------------------------
@@ -41,4 +183,86 @@ uint32_t block_count(void);
 BlockDevice *block_get(uint32_t index);
 BlockDevice *block_get_by_name(const char *name);
 
+/* Per-request sector limit for `dev` (see BlockDevice.max_sectors). */
+uint32_t block_max_sectors(const BlockDevice *dev);
+
+/*
+ * Asynchronous I/O. block_submit() queues `rq` and starts it if the device is
+ * idle, then returns. Completion is signalled by rq->state == BLOCK_RQ_DONE
+ * and rq->done (if set). Waiters make progress with block_poll(), or block in
+ * block_wait(), which returns the request status.
+ */
+int block_submit(BlockDevice *dev, BlockRequest *rq);
+void block_poll(BlockDevice *dev);
+int block_wait(BlockDevice *dev, BlockRequest *rq);
+
+/* Hybrid completion polling in block_wait() (on by default). */
+void block_set_hybrid_poll(bool enabled);
+bool block_hybrid_poll(void);
+
+/*
+ * Synchronous multi-sector I/O (wrappers over the asynchronous path).
+ * Large transfers are split into requests of block_max_sectors() and merged
+ * back together by the queue where the driver allows it.
+ */
+int block_read(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer);
+int block_write(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer);
+
+/*
+ * Write barriers. block_flush() queues a BLOCK_OP_FLUSH and waits: every
+ * write completed before it is then on stable media. block_write_fua() is
+ * block_write() with BLOCK_RQ_FUA: the data itself is durable on return,
+ * which on FUA-capable devices avoids flushing the rest of the cache. Callers
+ * can keep the write cache on and pay for durability only at commit points.
+ */
+int block_flush(BlockDevice *dev);
+int block_write_fua(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer);
+
+/*
+ * Write-behind: copy `buffer` into a staged request and return without waiting
+ * for the device. Adjacent staged writes are coalesced by the request queue
+ * into single driver commands. Staged data is written out when the queue next
+ * runs (any synchronous I/O on the device), once BLOCK_WB_MAX_DIRTY sectors
+ * are pending, BLOCK_WB_EXPIRE_TICKS after it was first staged, or on
+ * block_sync(). Errors are reported by the next block_sync().
+ */
+int block_write_behind(BlockDevice *dev, uint32_t lba, uint32_t count, const uint8_t *buffer);
+
+/* Write out staged data, then flush the device cache. Returns BLOCK_ERROR if
+ * any staged write since the last sync, or the flush, failed. */
+int block_sync(BlockDevice *dev);
+
+/* block_sync() every registered device. */
+int block_sync_all(void);
+
+/*
+ * Start the "blkwb" thread (after sched_init()). The writeback timer runs in
+ * softirq context, where it only starts staged data on drivers with submit();
+ * for synchronous drivers the transfer is left to this thread. Without it the
+ * data goes out with the next I/O on the device.
+ */
+int block_writeback_start(void);
+
+/* --------------------------------------------------------------------------
+ * Statistics
+ * -------------------------------------------------------------------------- */
+
+/* Called by the request queue when a request is accepted / completed. */
+void block_account_submit(BlockDevice *dev, BlockRequest *rq);
+void block_account_complete(BlockDevice *dev, BlockRequest *rq);
+
+/* Called by the request queue when a device cache flush took `cycles`. */
+void block_account_flush(BlockDevice *dev, uint64_t cycles);
+
+void block_stats_reset(BlockDevice *dev);
+
+/* floor(log2(v)) clamped to the histogram range (0 for v == 0). */
+uint32_t block_lat_bucket(uint64_t v);
+
+/*
+ * Render statistics for every registered device as text (used by /dev/iostat).
+ * Returns the number of bytes written (output is always NUL-terminated).
+ */
+uint32_t block_stats_format(char *buf, uint32_t size);
+
 #endif /* BLOCK_H */
\ No newline at end of file
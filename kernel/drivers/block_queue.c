@@ -0,0 +1,861 @@
+#include "block_queue.h"
+
+#include "block.h"
+#include "cpu.h"
+#include "heap.h"
+#include "sched.h"
+#include "string.h"
+#include "timer.h"
+
+/* --------------------------------------------------------------------------
+ * Helpers
+ * -------------------------------------------------------------------------- */
+
+static uint32_t blkq_end(uint32_t lba, uint32_t count)
+{
+    return lba + count;
+}
+
+/* [a, a+an) and [b, b+bn) share at least one sector. */
+static int blkq_overlaps(uint32_t a, uint32_t an, uint32_t b, uint32_t bn)
+{
+    return (a < blkq_end(b, bn)) && (b < blkq_end(a, an));
+}
+
+/* Ranges overlap or are directly adjacent. */
+static int blkq_touches(uint32_t a, uint32_t an, uint32_t b, uint32_t bn)
+{
+    return (a <= blkq_end(b, bn)) && (b <= blkq_end(a, an));
+}
+
+static void blkq_sorted_insert(BlockQueue *q, BlockRequest *unit)
+{
+    BlockRequest **link = &q->sorted;
+
+    /* Equal LBAs keep submission order. */
+    while (*link && (*link)->unit_lba <= unit->unit_lba)
+        link = &(*link)->sort_next;
+
+    unit->sort_next = *link;
+    *link = unit;
+}
+
+static void blkq_sorted_remove(BlockQueue *q, BlockRequest *unit)
+{
+    BlockRequest **link = &q->sorted;
+
+    while (*link && *link != unit)
+        link = &(*link)->sort_next;
+
+    if (*link)
+        *link = unit->sort_next;
+
+    unit->sort_next = 0;
+}
+
+static void blkq_fifo_append(BlockQueue *q, BlockRequest *unit)
+{
+    unit->fifo_next = 0;
+
+    if (q->fifo_tail)
+        q->fifo_tail->fifo_next = unit;
+    else
+        q->fifo_head = unit;
+
+    q->fifo_tail = unit;
+}
+
+static void blkq_fifo_remove(BlockQueue *q, BlockRequest *unit)
+{
+    BlockRequest *prev = 0;
+    BlockRequest *cur = q->fifo_head;
+
+    while (cur && cur != unit)
+    {
+        prev = cur;
+        cur = cur->fifo_next;
+    }
+
+    if (!cur)
+        return;
+
+    if (prev)
+        prev->fifo_next = cur->fifo_next;
+    else
+        q->fifo_head = cur->fifo_next;
+
+    if (q->fifo_tail == cur)
+        q->fifo_tail = prev;
+
+    unit->fifo_next = 0;
+}
+
+/* Flush units (explicit flushes and FUA writes waiting for theirs) are barriers. */
+static int blkq_is_flush(const BlockRequest *unit)
+{
+    return unit->op == BLOCK_OP_FLUSH || (unit->flags & BLOCK_RQ_POSTFLUSH) != 0u;
+}
+
+/* Re-sort a unit whose start LBA moved (front merge). */
+static void blkq_resort(BlockQueue *q, BlockRequest *unit)
+{
+    blkq_sorted_remove(q, unit);
+    blkq_sorted_insert(q, unit);
+}
+
+/* --------------------------------------------------------------------------
+ * Driver interface
+ * -------------------------------------------------------------------------- */
+
+static int blkq_driver_transfer(BlockDevice *dev, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (op == BLOCK_OP_READ)
+    {
+        if (dev->read_sectors)
+            return dev->read_sectors(dev, lba, count, buffer);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (dev->read(dev, lba + i, buffer + (i * dev->sector_size)) != BLOCK_SUCCESS)
+                return BLOCK_ERROR;
+        }
+
+        return BLOCK_SUCCESS;
+    }
+
+    if (dev->write_sectors)
+        return dev->write_sectors(dev, lba, count, buffer);
+
+    if (!dev->write)
+        return BLOCK_ERROR;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (dev->write(dev, lba + i, buffer + (i * dev->sector_size)) != BLOCK_SUCCESS)
+            return BLOCK_ERROR;
+    }
+
+    return BLOCK_SUCCESS;
+}
+
+/* A unit can skip the bounce buffer when its members are laid out back-to-back
+ * both on disk and in memory (e.g. a large read split into chunks). */
+static int blkq_unit_is_direct(const BlockDevice *dev, const BlockRequest *unit)
+{
+    if (unit->lba != unit->unit_lba)
+        return 0;
+
+    const BlockRequest *prev = unit;
+    for (const BlockRequest *m = unit->merge_next; m; m = m->merge_next)
+    {
+        if (m->lba != blkq_end(prev->lba, prev->count))
+            return 0;
+
+        if (m->buffer != prev->buffer + (prev->count * dev->sector_size))
+            return 0;
+
+        prev = m;
+    }
+
+    return 1;
+}
+
+static void blkq_complete_unit(BlockDevice *dev, BlockRequest *unit, int status)
+{
+    BlockQueue *q = &dev->queue;
+    BlockRequest *m = unit;
+    while (m)
+    {
+        BlockRequest *next = m->merge_next;
+
+        m->status = status;
+        m->state = BLOCK_RQ_DONE;
+        m->merge_next = 0;
+        m->sort_next = 0;
+        m->fifo_next = 0;
+
+        if (q->depth > 0u)
+            q->depth--;
+
+        block_account_complete(dev, m);
+
+        /* Last touch: the callback may reuse or free the request. */
+        if (m->done)
+            m->done(m);
+
+        m = next;
+    }
+
+    if (status != BLOCK_SUCCESS)
+        q->stats.errors++;
+}
+
+static uint32_t blkq_depth_limit(const BlockDevice *dev)
+{
+    if (!dev->submit || dev->queue_depth <= 1u)
+        return 1u;
+
+    return (dev->queue_depth > BLOCK_QUEUE_MAX_TAGS) ? BLOCK_QUEUE_MAX_TAGS : dev->queue_depth;
+}
+
+/* A written FUA unit the device cannot make durable by itself. */
+static int blkq_needs_postflush(const BlockDevice *dev, const BlockRequest *unit)
+{
+    return unit->op == BLOCK_OP_WRITE && (unit->flags & (BLOCK_RQ_FUA | BLOCK_RQ_POSTFLUSH)) == BLOCK_RQ_FUA
+        && dev->write_cache && !dev->fua;
+}
+
+/* Put a written FUA unit back at the head of the queue as a flush barrier. */
+static void blkq_requeue_flush(BlockQueue *q, BlockRequest *unit)
+{
+    unit->flags |= BLOCK_RQ_POSTFLUSH;
+    unit->sort_next = 0;
+    unit->fifo_next = q->fifo_head;
+
+    q->fifo_head = unit;
+    if (!q->fifo_tail)
+        q->fifo_tail = unit;
+
+    blkq_sorted_insert(q, unit);
+    q->barriers++;
+    q->stats.fua_emulated++;
+}
+
+/* Retire the unit in flight under `tag`: copy bounced reads out and complete members. */
+static void blkq_finish_tag(BlockDevice *dev, uint32_t tag, int status)
+{
+    BlockQueue *q = &dev->queue;
+    uint32_t ss = dev->sector_size;
+
+    if (tag >= BLOCK_QUEUE_MAX_TAGS || !q->active[tag])
+        return;
+
+    BlockRequest *unit = q->active[tag];
+    q->active[tag] = 0;
+    q->active_count--;
+
+    if (q->flush_active && q->flush_tag == tag)
+    {
+        q->flush_active = 0u;
+        if (q->flush_tsc != 0u)
+            block_account_flush(dev, cpu_rdtsc() - q->flush_tsc);
+        q->flush_tsc = 0u;
+    }
+
+    if (q->bounce_busy && q->bounce_tag == tag)
+    {
+        if (unit->op == BLOCK_OP_READ && status == BLOCK_SUCCESS)
+        {
+            for (BlockRequest *m = unit; m; m = m->merge_next)
+                memcpy(m->buffer, q->bounce + ((m->lba - unit->unit_lba) * ss), m->count * ss);
+        }
+
+        q->bounce_busy = 0u;
+    }
+
+    /* Emulated FUA: the data sits in the write cache; complete after a flush. */
+    if (status == BLOCK_SUCCESS && blkq_needs_postflush(dev, unit))
+    {
+        blkq_requeue_flush(q, unit);
+        return;
+    }
+
+    blkq_complete_unit(dev, unit, status);
+}
+
+/* Make `unit` the in-flight command under `tag`. */
+static void blkq_activate(BlockQueue *q, BlockRequest *unit, uint32_t tag, uint8_t bounced)
+{
+    blkq_sorted_remove(q, unit);
+    blkq_fifo_remove(q, unit);
+
+    if (blkq_is_flush(unit))
+    {
+        q->barriers--;
+        q->flush_active = 1u;
+        q->flush_tag = (uint8_t)tag;
+    }
+
+    q->active[tag] = unit;
+    q->active_count++;
+    if (q->active_count > q->stats.max_inflight)
+        q->stats.max_inflight = q->active_count;
+
+    if (bounced)
+    {
+        q->bounce_busy = 1u;
+        q->bounce_tag = (uint8_t)tag;
+    }
+}
+
+/*
+ * Start a flush unit (the queue only does so once nothing else is in flight).
+ * Without a write cache there is nothing to flush: it completes at once.
+ * `irq_flags` as for blkq_dispatch_unit().
+ */
+static int blkq_dispatch_flush(BlockDevice *dev, BlockRequest *unit, uint32_t tag, uint32_t irq_flags)
+{
+    BlockQueue *q = &dev->queue;
+
+    if (!dev->write_cache)
+    {
+        blkq_activate(q, unit, tag, 0u);
+        blkq_finish_tag(dev, tag, BLOCK_SUCCESS);
+        return BLOCK_SUCCESS;
+    }
+
+    if (dev->submit)
+    {
+        int rc = dev->submit(dev, tag, BLOCK_OP_FLUSH, 0u, 0u, 0);
+        if (rc == BLOCK_BUSY)
+            return BLOCK_BUSY;
+
+        blkq_activate(q, unit, tag, 0u);
+        q->flush_tsc = cpu_rdtsc();
+        q->stats.flushes++;
+
+        if (rc != BLOCK_SUCCESS)
+            blkq_finish_tag(dev, tag, BLOCK_ERROR);
+
+        return BLOCK_SUCCESS;
+    }
+
+    blkq_activate(q, unit, tag, 0u);
+    q->flush_tsc = cpu_rdtsc();
+    q->stats.flushes++;
+
+    cpu_irq_restore(irq_flags);
+    int status = dev->flush ? dev->flush(dev) : BLOCK_SUCCESS;
+    (void)cpu_irq_save();
+
+    blkq_finish_tag(dev, tag, status);
+    return BLOCK_SUCCESS;
+}
+
+/*
+ * Hand one unit to the driver under a free `tag`. Synchronous drivers finish
+ * it before this returns; asynchronous ones (dev->submit) leave it in
+ * q->active[tag] until they call block_complete(). Returns BLOCK_BUSY (unit
+ * left pending) if the driver or the bounce buffer cannot take it right now.
+ *
+ * Called with interrupts off. A synchronous transfer runs with the caller's
+ * interrupt state (`irq_flags`) so the driver can sleep until its interrupt;
+ * the unit holds its tag meanwhile, and at depth 1 that keeps every other
+ * kick out of the queue.
+ */
+static int blkq_dispatch_unit(BlockDevice *dev, BlockRequest *unit, uint32_t tag, uint32_t irq_flags)
+{
+    BlockQueue *q = &dev->queue;
+    uint32_t ss = dev->sector_size;
+    uint32_t lba = unit->unit_lba;      /* Unit may be gone after completion. */
+    uint32_t count = unit->unit_count;
+    uint8_t *buffer = unit->buffer;
+    uint8_t bounced = 0u;
+
+    if (blkq_is_flush(unit))
+        return blkq_dispatch_flush(dev, unit, tag, irq_flags);
+
+    if (!blkq_unit_is_direct(dev, unit))
+    {
+        /* One merge buffer: a second scattered unit waits for it. */
+        if (q->bounce_busy)
+            return BLOCK_BUSY;
+
+        if (!q->bounce)
+            q->bounce = (uint8_t *)kmalloc(BLOCK_QUEUE_MAX_SECTORS * ss);
+
+        if (!q->bounce)
+        {
+            /* No merge buffer: one synchronous command per member (submission order). */
+            int status = BLOCK_SUCCESS;
+
+            blkq_activate(q, unit, tag, 0u);
+
+            q->stats.dispatched++;
+            q->stats.sectors += count;
+            q->head_pos = blkq_end(lba, count);
+
+            cpu_irq_restore(irq_flags);
+
+            for (BlockRequest *m = unit; m; m = m->merge_next)
+            {
+                if (blkq_driver_transfer(dev, m->op, m->lba, m->count, m->buffer) != BLOCK_SUCCESS)
+                    status = BLOCK_ERROR;
+            }
+
+            /* FUA on this last-resort path: flush before completing. */
+            if (status == BLOCK_SUCCESS && (unit->flags & BLOCK_RQ_FUA) && dev->write_cache && dev->flush)
+                status = dev->flush(dev);
+
+            (void)cpu_irq_save();
+
+            /* Already flushed: complete directly rather than via blkq_finish_tag(). */
+            q->active[tag] = 0;
+            q->active_count--;
+            blkq_complete_unit(dev, unit, status);
+            return BLOCK_SUCCESS;
+        }
+
+        /* Later members overwrite earlier ones where they overlap. */
+        if (unit->op == BLOCK_OP_WRITE)
+        {
+            for (BlockRequest *m = unit; m; m = m->merge_next)
+                memcpy(q->bounce + ((m->lba - unit->unit_lba) * ss), m->buffer, m->count * ss);
+        }
+
+        buffer = q->bounce;
+        bounced = 1u;
+    }
+
+    if (dev->submit)
+    {
+        uint32_t op = unit->op;
+        if (op == BLOCK_OP_WRITE && (unit->flags & BLOCK_RQ_FUA) && dev->write_cache && dev->fua)
+            op = BLOCK_OP_WRITE_FUA;
+
+        int rc = dev->submit(dev, tag, op, lba, count, buffer);
+        if (rc == BLOCK_BUSY)
+            return BLOCK_BUSY;
+
+        blkq_activate(q, unit, tag, bounced);
+
+        if (rc != BLOCK_SUCCESS)
+            blkq_finish_tag(dev, tag, BLOCK_ERROR);
+    }
+    else
+    {
+        uint32_t op = unit->op;
+
+        blkq_activate(q, unit, tag, bounced);
+
+        cpu_irq_restore(irq_flags);
+        int status = blkq_driver_transfer(dev, op, lba, count, buffer);
+        (void)cpu_irq_save();
+
+        blkq_finish_tag(dev, tag, status);
+    }
+
+    q->stats.dispatched++;
+    q->stats.sectors += count;
+    if (bounced)
+        q->stats.bounced++;
+    q->head_pos = blkq_end(lba, count);
+
+    return BLOCK_SUCCESS;
+}
+
+/* --------------------------------------------------------------------------
+ * Scheduling (C-LOOK elevator + FIFO deadlines)
+ * -------------------------------------------------------------------------- */
+
+static BlockRequest *blkq_pick(BlockQueue *q)
+{
+    if (!q->sorted)
+        return 0;
+
+    /* Barrier pending: nothing may pass it, dispatch in submission order. */
+    if (q->barriers != 0u)
+        return q->fifo_head;
+
+    /* Deadline first: the oldest unit wins once it has expired. */
+    if (q->fifo_head && timer_get_ticks() >= q->fifo_head->deadline)
+    {
+        q->stats.deadline_dispatches++;
+        return q->fifo_head;
+    }
+
+    /* C-LOOK: next unit at or beyond the head position, else wrap around. */
+    for (BlockRequest *u = q->sorted; u; u = u->sort_next)
+    {
+        if (u->unit_lba >= q->head_pos)
+            return u;
+    }
+
+    return q->sorted;
+}
+
+/* --------------------------------------------------------------------------
+ * Merging
+ * -------------------------------------------------------------------------- */
+
+static int blkq_range_fits(uint32_t a, uint32_t an, uint32_t b, uint32_t bn)
+{
+    uint32_t lo = (a < b) ? a : b;
+    uint32_t hi_a = blkq_end(a, an);
+    uint32_t hi_b = blkq_end(b, bn);
+    uint32_t hi = (hi_a > hi_b) ? hi_a : hi_b;
+
+    return (hi - lo) <= BLOCK_QUEUE_MAX_SECTORS;
+}
+
+static int blkq_fits(const BlockRequest *unit, const BlockRequest *rq)
+{
+    return blkq_range_fits(unit->unit_lba, unit->unit_count, rq->lba, rq->count);
+}
+
+/*
+ * A merge can close the gap between two units (e.g. scattered reads filling a
+ * range). Fuse the following unit into this one while they are adjacent.
+ * Write units never overlap, so only adjacency is possible and member order
+ * across the two units does not matter.
+ */
+static void blkq_fuse_next(BlockQueue *q, BlockRequest *unit)
+{
+    for (;;)
+    {
+        BlockRequest *next = unit->sort_next;
+        if (!next || next->op != unit->op || blkq_is_flush(next) || blkq_is_flush(unit))
+            return;
+
+        if (!blkq_touches(unit->unit_lba, unit->unit_count, next->unit_lba, next->unit_count))
+            return;
+
+        if (!blkq_range_fits(unit->unit_lba, unit->unit_count, next->unit_lba, next->unit_count))
+            return;
+
+        blkq_sorted_remove(q, next);
+        blkq_fifo_remove(q, next);
+
+        BlockRequest *tail = unit;
+        while (tail->merge_next)
+            tail = tail->merge_next;
+        tail->merge_next = next;
+        unit->flags |= next->flags & BLOCK_RQ_FUA;
+
+        uint32_t unit_end = blkq_end(unit->unit_lba, unit->unit_count);
+        uint32_t next_end = blkq_end(next->unit_lba, next->unit_count);
+        if (next_end > unit_end)
+            unit->unit_count = next_end - unit->unit_lba;
+
+        /* The fused unit inherits the more urgent deadline. */
+        if (next->deadline < unit->deadline)
+            unit->deadline = next->deadline;
+    }
+}
+
+static void blkq_fuse(BlockQueue *q, BlockRequest *unit)
+{
+    /* Absorb the successor(s), then let the predecessor absorb this unit. */
+    blkq_fuse_next(q, unit);
+
+    BlockRequest *prev = 0;
+    for (BlockRequest *u = q->sorted; u && u != unit; u = u->sort_next)
+        prev = u;
+
+    if (prev)
+        blkq_fuse_next(q, prev);
+}
+
+static void blkq_merge_into(BlockQueue *q, BlockRequest *unit, BlockRequest *rq)
+{
+    uint32_t unit_end = blkq_end(unit->unit_lba, unit->unit_count);
+    uint32_t rq_end = blkq_end(rq->lba, rq->count);
+
+    if (blkq_overlaps(unit->unit_lba, unit->unit_count, rq->lba, rq->count))
+        q->stats.overlap_merges++;
+    else if (rq->lba == unit_end)
+        q->stats.back_merges++;
+    else
+        q->stats.front_merges++;
+
+    /* Append in submission order; the unit head keeps the queue linkage. */
+    BlockRequest *tail = unit;
+    while (tail->merge_next)
+        tail = tail->merge_next;
+    tail->merge_next = rq;
+
+    /* One FUA member makes the whole command FUA. */
+    unit->flags |= rq->flags & BLOCK_RQ_FUA;
+
+    uint32_t new_lba = (rq->lba < unit->unit_lba) ? rq->lba : unit->unit_lba;
+    uint32_t new_end = (rq_end > unit_end) ? rq_end : unit_end;
+
+    int moved = (new_lba != unit->unit_lba);
+    unit->unit_lba = new_lba;
+    unit->unit_count = new_end - new_lba;
+
+    if (moved)
+        blkq_resort(q, unit);
+
+    blkq_fuse(q, unit);
+}
+
+/*
+ * Find a unit to merge into. Returns:
+ *   1 -> *out_unit set (merge), 0 -> insert as a new unit, -1 -> drain first.
+ *
+ * Invariant kept for writes: pending write units never overlap each other,
+ * so submission order only matters inside a unit (where it is preserved).
+ */
+static int blkq_find_merge(BlockQueue *q, const BlockRequest *rq, BlockRequest **out_unit)
+{
+    BlockRequest *overlap_unit = 0;
+    BlockRequest *touch_unit = 0;
+    uint32_t overlap_count = 0u;
+
+    /* Queued units may start while others run: order against in-flight writes. */
+    for (uint32_t t = 0; t < BLOCK_QUEUE_MAX_TAGS && q->active_count != 0u; t++)
+    {
+        const BlockRequest *a = q->active[t];
+        if (!a || a->op == BLOCK_OP_FLUSH || (a->op == BLOCK_OP_READ && rq->op == BLOCK_OP_READ))
+            continue;
+
+        if (blkq_overlaps(a->unit_lba, a->unit_count, rq->lba, rq->count))
+            return -1;
+    }
+
+    for (BlockRequest *u = q->sorted; u; u = u->sort_next)
+    {
+        /* Written FUA units awaiting their flush no longer conflict. */
+        if (blkq_is_flush(u))
+            continue;
+
+        int ov = blkq_overlaps(u->unit_lba, u->unit_count, rq->lba, rq->count);
+
+        /* Read-after-write / write-after-read on the same sectors: flush first. */
+        if (u->op != rq->op)
+        {
+            if (ov)
+                return -1;
+            continue;
+        }
+
+        if (ov)
+        {
+            overlap_count++;
+            if (!overlap_unit)
+                overlap_unit = u;
+        }
+        else if (!touch_unit && blkq_touches(u->unit_lba, u->unit_count, rq->lba, rq->count))
+        {
+            touch_unit = u;
+        }
+    }
+
+    /* Behind a barrier new requests stay separate (an overlapping write drains). */
+    if (q->barriers != 0u)
+        return (rq->op == BLOCK_OP_WRITE && overlap_count > 0u) ? -1 : 0;
+
+    if (rq->op == BLOCK_OP_WRITE && overlap_count > 0u)
+    {
+        if (overlap_count > 1u || !blkq_fits(overlap_unit, rq))
+            return -1;
+
+        *out_unit = overlap_unit;
+        return 1;
+    }
+
+    if (overlap_unit && blkq_fits(overlap_unit, rq))
+    {
+        *out_unit = overlap_unit;
+        return 1;
+    }
+
+    if (touch_unit && blkq_fits(touch_unit, rq))
+    {
+        *out_unit = touch_unit;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Public API
+ * -------------------------------------------------------------------------- */
+
+void block_request_init(BlockRequest *rq, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!rq)
+        return;
+
+    memset(rq, 0, sizeof(*rq));
+    rq->op = op;
+    rq->lba = lba;
+    rq->count = count;
+    rq->buffer = buffer;
+    rq->state = BLOCK_RQ_IDLE;
+    rq->status = BLOCK_SUCCESS;
+}
+
+void block_queue_init(BlockQueue *q)
+{
+    if (!q)
+        return;
+
+    memset(q, 0, sizeof(*q));
+}
+
+int block_queue_submit(BlockDevice *dev, BlockRequest *rq)
+{
+    if (!dev || !rq)
+        return BLOCK_ERROR;
+
+    if (rq->op == BLOCK_OP_FLUSH)
+    {
+        if (rq->count != 0u)
+            return BLOCK_ERROR;
+    }
+    else
+    {
+        if (rq->op != BLOCK_OP_READ && rq->op != BLOCK_OP_WRITE)
+            return BLOCK_ERROR;
+
+        if (!rq->buffer || rq->count == 0u || rq->count > block_max_sectors(dev))
+            return BLOCK_ERROR;
+
+        /* Reject LBA wrap-around. */
+        if (rq->lba > (0xFFFFFFFFu - rq->count))
+            return BLOCK_ERROR;
+    }
+
+    if (rq->state == BLOCK_RQ_QUEUED)
+        return BLOCK_ERROR;
+
+    if (rq->op == BLOCK_OP_WRITE && !dev->write && !dev->write_sectors)
+        return BLOCK_ERROR;
+
+    /* FUA only means something for writes; POSTFLUSH belongs to the queue. */
+    rq->flags &= (rq->op == BLOCK_OP_WRITE) ? BLOCK_RQ_FUA : 0u;
+
+    BlockQueue *q = &dev->queue;
+    BlockRequest *unit = 0;
+
+    /* Completions may run from IRQ context: keep them out while we edit. */
+    uint32_t flags = cpu_irq_save();
+
+    int m = (rq->op == BLOCK_OP_FLUSH) ? 0 : blkq_find_merge(q, rq, &unit);
+    if (m < 0)
+    {
+        /* Drain with the caller's interrupt state so the driver can sleep. */
+        q->stats.drains++;
+        cpu_irq_restore(flags);
+        block_queue_run(dev);
+        flags = cpu_irq_save();
+        m = 0;
+    }
+
+    rq->state = BLOCK_RQ_QUEUED;
+    rq->status = BLOCK_SUCCESS;
+    rq->merge_next = 0;
+    rq->sort_next = 0;
+    rq->fifo_next = 0;
+
+    if (m > 0)
+    {
+        blkq_merge_into(q, unit, rq);
+    }
+    else
+    {
+        uint32_t expire = (rq->op == BLOCK_OP_READ) ? BLOCK_QUEUE_READ_EXPIRE_TICKS : BLOCK_QUEUE_WRITE_EXPIRE_TICKS;
+
+        rq->deadline = timer_get_ticks() + expire;
+        rq->unit_lba = rq->lba;
+        rq->unit_count = rq->count;
+
+        blkq_sorted_insert(q, rq);
+        blkq_fifo_append(q, rq);
+
+        if (rq->op == BLOCK_OP_FLUSH)
+            q->barriers++;
+    }
+
+    block_account_submit(dev, rq);
+
+    q->depth++;
+    q->stats.submitted++;
+    q->stats.depth_sum += q->depth;
+    if (q->depth > q->stats.max_depth)
+        q->stats.max_depth = q->depth;
+
+    cpu_irq_restore(flags);
+    return BLOCK_SUCCESS;
+}
+
+void block_queue_kick(BlockDevice *dev)
+{
+    if (!dev)
+        return;
+
+    BlockQueue *q = &dev->queue;
+    uint32_t depth = blkq_depth_limit(dev);
+    uint32_t started = 0u;
+    uint32_t flags = cpu_irq_save();
+
+    while (q->active_count < depth && !q->flush_active)
+    {
+        BlockRequest *unit = blkq_pick(q);
+        if (!unit)
+            break;
+
+        /* A barrier waits for everything submitted before it. */
+        if (blkq_is_flush(unit) && q->active_count != 0u)
+            break;
+
+        uint32_t tag = 0u;
+        while (q->active[tag])
+            tag++;
+
+        if (blkq_dispatch_unit(dev, unit, tag, flags) == BLOCK_BUSY)
+        {
+            q->stats.busy++;
+            break;
+        }
+        started++;
+    }
+
+    /* Let the driver publish the whole batch at once. */
+    if (started > 0u && dev->submit && dev->commit)
+        dev->commit(dev);
+
+    cpu_irq_restore(flags);
+}
+
+void block_queue_run(BlockDevice *dev)
+{
+    if (!dev)
+        return;
+
+    BlockQueue *q = &dev->queue;
+
+    for (;;)
+    {
+        block_queue_kick(dev);
+
+        uint32_t flags = cpu_irq_save();
+        int idle = q->active_count == 0u && !q->sorted;
+        cpu_irq_restore(flags);
+
+        if (idle)
+            break;
+
+        /* In flight (or driver busy): wait for completion (poll or IRQ). */
+        if (dev->poll)
+            dev->poll(dev);
+        else if (!dev->submit && q->active_count != 0u)
+            sched_yield(); /* Another thread is inside a synchronous transfer. */
+    }
+}
+
+void block_complete(BlockDevice *dev, uint32_t tag, int status)
+{
+    if (!dev || tag >= BLOCK_QUEUE_MAX_TAGS)
+        return;
+
+    uint32_t flags = cpu_irq_save();
+
+    if (dev->queue.active[tag])
+    {
+        blkq_finish_tag(dev, tag, status);
+
+        /* Keep the device busy: start the next unit from completion context. */
+        block_queue_kick(dev);
+    }
+
+    cpu_irq_restore(flags);
+}
+
+uint32_t block_queue_inflight(const BlockDevice *dev)
+{
+    return dev ? dev->queue.active_count : 0u;
+}
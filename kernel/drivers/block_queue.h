@@ -0,0 +1,162 @@
+#ifndef BLOCK_QUEUE_H
+#define BLOCK_QUEUE_H
+
+#include <stdint.h>
+
+/*
+ * Per-device block request queue.
+ *
+ * Callers fill a BlockRequest (caller-owned storage), submit it to a device
+ * queue and then kick the dispatch loop. While requests are pending the queue:
+ *   - merges adjacent / overlapping requests of the same direction into a
+ *     single driver command ("unit"),
+ *   - orders units with a C-LOOK elevator (ascending LBA, wrap around),
+ *   - bounds starvation with per-direction deadlines (timer ticks).
+ *
+ * Synchronous drivers complete each unit inside the dispatch call.
+ * Asynchronous drivers (BlockDevice.submit) start the command and later report
+ * it with `block_complete()` from poll or IRQ context; up to
+ * BlockDevice.queue_depth units are in flight at once, each under a tag the
+ * queue assigns (0 .. depth-1). Units that overlap an in-flight write (or a
+ * read, for writes) are held back until it completes.
+ *
+ * Write barriers: a BLOCK_OP_FLUSH request commits the device's volatile write
+ * cache. It is an ordering point: it starts once everything submitted before
+ * it has completed, and nothing submitted after it starts until it is done
+ * (while a flush is pending the queue dispatches in submission order and stops
+ * merging). A write flagged BLOCK_RQ_FUA completes only once it is on stable
+ * media; drivers without native FUA (BlockDevice.fua) get the write followed
+ * by a flush. Devices without a write cache complete both without flushing.
+ */
+
+struct BlockDevice;
+
+/* --------------------------------------------------------------------------
+ * Request directions
+ * -------------------------------------------------------------------------- */
+#define BLOCK_OP_READ   0u
+#define BLOCK_OP_WRITE  1u
+#define BLOCK_OP_FLUSH  2u      /* Commit the write cache: no data (count 0, buffer may be 0) */
+
+/* Driver-level only: passed to BlockDevice.submit for BLOCK_RQ_FUA writes on
+ * devices that set BlockDevice.fua. */
+#define BLOCK_OP_WRITE_FUA 3u
+
+/* Request flags (BlockRequest.flags) */
+#define BLOCK_RQ_FUA        (1u << 0)   /* Write: on stable media when completed */
+#define BLOCK_RQ_POSTFLUSH  (1u << 8)   /* Queue internal: FUA write waiting for its flush */
+
+/* Request states */
+#define BLOCK_RQ_IDLE   0u
+#define BLOCK_RQ_QUEUED 1u
+#define BLOCK_RQ_DONE   2u
+
+/* --------------------------------------------------------------------------
+ * Queue tuning
+ * -------------------------------------------------------------------------- */
+
+/* Largest merged unit (64 KiB with 512-byte sectors, the bounce buffer size).
+ * Drivers may accept larger single requests (BlockDevice.max_sectors). */
+#define BLOCK_QUEUE_MAX_SECTORS         128u
+
+/* Most commands a driver can have in flight (tags 0..31, e.g. NCQ). */
+#define BLOCK_QUEUE_MAX_TAGS            32u
+
+/* Deadlines (PIT ticks, 100 Hz): reads are latency-sensitive, writes are not. */
+#define BLOCK_QUEUE_READ_EXPIRE_TICKS   50u
+#define BLOCK_QUEUE_WRITE_EXPIRE_TICKS  500u
+
+typedef struct BlockRequest
+{
+    /* Filled by the caller (see block_request_init()). */
+    uint32_t op;
+    uint32_t lba;
+    uint32_t count;
+    uint8_t *buffer;
+    uint32_t flags;                   /* BLOCK_RQ_FUA (set after block_request_init()). */
+
+    /* Optional completion callback (set after block_request_init()). Runs in
+     * completion context (poll or IRQ) once state == BLOCK_RQ_DONE. */
+    void (*done)(struct BlockRequest *rq);
+    void *private;
+
+    /* Filled by the queue. */
+    uint32_t state;
+    int status;
+
+    /* Queue internals (valid while state == BLOCK_RQ_QUEUED). */
+    uint64_t submit_tsc;              /* Latency accounting (block_account_*). */
+    uint64_t deadline;
+    uint32_t unit_lba;                /* Range covered by this unit (head only). */
+    uint32_t unit_count;
+    struct BlockRequest *sort_next;   /* Elevator order (unit heads only). */
+    struct BlockRequest *fifo_next;   /* Deadline order (unit heads only). */
+    struct BlockRequest *merge_next;  /* Members of this unit, submission order. */
+} BlockRequest;
+
+typedef struct
+{
+    uint32_t submitted;           /* Requests accepted by block_queue_submit(). */
+    uint32_t back_merges;         /* Request appended to the end of a unit. */
+    uint32_t front_merges;        /* Request prepended to the start of a unit. */
+    uint32_t overlap_merges;      /* Request overlapping a pending unit. */
+    uint32_t dispatched;          /* Units (driver commands) issued. */
+    uint32_t sectors;             /* Sectors transferred by dispatched units. */
+    uint32_t deadline_dispatches; /* Units chosen by deadline instead of elevator. */
+    uint32_t bounced;             /* Units that needed the bounce buffer. */
+    uint32_t drains;              /* Forced drains (read/write hazards). */
+    uint32_t errors;              /* Units completed with an error. */
+    uint32_t busy;                /* Dispatches deferred because the driver was busy. */
+    uint32_t flushes;             /* Flush commands issued to the driver. */
+    uint32_t fua_emulated;        /* FUA writes completed by write + flush. */
+    uint32_t max_inflight;        /* Most units in flight at once. */
+    uint32_t max_depth;           /* Highest number of pending requests seen. */
+    uint32_t depth_sum;           /* Sum of depth sampled at each submit. */
+} BlockQueueStats;
+
+typedef struct
+{
+    BlockRequest *sorted;     /* Pending units, ascending unit_lba. */
+    BlockRequest *fifo_head;  /* Pending units, oldest first. */
+    BlockRequest *fifo_tail;
+    uint32_t head_pos;        /* LBA following the last dispatched unit. */
+    uint32_t depth;           /* Pending requests (members, not units). */
+    BlockRequest *active[BLOCK_QUEUE_MAX_TAGS]; /* In-flight units by tag (0 = free). */
+    uint32_t active_count;
+    uint32_t barriers;        /* Pending flush units: dispatch in FIFO order. */
+    uint8_t flush_active;     /* A flush is in flight: nothing else starts. */
+    uint8_t flush_tag;
+    uint64_t flush_tsc;       /* Flush dispatch time (latency accounting). */
+    uint8_t bounce_tag;       /* Tag using the bounce buffer (valid if bounce_busy). */
+    uint8_t bounce_busy;
+    uint8_t *bounce;          /* Lazily allocated merge buffer. */
+    BlockQueueStats stats;
+} BlockQueue;
+
+void block_request_init(BlockRequest *rq, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer);
+
+void block_queue_init(BlockQueue *q);
+
+/*
+ * Queue a request. Does not start I/O unless a read/write hazard forces the
+ * pending units out first. Returns BLOCK_SUCCESS or BLOCK_ERROR.
+ */
+int block_queue_submit(struct BlockDevice *dev, BlockRequest *rq);
+
+/* Start the next unit if the driver is idle (returns without waiting). */
+void block_queue_kick(struct BlockDevice *dev);
+
+/* Dispatch loop: feed pending units to the driver until the queue is empty,
+ * polling asynchronous drivers for completion. */
+void block_queue_run(struct BlockDevice *dev);
+
+/*
+ * Called by asynchronous drivers when the unit submitted under `tag` finishes
+ * (poll or IRQ context). Completes its requests and starts the next unit.
+ */
+void block_complete(struct BlockDevice *dev, uint32_t tag, int status);
+
+/* Units currently in flight (0 = driver idle). */
+uint32_t block_queue_inflight(const struct BlockDevice *dev);
+
+#endif /* BLOCK_QUEUE_H */
@@ -0,0 +1,197 @@
+#include "clock.h"
+
+#include "cpu.h"
+#include "div64.h"
+#include "io.h"
+#include "rtc.h"
+#include "seqlock.h"
+#include "timer.h"
+
+/* PIT ports */
+#define CLOCK_PIT_CH2           0x42
+#define CLOCK_PIT_CMD           0x43
+#define CLOCK_PIT_CMD_CH2_MODE0 0xB0    /* Channel 2, lo/hi byte, mode 0, binary */
+
+/* Port 0x61 (system control port B) */
+#define CLOCK_PORT_CTL          0x61
+#define CLOCK_CTL_GATE2         0x01    /* Channel 2 gate */
+#define CLOCK_CTL_SPEAKER       0x02    /* Speaker data enable */
+#define CLOCK_CTL_OUT2          0x20    /* Channel 2 output (read-only) */
+
+static ClockInfo g_info;
+
+/*
+ * Scaling base, written by clock_tick() and read under g_seq. mult/shift are
+ * fixed once clock_init() has returned, so they are read without it.
+ */
+static SeqCount g_seq = SEQCOUNT_INIT;
+static uint64_t g_base_tsc;
+static uint64_t g_base_ns;
+static uint32_t g_base_frac;    /* Sub-nanosecond remainder (units of 2^-shift ns) */
+
+static uint64_t g_rtc_ns;       /* Monotonic time of the RTC sample */
+
+/*
+ * (cycles * mult + frac) >> shift, as two 32x32 partial products (the full
+ * product is up to 96 bits). Bits shifted out are returned in *frac_out.
+ */
+static uint64_t clock_scale(uint64_t cycles, uint32_t frac, uint32_t *frac_out)
+{
+    uint64_t lo = (uint64_t)(uint32_t)cycles * g_info.mult + frac;
+    uint64_t hi = (uint64_t)(uint32_t)(cycles >> 32) * g_info.mult;
+
+    if (frac_out)
+        *frac_out = (uint32_t)(lo & ((1ull << g_info.shift) - 1u));
+
+    return (hi << (32u - g_info.shift)) + (lo >> g_info.shift);
+}
+
+/* TSC cycles while PIT channel 2 counts down CLOCK_CAL_PIT_COUNT (0 = timeout). */
+static uint32_t clock_pit_window(void)
+{
+    uint8_t ctl = inb(CLOCK_PORT_CTL);
+
+    // Gate channel 2 on with the speaker disconnected, then arm a one-shot:
+    // OUT2 drops when the mode is written and rises when the count expires.
+    outb(CLOCK_PORT_CTL, (uint8_t)((ctl & ~CLOCK_CTL_SPEAKER) | CLOCK_CTL_GATE2));
+    outb(CLOCK_PIT_CMD, CLOCK_PIT_CMD_CH2_MODE0);
+    outb(CLOCK_PIT_CH2, (uint8_t)(CLOCK_CAL_PIT_COUNT & 0xFFu));
+    outb(CLOCK_PIT_CH2, (uint8_t)(CLOCK_CAL_PIT_COUNT >> 8));
+
+    uint64_t start = cpu_rdtsc();
+    uint32_t spins = 0u;
+    while (!(inb(CLOCK_PORT_CTL) & CLOCK_CTL_OUT2) && spins < CLOCK_CAL_SPIN_LIMIT)
+        spins++;
+    uint64_t end = cpu_rdtsc();
+
+    outb(CLOCK_PORT_CTL, ctl);
+
+    if (spins >= CLOCK_CAL_SPIN_LIMIT || (end - start) >> 32)
+        return 0u;
+    return (uint32_t)(end - start);
+}
+
+int clock_init(void)
+{
+    uint32_t flags = cpu_irq_save();
+    uint32_t cycles = 0u;
+
+    g_info.calibrated = false;
+    g_info.cal_cycles_min = 0u;
+    g_info.cal_cycles_max = 0u;
+
+    for (uint32_t run = 0; run < CLOCK_CAL_RUNS; run++)
+    {
+        uint32_t c = clock_pit_window();
+        if (c == 0u)
+            continue;
+
+        if (g_info.cal_cycles_min == 0u || c < g_info.cal_cycles_min)
+            g_info.cal_cycles_min = c;
+        if (c > g_info.cal_cycles_max)
+            g_info.cal_cycles_max = c;
+    }
+    cycles = g_info.cal_cycles_min;
+
+    if (cycles != 0u)
+    {
+        // ns per cycle as 32.32 fixed point, narrowed until it fits 32 bits.
+        uint64_t window_ns = div64_u32((uint64_t)CLOCK_CAL_PIT_COUNT * CLOCK_NS_PER_SEC, CLOCK_PIT_HZ, 0);
+        uint64_t mult = div64_u32(window_ns << 32, cycles, 0);
+        uint32_t shift = 32u;
+
+        while (mult >> 32)
+        {
+            mult >>= 1;
+            shift--;
+        }
+
+        g_info.mult = (uint32_t)mult;
+        g_info.shift = shift;
+        g_info.tsc_khz = (uint32_t)div64_u32((uint64_t)cycles * CLOCK_PIT_HZ, CLOCK_CAL_PIT_COUNT * 1000u, 0);
+
+        seqcount_write_begin(&g_seq);
+        g_base_tsc = cpu_rdtsc();
+        g_base_ns = timer_get_ticks() * TIMER_TICK_NS;
+        g_base_frac = 0u;
+        seqcount_write_end(&g_seq);
+
+        g_info.calibrated = true;
+    }
+
+    cpu_irq_restore(flags);
+
+    DateTime dt;
+    rtc_get_time(&dt);
+    g_rtc_ns = clock_monotonic_ns();
+    g_info.boot_epoch = rtc_to_epoch(&dt);
+
+    return g_info.calibrated ? CLOCK_OK : CLOCK_ERR_CALIBRATION;
+}
+
+void clock_tick(void)
+{
+    if (!g_info.calibrated)
+        return;
+
+    // IRQ0 with interrupts off: the only writer.
+    uint64_t now = cpu_rdtsc();
+
+    seqcount_write_begin(&g_seq);
+    g_base_ns += clock_scale(now - g_base_tsc, g_base_frac, &g_base_frac);
+    g_base_tsc = now;
+    seqcount_write_end(&g_seq);
+
+    g_info.updates++;
+}
+
+uint64_t clock_monotonic_ns(void)
+{
+    if (!g_info.calibrated)
+        return timer_get_ticks() * TIMER_TICK_NS;
+
+    uint64_t base_tsc;
+    uint64_t base_ns;
+    uint32_t frac;
+    uint32_t seq;
+
+    do
+    {
+        seq = seqcount_read_begin(&g_seq);
+        base_tsc = g_base_tsc;
+        base_ns = g_base_ns;
+        frac = g_base_frac;
+    } while (seqcount_read_retry(&g_seq, seq));
+
+    // RDTSC is not serializing; never let it land before the base.
+    uint64_t now = cpu_rdtsc();
+    if (now < base_tsc)
+        now = base_tsc;
+
+    return base_ns + clock_scale(now - base_tsc, frac, 0);
+}
+
+uint64_t clock_realtime_ns(void)
+{
+    return (uint64_t)g_info.boot_epoch * CLOCK_NS_PER_SEC + (clock_monotonic_ns() - g_rtc_ns);
+}
+
+uint32_t clock_realtime(void)
+{
+    return g_info.boot_epoch + clock_ns_to_sec(clock_monotonic_ns() - g_rtc_ns, 0);
+}
+
+uint64_t clock_cycles_to_ns(uint64_t cycles)
+{
+    return g_info.calibrated ? clock_scale(cycles, 0u, 0) : 0u;
+}
+
+uint32_t clock_ns_to_sec(uint64_t ns, uint32_t *rem_ns)
+{
+    return (uint32_t)div64_u32(ns, CLOCK_NS_PER_SEC, rem_ns);
+}
+
+const ClockInfo *clock_info(void)
+{
+    return &g_info;
+}
@@ -0,0 +1,73 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * High-resolution clock.
+ *
+ * clock_monotonic_ns() scales the CPU time stamp counter to nanoseconds. The
+ * TSC rate is measured once at boot against PIT channel 2 (the speaker
+ * channel, gated through port 0x61, so the 100 Hz tick on channel 0 keeps
+ * running), and stored as a 32-bit multiplier and shift: a read is one RDTSC,
+ * two 32x32 multiplies and no division.
+ *
+ * The scaling base (TSC value, nanoseconds at that value) is moved forward on
+ * every timer interrupt; readers copy it under a sequence counter, so a read never
+ * sees a half-updated base.
+ *
+ * Wall time comes from a single RTC sample taken at boot plus the monotonic
+ * time elapsed since; the CMOS is not touched again.
+ */
+
+/* Calibration against PIT channel 2 (mode 0, one-shot). */
+#define CLOCK_PIT_HZ            1193182u
+#define CLOCK_CAL_PIT_COUNT     11932u  /* ~10 ms per run */
+#define CLOCK_CAL_RUNS          3u      /* Fastest run wins (least disturbed) */
+#define CLOCK_CAL_SPIN_LIMIT    1000000u
+
+#define CLOCK_NS_PER_SEC        1000000000u
+
+/* Return codes (0 = success) */
+#define CLOCK_OK                0
+#define CLOCK_ERR_CALIBRATION   1       /* PIT channel 2 never expired */
+
+typedef struct
+{
+    bool calibrated;
+    uint32_t tsc_khz;
+    uint32_t mult;              /* ns = (cycles * mult) >> shift */
+    uint32_t shift;
+    uint32_t cal_cycles_min;    /* TSC cycles per calibration window */
+    uint32_t cal_cycles_max;
+    uint32_t boot_epoch;        /* RTC sample, seconds since 1970 (UTC) */
+    uint32_t updates;           /* Base updates (timer interrupts) */
+} ClockInfo;
+
+/*
+ * Calibrate the TSC and take the RTC sample. Call after timer_init() with
+ * interrupts still off. On failure the clock falls back to tick resolution
+ * (TIMER_TICK_NS) and the timer stays periodic.
+ */
+int clock_init(void);
+
+/* Timer interrupt hook (IRQ0): moves the scaling base forward. */
+void clock_tick(void);
+
+/* Nanoseconds since clock_init(). */
+uint64_t clock_monotonic_ns(void);
+
+/* Wall time: nanoseconds / seconds since 1970-01-01 00:00:00 UTC. */
+uint64_t clock_realtime_ns(void);
+uint32_t clock_realtime(void);
+
+/* Convert a TSC cycle count (e.g. a latency) to nanoseconds. */
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+
+/* Split nanoseconds into whole seconds and the nanosecond remainder. */
+uint32_t clock_ns_to_sec(uint64_t ns, uint32_t *rem_ns);
+
+const ClockInfo *clock_info(void);
+
+#endif /* CLOCK_H */
@@ -1,6 +1,9 @@
 #include "keyboard.h"
 #include "io.h"
 #include "cpu.h"
+#include "irq.h"
+#include "softirq.h"
+#include "sched.h"
 #include <stdbool.h> // We need bool types
 
 // Buffer Configuration
@@ -8,6 +11,13 @@
 static char kb_buffer[KB_BUFFER_SIZE];
 static volatile uint16_t write_ptr = 0;
 static volatile uint16_t read_ptr = 0;
+static WaitQueue kb_waiters = WAIT_QUEUE_INIT; // keyboard_get_char() callers
+
+// Raw scancodes from the IRQ, decoded by the input softirq
+#define KB_RAW_SIZE 64
+static uint8_t kb_raw[KB_RAW_SIZE];
+static volatile uint16_t raw_write = 0;
+static volatile uint16_t raw_read = 0;
 
 // State variables
 static bool shift_pressed = false;
@@ -30,6 +40,11 @@ static char scancode_set1_shifted[] = {
     0, '|', 'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0,
     '*', 0, ' '};
 
+static int keyboard_irq(uint8_t irq, void *ctx);
+static void keyboard_softirq(void *arg);
+
+static SoftirqWork kb_work = SOFTIRQ_WORK_INIT(keyboard_softirq, 0);
+
 void keyboard_init(void)
 {
     // Reset states
@@ -37,6 +52,10 @@ void keyboard_init(void)
     caps_lock = false;
     write_ptr = 0;
     read_ptr = 0;
+    raw_write = 0;
+    raw_read = 0;
+
+    irq_register(1, keyboard_irq, 0, "keyboard");
 }
 
 // Helper: Add char to buffer
@@ -47,6 +66,7 @@ static void buffer_write(char c)
     { // Check if full
         kb_buffer[write_ptr] = c;
         write_ptr = next;
+        wait_queue_wake_all(&kb_waiters);
     }
     // If full, drop the key (simple solution)
 }
@@ -62,7 +82,7 @@ char keyboard_try_get_char(void)
     return c;
 }
 
-// Public: Blocking read (race-free halt loop)
+// Public: Blocking read (race-free wait queue sleep)
 char keyboard_get_char(void)
 {
     for (;;)
@@ -71,7 +91,8 @@ char keyboard_get_char(void)
          * Avoid missed-wakeup:
          *  - Disable interrupts
          *  - Re-check the buffer
-         *  - If still empty: atomically enable interrupts then HLT
+         *  - If still empty: block on kb_waiters (other threads run) or,
+         *    before the scheduler starts, atomically sti; hlt
          */
         cpu_cli();
 
@@ -83,14 +104,12 @@ char keyboard_get_char(void)
             return c;
         }
 
-        cpu_idle();
+        wait_queue_sleep(&kb_waiters, 0);
     }
 }
 
-void keyboard_handler(void)
+static void keyboard_scancode(uint8_t scancode)
 {
-    uint8_t scancode = inb(0x60);
-
     // --- Handle Shift Keys ---
     if (scancode == 0x2A || scancode == 0x36)
     { // Left or Right Shift Pressed
@@ -147,4 +166,35 @@ void keyboard_handler(void)
             }
         }
     }
-}
\ No newline at end of file
+}
+
+// IRQ 1: read the scancode (acknowledges the controller), decode later
+static int keyboard_irq(uint8_t irq, void *ctx)
+{
+    (void)irq;
+    (void)ctx;
+
+    uint8_t scancode = inb(0x60);
+    uint16_t next = (uint16_t)((raw_write + 1u) % KB_RAW_SIZE);
+    if (next != raw_read)
+    { // Full: drop, like the character buffer
+        kb_raw[raw_write] = scancode;
+        raw_write = next;
+    }
+
+    softirq_queue(SOFTIRQ_INPUT, &kb_work);
+    return IRQ_HANDLED;
+}
+
+// Input softirq (interrupts enabled): the IRQ only appends to kb_raw
+static void keyboard_softirq(void *arg)
+{
+    (void)arg;
+
+    while (raw_read != raw_write)
+    {
+        uint8_t scancode = kb_raw[raw_read];
+        raw_read = (uint16_t)((raw_read + 1u) % KB_RAW_SIZE);
+        keyboard_scancode(scancode);
+    }
+}
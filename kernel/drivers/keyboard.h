@@ -3,16 +3,14 @@
 
 #include <stdint.h>
 
-// Initialize keyboard (if needed in future)
+// Reset state and register the IRQ 1 handler
 void keyboard_init(void);
 
-// Main interrupt handler called by ISR 33
-void keyboard_handler(void);
-
 // Non-blocking: returns 0 if buffer is empty.
 char keyboard_try_get_char(void);
 
-// Blocking read: halts the CPU while waiting for the next keypress.
+// Blocking read: the calling thread sleeps until the next keypress (the CPU
+// runs other threads or halts meanwhile).
 char keyboard_get_char(void);
 
 #endif
\ No newline at end of file
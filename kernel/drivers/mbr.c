@@ -75,11 +75,9 @@ static int mbr_build_partition_name(char out_name[BLOCK_NAME_MAX], const char *d
     return MBR_OK;
 }
 
-static int mbr_partition_read(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+/* Translate a partition-relative range into the parent's LBA space. */
+static int mbr_partition_map(BlockDevice *dev, uint32_t lba, uint32_t count, MbrPartitionCtx **out_ctx, uint32_t *out_parent_lba)
 {
-    if (!dev || !buffer)
-        return BLOCK_ERROR;
-
     MbrPartitionCtx *ctx = (MbrPartitionCtx *)dev->ctx;
     if (!ctx || !ctx->parent || !ctx->parent->read)
         return BLOCK_ERROR;
@@ -87,26 +85,69 @@ static int mbr_partition_read(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
     /* Enforce partition boundary when we know the size. */
     if (ctx->sector_count != 0u)
     {
-        if (lba >= ctx->sector_count)
+        if (lba >= ctx->sector_count || count > ctx->sector_count - lba)
             return BLOCK_ERROR;
     }
 
-    /* Overflow guard: base_lba + lba */
-    if (ctx->base_lba > (0xFFFFFFFFu - lba))
+    /* Overflow guard: base_lba + lba + count */
+    if (ctx->base_lba > (0xFFFFFFFFu - lba) || (ctx->base_lba + lba) > (0xFFFFFFFFu - count))
+        return BLOCK_ERROR;
+
+    *out_ctx = ctx;
+    *out_parent_lba = ctx->base_lba + lba;
+    return BLOCK_SUCCESS;
+}
+
+/*
+ * Partitions have their own request queue, and each dispatched unit is
+ * submitted to the parent's queue at the mapped LBA (block_read() and friends)
+ * rather than to the parent driver. I/O through diskN and diskNpM therefore
+ * shares one queue: the parent's ordering, barriers and FUA handling cover both.
+ */
+static int mbr_partition_read_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !buffer)
+        return BLOCK_ERROR;
+
+    MbrPartitionCtx *ctx = 0;
+    uint32_t parent_lba = 0u;
+    if (mbr_partition_map(dev, lba, count, &ctx, &parent_lba) != BLOCK_SUCCESS)
+        return BLOCK_ERROR;
+
+    return block_read(ctx->parent, parent_lba, count, buffer);
+}
+
+static int mbr_partition_read(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return mbr_partition_read_sectors(dev, lba, 1u, buffer);
+}
+
+static int mbr_partition_write_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !buffer)
+        return BLOCK_ERROR;
+
+    MbrPartitionCtx *ctx = 0;
+    uint32_t parent_lba = 0u;
+    if (mbr_partition_map(dev, lba, count, &ctx, &parent_lba) != BLOCK_SUCCESS)
         return BLOCK_ERROR;
 
-    uint32_t parent_lba = ctx->base_lba + lba;
-    return ctx->parent->read(ctx->parent, parent_lba, buffer);
+    return block_write(ctx->parent, parent_lba, count, buffer);
 }
 
 static int mbr_partition_write(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
 {
-    (void)dev;
-    (void)lba;
-    (void)buffer;
+    return mbr_partition_write_sectors(dev, lba, 1u, buffer);
+}
+
+/* The cache belongs to the whole disk: a flush barrier on the parent's queue. */
+static int mbr_partition_flush(BlockDevice *dev)
+{
+    MbrPartitionCtx *ctx = dev ? (MbrPartitionCtx *)dev->ctx : 0;
+    if (!ctx || !ctx->parent)
+        return BLOCK_ERROR;
 
-    /* Read-only for now. */
-    return BLOCK_ERROR;
+    return block_flush(ctx->parent);
 }
 
 int mbr_scan_and_register(BlockDevice *disk, const char *disk_name)
@@ -125,7 +166,7 @@ int mbr_scan_and_register(BlockDevice *disk, const char *disk_name)
         return MBR_ERR_NOT_SUPPORTED;
 
     uint8_t mbr[MBR_SECTOR_SIZE];
-    if (disk->read(disk, 0u, mbr) != BLOCK_SUCCESS)
+    if (block_read(disk, 0u, 1u, mbr) != BLOCK_SUCCESS)
         return MBR_ERR_IO;
 
     if (mbr[MBR_SIGNATURE_OFFSET] != MBR_SIGNATURE_LO ||
@@ -164,9 +205,8 @@ int mbr_scan_and_register(BlockDevice *disk, const char *disk_name)
         ctx->base_lba = lba_start;
         ctx->sector_count = lba_count;
 
-        /* Fill the BlockDevice struct. */
-        for (uint32_t z = 0; z < BLOCK_NAME_MAX; z++)
-            pdev->name[z] = '\0';
+        /* Fill the BlockDevice struct (optional ops/queue start zeroed). */
+        memset(pdev, 0, sizeof(BlockDevice));
 
         if (mbr_build_partition_name(pdev->name, disk_name, i + 1u) != MBR_OK)
         {
@@ -176,9 +216,15 @@ int mbr_scan_and_register(BlockDevice *disk, const char *disk_name)
         }
 
         pdev->sector_size = disk->sector_size;
+        pdev->sector_count = lba_count;
+        pdev->max_sectors = disk->max_sectors;
         pdev->ctx = ctx;
         pdev->read = mbr_partition_read;
         pdev->write = mbr_partition_write;
+        pdev->read_sectors = mbr_partition_read_sectors;
+        pdev->write_sectors = mbr_partition_write_sectors;
+        pdev->flush = mbr_partition_flush;
+        pdev->write_cache = disk->write_cache;
 
         if (block_register(pdev) != BLOCK_SUCCESS)
         {
@@ -0,0 +1,1052 @@
+#include "md.h"
+
+#include "cpu.h"
+#include "heap.h"
+#include "string.h"
+#include "timer.h"
+
+#define MD_SECTOR_SIZE          512u
+#define MD_NO_MEMBER            0xFFFFFFFFu
+
+/* Child requests per array command: a RAID0 command crosses at most this many chunks. */
+#define MD_MAX_CHILDREN         ((MD_MAX_SECTORS / MD_MIN_CHUNK_SECTORS) + 1u)
+
+/* --------------------------------------------------------------------------
+ * On-disk member superblock (first sector of the reserved area)
+ * -------------------------------------------------------------------------- */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t uuid[4];           /* Array identity, shared by all members */
+    uint32_t level;
+    uint32_t raid_disks;
+    uint32_t chunk_sectors;     /* RAID0 */
+    uint32_t data_sectors;      /* Used on each member, from LBA 0 */
+    uint32_t role;              /* Slot of the member holding this copy */
+    uint32_t events;            /* Bumped whenever the array state changes */
+    uint32_t failed_mask;       /* Slots dropped from the array (RAID1) */
+    uint32_t checksum;          /* Dword sum of the sector is zero */
+    uint8_t reserved[MD_SECTOR_SIZE - (14u * 4u)];
+} MdSuperblock;
+
+/* --------------------------------------------------------------------------
+ * Array state
+ * -------------------------------------------------------------------------- */
+struct MdArray;
+
+/* One array command and the member requests it was split into. */
+typedef struct
+{
+    struct MdArray *md;
+    uint32_t tag;               /* Array queue tag */
+    bool sync;                  /* Waited for by md_sync_io(), not reported to the queue */
+    bool fua;                   /* Write children carry BLOCK_RQ_FUA */
+    uint32_t op;
+    uint32_t lba;
+    uint32_t count;
+    uint8_t *buffer;
+    int status;
+    uint32_t pending;           /* Children in flight, plus one while issuing */
+    uint32_t used;              /* Children issued */
+    uint32_t tried;             /* RAID1 read: members already tried */
+    uint32_t written;           /* RAID1 write/flush: members that took it */
+    BlockRequest child[MD_MAX_CHILDREN];
+    uint32_t child_member[MD_MAX_CHILDREN];
+} MdCmd;
+
+typedef struct MdArray
+{
+    BlockDevice dev;
+    MdSuperblock sb;            /* In-memory copy (role unused) */
+    BlockDevice *member[MD_MAX_MEMBERS];
+    uint32_t next_lba[MD_MAX_MEMBERS];  /* Sector after each member's last request */
+    uint32_t inflight[MD_MAX_MEMBERS];
+    uint32_t chunk_shift;
+    uint32_t submitting;        /* Inside md_submit(): completions are deferred */
+    uint32_t deferred;          /* Finished tags not yet reported (bit N = tag N) */
+    bool sb_dirty;              /* Superblocks rewritten on the next flush */
+    bool sync_busy;
+    MdSuperblock sb_out[MD_MAX_MEMBERS];    /* Written by a queued flush */
+    MdCmd cmd[MD_QUEUE_DEPTH];
+    MdCmd sync_cmd;
+    MdArrayInfo info;
+} MdArray;
+
+static MdArray *g_md[MD_MAX_ARRAYS];
+static uint32_t g_md_count = 0u;
+
+static int md_submit(BlockDevice *dev, uint32_t tag, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer);
+
+/* --------------------------------------------------------------------------
+ * Helpers
+ * -------------------------------------------------------------------------- */
+
+static uint32_t md_sb_sum(const MdSuperblock *sb)
+{
+    const uint32_t *w = (const uint32_t *)sb;
+    uint32_t sum = 0u;
+
+    for (uint32_t i = 0; i < MD_SECTOR_SIZE / 4u; i++)
+        sum += w[i];
+
+    return sum;
+}
+
+static bool md_is_pow2(uint32_t v)
+{
+    return v != 0u && (v & (v - 1u)) == 0u;
+}
+
+static uint32_t md_log2(uint32_t v)
+{
+    uint32_t n = 0u;
+
+    while (v > 1u)
+    {
+        v >>= 1;
+        n++;
+    }
+
+    return n;
+}
+
+static bool md_usable(const MdArray *md, uint32_t m)
+{
+    return md->member[m] && (md->sb.failed_mask & (1u << m)) == 0u;
+}
+
+static uint32_t md_working(const MdArray *md)
+{
+    uint32_t n = 0u;
+
+    for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+    {
+        if (md_usable(md, m))
+            n++;
+    }
+
+    return n;
+}
+
+static bool md_range_ok(const MdArray *md, uint32_t lba, uint32_t count)
+{
+    return count != 0u && lba < md->dev.sector_count && count <= md->dev.sector_count - lba;
+}
+
+/*
+ * Drop a RAID1 member after an I/O error. The last working member is kept:
+ * with no other copy left its errors go to the caller instead.
+ */
+static void md_fail_member(MdArray *md, uint32_t m)
+{
+    if (md->sb.level != MD_LEVEL_RAID1 || !md_usable(md, m) || md_working(md) <= 1u)
+        return;
+
+    md->sb.failed_mask |= 1u << m;
+    md->sb.events++;
+    md->sb_dirty = true;
+
+    md->info.failed[m] = true;
+    md->info.degraded = true;
+    md->info.events = md->sb.events;
+}
+
+/* RAID0: member and member sector of array sector `lba`; returns sectors left in its chunk. */
+static uint32_t md_raid0_map(const MdArray *md, uint32_t lba, uint32_t *member, uint32_t *member_lba)
+{
+    uint32_t chunk = lba >> md->chunk_shift;
+    uint32_t offset = lba & (md->sb.chunk_sectors - 1u);
+    uint32_t n = md->sb.raid_disks;
+
+    *member = chunk % n;
+    *member_lba = ((chunk / n) << md->chunk_shift) + offset;
+    return md->sb.chunk_sectors - offset;
+}
+
+/*
+ * RAID1 read balancing: a request continuing a member's last one stays there
+ * (sequential streams keep their read-ahead); otherwise the least busy member
+ * wins, then the one whose head is closest.
+ */
+static uint32_t md_raid1_pick(const MdArray *md, uint32_t lba, uint32_t skip)
+{
+    uint32_t best = MD_NO_MEMBER;
+    uint32_t best_dist = 0u;
+
+    for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+    {
+        if (!md_usable(md, m) || (skip & (1u << m)))
+            continue;
+
+        if (md->next_lba[m] == lba)
+            return m;
+
+        uint32_t dist = (md->next_lba[m] > lba) ? (md->next_lba[m] - lba) : (lba - md->next_lba[m]);
+
+        if (best == MD_NO_MEMBER ||
+            md->inflight[m] < md->inflight[best] ||
+            (md->inflight[m] == md->inflight[best] && dist < best_dist))
+        {
+            best = m;
+            best_dist = dist;
+        }
+    }
+
+    return best;
+}
+
+/* --------------------------------------------------------------------------
+ * Command execution (children on the member queues)
+ * -------------------------------------------------------------------------- */
+
+/* Report tags that finished while md_submit() was still running. */
+static void md_report_deferred(MdArray *md)
+{
+    uint32_t flags = cpu_irq_save();
+
+    while (md->deferred != 0u && md->submitting == 0u)
+    {
+        uint32_t tag = 0u;
+        while ((md->deferred & (1u << tag)) == 0u)
+            tag++;
+
+        md->deferred &= ~(1u << tag);
+        block_complete(&md->dev, tag, md->cmd[tag].status);
+    }
+
+    cpu_irq_restore(flags);
+}
+
+static void md_cmd_finish(MdCmd *c)
+{
+    MdArray *md = c->md;
+
+    if (md->sb.level == MD_LEVEL_RAID1 && c->op != BLOCK_OP_READ)
+        c->status = (c->written != 0u) ? BLOCK_SUCCESS : BLOCK_ERROR;
+
+    if (c->sync)
+        return;
+
+    /* The queue activates the tag only after md_submit() returns. */
+    if (md->submitting != 0u)
+    {
+        md->deferred |= 1u << c->tag;
+        return;
+    }
+
+    block_complete(&md->dev, c->tag, c->status);
+}
+
+static void md_cmd_put(MdCmd *c)
+{
+    if (--c->pending == 0u)
+        md_cmd_finish(c);
+}
+
+static void md_child_done(BlockRequest *rq);
+
+static int md_issue(MdCmd *c, uint32_t m, uint32_t op, uint32_t member_lba, uint32_t count, uint8_t *buffer)
+{
+    MdArray *md = c->md;
+
+    if (c->used >= MD_MAX_CHILDREN)
+        return BLOCK_ERROR;
+
+    uint32_t i = c->used++;
+    BlockRequest *rq = &c->child[i];
+
+    block_request_init(rq, op, member_lba, count, buffer);
+    rq->flags = (c->fua && op == BLOCK_OP_WRITE) ? BLOCK_RQ_FUA : 0u;
+    rq->done = md_child_done;
+    rq->private = c;
+    c->child_member[i] = m;
+
+    c->pending++;
+    md->inflight[m]++;
+
+    /* Superblock writes and flushes say nothing about where the head is. */
+    if (op == c->op && op != BLOCK_OP_FLUSH)
+        md->next_lba[m] = member_lba + count;
+
+    if (op == BLOCK_OP_READ)
+        md->info.reads[m]++;
+    else if (op == BLOCK_OP_WRITE)
+        md->info.writes[m]++;
+
+    /* May complete (and call md_child_done()) before returning. */
+    if (block_submit(md->member[m], rq) != BLOCK_SUCCESS)
+    {
+        c->pending--;
+        md->inflight[m]--;
+        md->info.errors++;
+        return BLOCK_ERROR;
+    }
+
+    return BLOCK_SUCCESS;
+}
+
+static void md_child_done(BlockRequest *rq)
+{
+    MdCmd *c = (MdCmd *)rq->private;
+    MdArray *md = c->md;
+    uint32_t m = c->child_member[rq - c->child];
+
+    md->inflight[m]--;
+
+    if (rq->status == BLOCK_SUCCESS)
+    {
+        if (c->op != BLOCK_OP_READ)
+            c->written |= 1u << m;
+    }
+    else if (md->sb.level == MD_LEVEL_RAID1)
+    {
+        md->info.errors++;
+        md_fail_member(md, m);
+
+        /* Writes succeed if any copy made it; reads try the next copy. */
+        if (c->op == BLOCK_OP_READ)
+        {
+            bool retried = false;
+
+            c->tried |= 1u << m;
+            for (;;)
+            {
+                uint32_t next = md_raid1_pick(md, rq->lba, c->tried);
+                if (next == MD_NO_MEMBER)
+                    break;
+
+                c->tried |= 1u << next;
+                if (md_issue(c, next, BLOCK_OP_READ, rq->lba, rq->count, rq->buffer) == BLOCK_SUCCESS)
+                {
+                    md->info.retries++;
+                    retried = true;
+                    break;
+                }
+            }
+
+            if (!retried)
+                c->status = BLOCK_ERROR;
+        }
+    }
+    else
+    {
+        md->info.errors++;
+        c->status = BLOCK_ERROR;
+    }
+
+    md_cmd_put(c);
+}
+
+/* Member `m`'s copy of the current superblock. */
+static void md_sb_prepare(const MdArray *md, uint32_t m, MdSuperblock *sb)
+{
+    *sb = md->sb;
+    sb->role = m;
+    sb->checksum = 0u;
+    sb->checksum = 0u - md_sb_sum(sb);
+}
+
+/*
+ * Flush: a pending superblock update goes out first, then every working
+ * member flushes. Each member queue orders its flush after the write.
+ */
+static void md_start_flush(MdCmd *c)
+{
+    MdArray *md = c->md;
+    bool write_sb = md->sb_dirty;
+
+    md->sb_dirty = false;
+
+    for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+    {
+        if (!md_usable(md, m))
+            continue;
+
+        BlockDevice *member = md->member[m];
+
+        if (write_sb)
+        {
+            md_sb_prepare(md, m, &md->sb_out[m]);
+            if (md_issue(c, m, BLOCK_OP_WRITE, member->sector_count - MD_RESERVED_SECTORS, 1u, (uint8_t *)&md->sb_out[m]) != BLOCK_SUCCESS)
+                md->sb_dirty = true;
+        }
+
+        if (md_issue(c, m, BLOCK_OP_FLUSH, 0u, 0u, 0) != BLOCK_SUCCESS && md->sb.level == MD_LEVEL_RAID0)
+            c->status = BLOCK_ERROR;
+    }
+}
+
+/*
+ * Split `c` into member requests and submit them. The caller holds one
+ * `pending` reference (dropped with md_cmd_put()) so that children finishing
+ * early cannot complete the command before all of them are issued.
+ */
+static void md_start(MdCmd *c)
+{
+    MdArray *md = c->md;
+
+    c->status = BLOCK_SUCCESS;
+    c->pending = 1u;
+    c->used = 0u;
+    c->tried = 0u;
+    c->written = 0u;
+
+    if (c->op == BLOCK_OP_FLUSH)
+    {
+        md_start_flush(c);
+    }
+    else if (md->sb.level == MD_LEVEL_RAID0)
+    {
+        uint32_t lba = c->lba;
+        uint32_t left = c->count;
+        uint8_t *buffer = c->buffer;
+
+        while (left > 0u)
+        {
+            uint32_t m = 0u;
+            uint32_t member_lba = 0u;
+            uint32_t run = md_raid0_map(md, lba, &m, &member_lba);
+            if (run > left)
+                run = left;
+
+            if (md_issue(c, m, c->op, member_lba, run, buffer) != BLOCK_SUCCESS)
+            {
+                c->status = BLOCK_ERROR;
+                break;
+            }
+
+            lba += run;
+            left -= run;
+            buffer += run * MD_SECTOR_SIZE;
+        }
+    }
+    else if (c->op == BLOCK_OP_READ)
+    {
+        for (;;)
+        {
+            uint32_t m = md_raid1_pick(md, c->lba, c->tried);
+            if (m == MD_NO_MEMBER)
+            {
+                c->status = BLOCK_ERROR;
+                break;
+            }
+
+            c->tried |= 1u << m;
+            if (md_issue(c, m, BLOCK_OP_READ, c->lba, c->count, c->buffer) == BLOCK_SUCCESS)
+                break;
+
+            md_fail_member(md, m);
+        }
+    }
+    else
+    {
+        for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+        {
+            if (md_usable(md, m) && md_issue(c, m, BLOCK_OP_WRITE, c->lba, c->count, c->buffer) != BLOCK_SUCCESS)
+                md_fail_member(md, m);
+        }
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * BlockDevice operations
+ * -------------------------------------------------------------------------- */
+
+/* FUA writes pass the flag on to the member writes (members emulate it as needed). */
+static int md_submit(BlockDevice *dev, uint32_t tag, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    MdArray *md = dev ? (MdArray *)dev->ctx : 0;
+    if (!md || tag >= MD_QUEUE_DEPTH)
+        return BLOCK_ERROR;
+    if (op != BLOCK_OP_FLUSH && (!buffer || count > MD_MAX_SECTORS || !md_range_ok(md, lba, count)))
+        return BLOCK_ERROR;
+
+    MdCmd *c = &md->cmd[tag];
+    c->md = md;
+    c->tag = tag;
+    c->sync = false;
+    c->fua = (op == BLOCK_OP_WRITE_FUA);
+    c->op = c->fua ? BLOCK_OP_WRITE : op;
+    c->lba = lba;
+    c->count = count;
+    c->buffer = buffer;
+
+    md->submitting++;
+    md_start(c);
+    md_cmd_put(c);
+    md->submitting--;
+
+    /* Failures are reported through the tag like any other completion. */
+    return BLOCK_SUCCESS;
+}
+
+/* End of a dispatch pass: the new tags are active now. */
+static void md_commit(BlockDevice *dev)
+{
+    md_report_deferred((MdArray *)dev->ctx);
+}
+
+static void md_poll(BlockDevice *dev)
+{
+    MdArray *md = (MdArray *)dev->ctx;
+
+    for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+    {
+        BlockDevice *member = md->member[m];
+        if (member && (member->queue.active_count != 0u || member->queue.sorted))
+            block_poll(member);
+    }
+
+    md_report_deferred(md);
+}
+
+static void md_reap(BlockDevice *dev)
+{
+    MdArray *md = (MdArray *)dev->ctx;
+
+    for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+    {
+        BlockDevice *member = md->member[m];
+        if (!member)
+            continue;
+
+        if (member->reap && member->queue.active_count != 0u)
+            member->reap(member);
+
+        block_queue_kick(member);
+    }
+
+    md_report_deferred(md);
+}
+
+/*
+ * Synchronous path (partitions on the array call it directly): the same
+ * splitting, then wait for the children on their member queues.
+ */
+static int md_sync_io(BlockDevice *dev, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    MdArray *md = dev ? (MdArray *)dev->ctx : 0;
+    if (!md || !buffer || !md_range_ok(md, lba, count))
+        return BLOCK_ERROR;
+
+    MdCmd *c = &md->sync_cmd;
+    bool owned = false;
+
+    if (md->sync_busy)
+    {
+        c = (MdCmd *)kmalloc(sizeof(MdCmd));
+        if (!c)
+            return BLOCK_ERROR;
+        owned = true;
+    }
+    else
+    {
+        md->sync_busy = true;
+    }
+
+    int rc = BLOCK_SUCCESS;
+
+    while (count > 0u && rc == BLOCK_SUCCESS)
+    {
+        uint32_t n = (count > MD_MAX_SECTORS) ? MD_MAX_SECTORS : count;
+
+        c->md = md;
+        c->tag = 0u;
+        c->sync = true;
+        c->fua = false;
+        c->op = op;
+        c->lba = lba;
+        c->count = n;
+        c->buffer = buffer;
+
+        md_start(c);
+        md_cmd_put(c);
+
+        /* Retries append children while we wait. */
+        for (uint32_t i = 0; i < c->used; i++)
+            (void)block_wait(md->member[c->child_member[i]], &c->child[i]);
+
+        rc = (c->pending == 0u) ? c->status : BLOCK_ERROR;
+
+        lba += n;
+        count -= n;
+        buffer += n * MD_SECTOR_SIZE;
+    }
+
+    if (owned)
+        kfree(c);
+    else
+        md->sync_busy = false;
+
+    return rc;
+}
+
+static int md_read_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return md_sync_io(dev, BLOCK_OP_READ, lba, count, buffer);
+}
+
+static int md_write_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return md_sync_io(dev, BLOCK_OP_WRITE, lba, count, buffer);
+}
+
+static int md_read(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return md_sync_io(dev, BLOCK_OP_READ, lba, 1u, buffer);
+}
+
+static int md_write(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return md_sync_io(dev, BLOCK_OP_WRITE, lba, 1u, buffer);
+}
+
+/* Write the current superblock to every working member. */
+static int md_write_superblocks(MdArray *md)
+{
+    MdSuperblock sb;
+    uint32_t written = 0u;
+
+    for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+    {
+        if (!md_usable(md, m))
+            continue;
+
+        BlockDevice *member = md->member[m];
+
+        md_sb_prepare(md, m, &sb);
+        if (block_write(member, member->sector_count - MD_RESERVED_SECTORS, 1u, (uint8_t *)&sb) == BLOCK_SUCCESS)
+            written++;
+    }
+
+    md->sb_dirty = false;
+    return (written != 0u) ? MD_OK : MD_ERR_IO;
+}
+
+/* Persist member failures, then flush every member's cache. */
+static int md_flush(BlockDevice *dev)
+{
+    MdArray *md = (MdArray *)dev->ctx;
+    int rc = BLOCK_SUCCESS;
+
+    if (md->sb_dirty && md_write_superblocks(md) != MD_OK)
+        rc = BLOCK_ERROR;
+
+    uint32_t flushed = 0u;
+    for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+    {
+        if (!md_usable(md, m))
+            continue;
+
+        if (block_sync(md->member[m]) == BLOCK_SUCCESS)
+            flushed++;
+        else if (md->sb.level == MD_LEVEL_RAID0)
+            rc = BLOCK_ERROR;
+    }
+
+    if (flushed == 0u)
+        rc = BLOCK_ERROR;
+
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+ * Array registration
+ * -------------------------------------------------------------------------- */
+
+static uint32_t md_array_sectors(const MdSuperblock *sb)
+{
+    return (sb->level == MD_LEVEL_RAID0) ? sb->data_sectors * sb->raid_disks : sb->data_sectors;
+}
+
+static int md_start_array(MdArray *md)
+{
+    uint32_t index = g_md_count;
+    char num[12];
+
+    strcpy(md->dev.name, "md");
+    strcat(md->dev.name, utoa(index, num, 10u));
+
+    md->chunk_shift = (md->sb.level == MD_LEVEL_RAID0) ? md_log2(md->sb.chunk_sectors) : 0u;
+
+    md->dev.sector_size = MD_SECTOR_SIZE;
+    md->dev.sector_count = md_array_sectors(&md->sb);
+    md->dev.max_sectors = MD_MAX_SECTORS;
+    md->dev.ctx = md;
+    md->dev.read = md_read;
+    md->dev.write = md_write;
+    md->dev.read_sectors = md_read_sectors;
+    md->dev.write_sectors = md_write_sectors;
+    md->dev.submit = md_submit;
+    md->dev.poll = md_poll;
+    md->dev.reap = md_reap;
+    md->dev.commit = md_commit;
+    md->dev.flush = md_flush;
+    md->dev.queue_depth = MD_QUEUE_DEPTH;
+    md->dev.fua = true;
+
+    /* Always take flushes: they also carry pending superblock updates. */
+    md->dev.write_cache = true;
+
+    MdArrayInfo *info = &md->info;
+    strcpy(info->name, md->dev.name);
+    info->level = md->sb.level;
+    info->chunk_sectors = md->sb.chunk_sectors;
+    info->raid_disks = md->sb.raid_disks;
+    info->sectors = md->dev.sector_count;
+    info->events = md->sb.events;
+
+    for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+    {
+        if (md->member[m])
+            strcpy(info->member[m], md->member[m]->name);
+
+        info->failed[m] = !md_usable(md, m);
+        if (info->failed[m])
+            info->degraded = true;
+    }
+
+    if (block_register(&md->dev) != BLOCK_SUCCESS)
+        return MD_ERR_NO_SLOT;
+
+    g_md[index] = md;
+    g_md_count++;
+    return MD_OK;
+}
+
+static void md_new_uuid(uint32_t uuid[4])
+{
+    uint64_t tsc = cpu_rdtsc();
+
+    uuid[0] = (uint32_t)tsc;
+    uuid[1] = (uint32_t)(tsc >> 32);
+    uuid[2] = (uint32_t)timer_get_ticks() ^ 0x9E3779B9u;
+    uuid[3] = (uuid[0] * 2654435761u) ^ g_md_count;
+}
+
+/* RAID1: make every member a copy of member 0. */
+static int md_resync(MdArray *md)
+{
+    uint8_t *buf = (uint8_t *)kmalloc(MD_MAX_SECTORS * MD_SECTOR_SIZE);
+    if (!buf)
+        return MD_ERR_NO_MEMORY;
+
+    int rc = MD_OK;
+
+    for (uint32_t lba = 0; lba < md->sb.data_sectors && rc == MD_OK; lba += MD_MAX_SECTORS)
+    {
+        uint32_t n = md->sb.data_sectors - lba;
+        if (n > MD_MAX_SECTORS)
+            n = MD_MAX_SECTORS;
+
+        if (block_read(md->member[0], lba, n, buf) != BLOCK_SUCCESS)
+        {
+            rc = MD_ERR_IO;
+            break;
+        }
+
+        for (uint32_t m = 1; m < md->sb.raid_disks; m++)
+        {
+            if (block_write(md->member[m], lba, n, buf) != BLOCK_SUCCESS)
+                rc = MD_ERR_IO;
+        }
+    }
+
+    kfree(buf);
+    return rc;
+}
+
+int md_create(uint32_t level, uint32_t chunk_sectors, BlockDevice **members, uint32_t count)
+{
+    if (!members || count < 2u || count > MD_MAX_MEMBERS)
+        return MD_ERR_INVALID;
+
+    if (level == MD_LEVEL_RAID0)
+    {
+        if (chunk_sectors == 0u)
+            chunk_sectors = MD_DEFAULT_CHUNK_SECTORS;
+
+        if (!md_is_pow2(chunk_sectors) || chunk_sectors < MD_MIN_CHUNK_SECTORS || chunk_sectors > MD_MAX_CHUNK_SECTORS)
+            return MD_ERR_INVALID;
+    }
+    else if (level == MD_LEVEL_RAID1)
+    {
+        chunk_sectors = 0u;
+    }
+    else
+    {
+        return MD_ERR_INVALID;
+    }
+
+    if (g_md_count >= MD_MAX_ARRAYS)
+        return MD_ERR_NO_SLOT;
+
+    uint32_t data_sectors = 0xFFFFFFFFu;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        BlockDevice *dev = members[i];
+
+        if (!dev || dev->sector_size != MD_SECTOR_SIZE || dev->submit == md_submit)
+            return MD_ERR_INVALID;
+
+        if ((!dev->write && !dev->write_sectors) || dev->sector_count <= MD_RESERVED_SECTORS + chunk_sectors)
+            return MD_ERR_INVALID;
+
+        if (md_is_member(dev))
+            return MD_ERR_BUSY;
+
+        for (uint32_t j = 0; j < i; j++)
+        {
+            if (members[j] == dev)
+                return MD_ERR_INVALID;
+        }
+
+        if (dev->sector_count - MD_RESERVED_SECTORS < data_sectors)
+            data_sectors = dev->sector_count - MD_RESERVED_SECTORS;
+    }
+
+    if (level == MD_LEVEL_RAID0)
+    {
+        /* Whole chunks only, and the array size must fit in 32 bits. */
+        if (data_sectors > 0xFFFFFFFFu / count)
+            data_sectors = 0xFFFFFFFFu / count;
+
+        data_sectors &= ~(chunk_sectors - 1u);
+    }
+
+    MdArray *md = (MdArray *)kmalloc(sizeof(MdArray));
+    if (!md)
+        return MD_ERR_NO_MEMORY;
+
+    memset(md, 0, sizeof(MdArray));
+
+    md->sb.magic = MD_SB_MAGIC;
+    md->sb.version = MD_SB_VERSION;
+    md_new_uuid(md->sb.uuid);
+    md->sb.level = level;
+    md->sb.raid_disks = count;
+    md->sb.chunk_sectors = chunk_sectors;
+    md->sb.data_sectors = data_sectors;
+    md->sb.events = 1u;
+
+    for (uint32_t i = 0; i < count; i++)
+        md->member[i] = members[i];
+
+    int rc = (level == MD_LEVEL_RAID1) ? md_resync(md) : MD_OK;
+
+    if (rc == MD_OK)
+        rc = md_write_superblocks(md);
+
+    if (rc == MD_OK)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (block_sync(members[i]) != BLOCK_SUCCESS)
+                rc = MD_ERR_IO;
+        }
+    }
+
+    if (rc == MD_OK)
+        rc = md_start_array(md);
+
+    if (rc != MD_OK)
+        kfree(md);
+
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+ * Boot-time assembly
+ * -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    BlockDevice *dev;
+    MdSuperblock sb;
+    bool used;
+} MdCandidate;
+
+/* Read and validate the superblock at the end of `dev`. */
+static bool md_load_superblock(BlockDevice *dev, MdSuperblock *sb)
+{
+    if (dev->sector_size != MD_SECTOR_SIZE || dev->sector_count <= MD_RESERVED_SECTORS)
+        return false;
+
+    if (block_read(dev, dev->sector_count - MD_RESERVED_SECTORS, 1u, (uint8_t *)sb) != BLOCK_SUCCESS)
+        return false;
+
+    if (sb->magic != MD_SB_MAGIC || sb->version != MD_SB_VERSION || md_sb_sum(sb) != 0u)
+        return false;
+
+    if (sb->raid_disks < 2u || sb->raid_disks > MD_MAX_MEMBERS || sb->role >= sb->raid_disks)
+        return false;
+
+    if (sb->data_sectors == 0u || sb->data_sectors > dev->sector_count - MD_RESERVED_SECTORS)
+        return false;
+
+    if (sb->level == MD_LEVEL_RAID0)
+    {
+        return md_is_pow2(sb->chunk_sectors) &&
+               sb->chunk_sectors >= MD_MIN_CHUNK_SECTORS &&
+               sb->chunk_sectors <= MD_MAX_CHUNK_SECTORS &&
+               sb->data_sectors <= 0xFFFFFFFFu / sb->raid_disks;
+    }
+
+    return sb->level == MD_LEVEL_RAID1;
+}
+
+static bool md_same_array(const MdSuperblock *a, const MdSuperblock *b)
+{
+    return memcmp(a->uuid, b->uuid, sizeof(a->uuid)) == 0;
+}
+
+uint32_t md_assemble(void)
+{
+    MdCandidate *cand = (MdCandidate *)kmalloc(BLOCK_MAX_DEVICES * sizeof(MdCandidate));
+    if (!cand)
+        return 0u;
+
+    uint32_t n = 0u;
+
+    for (uint32_t i = 0; i < block_count() && n < BLOCK_MAX_DEVICES; i++)
+    {
+        BlockDevice *dev = block_get(i);
+        if (!dev || dev->submit == md_submit || md_is_member(dev))
+            continue;
+
+        if (md_load_superblock(dev, &cand[n].sb))
+        {
+            cand[n].dev = dev;
+            cand[n].used = false;
+            n++;
+        }
+    }
+
+    uint32_t started = 0u;
+
+    for (uint32_t i = 0; i < n && g_md_count < MD_MAX_ARRAYS; i++)
+    {
+        if (cand[i].used)
+            continue;
+
+        /* The member with the most recent superblock describes the array. */
+        const MdSuperblock *fresh = &cand[i].sb;
+        for (uint32_t j = i + 1u; j < n; j++)
+        {
+            if (!cand[j].used && md_same_array(&cand[j].sb, fresh) && cand[j].sb.events > fresh->events)
+                fresh = &cand[j].sb;
+        }
+
+        MdArray *md = (MdArray *)kmalloc(sizeof(MdArray));
+        if (!md)
+            break;
+
+        memset(md, 0, sizeof(MdArray));
+        md->sb = *fresh;
+
+        for (uint32_t j = i; j < n; j++)
+        {
+            MdCandidate *c = &cand[j];
+            if (c->used || !md_same_array(&c->sb, &md->sb))
+                continue;
+
+            c->used = true;
+
+            /* Dropped earlier, or missed updates while it was away: out of date. */
+            if (c->sb.events != md->sb.events || (md->sb.failed_mask & (1u << c->sb.role)))
+                continue;
+
+            /* The same slot twice (e.g. a partition ending with its disk). */
+            if (md->member[c->sb.role])
+                continue;
+
+            md->member[c->sb.role] = c->dev;
+        }
+
+        uint32_t present = 0u;
+        for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+        {
+            if (md->member[m])
+                present++;
+            else
+                md->sb.failed_mask |= 1u << m;
+        }
+
+        /* RAID0 needs every stripe; RAID1 runs (degraded) on any one copy. */
+        bool runnable = (md->sb.level == MD_LEVEL_RAID0) ? (present == md->sb.raid_disks) : (present > 0u);
+
+        if (!runnable || md_start_array(md) != MD_OK)
+        {
+            kfree(md);
+            continue;
+        }
+
+        started++;
+    }
+
+    kfree(cand);
+    return started;
+}
+
+/* --------------------------------------------------------------------------
+ * Queries
+ * -------------------------------------------------------------------------- */
+
+uint32_t md_count(void)
+{
+    return g_md_count;
+}
+
+const MdArrayInfo *md_info(uint32_t index)
+{
+    return (index < g_md_count) ? &g_md[index]->info : 0;
+}
+
+BlockDevice *md_device(uint32_t index)
+{
+    return (index < g_md_count) ? &g_md[index]->dev : 0;
+}
+
+bool md_is_member(const BlockDevice *dev)
+{
+    for (uint32_t i = 0; i < g_md_count; i++)
+    {
+        for (uint32_t m = 0; m < g_md[i]->sb.raid_disks; m++)
+        {
+            if (g_md[i]->member[m] == dev)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+int md_map(uint32_t index, uint32_t lba, uint32_t *member, uint32_t *member_lba)
+{
+    if (index >= g_md_count || !member || !member_lba)
+        return MD_ERR_INVALID;
+
+    MdArray *md = g_md[index];
+    if (lba >= md->dev.sector_count)
+        return MD_ERR_INVALID;
+
+    if (md->sb.level == MD_LEVEL_RAID0)
+    {
+        (void)md_raid0_map(md, lba, member, member_lba);
+        return MD_OK;
+    }
+
+    for (uint32_t m = 0; m < md->sb.raid_disks; m++)
+    {
+        if (md_usable(md, m))
+        {
+            *member = m;
+            *member_lba = lba;
+            return MD_OK;
+        }
+    }
+
+    return MD_ERR_IO;
+}
@@ -0,0 +1,105 @@
+#ifndef MD_H
+#define MD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "block.h"
+
+/*
+ * Software RAID ("md") virtual block devices.
+ *
+ * An array combines 2..MD_MAX_MEMBERS registered block devices into one
+ * BlockDevice "md<N>":
+ *   RAID0 - striping: the array is cut into chunks of chunk_sectors, dealt to
+ *           the members in turn; requests spanning chunks run on all members
+ *           at once.
+ *   RAID1 - mirroring: writes go to every working member; each read goes to
+ *           one member, picked by head position (sequential streams stay on
+ *           their member, random reads spread out).
+ *
+ * Array I/O is stacked asynchronously: one array command becomes child
+ * requests on the members' own queues, and completes when all of them have.
+ *
+ * Every member keeps a superblock in its last MD_RESERVED_SECTORS sectors
+ * (data starts at member LBA 0, so a RAID1 member still boots on its own).
+ * md_assemble() reads them back at boot and re-creates the arrays.
+ */
+
+/* Levels */
+#define MD_LEVEL_RAID0          0u
+#define MD_LEVEL_RAID1          1u
+
+/* Limits */
+#define MD_MAX_ARRAYS           4u      /* md0..md3 */
+#define MD_MAX_MEMBERS          4u
+#define MD_RESERVED_SECTORS     8u      /* Superblock area at the end of each member */
+#define MD_QUEUE_DEPTH          8u      /* Array commands in flight */
+#define MD_MAX_SECTORS          BLOCK_QUEUE_MAX_SECTORS
+
+/* RAID0 chunk size (sectors, power of two) */
+#define MD_DEFAULT_CHUNK_SECTORS 128u   /* 64 KiB */
+#define MD_MIN_CHUNK_SECTORS    8u      /* 4 KiB */
+#define MD_MAX_CHUNK_SECTORS    2048u   /* 1 MiB */
+
+/* Superblock */
+#define MD_SB_MAGIC             0x444D5950u     /* "PYMD" */
+#define MD_SB_VERSION           1u
+
+/* Return codes (0 = success) */
+#define MD_OK                   0
+#define MD_ERR_INVALID          1
+#define MD_ERR_NO_MEMORY        2
+#define MD_ERR_IO               3
+#define MD_ERR_NO_SLOT          4
+#define MD_ERR_BUSY             5       /* Device already belongs to an array */
+
+typedef struct
+{
+    char name[BLOCK_NAME_MAX];
+    uint32_t level;
+    uint32_t chunk_sectors;     /* RAID0 only */
+    uint32_t raid_disks;
+    uint32_t sectors;           /* Array size */
+    uint32_t events;            /* Superblock generation */
+    bool degraded;
+    uint32_t errors;            /* Member I/O errors */
+    uint32_t retries;           /* RAID1 reads retried on another member */
+
+    /* Per member slot ("" = missing). */
+    char member[MD_MAX_MEMBERS][BLOCK_NAME_MAX];
+    bool failed[MD_MAX_MEMBERS];
+    uint32_t reads[MD_MAX_MEMBERS];     /* Child requests issued */
+    uint32_t writes[MD_MAX_MEMBERS];
+} MdArrayInfo;
+
+/*
+ * Build a new array from `count` registered devices, write their superblocks
+ * and register it as the next md<N>. RAID1 copies members[0] onto the other
+ * members first. The usable size is the smallest member less the superblock
+ * area (times the member count for RAID0); `chunk_sectors` (0 = default) only
+ * matters for RAID0.
+ */
+int md_create(uint32_t level, uint32_t chunk_sectors, BlockDevice **members, uint32_t count);
+
+/*
+ * Scan the registered devices for member superblocks and register every array
+ * that can run (RAID0: all members; RAID1: at least one current member).
+ * Returns the number of arrays started.
+ */
+uint32_t md_assemble(void);
+
+uint32_t md_count(void);
+const MdArrayInfo *md_info(uint32_t index);
+BlockDevice *md_device(uint32_t index);
+
+/* True if `dev` is a member of a running array (not to be used directly). */
+bool md_is_member(const BlockDevice *dev);
+
+/*
+ * Locate array sector `lba` of array `index`: the member slot holding it (for
+ * RAID1, the first working one) and the sector on that member.
+ */
+int md_map(uint32_t index, uint32_t lba, uint32_t *member, uint32_t *member_lba);
+
+#endif /* MD_H */
@@ -0,0 +1,971 @@
+#include "nvme.h"
+
+#include "block.h"
+#include "cpu.h"
+#include "irq.h"
+#include "softirq.h"
+#include "pci.h"
+#include "pmm.h"
+#include "sched.h"
+#include "string.h"
+#include "timer.h"
+#include "vmm.h"
+
+/* --------------------------------------------------------------------------
+ * NVMe -> BlockDevice driver
+ *
+ * Queues, identify data and PRP lists live in identity-mapped low pages. A
+ * command identifier is (namespace slot << 5) | block queue tag, so any
+ * completion queue entry leads straight back to its namespace and tag.
+ * Submissions only advance the queue's tail in memory; the doorbell is
+ * written once per batch (nvme_ring), completion queue heads once per reap.
+ * -------------------------------------------------------------------------- */
+
+#define NVME_LOWMEM_LIMIT       0x00400000u
+
+/* Registers + doorbells for the admin queue and NVME_MAX_IO_QUEUES pairs at
+ * the largest stride we accept. */
+#define NVME_MAX_DSTRD          4u
+#define NVME_MMIO_SIZE          (NVME_REG_DOORBELL + ((NVME_MAX_IO_QUEUES + 1u) * 2u * (4u << NVME_MAX_DSTRD)))
+
+/* Register handshakes and polled admin commands: iterations before giving up. */
+#define NVME_SPIN_LIMIT         10000000u
+
+/* Interrupt mode: no progress for this long -> poll instead of sleeping. */
+#define NVME_IRQ_TIMEOUT_TICKS  100u
+
+/* nvme_sync_cmd(): command still running. */
+#define NVME_IN_PROGRESS        (-1)
+
+#define NVME_CID_NS_SHIFT       5u      /* BLOCK_QUEUE_MAX_TAGS == 32 */
+#define NVME_CID_TAG_MASK       0x1Fu
+
+#define nvme_barrier() __asm__ volatile("" ::: "memory")
+
+typedef struct
+{
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t cid;
+    uint32_t nsid;
+    uint32_t cdw2;
+    uint32_t cdw3;
+    uint64_t mptr;
+    uint64_t prp1;
+    uint64_t prp2;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+} NvmeCommand;
+
+typedef struct
+{
+    uint32_t result;
+    uint32_t reserved;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t cid;
+    uint16_t status;        /* Bit 0: phase tag */
+} NvmeCompletion;
+
+typedef struct
+{
+    uint16_t qid;
+    uint16_t size;
+    NvmeCommand *sq;
+    volatile NvmeCompletion *cq;
+    volatile uint32_t *sq_db;
+    volatile uint32_t *cq_db;
+    uint16_t sq_tail;
+    uint16_t sq_rung;           /* Tail last written to the doorbell */
+    uint16_t cq_head;
+    uint16_t phase;             /* Phase tag of new completions */
+    uint32_t inflight;          /* Never more than size - 1: the CQ cannot overflow */
+} NvmeQueue;
+
+struct NvmeController;
+
+typedef struct
+{
+    struct NvmeController *ctrl;
+    uint32_t slot;              /* Index in ctrl->ns (CID high bits) */
+    uint64_t *prp;              /* NVME_PRP_LIST_ENTRIES per tag, identity-mapped */
+    uint32_t outstanding;       /* Tags submitted and not yet reaped */
+    bool sync_busy;
+    uint32_t sync_mask;
+    volatile int sync_rc;
+    uint64_t progress_tick;
+    BlockDevice dev;
+    NvmeNamespaceInfo info;
+} NvmeNamespace;
+
+typedef struct NvmeController
+{
+    volatile uint8_t *regs;
+    uint32_t db_stride;         /* Bytes between doorbells */
+    NvmeQueue admin;
+    uint16_t admin_cid;
+    NvmeQueue io[NVME_MAX_IO_QUEUES];
+    uint8_t *ident;             /* Identify buffer (one page) */
+    NvmeNamespace ns[NVME_MAX_NAMESPACES];
+    SoftirqWork work;           /* Bottom half: nvme_reap(), then unmask */
+    WaitQueue waiters;          /* Threads in nvme_wait_event() */
+    NvmeControllerInfo info;
+} NvmeController;
+
+static NvmeController g_nvme[NVME_MAX_CONTROLLERS];
+static uint32_t g_nvme_count = 0u;
+static bool g_nvme_irq_mode = false;
+
+/* --------------------------------------------------------------------------
+ * Register access
+ * -------------------------------------------------------------------------- */
+
+static uint32_t nvme_read(const NvmeController *c, uint32_t reg)
+{
+    return *(volatile uint32_t *)(c->regs + reg);
+}
+
+static void nvme_write(NvmeController *c, uint32_t reg, uint32_t value)
+{
+    *(volatile uint32_t *)(c->regs + reg) = value;
+}
+
+/* 64-bit registers as two dwords, low half first. */
+static void nvme_write64(NvmeController *c, uint32_t reg, uint64_t value)
+{
+    nvme_write(c, reg, (uint32_t)value);
+    nvme_write(c, reg + 4u, (uint32_t)(value >> 32));
+}
+
+static bool nvme_wait_ready(NvmeController *c, bool ready)
+{
+    for (uint32_t i = 0; i < NVME_SPIN_LIMIT; i++)
+    {
+        uint32_t csts = nvme_read(c, NVME_REG_CSTS);
+        if (csts & NVME_CSTS_CFS)
+            return false;
+        if (((csts & NVME_CSTS_RDY) != 0u) == ready)
+            return true;
+    }
+
+    return false;
+}
+
+/* --------------------------------------------------------------------------
+ * Queue pairs
+ * -------------------------------------------------------------------------- */
+
+static bool nvme_queue_alloc(NvmeController *c, NvmeQueue *q, uint16_t qid, uint16_t size)
+{
+    memset(q, 0, sizeof(*q));
+
+    q->sq = (NvmeCommand *)pmm_alloc_page_low(NVME_LOWMEM_LIMIT);
+    q->cq = (volatile NvmeCompletion *)pmm_alloc_page_low(NVME_LOWMEM_LIMIT);
+    if (!q->sq || !q->cq)
+        return false;
+
+    memset(q->sq, 0, PMM_PAGE_SIZE);
+    memset((void *)q->cq, 0, PMM_PAGE_SIZE);
+
+    q->qid = qid;
+    q->size = size;
+    q->phase = 1u;
+    q->sq_db = (volatile uint32_t *)(c->regs + NVME_REG_DOORBELL + ((2u * qid) * c->db_stride));
+    q->cq_db = (volatile uint32_t *)(c->regs + NVME_REG_DOORBELL + ((2u * qid + 1u) * c->db_stride));
+    return true;
+}
+
+/* Copy `cmd` to the tail of `q`. The controller sees it after nvme_ring(). */
+static void nvme_queue_push(NvmeQueue *q, const NvmeCommand *cmd)
+{
+    memcpy(&q->sq[q->sq_tail], cmd, sizeof(*cmd));
+
+    q->sq_tail++;
+    if (q->sq_tail == q->size)
+        q->sq_tail = 0u;
+    q->inflight++;
+}
+
+/* Publish every entry pushed since the last doorbell write. */
+static bool nvme_ring(NvmeQueue *q)
+{
+    if (q->sq_tail == q->sq_rung)
+        return false;
+
+    nvme_barrier();
+    *q->sq_db = q->sq_tail;
+    q->sq_rung = q->sq_tail;
+    return true;
+}
+
+/* Next completion of `q` (consumed), or false. The head doorbell is left to
+ * the caller, once for all entries taken. */
+/* The completion at the head is new (phase matches); nothing is consumed. */
+static bool nvme_queue_ready(const NvmeQueue *q)
+{
+    return (q->cq[q->cq_head].status & NVME_STATUS_PHASE) == q->phase;
+}
+
+static bool nvme_queue_pop(NvmeQueue *q, NvmeCompletion *out)
+{
+    volatile NvmeCompletion *e = &q->cq[q->cq_head];
+
+    if ((e->status & NVME_STATUS_PHASE) != q->phase)
+        return false;
+
+    nvme_barrier();
+    out->result = e->result;
+    out->sq_head = e->sq_head;
+    out->sq_id = e->sq_id;
+    out->cid = e->cid;
+    out->status = e->status;
+
+    q->cq_head++;
+    if (q->cq_head == q->size)
+    {
+        q->cq_head = 0u;
+        q->phase ^= 1u;
+    }
+
+    if (q->inflight > 0u)
+        q->inflight--;
+    return true;
+}
+
+/* --------------------------------------------------------------------------
+ * Admin commands (polled: only used during bring-up)
+ * -------------------------------------------------------------------------- */
+
+static int nvme_admin_cmd(NvmeController *c, NvmeCommand *cmd, uint32_t *result)
+{
+    NvmeQueue *q = &c->admin;
+    NvmeCompletion cqe;
+
+    cmd->cid = c->admin_cid++;
+    nvme_queue_push(q, cmd);
+    (void)nvme_ring(q);
+
+    for (uint32_t i = 0; i < NVME_SPIN_LIMIT; i++)
+    {
+        if (!nvme_queue_pop(q, &cqe))
+            continue;
+
+        *q->cq_db = q->cq_head;
+
+        if (cqe.cid != cmd->cid)
+            continue;   /* Stale entry from an earlier timed-out command */
+
+        if (result)
+            *result = cqe.result;
+        return ((cqe.status >> 1) == 0u) ? NVME_OK : NVME_ERR_DEVICE;
+    }
+
+    return NVME_ERR_TIMEOUT;
+}
+
+static int nvme_identify(NvmeController *c, uint32_t cns, uint32_t nsid)
+{
+    NvmeCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADMIN_IDENTIFY;
+    cmd.nsid = nsid;
+    cmd.prp1 = (uint32_t)(uintptr_t)c->ident;
+    cmd.cdw10 = cns;
+
+    memset(c->ident, 0, PMM_PAGE_SIZE);
+    return nvme_admin_cmd(c, &cmd, 0);
+}
+
+/* Create I/O queue pair `q` (completion queue first: the SQ names it). */
+static int nvme_create_io_queue(NvmeController *c, NvmeQueue *q)
+{
+    NvmeCommand cmd;
+    uint32_t dw10 = ((uint32_t)(q->size - 1u) << 16) | q->qid;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADMIN_CREATE_CQ;
+    cmd.prp1 = (uint32_t)(uintptr_t)q->cq;
+    cmd.cdw10 = dw10;
+    cmd.cdw11 = NVME_QUEUE_CONTIGUOUS | NVME_CQ_IRQ_ENABLED; /* Vector 0 (INTx) */
+
+    int rc = nvme_admin_cmd(c, &cmd, 0);
+    if (rc != NVME_OK)
+        return rc;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADMIN_CREATE_SQ;
+    cmd.prp1 = (uint32_t)(uintptr_t)q->sq;
+    cmd.cdw10 = dw10;
+    cmd.cdw11 = NVME_QUEUE_CONTIGUOUS | ((uint32_t)q->qid << 16);
+
+    return nvme_admin_cmd(c, &cmd, 0);
+}
+
+/* --------------------------------------------------------------------------
+ * I/O commands
+ * -------------------------------------------------------------------------- */
+
+/*
+ * I/O queue pair for the submitting CPU. A pair is only touched with
+ * interrupts off by the CPU that owns it, so per-CPU pairs need no lock.
+ * Until there is more than one CPU, pair 0 carries all I/O; the others are
+ * created at bring-up so that later CPUs only have to pick theirs here.
+ */
+static NvmeQueue *nvme_io_queue(NvmeController *c)
+{
+    return &c->io[0];
+}
+
+/*
+ * Describe `bytes` at `buf` with PRP1/PRP2, using the PRP list of `tag` when
+ * the buffer spans more than two pages. Returns false if the buffer is
+ * unmapped, misaligned or too large.
+ */
+static bool nvme_build_prps(NvmeNamespace *ns, uint32_t tag, uint8_t *buf, uint32_t bytes, NvmeCommand *cmd)
+{
+    uint32_t vaddr = (uint32_t)(uintptr_t)buf;
+    if (vaddr & 3u)
+        return false;
+
+    uint32_t phys = vmm_get_phys(vaddr);
+    if (!phys)
+        return false;
+
+    cmd->prp1 = phys;
+    cmd->prp2 = 0u;
+
+    uint32_t first = NVME_PAGE_SIZE - (vaddr & (NVME_PAGE_SIZE - 1u));
+    if (first >= bytes)
+        return true;
+
+    /* Every further entry is a whole page, page aligned. */
+    uint64_t *list = &ns->prp[tag * NVME_PRP_LIST_ENTRIES];
+    uint32_t n = 0u;
+
+    vaddr += first;
+    bytes -= first;
+    while (bytes > 0u)
+    {
+        if (n == NVME_PRP_LIST_ENTRIES)
+            return false;
+
+        phys = vmm_get_phys(vaddr);
+        if (!phys)
+            return false;
+
+        list[n++] = phys;
+        vaddr += NVME_PAGE_SIZE;
+        bytes = (bytes > NVME_PAGE_SIZE) ? bytes - NVME_PAGE_SIZE : 0u;
+    }
+
+    cmd->prp2 = (n == 1u) ? list[0] : (uint64_t)(uint32_t)(uintptr_t)list;
+    return true;
+}
+
+/*
+ * Build the command for `op` on `tag` and push it to this CPU's queue without
+ * ringing. Interrupts are off. Returns BLOCK_SUCCESS, BLOCK_BUSY (queue full)
+ * or BLOCK_ERROR.
+ */
+static int nvme_post(NvmeNamespace *ns, uint32_t tag, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buf)
+{
+    NvmeController *c = ns->ctrl;
+    NvmeQueue *q = nvme_io_queue(c);
+
+    if (q->inflight >= (uint32_t)q->size - 1u)
+        return BLOCK_BUSY;
+
+    NvmeCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cid = (uint16_t)((ns->slot << NVME_CID_NS_SHIFT) | tag);
+    cmd.nsid = ns->info.nsid;
+
+    if (op == BLOCK_OP_FLUSH)
+    {
+        cmd.opcode = NVME_CMD_FLUSH;
+    }
+    else
+    {
+        cmd.opcode = (op == BLOCK_OP_READ) ? NVME_CMD_READ : NVME_CMD_WRITE;
+        cmd.cdw10 = lba;
+        cmd.cdw11 = 0u;
+        cmd.cdw12 = count - 1u;
+        if (op == BLOCK_OP_WRITE_FUA)
+            cmd.cdw12 |= NVME_RW_FUA;
+
+        if (!nvme_build_prps(ns, tag, buf, count * NVME_SECTOR_SIZE, &cmd))
+            return BLOCK_ERROR;
+    }
+
+    if (ns->outstanding == 0u)
+        ns->progress_tick = timer_get_ticks();
+
+    nvme_queue_push(q, &cmd);
+    ns->outstanding |= 1u << tag;
+    ns->info.requests++;
+    c->info.commands++;
+
+    uint32_t inflight = 0u;
+    for (uint32_t v = ns->outstanding; v; v &= v - 1u)
+        inflight++;
+    if (inflight > ns->info.max_outstanding)
+        ns->info.max_outstanding = inflight;
+
+    return BLOCK_SUCCESS;
+}
+
+/* Ring every I/O queue of `c` with unpublished submissions. */
+static void nvme_ring_all(NvmeController *c)
+{
+    for (uint32_t i = 0; i < c->info.io_queues; i++)
+    {
+        if (nvme_ring(&c->io[i]))
+            c->info.doorbells++;
+    }
+}
+
+/* Reap completions from every I/O queue of `c`. Interrupts are off, or
+ * softirq context. Returns the number of entries taken. */
+static uint32_t nvme_reap(NvmeController *c)
+{
+    uint32_t reaped = 0u;
+
+    for (uint32_t i = 0; i < c->info.io_queues; i++)
+    {
+        NvmeQueue *q = &c->io[i];
+        NvmeCompletion cqe;
+        uint32_t taken = 0u;
+
+        while (nvme_queue_pop(q, &cqe))
+        {
+            taken++;
+
+            uint32_t slot = cqe.cid >> NVME_CID_NS_SHIFT;
+            uint32_t tag = cqe.cid & NVME_CID_TAG_MASK;
+            if (slot >= c->info.namespaces)
+                continue;
+
+            NvmeNamespace *ns = &c->ns[slot];
+            uint32_t bit = 1u << tag;
+            if (!(ns->outstanding & bit))
+                continue;
+
+            bool ok = (cqe.status >> 1) == 0u;
+            if (!ok)
+                ns->info.errors++;
+
+            ns->progress_tick = timer_get_ticks();
+
+            /* Release first: completion may post the next unit under this tag. */
+            ns->outstanding &= ~bit;
+
+            if (ns->sync_mask & bit)
+            {
+                ns->sync_mask = 0u;
+                ns->sync_rc = ok ? NVME_OK : NVME_ERR_DEVICE;
+            }
+            else
+            {
+                block_complete(&ns->dev, tag, ok ? BLOCK_SUCCESS : BLOCK_ERROR);
+            }
+        }
+
+        /* One head doorbell for the whole batch. */
+        if (taken > 0u)
+            *q->cq_db = q->cq_head;
+        reaped += taken;
+    }
+
+    return reaped;
+}
+
+/* Sleep until the interrupt is handled when possible (other threads run
+ * meanwhile), otherwise poll the completion queues. */
+static void nvme_wait_event(NvmeNamespace *ns)
+{
+    uint32_t flags = cpu_irq_save();
+
+    if (ns->outstanding != 0u)
+    {
+        bool stalled = (timer_get_ticks() - ns->progress_tick) > NVME_IRQ_TIMEOUT_TICKS;
+
+        if (g_nvme_irq_mode && ns->ctrl->info.irq_line < 16u && (flags & CPU_EFLAGS_IF) && !stalled)
+        {
+            /* Until the interrupt, or the stall deadline if it is lost. */
+            wait_queue_sleep(&ns->ctrl->waiters, (ns->progress_tick + NVME_IRQ_TIMEOUT_TICKS + 1u) * TIMER_TICK_NS);
+        }
+        else
+            (void)nvme_reap(ns->ctrl);
+    }
+
+    cpu_irq_restore(flags);
+}
+
+/*
+ * Synchronous command on tag 0: claim the namespace (new async units are
+ * refused), let in-flight commands drain, then post, ring and wait. `op` is
+ * BLOCK_OP_READ, BLOCK_OP_WRITE or BLOCK_OP_FLUSH.
+ */
+static int nvme_sync_cmd(NvmeNamespace *ns, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buf)
+{
+    uint32_t flags = cpu_irq_save();
+    if (ns->sync_busy)
+    {
+        cpu_irq_restore(flags);
+        return NVME_ERR_INVALID;
+    }
+    ns->sync_busy = true;
+    cpu_irq_restore(flags);
+
+    while (ns->outstanding != 0u)
+        nvme_wait_event(ns);
+
+    int rc = NVME_ERR_INVALID;
+    flags = cpu_irq_save();
+    for (;;)
+    {
+        int post = nvme_post(ns, 0u, op, lba, count, buf);
+        if (post == BLOCK_SUCCESS)
+        {
+            ns->sync_rc = NVME_IN_PROGRESS;
+            ns->sync_mask = 1u;
+            nvme_ring_all(ns->ctrl);
+            rc = NVME_OK;
+            break;
+        }
+        if (post == BLOCK_ERROR)
+            break;
+
+        /* Queue full of another namespace's commands. */
+        (void)nvme_reap(ns->ctrl);
+    }
+    cpu_irq_restore(flags);
+
+    if (rc == NVME_OK)
+    {
+        while (ns->sync_rc == NVME_IN_PROGRESS)
+            nvme_wait_event(ns);
+        rc = ns->sync_rc;
+    }
+
+    ns->sync_busy = false;
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+ * BlockDevice operations
+ * -------------------------------------------------------------------------- */
+
+static int nvme_block_io(BlockDevice *dev, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !dev->ctx || !buffer)
+        return BLOCK_ERROR;
+
+    NvmeNamespace *ns = (NvmeNamespace *)dev->ctx;
+    if (lba >= dev->sector_count || count > dev->sector_count - lba)
+        return BLOCK_ERROR;
+
+    while (count > 0u)
+    {
+        uint32_t n = (count > dev->max_sectors) ? dev->max_sectors : count;
+
+        if (nvme_sync_cmd(ns, op, lba, n, buffer) != NVME_OK)
+            return BLOCK_ERROR;
+
+        lba += n;
+        count -= n;
+        buffer += n * NVME_SECTOR_SIZE;
+    }
+
+    return BLOCK_SUCCESS;
+}
+
+static int nvme_block_read(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return nvme_block_io(dev, BLOCK_OP_READ, lba, 1u, buffer);
+}
+
+static int nvme_block_write(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return nvme_block_io(dev, BLOCK_OP_WRITE, lba, 1u, buffer);
+}
+
+static int nvme_block_read_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return nvme_block_io(dev, BLOCK_OP_READ, lba, count, buffer);
+}
+
+static int nvme_block_write_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return nvme_block_io(dev, BLOCK_OP_WRITE, lba, count, buffer);
+}
+
+static int nvme_block_flush(BlockDevice *dev)
+{
+    if (!dev || !dev->ctx)
+        return BLOCK_ERROR;
+
+    NvmeNamespace *ns = (NvmeNamespace *)dev->ctx;
+
+    /* Without a volatile write cache, completed writes are already durable. */
+    if (!ns->ctrl->info.write_cache)
+        return BLOCK_SUCCESS;
+
+    return (nvme_sync_cmd(ns, BLOCK_OP_FLUSH, 0u, 0u, 0) == NVME_OK) ? BLOCK_SUCCESS : BLOCK_ERROR;
+}
+
+/* Called by the block queue with interrupts disabled; the doorbell waits for commit. */
+static int nvme_block_submit(BlockDevice *dev, uint32_t tag, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !dev->ctx)
+        return BLOCK_ERROR;
+
+    NvmeNamespace *ns = (NvmeNamespace *)dev->ctx;
+
+    if (tag >= ns->info.queue_depth)
+        return BLOCK_ERROR;
+    if (op != BLOCK_OP_FLUSH && (!buffer || lba >= dev->sector_count || count > dev->sector_count - lba))
+        return BLOCK_ERROR;
+
+    if (ns->sync_busy || (ns->outstanding & (1u << tag)))
+        return BLOCK_BUSY;
+
+    return nvme_post(ns, tag, op, lba, count, buffer);
+}
+
+/* End of a dispatch pass: one doorbell write per queue for everything posted. */
+static void nvme_block_commit(BlockDevice *dev)
+{
+    if (dev && dev->ctx)
+        nvme_ring_all(((NvmeNamespace *)dev->ctx)->ctrl);
+}
+
+/* Hybrid polling: check the completion queues once, never sleep. */
+static void nvme_block_reap(BlockDevice *dev)
+{
+    if (!dev || !dev->ctx)
+        return;
+
+    uint32_t flags = cpu_irq_save();
+    (void)nvme_reap(((NvmeNamespace *)dev->ctx)->ctrl);
+    cpu_irq_restore(flags);
+}
+
+static void nvme_block_poll(BlockDevice *dev)
+{
+    if (dev && dev->ctx)
+        nvme_wait_event((NvmeNamespace *)dev->ctx);
+}
+
+/* --------------------------------------------------------------------------
+ * Interrupts
+ * -------------------------------------------------------------------------- */
+
+/*
+ * One handler per controller (ctx); the INTx line may be shared. INTx only
+ * drops once the CQ heads pass every entry, so the handler masks the vector
+ * (INTMS) and leaves reaping to the block softirq, which unmasks it again.
+ */
+static int nvme_irq(uint8_t irq, void *ctx)
+{
+    NvmeController *c = (NvmeController *)ctx;
+    bool ready = false;
+    (void)irq;
+
+    for (uint32_t i = 0; i < c->info.io_queues && !ready; i++)
+        ready = nvme_queue_ready(&c->io[i]);
+
+    if (!ready)
+        return IRQ_NONE;
+
+    nvme_write(c, NVME_REG_INTMS, NVME_INT_VECTOR0);
+    c->info.irqs++;
+    softirq_queue(SOFTIRQ_BLOCK, &c->work);
+    return IRQ_HANDLED;
+}
+
+static void nvme_softirq(void *arg)
+{
+    NvmeController *c = (NvmeController *)arg;
+
+    (void)nvme_reap(c);
+    wait_queue_wake_all(&c->waiters);
+
+    /* nvme_set_irq_mode() runs with interrupts off: no race on the flag. */
+    if (g_nvme_irq_mode)
+        nvme_write(c, NVME_REG_INTMC, NVME_INT_VECTOR0);
+}
+
+void nvme_set_irq_mode(bool enabled)
+{
+    uint32_t flags = cpu_irq_save();
+
+    g_nvme_irq_mode = enabled;
+    for (uint32_t i = 0; i < g_nvme_count; i++)
+    {
+        NvmeController *c = &g_nvme[i];
+        if (c->info.namespaces == 0u)
+            continue;
+
+        bool irq = enabled && c->info.irq_line < 16u;
+
+        nvme_write(c, irq ? NVME_REG_INTMC : NVME_REG_INTMS, NVME_INT_VECTOR0);
+    }
+
+    cpu_irq_restore(flags);
+}
+
+/* --------------------------------------------------------------------------
+ * Discovery
+ * -------------------------------------------------------------------------- */
+
+/* Copy a space-padded identify string and trim it. */
+static void nvme_copy_string(char *dst, const uint8_t *src, uint32_t len)
+{
+    memcpy(dst, src, len);
+
+    int end = (int)len;
+    while (end > 0 && (dst[end - 1] == ' ' || dst[end - 1] == '\0'))
+        end--;
+    dst[end] = '\0';
+}
+
+/* "nvme<C>n<NSID>" */
+static void nvme_name(char *out, uint32_t ctrl, uint32_t nsid)
+{
+    char digits[10];
+    uint32_t n = 0u;
+    uint32_t pos = 0u;
+
+    memcpy(out, "nvme", 4u);
+    pos = 4u;
+    out[pos++] = (char)('0' + (char)ctrl);
+    out[pos++] = 'n';
+
+    do
+    {
+        digits[n++] = (char)('0' + (char)(nsid % 10u));
+        nsid /= 10u;
+    } while (nsid != 0u);
+
+    while (n > 0u)
+        out[pos++] = digits[--n];
+    out[pos] = '\0';
+}
+
+/* Identify namespace `nsid` and register it if it is active with 512-byte LBAs. */
+static void nvme_namespace_init(NvmeController *c, uint32_t nsid)
+{
+    if (nvme_identify(c, NVME_IDENTIFY_NAMESPACE, nsid) != NVME_OK)
+        return;
+
+    uint64_t nsze;
+    memcpy(&nsze, c->ident + NVME_IDNS_NSZE, sizeof(nsze));
+    if (nsze == 0u)
+        return;     /* Inactive */
+
+    uint32_t lbaf;
+    uint32_t format = c->ident[NVME_IDNS_FLBAS] & 0x0Fu;
+    memcpy(&lbaf, c->ident + NVME_IDNS_LBAF + (format * 4u), sizeof(lbaf));
+
+    /* The block layer, MBR and filesystems assume 512-byte sectors. */
+    if (((lbaf >> 16) & 0xFFu) != 9u)
+        return;
+
+    uint32_t slot = c->info.namespaces;
+    NvmeNamespace *ns = &c->ns[slot];
+    memset(ns, 0, sizeof(*ns));
+
+    uint32_t prp_bytes = BLOCK_QUEUE_MAX_TAGS * NVME_PRP_LIST_ENTRIES * sizeof(uint64_t);
+    ns->prp = (uint64_t *)pmm_alloc_pages_low((prp_bytes + PMM_PAGE_SIZE - 1u) / PMM_PAGE_SIZE, NVME_LOWMEM_LIMIT);
+    if (!ns->prp)
+        return;
+
+    uint32_t depth = c->info.queue_size - 1u;
+    if (depth > BLOCK_QUEUE_MAX_TAGS)
+        depth = BLOCK_QUEUE_MAX_TAGS;
+
+    ns->ctrl = c;
+    ns->slot = slot;
+    ns->info.nsid = nsid;
+    ns->info.sectors = nsze;
+    ns->info.queue_depth = depth;
+
+    BlockDevice *dev = &ns->dev;
+    nvme_name(dev->name, (uint32_t)(c - g_nvme), nsid);
+    dev->sector_size = NVME_SECTOR_SIZE;
+    dev->sector_count = (nsze > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)nsze;
+    dev->max_sectors = c->info.max_sectors;
+    dev->queue_depth = depth;
+    dev->ctx = ns;
+    dev->read = nvme_block_read;
+    dev->write = nvme_block_write;
+    dev->read_sectors = nvme_block_read_sectors;
+    dev->write_sectors = nvme_block_write_sectors;
+    dev->submit = nvme_block_submit;
+    dev->commit = nvme_block_commit;
+    dev->reap = nvme_block_reap;
+    dev->poll = nvme_block_poll;
+    dev->flush = nvme_block_flush;
+    dev->write_cache = c->info.write_cache;
+    dev->fua = true;
+
+    if (block_register(dev) == BLOCK_SUCCESS)
+        c->info.namespaces++;
+}
+
+static int nvme_controller_init(NvmeController *c, PciDevice *pci)
+{
+    memset(c, 0, sizeof(*c));
+
+    uint32_t bar = pci_bar_address(pci, NVME_PCI_BAR);
+    if (!bar || pci_bar_is_io(pci, NVME_PCI_BAR))
+        return NVME_ERR_NO_DEVICE;
+
+    c->regs = (volatile uint8_t *)vmm_map_mmio(bar, NVME_MMIO_SIZE);
+    if (!c->regs)
+        return NVME_ERR_NO_MEMORY;
+
+    pci_enable(pci, PCI_CMD_MEM_SPACE | PCI_CMD_BUS_MASTER);
+
+    uint32_t cap_lo = nvme_read(c, NVME_REG_CAP);
+    uint32_t cap_hi = nvme_read(c, NVME_REG_CAP + 4u);
+    uint32_t dstrd = cap_hi & NVME_CAP_HI_DSTRD_MASK;
+
+    /* 4 KiB memory pages and the NVM command set. */
+    if (((cap_hi >> NVME_CAP_HI_MPSMIN_SHIFT) & NVME_CAP_HI_MPSMIN_MASK) != 0u
+        || !(cap_hi & NVME_CAP_HI_CSS_NVM) || dstrd > NVME_MAX_DSTRD)
+        return NVME_ERR_NO_DEVICE;
+
+    c->db_stride = 4u << dstrd;
+    c->info.version = nvme_read(c, NVME_REG_VS);
+    c->info.irq_line = pci->irq_line;
+
+    uint32_t mqes = (cap_lo & NVME_CAP_MQES_MASK) + 1u;
+    uint32_t admin_size = (mqes < NVME_ADMIN_QUEUE_SIZE) ? mqes : NVME_ADMIN_QUEUE_SIZE;
+    uint32_t io_size = (mqes < NVME_IO_QUEUE_SIZE) ? mqes : NVME_IO_QUEUE_SIZE;
+
+    /* Reset, then bring up the admin queue pair. */
+    if (nvme_read(c, NVME_REG_CC) & NVME_CC_EN)
+    {
+        nvme_write(c, NVME_REG_CC, 0u);
+        if (!nvme_wait_ready(c, false))
+            return NVME_ERR_TIMEOUT;
+    }
+
+    c->ident = (uint8_t *)pmm_alloc_page_low(NVME_LOWMEM_LIMIT);
+    if (!c->ident || !nvme_queue_alloc(c, &c->admin, 0u, (uint16_t)admin_size))
+        return NVME_ERR_NO_MEMORY;
+
+    nvme_write(c, NVME_REG_AQA, ((admin_size - 1u) << 16) | (admin_size - 1u));
+    nvme_write64(c, NVME_REG_ASQ, (uint32_t)(uintptr_t)c->admin.sq);
+    nvme_write64(c, NVME_REG_ACQ, (uint32_t)(uintptr_t)c->admin.cq);
+
+    /* Polled until nvme_set_irq_mode(true). */
+    nvme_write(c, NVME_REG_INTMS, NVME_INT_VECTOR0);
+    nvme_write(c, NVME_REG_CC, NVME_CC_EN | NVME_CC_IOSQES | NVME_CC_IOCQES);
+    if (!nvme_wait_ready(c, true))
+        return NVME_ERR_TIMEOUT;
+
+    if (nvme_identify(c, NVME_IDENTIFY_CONTROLLER, 0u) != NVME_OK)
+        return NVME_ERR_DEVICE;
+
+    nvme_copy_string(c->info.serial, c->ident + NVME_IDCTL_SERIAL, 20u);
+    nvme_copy_string(c->info.model, c->ident + NVME_IDCTL_MODEL, 40u);
+    c->info.write_cache = (c->ident[NVME_IDCTL_VWC] & 0x01u) != 0u;
+
+    uint32_t nn;
+    memcpy(&nn, c->ident + NVME_IDCTL_NN, sizeof(nn));
+
+    /* MDTS is in units of the minimum page size (4 KiB = 8 sectors). */
+    uint32_t mdts = c->ident[NVME_IDCTL_MDTS];
+    c->info.max_sectors = NVME_MAX_SECTORS_PER_CMD;
+    if (mdts != 0u && mdts < 16u && (8u << mdts) < c->info.max_sectors)
+        c->info.max_sectors = 8u << mdts;
+
+    /* Ask for one I/O queue pair per CPU we may bring up; take what is granted. */
+    NvmeCommand cmd;
+    uint32_t granted = 0u;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode = NVME_ADMIN_SET_FEATURES;
+    cmd.cdw10 = NVME_FEAT_NUM_QUEUES;
+    cmd.cdw11 = ((NVME_MAX_IO_QUEUES - 1u) << 16) | (NVME_MAX_IO_QUEUES - 1u);
+    if (nvme_admin_cmd(c, &cmd, &granted) != NVME_OK)
+        return NVME_ERR_DEVICE;
+
+    uint32_t pairs = NVME_MAX_IO_QUEUES;
+    if ((granted & 0xFFFFu) + 1u < pairs)
+        pairs = (granted & 0xFFFFu) + 1u;
+    if ((granted >> 16) + 1u < pairs)
+        pairs = (granted >> 16) + 1u;
+
+    c->info.queue_size = io_size;
+    for (uint32_t i = 0; i < pairs; i++)
+    {
+        NvmeQueue *q = &c->io[i];
+        if (!nvme_queue_alloc(c, q, (uint16_t)(i + 1u), (uint16_t)io_size))
+            break;
+        if (nvme_create_io_queue(c, q) != NVME_OK)
+            break;
+        c->info.io_queues++;
+    }
+
+    if (c->info.io_queues == 0u)
+        return NVME_ERR_DEVICE;
+
+    /* Namespace IDs are usually dense from 1: stop after a bounded scan. */
+    for (uint32_t nsid = 1u; nsid <= nn && nsid <= 32u && c->info.namespaces < NVME_MAX_NAMESPACES; nsid++)
+        nvme_namespace_init(c, nsid);
+
+    return (c->info.namespaces > 0u) ? NVME_OK : NVME_ERR_NO_DEVICE;
+}
+
+int nvme_register_devices(void)
+{
+    uint32_t n = pci_count();
+    uint32_t namespaces = 0u;
+
+    for (uint32_t i = 0; i < n && g_nvme_count < NVME_MAX_CONTROLLERS; i++)
+    {
+        PciDevice *pci = pci_get(i);
+        if (!pci || pci->class_code != PCI_CLASS_STORAGE || pci->subclass != NVME_PCI_SUBCLASS
+            || pci->prog_if != NVME_PCI_PROG_IF)
+            continue;
+
+        /* A controller that failed part-way keeps its slot so names stay stable. */
+        NvmeController *c = &g_nvme[g_nvme_count++];
+        (void)nvme_controller_init(c, pci);
+        namespaces += c->info.namespaces;
+
+        c->work.fn = nvme_softirq;
+        c->work.arg = c;
+
+        /* Labelled by its first namespace (slots fill in order). */
+        if (c->info.namespaces > 0u && c->info.irq_line < 16u)
+            irq_register(c->info.irq_line, nvme_irq, c, c->ns[0].dev.name);
+    }
+
+    return (namespaces > 0u) ? NVME_OK : NVME_ERR_NO_DEVICE;
+}
+
+uint32_t nvme_controller_count(void)
+{
+    return g_nvme_count;
+}
+
+const NvmeControllerInfo *nvme_controller_info(uint32_t ctrl)
+{
+    return (ctrl < g_nvme_count) ? &g_nvme[ctrl].info : 0;
+}
+
+const NvmeNamespaceInfo *nvme_namespace_info(uint32_t ctrl, uint32_t index)
+{
+    if (ctrl >= g_nvme_count || index >= g_nvme[ctrl].info.namespaces)
+        return 0;
+
+    return &g_nvme[ctrl].ns[index].info;
+}
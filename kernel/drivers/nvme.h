@@ -0,0 +1,167 @@
+#ifndef NVME_H
+#define NVME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * NVMe (PCIe SSD) controller driver.
+ *
+ * Controllers are found on the PCI bus (class 01h, subclass 08h, prog_if 02h)
+ * and driven through BAR0: an admin queue pair for bring-up and identify,
+ * then up to NVME_MAX_IO_QUEUES I/O queue pairs. Each active namespace with
+ * 512-byte LBAs is registered as block device "nvme<C>n<NSID>".
+ *
+ * Block queue tags become command identifiers, so up to
+ * BlockDevice.queue_depth commands per namespace are outstanding. Commands
+ * started in one dispatch pass share a single submission doorbell write
+ * (BlockDevice.commit). Transfers are described with PRP entries, using a
+ * per-tag PRP list once they span more than two pages.
+ */
+
+/* --------------------------------------------------------------------------
+ * PCI identification
+ * -------------------------------------------------------------------------- */
+#define NVME_PCI_SUBCLASS       0x08u
+#define NVME_PCI_PROG_IF        0x02u
+#define NVME_PCI_BAR            0u
+
+/* --------------------------------------------------------------------------
+ * Controller registers (offsets into BAR0)
+ * -------------------------------------------------------------------------- */
+#define NVME_REG_CAP            0x00u   /* 64-bit */
+#define NVME_REG_VS             0x08u
+#define NVME_REG_INTMS          0x0Cu
+#define NVME_REG_INTMC          0x10u
+#define NVME_REG_CC             0x14u
+#define NVME_REG_CSTS           0x1Cu
+#define NVME_REG_AQA            0x24u
+#define NVME_REG_ASQ            0x28u   /* 64-bit */
+#define NVME_REG_ACQ            0x30u   /* 64-bit */
+#define NVME_REG_DOORBELL       0x1000u
+
+/* CAP (low dword / high dword) */
+#define NVME_CAP_MQES_MASK      0xFFFFu         /* Max queue entries - 1 */
+#define NVME_CAP_HI_DSTRD_MASK  0x0Fu           /* Doorbell stride: 4 << DSTRD */
+#define NVME_CAP_HI_CSS_NVM     (1u << 5)       /* Bit 37 */
+#define NVME_CAP_HI_MPSMIN_SHIFT 16u            /* Bits 51:48 */
+#define NVME_CAP_HI_MPSMIN_MASK 0x0Fu
+
+/* CC */
+#define NVME_CC_EN              (1u << 0)
+#define NVME_CC_IOSQES          (6u << 16)      /* 64-byte submission entries */
+#define NVME_CC_IOCQES          (4u << 20)      /* 16-byte completion entries */
+
+/* CSTS */
+#define NVME_CSTS_RDY           (1u << 0)
+#define NVME_CSTS_CFS           (1u << 1)
+
+/* With INTx every completion queue signals on interrupt vector 0. */
+#define NVME_INT_VECTOR0        (1u << 0)
+
+/* --------------------------------------------------------------------------
+ * Commands
+ * -------------------------------------------------------------------------- */
+
+/* Admin opcodes */
+#define NVME_ADMIN_CREATE_SQ    0x01u
+#define NVME_ADMIN_CREATE_CQ    0x05u
+#define NVME_ADMIN_IDENTIFY     0x06u
+#define NVME_ADMIN_SET_FEATURES 0x09u
+
+/* I/O opcodes (NVM command set) */
+#define NVME_CMD_FLUSH          0x00u
+#define NVME_CMD_WRITE          0x01u
+#define NVME_CMD_READ           0x02u
+
+/* Identify CNS values */
+#define NVME_IDENTIFY_NAMESPACE 0x00u
+#define NVME_IDENTIFY_CONTROLLER 0x01u
+
+/* Features */
+#define NVME_FEAT_NUM_QUEUES    0x07u
+
+/* Read/write CDW12 */
+#define NVME_RW_FUA             (1u << 30)      /* Force unit access: write through the cache */
+
+/* Create I/O queue flags (CDW11) */
+#define NVME_QUEUE_CONTIGUOUS   (1u << 0)
+#define NVME_CQ_IRQ_ENABLED     (1u << 1)
+
+/* Identify controller layout (byte offsets) */
+#define NVME_IDCTL_SERIAL       4u      /* 20 bytes, space padded */
+#define NVME_IDCTL_MODEL        24u     /* 40 bytes */
+#define NVME_IDCTL_MDTS         77u     /* Max transfer: 2^MDTS pages (0 = none) */
+#define NVME_IDCTL_NN           516u    /* Number of namespaces */
+#define NVME_IDCTL_VWC          525u    /* Bit 0: volatile write cache */
+
+/* Identify namespace layout (byte offsets) */
+#define NVME_IDNS_NSZE          0u      /* 64-bit size in logical blocks */
+#define NVME_IDNS_FLBAS         26u     /* Bits 3:0: LBA format in use */
+#define NVME_IDNS_LBAF          128u    /* 4-byte formats; bits 23:16 = LBADS */
+
+/* Completion status field (status >> 1): SC | SCT << 8 */
+#define NVME_STATUS_PHASE       0x0001u
+
+/* --------------------------------------------------------------------------
+ * Driver limits
+ * -------------------------------------------------------------------------- */
+#define NVME_MAX_CONTROLLERS    2u
+#define NVME_MAX_NAMESPACES     4u      /* Per controller */
+#define NVME_MAX_IO_QUEUES      4u      /* Queue pairs per controller (one per CPU) */
+#define NVME_ADMIN_QUEUE_SIZE   32u
+#define NVME_IO_QUEUE_SIZE      64u     /* Submission queue = one page */
+#define NVME_PAGE_SIZE          4096u
+#define NVME_SECTOR_SIZE        512u
+#define NVME_MAX_SECTORS_PER_CMD 256u   /* 128 KiB: PRP1 + at most 32 list entries */
+#define NVME_PRP_LIST_ENTRIES   32u
+
+/* Return codes (0 = success) */
+#define NVME_OK                 0
+#define NVME_ERR_NO_DEVICE      1
+#define NVME_ERR_TIMEOUT        2
+#define NVME_ERR_DEVICE         3
+#define NVME_ERR_NO_MEMORY      4
+#define NVME_ERR_INVALID        5
+
+typedef struct
+{
+    char model[41];
+    char serial[21];
+    uint32_t version;           /* VS register */
+    uint32_t io_queues;         /* I/O queue pairs created */
+    uint32_t queue_size;        /* Entries per I/O queue */
+    uint32_t max_sectors;       /* Per command (MDTS and driver limit) */
+    bool write_cache;
+    uint8_t irq_line;
+    uint32_t namespaces;        /* Registered namespaces */
+    uint32_t commands;          /* I/O commands submitted */
+    uint32_t doorbells;         /* I/O submission doorbell writes */
+    uint32_t irqs;
+} NvmeControllerInfo;
+
+typedef struct
+{
+    uint32_t nsid;
+    uint64_t sectors;
+    uint32_t queue_depth;       /* Tags usable by the block queue */
+    uint32_t requests;
+    uint32_t max_outstanding;
+    uint32_t errors;
+} NvmeNamespaceInfo;
+
+/*
+ * Probe every NVMe controller, bring up its queues, register its
+ * namespaces as block devices and attach its IRQ handler. Returns NVME_OK, or NVME_ERR_NO_DEVICE if no
+ * namespace could be registered.
+ */
+int nvme_register_devices(void);
+
+uint32_t nvme_controller_count(void);
+const NvmeControllerInfo *nvme_controller_info(uint32_t ctrl);
+const NvmeNamespaceInfo *nvme_namespace_info(uint32_t ctrl, uint32_t index);
+
+/* Interrupt mode: waiters sleep until the controller interrupts (else they poll). */
+void nvme_set_irq_mode(bool enabled);
+
+#endif /* NVME_H */
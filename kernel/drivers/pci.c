@@ -0,0 +1,202 @@
+#include "pci.h"
+
+#include "io.h"
+#include "string.h"
+
+static PciDevice g_pci_devices[PCI_MAX_DEVICES];
+static uint32_t g_pci_count = 0u;
+
+static uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset)
+{
+    return 0x80000000u
+        | ((uint32_t)bus << 16)
+        | ((uint32_t)(slot & 0x1Fu) << 11)
+        | ((uint32_t)(func & 0x07u) << 8)
+        | ((uint32_t)offset & 0xFCu);
+}
+
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_config_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset)
+{
+    uint32_t v = pci_config_read32(bus, slot, func, offset);
+    return (uint16_t)(v >> ((offset & 2u) * 8u));
+}
+
+uint8_t pci_config_read8(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset)
+{
+    uint32_t v = pci_config_read32(bus, slot, func, offset);
+    return (uint8_t)(v >> ((offset & 3u) * 8u));
+}
+
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+void pci_config_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t value)
+{
+    uint32_t shift = (offset & 2u) * 8u;
+    uint32_t v = pci_config_read32(bus, slot, func, offset);
+
+    v &= ~(0xFFFFu << shift);
+    v |= (uint32_t)value << shift;
+    pci_config_write32(bus, slot, func, offset, v);
+}
+
+static int pci_record(uint8_t bus, uint8_t slot, uint8_t func)
+{
+    if (g_pci_count >= PCI_MAX_DEVICES)
+        return PCI_ERR_FULL;
+
+    PciDevice *dev = &g_pci_devices[g_pci_count];
+    memset(dev, 0, sizeof(*dev));
+
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    dev->vendor_id = pci_config_read16(bus, slot, func, PCI_VENDOR_ID);
+    dev->device_id = pci_config_read16(bus, slot, func, PCI_DEVICE_ID);
+    dev->revision = pci_config_read8(bus, slot, func, PCI_REVISION_ID);
+    dev->prog_if = pci_config_read8(bus, slot, func, PCI_PROG_IF);
+    dev->subclass = pci_config_read8(bus, slot, func, PCI_SUBCLASS);
+    dev->class_code = pci_config_read8(bus, slot, func, PCI_CLASS);
+    dev->header_type = pci_config_read8(bus, slot, func, PCI_HEADER_TYPE);
+    dev->irq_line = pci_config_read8(bus, slot, func, PCI_INTERRUPT_LINE);
+
+    /* BARs only exist in type 0 (endpoint) headers. */
+    if ((dev->header_type & 0x7Fu) == 0u)
+    {
+        for (uint32_t b = 0; b < PCI_BAR_COUNT; b++)
+            dev->bar[b] = pci_config_read32(bus, slot, func, (uint8_t)(PCI_BAR0 + (b * 4u)));
+    }
+
+    g_pci_count++;
+    return PCI_OK;
+}
+
+int pci_init(void)
+{
+    int rc = PCI_OK;
+
+    g_pci_count = 0u;
+
+    /* Brute-force scan: small enough (8192 slots) and needs no bridge walking. */
+    for (uint32_t bus = 0; bus < 256u; bus++)
+    {
+        for (uint8_t slot = 0; slot < 32u; slot++)
+        {
+            if (pci_config_read16((uint8_t)bus, slot, 0u, PCI_VENDOR_ID) == PCI_VENDOR_NONE)
+                continue;
+
+            uint8_t header = pci_config_read8((uint8_t)bus, slot, 0u, PCI_HEADER_TYPE);
+            uint8_t funcs = (header & PCI_HEADER_MULTIFUNC) ? 8u : 1u;
+
+            for (uint8_t func = 0; func < funcs; func++)
+            {
+                if (pci_config_read16((uint8_t)bus, slot, func, PCI_VENDOR_ID) == PCI_VENDOR_NONE)
+                    continue;
+
+                if (pci_record((uint8_t)bus, slot, func) != PCI_OK)
+                    rc = PCI_ERR_FULL;
+            }
+        }
+    }
+
+    return rc;
+}
+
+uint32_t pci_count(void)
+{
+    return g_pci_count;
+}
+
+PciDevice *pci_get(uint32_t index)
+{
+    if (index >= g_pci_count)
+        return 0;
+
+    return &g_pci_devices[index];
+}
+
+PciDevice *pci_find_class(uint8_t class_code, uint8_t subclass, uint8_t prog_if)
+{
+    for (uint32_t i = 0; i < g_pci_count; i++)
+    {
+        PciDevice *dev = &g_pci_devices[i];
+
+        if (dev->class_code != class_code || dev->subclass != subclass)
+            continue;
+
+        if (prog_if != 0xFFu && dev->prog_if != prog_if)
+            continue;
+
+        return dev;
+    }
+
+    return 0;
+}
+
+void pci_enable(PciDevice *dev, uint16_t command_bits)
+{
+    if (!dev)
+        return;
+
+    uint16_t cmd = pci_config_read16(dev->bus, dev->slot, dev->func, PCI_COMMAND);
+    pci_config_write16(dev->bus, dev->slot, dev->func, PCI_COMMAND, (uint16_t)(cmd | command_bits));
+}
+
+bool pci_bar_is_io(const PciDevice *dev, uint32_t bar)
+{
+    if (!dev || bar >= PCI_BAR_COUNT)
+        return false;
+
+    return (dev->bar[bar] & PCI_BAR_IO) != 0u;
+}
+
+uint32_t pci_bar_address(const PciDevice *dev, uint32_t bar)
+{
+    if (!dev || bar >= PCI_BAR_COUNT)
+        return 0u;
+
+    if (dev->bar[bar] & PCI_BAR_IO)
+        return dev->bar[bar] & 0xFFFFFFFCu;
+
+    /* The upper half of a 64-bit BAR lives in the next slot. */
+    if ((dev->bar[bar] & PCI_BAR_TYPE_MASK) == PCI_BAR_TYPE_64 && bar + 1u < PCI_BAR_COUNT && dev->bar[bar + 1u] != 0u)
+        return 0u;
+
+    return dev->bar[bar] & 0xFFFFFFF0u;
+}
+
+uint8_t pci_find_capability(const PciDevice *dev, uint8_t cap_id, uint8_t after)
+{
+    if (!dev)
+        return 0u;
+
+    if (!(pci_config_read16(dev->bus, dev->slot, dev->func, PCI_STATUS) & PCI_STATUS_CAP_LIST))
+        return 0u;
+
+    uint8_t ptr;
+    if (after == 0u)
+        ptr = pci_config_read8(dev->bus, dev->slot, dev->func, PCI_CAPABILITY_LIST);
+    else
+        ptr = pci_config_read8(dev->bus, dev->slot, dev->func, (uint8_t)(after + 1u));
+
+    /* Bounded walk: a malformed list must not loop forever. */
+    for (uint32_t i = 0; i < 48u && ptr >= 0x40u; i++)
+    {
+        ptr &= 0xFCu;
+        if (pci_config_read8(dev->bus, dev->slot, dev->func, ptr) == cap_id)
+            return ptr;
+
+        ptr = pci_config_read8(dev->bus, dev->slot, dev->func, (uint8_t)(ptr + 1u));
+    }
+
+    return 0u;
+}
@@ -0,0 +1,104 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* --------------------------------------------------------------------------
+ * PCI configuration mechanism #1 (I/O ports)
+ * -------------------------------------------------------------------------- */
+#define PCI_CONFIG_ADDRESS  0xCF8u
+#define PCI_CONFIG_DATA     0xCFCu
+
+/* Configuration space header (type 0) offsets */
+#define PCI_VENDOR_ID       0x00u
+#define PCI_DEVICE_ID       0x02u
+#define PCI_COMMAND         0x04u
+#define PCI_STATUS          0x06u
+#define PCI_REVISION_ID     0x08u
+#define PCI_PROG_IF         0x09u
+#define PCI_SUBCLASS        0x0Au
+#define PCI_CLASS           0x0Bu
+#define PCI_HEADER_TYPE     0x0Eu
+#define PCI_BAR0            0x10u
+#define PCI_CAPABILITY_LIST 0x34u
+#define PCI_INTERRUPT_LINE  0x3Cu
+
+/* Command register bits */
+#define PCI_CMD_IO_SPACE    0x0001u
+#define PCI_CMD_MEM_SPACE   0x0002u
+#define PCI_CMD_BUS_MASTER  0x0004u
+
+/* Status register bits */
+#define PCI_STATUS_CAP_LIST 0x0010u
+
+/* Capability IDs */
+#define PCI_CAP_ID_VENDOR   0x09u
+
+#define PCI_HEADER_MULTIFUNC 0x80u
+#define PCI_BAR_IO           0x01u
+#define PCI_BAR_TYPE_MASK    0x06u
+#define PCI_BAR_TYPE_64      0x04u
+#define PCI_VENDOR_NONE      0xFFFFu
+
+/* Class codes used by drivers */
+#define PCI_CLASS_STORAGE       0x01u
+#define PCI_SUBCLASS_IDE        0x01u
+
+/* Limits */
+#define PCI_MAX_DEVICES     32u
+#define PCI_BAR_COUNT       6u
+
+/* Return codes (0 = success) */
+#define PCI_OK              0
+#define PCI_ERR_NOT_FOUND   1
+#define PCI_ERR_FULL        2
+
+typedef struct
+{
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint8_t header_type;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    uint8_t irq_line;
+    uint32_t bar[PCI_BAR_COUNT];
+} PciDevice;
+
+/* Scan every bus/slot/function and record the functions found.
+ * Returns PCI_OK, or PCI_ERR_FULL if the table overflowed. */
+int pci_init(void);
+
+uint32_t pci_count(void);
+PciDevice *pci_get(uint32_t index);
+
+/* First function matching class/subclass (prog_if 0xFF = any), or 0. */
+PciDevice *pci_find_class(uint8_t class_code, uint8_t subclass, uint8_t prog_if);
+
+/* Raw configuration space access (offset is aligned down as needed). */
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+uint16_t pci_config_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+uint8_t pci_config_read8(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value);
+void pci_config_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t value);
+
+/* Set Command register bits (e.g. PCI_CMD_BUS_MASTER). */
+void pci_enable(PciDevice *dev, uint16_t command_bits);
+
+/* BAR decoding: I/O BARs give a port, memory BARs a 32-bit physical address
+ * (0 for a 64-bit BAR placed above 4 GiB). */
+bool pci_bar_is_io(const PciDevice *dev, uint32_t bar);
+uint32_t pci_bar_address(const PciDevice *dev, uint32_t bar);
+
+/*
+ * Walk the capability list: offset of the first capability with `cap_id`
+ * after offset `after` (0 = from the start), or 0 if there is none.
+ */
+uint8_t pci_find_capability(const PciDevice *dev, uint8_t cap_id, uint8_t after);
+
+#endif /* PCI_H */
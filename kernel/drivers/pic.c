@@ -13,6 +13,7 @@
 #define ICW4_8086    0x01
 
 #define PIC_EOI      0x20
+#define PIC_READ_ISR 0x0B // OCW3: next command-port read returns the ISR
 
 // Remap the PICs to 0x20 (32) and 0x28 (40)
 void pic_remap(void) {
@@ -62,6 +63,14 @@ void pic_send_eoi(uint8_t irq)
     outb(PIC1_COMMAND, PIC_EOI);
 }
 
+// In-service register of both PICs (bit N = IRQ N being serviced)
+uint16_t pic_get_isr(void)
+{
+    outb(PIC1_COMMAND, PIC_READ_ISR);
+    outb(PIC2_COMMAND, PIC_READ_ISR);
+    return (uint16_t)inb(PIC1_COMMAND) | ((uint16_t)inb(PIC2_COMMAND) << 8);
+}
+
 // Disable all interrupts
 uint16_t pic_get_mask(void)
 {
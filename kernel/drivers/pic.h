@@ -6,6 +6,9 @@
 void pic_remap(void);
 void pic_send_eoi(uint8_t irq);
 
+/* In-service register (bit N = IRQ N); tells real IRQ7/15 from spurious ones. */
+uint16_t pic_get_isr(void);
+
 /* Mask control (IRQ 0-15). Mask bit = 1 disables the IRQ line. */
 uint16_t pic_get_mask(void);
 void pic_set_mask(uint8_t irq);
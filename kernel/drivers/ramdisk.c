@@ -0,0 +1,131 @@
+#include "ramdisk.h"
+
+#include "block.h"
+#include "pmm.h"
+#include "string.h"
+#include "vmm.h"
+
+typedef struct
+{
+    uint8_t *base;      /* Virtual address of sector 0. */
+    uint32_t sectors;
+} RamdiskCtx;
+
+static BlockDevice g_ram_dev[RAMDISK_MAX_DISKS];
+static RamdiskCtx g_ram_ctx[RAMDISK_MAX_DISKS];
+static uint32_t g_ram_count = 0u;
+
+/* Bounds check shared by all ops; returns the byte address of `lba`. */
+static uint8_t *ramdisk_sector_ptr(BlockDevice *dev, uint32_t lba, uint32_t count)
+{
+    if (!dev || !dev->ctx || count == 0u)
+        return 0;
+
+    RamdiskCtx *ctx = (RamdiskCtx *)dev->ctx;
+
+    if (lba >= ctx->sectors || count > ctx->sectors - lba)
+        return 0;
+
+    return ctx->base + (lba * RAMDISK_SECTOR_SIZE);
+}
+
+static int ramdisk_read_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    uint8_t *src = ramdisk_sector_ptr(dev, lba, count);
+    if (!src || !buffer)
+        return BLOCK_ERROR;
+
+    memcpy(buffer, src, count * RAMDISK_SECTOR_SIZE);
+    return BLOCK_SUCCESS;
+}
+
+static int ramdisk_write_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    uint8_t *dst = ramdisk_sector_ptr(dev, lba, count);
+    if (!dst || !buffer)
+        return BLOCK_ERROR;
+
+    memcpy(dst, buffer, count * RAMDISK_SECTOR_SIZE);
+    return BLOCK_SUCCESS;
+}
+
+static int ramdisk_read(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return ramdisk_read_sectors(dev, lba, 1u, buffer);
+}
+
+static int ramdisk_write(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return ramdisk_write_sectors(dev, lba, 1u, buffer);
+}
+
+int ramdisk_create(uint32_t sectors)
+{
+    if (sectors == 0u || sectors > RAMDISK_MAX_SECTORS)
+        return RAMDISK_ERR_INVALID;
+
+    if (g_ram_count >= RAMDISK_MAX_DISKS)
+        return RAMDISK_ERR_NO_SLOT;
+
+    uint32_t bytes = sectors * RAMDISK_SECTOR_SIZE;
+    uint32_t pages = (bytes + (PMM_PAGE_SIZE - 1u)) / PMM_PAGE_SIZE;
+
+    /*
+     * Check up front: mapped frames are never unmapped (no vmm_unmap yet), so
+     * a half-built disk would leak its window. Keep a small reserve for page
+     * tables and later allocations.
+     */
+    if (pmm_get_free_memory() / PMM_PAGE_SIZE < pages + 16u)
+        return RAMDISK_ERR_NO_MEMORY;
+
+    uint32_t index = g_ram_count;
+    uint32_t base = RAMDISK_VIRT_BASE + (index * RAMDISK_MAX_BYTES);
+
+    for (uint32_t i = 0; i < pages; i++)
+    {
+        if (!vmm_alloc_page(base + (i * PMM_PAGE_SIZE)))
+            return RAMDISK_ERR_NO_MEMORY;
+    }
+
+    RamdiskCtx *ctx = &g_ram_ctx[index];
+    ctx->base = (uint8_t *)base;
+    ctx->sectors = sectors;
+
+    /* Fresh disks read back as zeros. */
+    memset(ctx->base, 0, pages * PMM_PAGE_SIZE);
+
+    BlockDevice *dev = &g_ram_dev[index];
+    memset(dev, 0, sizeof(BlockDevice));
+
+    dev->name[0] = 'r';
+    dev->name[1] = 'a';
+    dev->name[2] = 'm';
+    dev->name[3] = (char)('0' + (char)index);
+    dev->name[4] = '\0';
+
+    dev->sector_size = RAMDISK_SECTOR_SIZE;
+    dev->sector_count = sectors;
+    dev->ctx = ctx;
+    dev->read = ramdisk_read;
+    dev->write = ramdisk_write;
+    dev->read_sectors = ramdisk_read_sectors;
+    dev->write_sectors = ramdisk_write_sectors;
+
+    if (block_register(dev) != BLOCK_SUCCESS)
+        return RAMDISK_ERR_REGISTER;
+
+    g_ram_count++;
+    return RAMDISK_OK;
+}
+
+int ramdisk_init(uint32_t count, uint32_t sectors)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int rc = ramdisk_create(sectors);
+        if (rc != RAMDISK_OK)
+            return rc;
+    }
+
+    return RAMDISK_OK;
+}
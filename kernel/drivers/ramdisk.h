@@ -0,0 +1,45 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+
+/*
+ * RAM-backed block devices ("ram0".."ramN").
+ *
+ * Each disk is backed by PMM frames mapped into its own virtual window above
+ * the kernel heap, so sector I/O is a plain memcpy. Intended for benchmarking
+ * the block/VFS layers without PIO cost and as fast scratch storage.
+ * Contents are volatile (lost on reboot).
+ */
+
+#define RAMDISK_SECTOR_SIZE     512u
+#define RAMDISK_MAX_DISKS       4u
+
+/* Virtual windows: ram<i> lives at RAMDISK_VIRT_BASE + i * RAMDISK_MAX_BYTES. */
+#define RAMDISK_VIRT_BASE       0xE0000000u
+#define RAMDISK_MAX_BYTES       0x01000000u /* 16 MiB per disk */
+#define RAMDISK_MAX_SECTORS     (RAMDISK_MAX_BYTES / RAMDISK_SECTOR_SIZE)
+
+/* Boot-time configuration (override with make RAMDISK_COUNT=... RAMDISK_SECTORS=...). */
+#ifndef RAMDISK_DEFAULT_COUNT
+#define RAMDISK_DEFAULT_COUNT   1u
+#endif
+
+#ifndef RAMDISK_DEFAULT_SECTORS
+#define RAMDISK_DEFAULT_SECTORS 2048u /* 1 MiB */
+#endif
+
+/* Return codes (0 = success) */
+#define RAMDISK_OK              0
+#define RAMDISK_ERR_INVALID     1
+#define RAMDISK_ERR_NO_MEMORY   2
+#define RAMDISK_ERR_NO_SLOT     3
+#define RAMDISK_ERR_REGISTER    4
+
+/* Create one RAM disk of `sectors` sectors and register it as the next ramN. */
+int ramdisk_create(uint32_t sectors);
+
+/* Create `count` disks of `sectors` each (stops at the first failure). */
+int ramdisk_init(uint32_t count, uint32_t sectors);
+
+#endif /* RAMDISK_H */
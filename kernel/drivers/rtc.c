@@ -50,4 +50,41 @@ void rtc_get_time(DateTime* dt) {
     // Adjust year (CMOS usually stores last 2 digits)
     // We assume 20xx for now.
     dt->year += 2000;
-}
\ No newline at end of file
+}
+
+// Days since 1970-01-01 (proleptic Gregorian; March-based year so the leap
+// day falls at the end).
+static uint32_t days_from_civil(uint32_t y, uint32_t m, uint32_t d) {
+    y -= (m <= 2);
+    uint32_t era = y / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+uint32_t rtc_to_epoch(const DateTime* dt) {
+    uint32_t days = days_from_civil(dt->year, dt->month, dt->day);
+    return days * 86400 + dt->hour * 3600u + dt->minute * 60u + dt->second;
+}
+
+void rtc_from_epoch(uint32_t epoch, DateTime* dt) {
+    uint32_t days = epoch / 86400;
+    uint32_t rem = epoch % 86400;
+
+    dt->hour   = (uint8_t)(rem / 3600);
+    dt->minute = (uint8_t)((rem / 60) % 60);
+    dt->second = (uint8_t)(rem % 60);
+
+    uint32_t z = days + 719468;
+    uint32_t era = z / 146097;
+    uint32_t doe = z - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+
+    dt->day   = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+    dt->month = (uint8_t)m;
+    dt->year  = (uint16_t)(yoe + era * 400 + (m <= 2));
+}
@@ -14,4 +14,9 @@ typedef struct {
 
 void rtc_get_time(DateTime* dt);
 
+// Seconds since 1970-01-01 00:00:00 (RTC assumed to run on UTC) and back.
+// Valid from 1970 to 2106.
+uint32_t rtc_to_epoch(const DateTime* dt);
+void rtc_from_epoch(uint32_t epoch, DateTime* dt);
+
 #endif
\ No newline at end of file
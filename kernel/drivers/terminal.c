@@ -1,5 +1,6 @@
 #include "terminal.h"
 #include "io.h"
+#include "string.h"
 
 #include <stddef.h>
 #include <stdint.h>
@@ -107,4 +108,10 @@ void term_print_hex(uint32_t n, uint8_t color)
         tmp[1] = '\0';
         term_print(tmp, color);
     }
-}
\ No newline at end of file
+}
+
+void term_print_dec(uint32_t n, uint8_t color)
+{
+    char buf[11];
+    term_print(utoa(n, buf, 10u), color);
+}
@@ -25,5 +25,6 @@ void term_init(void);
 void term_clear(void);
 void term_print(const char *str, uint8_t color);
 void term_print_hex(uint32_t n, uint8_t color);
+void term_print_dec(uint32_t n, uint8_t color);
 
 #endif /* TERMINAL_H */
\ No newline at end of file
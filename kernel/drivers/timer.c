@@ -1,42 +1,235 @@
 #include "timer.h"
 #include "io.h"
 #include "cpu.h"
+#include "clock.h"
+#include "div64.h"
+#include "seqlock.h"
+#include "timer_wheel.h"
+#include "irq.h"
+#include "softirq.h"
+#include "apic.h"
+#include "irqtrace.h"
+#include "sched.h"
 
 // 1.193182 MHz / 100 Hz = 11931 divisor
-#define TIMER_FREQ 100
 #define TIMER_DIVISOR 11931
 
-volatile uint64_t ticks = 0;
+// PIT command words: channel 0, access lo/hi byte, binary
+#define TIMER_CMD_PERIODIC 0x36 // Mode 3 (square wave)
+#define TIMER_CMD_ONESHOT 0x30  // Mode 0 (interrupt on terminal count)
 
-void timer_init(void)
+// ns -> PIT counts: 1193182 / 1e9 as 0.32 fixed point
+#define TIMER_PIT_COUNTS_PER_NS_FP 5124678u
+
+// Counted IRQs; only used while the TSC clock is uncalibrated.
+// 64-bit: two stores on i386, so readers go through timer_seq
+static volatile uint64_t ticks = 0;
+static SeqCount timer_seq = SEQCOUNT_INIT;
+
+static TimerInfo timer_stats;
+static uint64_t oneshot_ns; // Deadline of the armed one-shot (0 = none)
+
+static void timer_program(uint8_t cmd, uint16_t count)
+{
+    outb(0x43, cmd);
+    outb(0x40, (uint8_t)(count & 0xFF));
+    outb(0x40, (uint8_t)((count >> 8) & 0xFF));
+}
+
+// Periodic interrupts at TIMER_HZ from whichever source drives line 0.
+static void timer_start_periodic(void)
+{
+    if (timer_stats.lapic)
+        apic_timer_periodic(TIMER_TICK_NS);
+    else
+        timer_program(TIMER_CMD_PERIODIC, TIMER_DIVISOR);
+}
+
+static void timer_stop(void)
 {
-    // Send command: Channel 0, Access Lo/Hi byte, Mode 3 (Square Wave), Binary
-    outb(0x43, 0x36);
+    // PIT: mode word alone, OUT0 drops and the counter waits for a count, so
+    // nothing fires until the next one-shot.
+    if (timer_stats.lapic)
+        apic_timer_stop();
+    else
+        outb(0x43, TIMER_CMD_ONESHOT);
+}
+
+static int timer_irq(uint8_t irq, void *ctx);
+static void timer_softirq(void *arg);
 
-    // Send Divisor Low Byte
-    outb(0x40, (uint8_t)(TIMER_DIVISOR & 0xFF));
-    // Send Divisor High Byte
-    outb(0x40, (uint8_t)((TIMER_DIVISOR >> 8) & 0xFF));
+static SoftirqWork timer_work = SOFTIRQ_WORK_INIT(timer_softirq, 0);
+
+void timer_init(void)
+{
+    // Periodic until the TSC clock is calibrated and tickless mode is chosen.
+    timer_start_periodic();
+    irq_register(0, timer_irq, 0, "timer");
 }
 
-void timer_handler(void)
+static int timer_irq(uint8_t irq, void *ctx)
 {
+    (void)irq;
+    (void)ctx;
+
+    timer_stats.irqs++;
+    irqtrace_wakeup(oneshot_ns); // How late the one-shot was delivered
+    oneshot_ns = 0;
+
+    seqcount_write_begin(&timer_seq);
     ticks++;
+    seqcount_write_end(&timer_seq);
+
+    clock_tick();
+
+    // Expire kernel timers (callbacks run from the timer softirq), then keep
+    // interrupts coming while more are pending.
+    if (timer_wheel_advance(timer_get_ticks()))
+        softirq_queue(SOFTIRQ_TIMER, &timer_work);
+
+    uint64_t next;
+    if (timer_stats.tickless && timer_wheel_next_event(TIMER_ONESHOT_MAX_TICKS, &next))
+        timer_schedule_event(next * TIMER_TICK_NS);
+
+    // Timed waits and time slices (the scheduler re-arms for its own).
+    sched_timer_tick();
+
+    return IRQ_HANDLED;
+}
+
+static void timer_softirq(void *arg)
+{
+    (void)arg;
+    timer_wheel_run_expired();
+}
+
+static void timer_arm_oneshot(uint64_t deadline_ns, uint64_t now)
+{
+    // Round up so the one-shot never fires before the deadline.
+    uint64_t delta = (deadline_ns > now) ? deadline_ns - now : 0;
+    if (delta > TIMER_ONESHOT_MAX_NS)
+        delta = TIMER_ONESHOT_MAX_NS;
+
+    if (timer_stats.lapic)
+    {
+        apic_timer_oneshot((uint32_t)delta);
+    }
+    else
+    {
+        uint32_t count = (uint32_t)((delta * TIMER_PIT_COUNTS_PER_NS_FP) >> 32) + 1u;
+        timer_program(TIMER_CMD_ONESHOT, (uint16_t)count);
+    }
+    oneshot_ns = now + delta;
+    timer_stats.oneshots++;
+}
+
+void timer_schedule_event(uint64_t deadline_ns)
+{
+    if (!timer_stats.tickless)
+        return;
+
+    // An earlier one-shot is already on its way.
+    if (oneshot_ns != 0 && oneshot_ns <= deadline_ns)
+        return;
+
+    timer_arm_oneshot(deadline_ns, clock_monotonic_ns());
 }
 
 uint64_t timer_get_ticks(void)
 {
-    return ticks;
+    // Catch-up accounting: with the TSC clock the tick count is derived from
+    // elapsed time, so it keeps advancing without timer interrupts.
+    if (clock_info()->calibrated)
+        return div64_u32(clock_monotonic_ns(), TIMER_TICK_NS, 0);
+
+    uint64_t t;
+    uint32_t seq;
+
+    do
+    {
+        seq = seqcount_read_begin(&timer_seq);
+        t = ticks;
+    } while (seqcount_read_retry(&timer_seq, seq));
+
+    return t;
+}
+
+void timer_idle_until(uint64_t deadline_ns)
+{
+    uint32_t flags = cpu_irq_save();
+    uint64_t now = clock_monotonic_ns();
+
+    if (now < deadline_ns)
+    {
+        timer_schedule_event(deadline_ns);
+        timer_stats.idle_waits++;
+        cpu_idle(); // sti; hlt: the one-shot cannot fire before the halt
+    }
+
+    cpu_irq_restore(flags);
 }
 
-// Naive sleep: waits for X milliseconds
 void timer_sleep(uint32_t ms)
 {
-    // ticks increments 100 times/sec -> 1 tick = 10ms
-    // target_ticks = ms / 10
-    uint64_t target = ticks + (ms / 10);
-    while (ticks < target)
+    uint64_t deadline = clock_monotonic_ns() + (uint64_t)ms * 1000000u;
+
+    // Blocks the calling thread; before the scheduler runs, halts.
+    sched_sleep_until(deadline);
+}
+
+void timer_set_tickless(bool enabled)
+{
+    uint32_t flags = cpu_irq_save();
+
+    if (enabled && clock_info()->calibrated)
     {
-        cpu_idle();
+        timer_stop();
+        oneshot_ns = 0;
+        timer_stats.tickless = true;
+
+        uint64_t next;
+        if (timer_wheel_next_event(TIMER_ONESHOT_MAX_TICKS, &next))
+            timer_schedule_event(next * TIMER_TICK_NS);
+    }
+    else
+    {
+        timer_start_periodic();
+        timer_stats.tickless = false;
     }
-}
\ No newline at end of file
+
+    cpu_irq_restore(flags);
+}
+
+bool timer_use_lapic(void)
+{
+    if (timer_stats.lapic)
+        return true;
+    if (apic_timer_calibrate() != APIC_OK)
+        return false;
+
+    uint32_t flags = cpu_irq_save();
+
+    // The PIT goes quiet for good (its I/O APIC pin is never unmasked).
+    outb(0x43, TIMER_CMD_ONESHOT);
+    timer_stats.lapic = true;
+    oneshot_ns = 0;
+
+    uint64_t next;
+    if (!timer_stats.tickless)
+        timer_start_periodic();
+    else if (timer_wheel_next_event(TIMER_ONESHOT_MAX_TICKS, &next))
+        timer_schedule_event(next * TIMER_TICK_NS);
+
+    cpu_irq_restore(flags);
+    return true;
+}
+
+bool timer_tickless(void)
+{
+    return timer_stats.tickless;
+}
+
+const TimerInfo *timer_info(void)
+{
+    return &timer_stats;
+}
@@ -1,11 +1,48 @@
 #ifndef TIMER_H
 #define TIMER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
-void timer_init(void);
-void timer_handler(void);
+// PIT channel 0, or the local APIC timer once the APICs are in charge (same
+// line 0, same modes). Periodic mode interrupts at TIMER_HZ; tickless mode
+// (the default once the TSC clock is calibrated) arms one-shots only while
+// someone waits for a deadline or kernel timers (timer_wheel.h) are pending,
+// and ticks are derived from the clock instead.
+#define TIMER_HZ 100u
+#define TIMER_TICK_NS 10000000u
+#define TIMER_ONESHOT_MAX_NS 50000000u // 16-bit PIT count: at most ~54.9 ms
+#define TIMER_ONESHOT_MAX_TICKS (TIMER_ONESHOT_MAX_NS / TIMER_TICK_NS)
+
+typedef struct
+{
+    bool tickless;
+    bool lapic;          // Local APIC timer instead of the PIT
+    uint32_t irqs;       // Timer interrupts taken
+    uint32_t oneshots;   // One-shots armed
+    uint32_t idle_waits; // timer_idle_until() halts
+} TimerInfo;
+
+void timer_init(void); // Periodic mode; registers the IRQ 0 handler
 uint64_t timer_get_ticks(void);
-void timer_sleep(uint32_t ms); // Simple busy-wait sleep
+void timer_sleep(uint32_t ms); // Blocks until the deadline (sched_sleep_until)
+
+// Halt until an interrupt or until clock_monotonic_ns() reaches deadline_ns,
+// whichever is first (returns at once if it already has). Interrupts are
+// enabled while halted.
+void timer_idle_until(uint64_t deadline_ns);
+
+// Make sure a timer interrupt arrives by deadline_ns (tickless mode; the
+// periodic tick already does). Interrupts must be off.
+void timer_schedule_event(uint64_t deadline_ns);
+
+// Switch between tickless and periodic mode (tickless needs the TSC clock).
+void timer_set_tickless(bool enabled);
+bool timer_tickless(void);
+
+// Move line 0 from the PIT to the local APIC timer (needs apic_init() and the
+// TSC clock; false = stays on the PIT). Keeps the current mode.
+bool timer_use_lapic(void);
+const TimerInfo *timer_info(void);
 
-#endif
\ No newline at end of file
+#endif
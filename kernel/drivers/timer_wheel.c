@@ -0,0 +1,240 @@
+#include "timer_wheel.h"
+
+#include "cpu.h"
+#include "timer.h"
+
+typedef struct
+{
+    Timer *first;
+} TimerList;
+
+static TimerList g_l0[TIMER_WHEEL_L0_SIZE];
+static TimerList g_ln[TIMER_WHEEL_UPPER][TIMER_WHEEL_LN_SIZE];
+static TimerList g_expired;     /* Batch waiting for timer_wheel_run_expired() */
+static uint64_t g_clk;          /* Next tick to process */
+static TimerWheelStats g_stats;
+
+static void timer_list_add(TimerList *l, Timer *t)
+{
+    t->next = l->first;
+    if (l->first)
+        l->first->pprev = &t->next;
+    l->first = t;
+    t->pprev = &l->first;
+}
+
+static void timer_list_del(Timer *t)
+{
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+    t->next = 0;
+    t->pprev = 0;
+}
+
+/* Level-N slot index of tick `e` (level 0 = the 256 one-tick slots). */
+static uint32_t timer_slot(uint64_t e, uint32_t level)
+{
+    uint32_t shift = TIMER_WHEEL_L0_BITS + (level - 1u) * TIMER_WHEEL_LN_BITS;
+    return (uint32_t)(e >> shift) & (TIMER_WHEEL_LN_SIZE - 1u);
+}
+
+/* Hash by distance from g_clk: the level is the first one whose turn covers it. */
+static void timer_wheel_insert(Timer *t)
+{
+    uint64_t e = t->expires;
+
+    if (e < g_clk)
+        e = g_clk; /* Overdue: runs with the next processed tick. */
+
+    uint64_t delta = e - g_clk;
+
+    if (delta < TIMER_WHEEL_L0_SIZE)
+    {
+        timer_list_add(&g_l0[(uint32_t)e & (TIMER_WHEEL_L0_SIZE - 1u)], t);
+        return;
+    }
+
+    if (delta > TIMER_WHEEL_MAX_DELTA)
+    {
+        e = g_clk + TIMER_WHEEL_MAX_DELTA;
+        t->expires = e;
+    }
+
+    uint32_t level = 1u;
+    while (level < TIMER_WHEEL_UPPER &&
+           (delta >> (TIMER_WHEEL_L0_BITS + level * TIMER_WHEEL_LN_BITS)) != 0u)
+        level++;
+
+    timer_list_add(&g_ln[level - 1u][timer_slot(e, level)], t);
+}
+
+/* Re-hash one upper-level slot; returns its index (0 = cascade further up). */
+static uint32_t timer_cascade(uint32_t level)
+{
+    uint32_t idx = timer_slot(g_clk, level);
+    TimerList *slot = &g_ln[level - 1u][idx];
+    Timer *t = slot->first;
+
+    slot->first = 0;
+    while (t)
+    {
+        Timer *next = t->next;
+        timer_wheel_insert(t);
+        g_stats.cascaded++;
+        t = next;
+    }
+
+    return idx;
+}
+
+void timer_add(Timer *t, TimerCallback fn, void *arg, uint64_t deadline)
+{
+    if (!t || !fn)
+        return;
+
+    uint32_t flags = cpu_irq_save();
+
+    if (t->pending)
+    {
+        timer_list_del(t);
+        if (!t->expired)
+            g_stats.pending--;
+    }
+
+    // An empty wheel has nothing to catch up on.
+    if (g_stats.pending == 0u)
+        g_clk = timer_get_ticks();
+
+    t->fn = fn;
+    t->arg = arg;
+    t->expires = deadline;
+    t->pending = true;
+    t->expired = false;
+    timer_wheel_insert(t);
+
+    g_stats.pending++;
+    g_stats.added++;
+
+    timer_schedule_event(t->expires * TIMER_TICK_NS);
+
+    cpu_irq_restore(flags);
+}
+
+bool timer_cancel(Timer *t)
+{
+    if (!t)
+        return false;
+
+    uint32_t flags = cpu_irq_save();
+    bool was = t->pending;
+
+    if (was)
+    {
+        timer_list_del(t);
+        if (!t->expired)
+            g_stats.pending--;
+        t->pending = false;
+        t->expired = false;
+        g_stats.cancelled++;
+    }
+
+    cpu_irq_restore(flags);
+    return was;
+}
+
+bool timer_wheel_advance(uint64_t now)
+{
+    if (g_stats.pending == 0u)
+    {
+        g_clk = now + 1u;
+        return g_expired.first != 0;
+    }
+
+    while (g_clk <= now)
+    {
+        uint32_t idx = (uint32_t)g_clk & (TIMER_WHEEL_L0_SIZE - 1u);
+
+        // Level 0 wrapped: pull the next turn's timers down from above.
+        if (idx == 0u)
+        {
+            for (uint32_t level = 1u; level <= TIMER_WHEEL_UPPER; level++)
+            {
+                if (timer_cascade(level) != 0u)
+                    break;
+            }
+        }
+
+        TimerList *slot = &g_l0[idx];
+        while (slot->first)
+        {
+            Timer *t = slot->first;
+            timer_list_del(t);
+            timer_list_add(&g_expired, t);
+            t->expired = true;
+            g_stats.pending--;
+        }
+
+        g_clk++;
+    }
+
+    return g_expired.first != 0;
+}
+
+bool timer_wheel_next_event(uint32_t limit, uint64_t *tick)
+{
+    if (g_stats.pending == 0u)
+        return false;
+
+    uint64_t t = g_clk;
+    for (uint32_t i = 0; i < limit; i++, t++)
+    {
+        uint32_t idx = (uint32_t)t & (TIMER_WHEEL_L0_SIZE - 1u);
+
+        // A wrap cascades timers we cannot see from level 0: stop there.
+        if (g_l0[idx].first || (idx == 0u && i != 0u))
+            break;
+    }
+
+    *tick = t;
+    return true;
+}
+
+void timer_wheel_run_expired(void)
+{
+    uint32_t flags = cpu_irq_save();
+    uint32_t batch = 0u;
+
+    // The list is shared with the timer IRQ: unlink with interrupts off,
+    // call with the caller's (softirq: enabled) state.
+    while (g_expired.first)
+    {
+        Timer *t = g_expired.first;
+        TimerCallback fn = t->fn;
+        void *arg = t->arg;
+
+        timer_list_del(t);
+        t->pending = false;
+        t->expired = false;
+        g_stats.fired++;
+        batch++;
+
+        cpu_irq_restore(flags);
+        fn(arg);
+        flags = cpu_irq_save();
+    }
+
+    if (batch > 0u)
+    {
+        g_stats.batches++;
+        if (batch > g_stats.max_batch)
+            g_stats.max_batch = batch;
+    }
+
+    cpu_irq_restore(flags);
+}
+
+const TimerWheelStats *timer_wheel_stats(void)
+{
+    return &g_stats;
+}
@@ -0,0 +1,81 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Kernel timers: run a callback at a future tick (timer_get_ticks() units).
+ *
+ * Timers live on a hashed hierarchical wheel (five levels: 256 one-tick slots,
+ * then 4 x 64 slots, each slot of a level spanning a whole turn of the level
+ * below). Adding and cancelling are O(1) list operations; a timer on an upper
+ * level is cascaded down once when the level below wraps around to it.
+ *
+ * The timer interrupt advances the wheel and moves expired timers to a batch;
+ * their callbacks run from the timer softirq, with interrupts enabled, one
+ * batch at a time. Callbacks must not sleep or wait for I/O;
+ * they may re-add their own timer. In tickless mode the timer interrupt is
+ * only armed while timers are pending.
+ */
+
+#define TIMER_WHEEL_L0_BITS     8u
+#define TIMER_WHEEL_LN_BITS     6u
+#define TIMER_WHEEL_L0_SIZE     (1u << TIMER_WHEEL_L0_BITS)
+#define TIMER_WHEEL_LN_SIZE     (1u << TIMER_WHEEL_LN_BITS)
+#define TIMER_WHEEL_UPPER       4u                 /* Levels above level 0 */
+#define TIMER_WHEEL_MAX_DELTA   0xFFFFFFFFu        /* Ticks (~497 days); later is clamped */
+
+typedef void (*TimerCallback)(void *arg);
+
+typedef struct Timer
+{
+    struct Timer *next;
+    struct Timer **pprev;       /* Link pointing at this timer */
+    uint64_t expires;           /* Tick */
+    TimerCallback fn;
+    void *arg;
+    bool pending;               /* On the wheel or in the expired batch */
+    bool expired;               /* In the expired batch */
+} Timer;
+
+typedef struct
+{
+    uint32_t pending;           /* Timers on the wheel */
+    uint32_t added;
+    uint32_t cancelled;
+    uint32_t fired;
+    uint32_t cascaded;          /* Timers moved down a level */
+    uint32_t batches;           /* Deferred runs with at least one callback */
+    uint32_t max_batch;
+} TimerWheelStats;
+
+/*
+ * Arm `t` to call fn(arg) once timer_get_ticks() >= `deadline`. A pending
+ * timer is moved to the new deadline. `t` must start zeroed and stay valid
+ * until it fires or is cancelled.
+ */
+void timer_add(Timer *t, TimerCallback fn, void *arg, uint64_t deadline);
+
+/* Disarm `t`. Returns true if it was pending (its callback will not run). */
+bool timer_cancel(Timer *t);
+
+static inline bool timer_pending(const Timer *t)
+{
+    return t->pending;
+}
+
+/* Timer IRQ hook: expire everything due up to and including tick `now`.
+ * Returns true if an expired batch is waiting for timer_wheel_run_expired(). */
+bool timer_wheel_advance(uint64_t now);
+
+/* Earliest tick the wheel must run at, looking at most `limit` ticks ahead
+ * (later events report the end of that window). False if the wheel is empty. */
+bool timer_wheel_next_event(uint32_t limit, uint64_t *tick);
+
+/* Run the expired batch (timer softirq; callbacks see interrupts enabled). */
+void timer_wheel_run_expired(void);
+
+const TimerWheelStats *timer_wheel_stats(void);
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,382 @@
+#include "virtio.h"
+
+#include "io.h"
+#include "pmm.h"
+#include "string.h"
+#include "vmm.h"
+
+/* Rings are handed to the device by physical address: identity-mapped memory. */
+#define VIRTIO_LOWMEM_LIMIT 0x00400000u
+
+/* Legacy devices with larger fixed queues are not supported. */
+#define VIRTIO_LEGACY_MAX_QUEUE 1024u
+
+/* Descriptor / ring stores must be visible before the index or doorbell. */
+#define virtio_barrier() __asm__ volatile("" ::: "memory")
+
+/* --------------------------------------------------------------------------
+ * Register access
+ * -------------------------------------------------------------------------- */
+
+static uint8_t virtio_common_read8(VirtioDevice *vd, uint32_t off)
+{
+    return *(volatile uint8_t *)(vd->common + off);
+}
+
+static uint16_t virtio_common_read16(VirtioDevice *vd, uint32_t off)
+{
+    return *(volatile uint16_t *)(vd->common + off);
+}
+
+static uint32_t virtio_common_read32(VirtioDevice *vd, uint32_t off)
+{
+    return *(volatile uint32_t *)(vd->common + off);
+}
+
+static void virtio_common_write8(VirtioDevice *vd, uint32_t off, uint8_t value)
+{
+    *(volatile uint8_t *)(vd->common + off) = value;
+}
+
+static void virtio_common_write16(VirtioDevice *vd, uint32_t off, uint16_t value)
+{
+    *(volatile uint16_t *)(vd->common + off) = value;
+}
+
+static void virtio_common_write32(VirtioDevice *vd, uint32_t off, uint32_t value)
+{
+    *(volatile uint32_t *)(vd->common + off) = value;
+}
+
+static uint8_t virtio_get_status(VirtioDevice *vd)
+{
+    if (vd->modern)
+        return virtio_common_read8(vd, VIRTIO_COMMON_STATUS);
+
+    return inb((uint16_t)(vd->io + VIRTIO_LEGACY_STATUS));
+}
+
+static void virtio_set_status(VirtioDevice *vd, uint8_t status)
+{
+    if (vd->modern)
+        virtio_common_write8(vd, VIRTIO_COMMON_STATUS, status);
+    else
+        outb((uint16_t)(vd->io + VIRTIO_LEGACY_STATUS), status);
+}
+
+/* --------------------------------------------------------------------------
+ * Transport discovery
+ * -------------------------------------------------------------------------- */
+
+/* Map the structure described by the virtio capability at `cap`. */
+static volatile uint8_t *virtio_map_cap(PciDevice *pci, uint8_t cap)
+{
+    uint8_t bar = pci_config_read8(pci->bus, pci->slot, pci->func, (uint8_t)(cap + VIRTIO_PCI_CAP_BAR));
+    uint32_t offset = pci_config_read32(pci->bus, pci->slot, pci->func, (uint8_t)(cap + VIRTIO_PCI_CAP_OFFSET));
+    uint32_t length = pci_config_read32(pci->bus, pci->slot, pci->func, (uint8_t)(cap + VIRTIO_PCI_CAP_LENGTH));
+
+    if (bar >= PCI_BAR_COUNT || pci_bar_is_io(pci, bar) || length == 0u)
+        return 0;
+
+    uint32_t base = pci_bar_address(pci, bar);
+    if (!base)
+        return 0;
+
+    return (volatile uint8_t *)vmm_map_mmio(base + offset, length);
+}
+
+/* Modern transport: needs common, notify, ISR and device structures. */
+static bool virtio_probe_modern(VirtioDevice *vd, PciDevice *pci)
+{
+    for (uint8_t cap = pci_find_capability(pci, PCI_CAP_ID_VENDOR, 0u); cap != 0u;
+         cap = pci_find_capability(pci, PCI_CAP_ID_VENDOR, cap))
+    {
+        uint8_t type = pci_config_read8(pci->bus, pci->slot, pci->func, (uint8_t)(cap + VIRTIO_PCI_CAP_CFG_TYPE));
+
+        /* The first capability of each type is the preferred one. */
+        if (type == VIRTIO_PCI_CAP_COMMON_CFG && !vd->common)
+        {
+            vd->common = virtio_map_cap(pci, cap);
+        }
+        else if (type == VIRTIO_PCI_CAP_NOTIFY_CFG && !vd->notify)
+        {
+            vd->notify = virtio_map_cap(pci, cap);
+            vd->notify_mult = pci_config_read32(pci->bus, pci->slot, pci->func, (uint8_t)(cap + VIRTIO_PCI_CAP_NOTIFY_MULT));
+        }
+        else if (type == VIRTIO_PCI_CAP_ISR_CFG && !vd->isr)
+        {
+            vd->isr = virtio_map_cap(pci, cap);
+        }
+        else if (type == VIRTIO_PCI_CAP_DEVICE_CFG && !vd->device_cfg)
+        {
+            vd->device_cfg = virtio_map_cap(pci, cap);
+        }
+    }
+
+    return vd->common && vd->notify && vd->isr && vd->device_cfg;
+}
+
+int virtio_pci_init(VirtioDevice *vd, PciDevice *pci)
+{
+    if (!vd || !pci)
+        return VIRTIO_ERR_NO_DEVICE;
+
+    memset(vd, 0, sizeof(*vd));
+    vd->pci = pci;
+
+    if (virtio_probe_modern(vd, pci))
+    {
+        vd->modern = true;
+    }
+    else if (pci_bar_is_io(pci, 0u))
+    {
+        vd->io = (uint16_t)pci_bar_address(pci, 0u);
+    }
+    else
+    {
+        return VIRTIO_ERR_NO_DEVICE;
+    }
+
+    pci_enable(pci, PCI_CMD_IO_SPACE | PCI_CMD_MEM_SPACE | PCI_CMD_BUS_MASTER);
+
+    /* Reset, then announce the driver. */
+    virtio_set_status(vd, 0u);
+    for (uint32_t i = 0; i < 1000000u && virtio_get_status(vd) != 0u; i++)
+        ;
+
+    virtio_set_status(vd, VIRTIO_STATUS_ACKNOWLEDGE);
+    virtio_set_status(vd, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    return VIRTIO_OK;
+}
+
+uint32_t virtio_device_features(VirtioDevice *vd)
+{
+    if (vd->modern)
+    {
+        virtio_common_write32(vd, VIRTIO_COMMON_DFSELECT, 0u);
+        return virtio_common_read32(vd, VIRTIO_COMMON_DF);
+    }
+
+    return inl((uint16_t)(vd->io + VIRTIO_LEGACY_HOST_FEATURES));
+}
+
+int virtio_set_features(VirtioDevice *vd, uint32_t features)
+{
+    if (!vd->modern)
+    {
+        /* Legacy devices have no FEATURES_OK handshake. */
+        outl((uint16_t)(vd->io + VIRTIO_LEGACY_GUEST_FEATURES), features);
+        return VIRTIO_OK;
+    }
+
+    virtio_common_write32(vd, VIRTIO_COMMON_DFSELECT, 1u);
+    if (!(virtio_common_read32(vd, VIRTIO_COMMON_DF) & VIRTIO_F_VERSION_1_HI))
+        return VIRTIO_ERR_FEATURES;
+
+    virtio_common_write32(vd, VIRTIO_COMMON_GFSELECT, 0u);
+    virtio_common_write32(vd, VIRTIO_COMMON_GF, features);
+    virtio_common_write32(vd, VIRTIO_COMMON_GFSELECT, 1u);
+    virtio_common_write32(vd, VIRTIO_COMMON_GF, VIRTIO_F_VERSION_1_HI);
+
+    virtio_set_status(vd, virtio_get_status(vd) | VIRTIO_STATUS_FEATURES_OK);
+    if (!(virtio_get_status(vd) & VIRTIO_STATUS_FEATURES_OK))
+        return VIRTIO_ERR_FEATURES;
+
+    return VIRTIO_OK;
+}
+
+void virtio_driver_ok(VirtioDevice *vd)
+{
+    virtio_set_status(vd, virtio_get_status(vd) | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(VirtioDevice *vd)
+{
+    virtio_set_status(vd, virtio_get_status(vd) | VIRTIO_STATUS_FAILED);
+}
+
+uint8_t virtio_isr_status(VirtioDevice *vd)
+{
+    if (vd->modern)
+        return *vd->isr;
+
+    return inb((uint16_t)(vd->io + VIRTIO_LEGACY_ISR));
+}
+
+uint32_t virtio_config_read32(VirtioDevice *vd, uint32_t offset)
+{
+    if (vd->modern)
+        return *(volatile uint32_t *)(vd->device_cfg + offset);
+
+    return inl((uint16_t)(vd->io + VIRTIO_LEGACY_CONFIG + offset));
+}
+
+uint64_t virtio_config_read64(VirtioDevice *vd, uint32_t offset)
+{
+    uint32_t lo = virtio_config_read32(vd, offset);
+    uint32_t hi = virtio_config_read32(vd, offset + 4u);
+
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* --------------------------------------------------------------------------
+ * Virtqueues
+ * -------------------------------------------------------------------------- */
+
+static void virtq_reset_free_list(Virtqueue *vq)
+{
+    for (uint16_t i = 0; i < vq->size; i++)
+        vq->desc[i].next = (uint16_t)(i + 1u);
+
+    vq->free_head = 0u;
+    vq->num_free = vq->size;
+    vq->last_used = 0u;
+}
+
+static void *virtio_alloc_zeroed(uint32_t pages)
+{
+    void *mem = (pages == 1u) ? pmm_alloc_page_low(VIRTIO_LOWMEM_LIMIT) : pmm_alloc_pages_low(pages, VIRTIO_LOWMEM_LIMIT);
+    if (mem)
+        memset(mem, 0, pages * PMM_PAGE_SIZE);
+    return mem;
+}
+
+int virtio_queue_init(VirtioDevice *vd, Virtqueue *vq, uint16_t index, uint16_t max_size)
+{
+    memset(vq, 0, sizeof(*vq));
+    vq->index = index;
+
+    if (max_size > VIRTQ_MAX_SIZE)
+        max_size = VIRTQ_MAX_SIZE;
+
+    if (vd->modern)
+    {
+        virtio_common_write16(vd, VIRTIO_COMMON_Q_SELECT, index);
+
+        uint16_t size = virtio_common_read16(vd, VIRTIO_COMMON_Q_SIZE);
+        if (size == 0u)
+            return VIRTIO_ERR_NO_QUEUE;
+
+        /* Both are powers of two; the device accepts a smaller queue. */
+        if (size > max_size)
+            size = max_size;
+        virtio_common_write16(vd, VIRTIO_COMMON_Q_SIZE, size);
+        vq->size = size;
+
+        /* Separate areas: each fits one page at VIRTQ_MAX_SIZE entries. */
+        vq->desc = (VirtqDesc *)virtio_alloc_zeroed(1u);
+        vq->avail = (VirtqAvail *)virtio_alloc_zeroed(1u);
+        vq->used = (volatile VirtqUsed *)virtio_alloc_zeroed(1u);
+        if (!vq->desc || !vq->avail || !vq->used)
+            return VIRTIO_ERR_NO_MEMORY;
+
+        virtio_common_write32(vd, VIRTIO_COMMON_Q_DESCLO, (uint32_t)(uintptr_t)vq->desc);
+        virtio_common_write32(vd, VIRTIO_COMMON_Q_DESCHI, 0u);
+        virtio_common_write32(vd, VIRTIO_COMMON_Q_AVAILLO, (uint32_t)(uintptr_t)vq->avail);
+        virtio_common_write32(vd, VIRTIO_COMMON_Q_AVAILHI, 0u);
+        virtio_common_write32(vd, VIRTIO_COMMON_Q_USEDLO, (uint32_t)(uintptr_t)vq->used);
+        virtio_common_write32(vd, VIRTIO_COMMON_Q_USEDHI, 0u);
+
+        vq->notify_off = virtio_common_read16(vd, VIRTIO_COMMON_Q_NOFF);
+        virtq_reset_free_list(vq);
+        virtio_common_write16(vd, VIRTIO_COMMON_Q_ENABLE, 1u);
+        return VIRTIO_OK;
+    }
+
+    outw((uint16_t)(vd->io + VIRTIO_LEGACY_QUEUE_SELECT), index);
+
+    /* Legacy queues have a fixed size and one contiguous, aligned layout:
+     * descriptors + available ring, then the used ring on the next boundary. */
+    uint16_t size = inw((uint16_t)(vd->io + VIRTIO_LEGACY_QUEUE_SIZE));
+    if (size == 0u || size > VIRTIO_LEGACY_MAX_QUEUE)
+        return VIRTIO_ERR_NO_QUEUE;
+
+    uint32_t align = VIRTIO_LEGACY_QUEUE_ALIGN - 1u;
+    uint32_t used_off = ((16u * size) + 6u + (2u * size) + align) & ~align;
+    uint32_t total = used_off + ((6u + (8u * size) + align) & ~align);
+
+    uint8_t *mem = (uint8_t *)virtio_alloc_zeroed(total / PMM_PAGE_SIZE);
+    if (!mem)
+        return VIRTIO_ERR_NO_MEMORY;
+
+    vq->size = size;
+    vq->desc = (VirtqDesc *)mem;
+    vq->avail = (VirtqAvail *)(mem + (16u * size));
+    vq->used = (volatile VirtqUsed *)(mem + used_off);
+    virtq_reset_free_list(vq);
+
+    outl((uint16_t)(vd->io + VIRTIO_LEGACY_QUEUE_PFN), (uint32_t)(uintptr_t)mem / VIRTIO_LEGACY_QUEUE_ALIGN);
+    return VIRTIO_OK;
+}
+
+int virtq_submit(Virtqueue *vq, const VirtqBuffer *bufs, uint32_t count)
+{
+    if (count == 0u || count > vq->num_free)
+        return -1;
+
+    /* The free list is already linked through `next`: fill it in order. */
+    uint16_t head = vq->free_head;
+    uint16_t idx = head;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        VirtqDesc *d = &vq->desc[idx];
+
+        d->addr = bufs[i].phys;
+        d->len = bufs[i].len;
+        d->flags = (uint16_t)((bufs[i].device_writes ? VIRTQ_DESC_F_WRITE : 0u) | ((i + 1u < count) ? VIRTQ_DESC_F_NEXT : 0u));
+
+        if (i + 1u == count)
+            vq->free_head = d->next;
+        idx = d->next;
+    }
+
+    vq->num_free = (uint16_t)(vq->num_free - count);
+
+    uint16_t avail_idx = vq->avail->idx;
+    vq->avail->ring[avail_idx % vq->size] = head;
+    virtio_barrier();
+    *(volatile uint16_t *)&vq->avail->idx = (uint16_t)(avail_idx + 1u);
+
+    return head;
+}
+
+void virtq_notify(VirtioDevice *vd, Virtqueue *vq)
+{
+    virtio_barrier();
+
+    if (vd->modern)
+        *(volatile uint16_t *)(vd->notify + ((uint32_t)vq->notify_off * vd->notify_mult)) = vq->index;
+    else
+        outw((uint16_t)(vd->io + VIRTIO_LEGACY_QUEUE_NOTIFY), vq->index);
+}
+
+int virtq_next_used(Virtqueue *vq, uint32_t *out_len)
+{
+    if (vq->last_used == vq->used->idx)
+        return -1;
+
+    /* Read the entry only after seeing the index move. */
+    virtio_barrier();
+
+    volatile VirtqUsedElem *e = &vq->used->ring[vq->last_used % vq->size];
+    uint16_t head = (uint16_t)e->id;
+    if (out_len)
+        *out_len = e->len;
+    vq->last_used++;
+
+    /* Return the chain to the free list. */
+    uint16_t tail = head;
+    uint16_t n = 1u;
+    while (vq->desc[tail].flags & VIRTQ_DESC_F_NEXT)
+    {
+        tail = vq->desc[tail].next;
+        n++;
+    }
+
+    vq->desc[tail].next = vq->free_head;
+    vq->free_head = head;
+    vq->num_free = (uint16_t)(vq->num_free + n);
+
+    return head;
+}
@@ -0,0 +1,204 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pci.h"
+
+/*
+ * Virtio PCI transport + split virtqueues.
+ *
+ * Modern devices (virtio 1.0) are driven through the vendor-specific PCI
+ * capabilities (common / notify / ISR / device config structures in memory
+ * BARs). Devices without them fall back to the legacy I/O BAR0 interface,
+ * which also fixes the queue layout (one physically contiguous area).
+ */
+
+/* --------------------------------------------------------------------------
+ * PCI identification
+ * -------------------------------------------------------------------------- */
+#define VIRTIO_PCI_VENDOR               0x1AF4u
+#define VIRTIO_PCI_DEVICE_BLK_LEGACY    0x1001u  /* Transitional */
+#define VIRTIO_PCI_DEVICE_BLK_MODERN    0x1042u  /* 0x1040 + device type 2 */
+
+/* --------------------------------------------------------------------------
+ * Device status
+ * -------------------------------------------------------------------------- */
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01u
+#define VIRTIO_STATUS_DRIVER        0x02u
+#define VIRTIO_STATUS_DRIVER_OK     0x04u
+#define VIRTIO_STATUS_FEATURES_OK   0x08u
+#define VIRTIO_STATUS_FAILED        0x80u
+
+/* Feature bits shared by all devices (word 1 = bits 32..63) */
+#define VIRTIO_F_VERSION_1_HI       (1u << 0)   /* Bit 32 */
+
+/* ISR status */
+#define VIRTIO_ISR_QUEUE            0x01u
+#define VIRTIO_ISR_CONFIG           0x02u
+
+/* --------------------------------------------------------------------------
+ * Legacy interface (I/O BAR0)
+ * -------------------------------------------------------------------------- */
+#define VIRTIO_LEGACY_HOST_FEATURES     0x00u
+#define VIRTIO_LEGACY_GUEST_FEATURES    0x04u
+#define VIRTIO_LEGACY_QUEUE_PFN         0x08u
+#define VIRTIO_LEGACY_QUEUE_SIZE        0x0Cu
+#define VIRTIO_LEGACY_QUEUE_SELECT      0x0Eu
+#define VIRTIO_LEGACY_QUEUE_NOTIFY      0x10u
+#define VIRTIO_LEGACY_STATUS            0x12u
+#define VIRTIO_LEGACY_ISR               0x13u
+#define VIRTIO_LEGACY_CONFIG            0x14u   /* Without MSI-X */
+
+#define VIRTIO_LEGACY_QUEUE_ALIGN       4096u
+
+/* --------------------------------------------------------------------------
+ * Modern interface (vendor-specific PCI capabilities)
+ * -------------------------------------------------------------------------- */
+#define VIRTIO_PCI_CAP_COMMON_CFG   1u
+#define VIRTIO_PCI_CAP_NOTIFY_CFG   2u
+#define VIRTIO_PCI_CAP_ISR_CFG      3u
+#define VIRTIO_PCI_CAP_DEVICE_CFG   4u
+
+/* Capability layout (offsets from the capability start) */
+#define VIRTIO_PCI_CAP_CFG_TYPE     3u
+#define VIRTIO_PCI_CAP_BAR          4u
+#define VIRTIO_PCI_CAP_OFFSET       8u
+#define VIRTIO_PCI_CAP_LENGTH       12u
+#define VIRTIO_PCI_CAP_NOTIFY_MULT  16u
+
+/* Common configuration structure */
+#define VIRTIO_COMMON_DFSELECT      0x00u
+#define VIRTIO_COMMON_DF            0x04u
+#define VIRTIO_COMMON_GFSELECT      0x08u
+#define VIRTIO_COMMON_GF            0x0Cu
+#define VIRTIO_COMMON_NUM_QUEUES    0x12u
+#define VIRTIO_COMMON_STATUS        0x14u
+#define VIRTIO_COMMON_Q_SELECT      0x16u
+#define VIRTIO_COMMON_Q_SIZE        0x18u
+#define VIRTIO_COMMON_Q_ENABLE      0x1Cu
+#define VIRTIO_COMMON_Q_NOFF        0x1Eu
+#define VIRTIO_COMMON_Q_DESCLO      0x20u
+#define VIRTIO_COMMON_Q_DESCHI      0x24u
+#define VIRTIO_COMMON_Q_AVAILLO     0x28u
+#define VIRTIO_COMMON_Q_AVAILHI     0x2Cu
+#define VIRTIO_COMMON_Q_USEDLO      0x30u
+#define VIRTIO_COMMON_Q_USEDHI      0x34u
+
+/* --------------------------------------------------------------------------
+ * Split virtqueue
+ * -------------------------------------------------------------------------- */
+#define VIRTQ_DESC_F_NEXT   0x01u
+#define VIRTQ_DESC_F_WRITE  0x02u   /* Device writes the buffer */
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 0x01u /* Polling: suppress used-buffer interrupts */
+
+/* Largest queue the driver asks for (modern devices may be shrunk to it). */
+#define VIRTQ_MAX_SIZE      256u
+
+typedef struct
+{
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} VirtqDesc;
+
+typedef struct
+{
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} VirtqAvail;
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t len;
+} VirtqUsedElem;
+
+typedef struct
+{
+    uint16_t flags;
+    uint16_t idx;
+    VirtqUsedElem ring[];
+} VirtqUsed;
+
+typedef struct
+{
+    uint16_t index;
+    uint16_t size;
+    VirtqDesc *desc;
+    VirtqAvail *avail;
+    volatile VirtqUsed *used;
+    uint16_t free_head;         /* Free descriptors, linked through `next` */
+    uint16_t num_free;
+    uint16_t last_used;         /* Next used ring entry to reap */
+    uint16_t notify_off;        /* Modern: queue_notify_off */
+} Virtqueue;
+
+/* One buffer of a descriptor chain (physical address). */
+typedef struct
+{
+    uint32_t phys;
+    uint32_t len;
+    bool device_writes;
+} VirtqBuffer;
+
+typedef struct
+{
+    PciDevice *pci;
+    bool modern;
+    uint16_t io;                    /* Legacy: I/O BAR0 */
+    volatile uint8_t *common;       /* Modern structures */
+    volatile uint8_t *notify;
+    volatile uint8_t *isr;
+    volatile uint8_t *device_cfg;
+    uint32_t notify_mult;
+} VirtioDevice;
+
+/* Return codes (0 = success) */
+#define VIRTIO_OK               0
+#define VIRTIO_ERR_NO_DEVICE    1
+#define VIRTIO_ERR_FEATURES     2
+#define VIRTIO_ERR_NO_QUEUE     3
+#define VIRTIO_ERR_NO_MEMORY    4
+
+/*
+ * Pick the transport (modern if its capabilities are present), enable the
+ * function, reset the device and set ACKNOWLEDGE | DRIVER.
+ */
+int virtio_pci_init(VirtioDevice *vd, PciDevice *pci);
+
+/* Device feature bits 0..31. */
+uint32_t virtio_device_features(VirtioDevice *vd);
+
+/* Accept `features` (plus VERSION_1 on modern devices) and set FEATURES_OK. */
+int virtio_set_features(VirtioDevice *vd, uint32_t features);
+
+/* Allocate and register queue `index` with at most `max_size` entries. */
+int virtio_queue_init(VirtioDevice *vd, Virtqueue *vq, uint16_t index, uint16_t max_size);
+
+void virtio_driver_ok(VirtioDevice *vd);
+void virtio_fail(VirtioDevice *vd);
+
+/* Read (and thereby clear) the ISR status. */
+uint8_t virtio_isr_status(VirtioDevice *vd);
+
+/* Device-specific configuration space. */
+uint32_t virtio_config_read32(VirtioDevice *vd, uint32_t offset);
+uint64_t virtio_config_read64(VirtioDevice *vd, uint32_t offset);
+
+/*
+ * Post a descriptor chain to the available ring. Returns the head descriptor
+ * index, or -1 if fewer than `count` descriptors are free. The device is not
+ * notified until virtq_notify().
+ */
+int virtq_submit(Virtqueue *vq, const VirtqBuffer *bufs, uint32_t count);
+void virtq_notify(VirtioDevice *vd, Virtqueue *vq);
+
+/* Next completed chain: returns its head (descriptors are freed), or -1. */
+int virtq_next_used(Virtqueue *vq, uint32_t *out_len);
+
+#endif /* VIRTIO_H */
@@ -0,0 +1,555 @@
+#include "virtio_blk.h"
+
+#include "block.h"
+#include "cpu.h"
+#include "irq.h"
+#include "softirq.h"
+#include "pci.h"
+#include "pmm.h"
+#include "sched.h"
+#include "string.h"
+#include "timer.h"
+#include "virtio.h"
+#include "vmm.h"
+
+/* --------------------------------------------------------------------------
+ * virtio-blk -> BlockDevice driver
+ *
+ * Request headers and status bytes live in one identity-mapped page, one
+ * slot per block queue tag. Completed chains are matched back to their slot
+ * by head descriptor, from the IRQ handler or the waiter's polling loop.
+ * -------------------------------------------------------------------------- */
+
+#define VIRTIO_BLK_LOWMEM_LIMIT 0x00400000u
+
+/* Interrupt mode: no progress for this long -> poll instead of sleeping. */
+#define VIRTIO_BLK_IRQ_TIMEOUT_TICKS 100u
+
+/* Smallest chain: header + one data segment + status. */
+#define VIRTIO_BLK_MIN_CHAIN    3u
+
+/* virtio_blk_sync_cmd(): request still running. */
+#define VIRTIO_BLK_IN_PROGRESS  (-1)
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+    volatile uint8_t status;
+    uint8_t pad[7];
+} VirtioBlkSlot;
+
+typedef struct
+{
+    VirtioDevice vd;
+    Virtqueue vq;
+    VirtioBlkSlot *slots;       /* BLOCK_QUEUE_MAX_TAGS, identity-mapped */
+    uint16_t slot_head[BLOCK_QUEUE_MAX_TAGS];
+    uint32_t outstanding;       /* Slots posted and not yet reaped */
+    uint32_t size_max;          /* Largest data segment */
+    uint32_t seg_max;           /* Most data segments per request */
+    bool sync_busy;
+    uint32_t sync_mask;
+    volatile int sync_rc;
+    uint64_t progress_tick;
+    SoftirqWork work;           /* Bottom half: virtio_blk_reap() */
+    WaitQueue waiters;          /* Threads in virtio_blk_wait_event() */
+    BlockDevice dev;
+    VirtioBlkInfo info;
+} VirtioBlkDisk;
+
+static VirtioBlkDisk g_vblk[VIRTIO_BLK_MAX_DISKS];
+static uint32_t g_vblk_count = 0u;
+static bool g_vblk_irq_mode = false;
+
+/* --------------------------------------------------------------------------
+ * Requests
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Describe a request as a descriptor chain in `bufs`: header, data segments
+ * (physically contiguous runs, each at most size_max), status. Returns the
+ * chain length, or 0 if the buffer is unmapped or too fragmented.
+ */
+static uint32_t virtio_blk_build(VirtioBlkDisk *d, uint32_t slot, uint32_t type, uint32_t lba, uint32_t count,
+                                 uint8_t *buf, VirtqBuffer *bufs)
+{
+    VirtioBlkSlot *s = &d->slots[slot];
+    s->type = type;
+    s->reserved = 0u;
+    s->sector = lba;
+    s->status = 0xFFu;
+
+    uint32_t n = 0u;
+    bufs[n].phys = (uint32_t)(uintptr_t)s;
+    bufs[n].len = 16u;
+    bufs[n].device_writes = false;
+    n++;
+
+    uint32_t vaddr = (uint32_t)(uintptr_t)buf;
+    uint32_t bytes = count * VIRTIO_BLK_SECTOR_SIZE;
+    uint32_t segs = 0u;
+
+    while (bytes > 0u)
+    {
+        uint32_t phys = vmm_get_phys(vaddr);
+        if (!phys)
+            return 0u;
+
+        uint32_t chunk = PAGE_SIZE - (vaddr & (PAGE_SIZE - 1u));
+        if (chunk > bytes)
+            chunk = bytes;
+
+        VirtqBuffer *last = &bufs[n - 1u];
+        if (segs > 0u && last->phys + last->len == phys && last->len + chunk <= d->size_max)
+        {
+            last->len += chunk;
+        }
+        else
+        {
+            if (segs == d->seg_max || segs == VIRTIO_BLK_MAX_SEGMENTS)
+                return 0u;
+
+            bufs[n].phys = phys;
+            bufs[n].len = chunk;
+            bufs[n].device_writes = (type == VIRTIO_BLK_T_IN);
+            n++;
+            segs++;
+        }
+
+        vaddr += chunk;
+        bytes -= chunk;
+    }
+
+    bufs[n].phys = (uint32_t)(uintptr_t)&s->status;
+    bufs[n].len = 1u;
+    bufs[n].device_writes = true;
+    return n + 1u;
+}
+
+/* Post a built chain for `slot`. Interrupts are off. Returns false if the
+ * ring lacks free descriptors. */
+static bool virtio_blk_post(VirtioBlkDisk *d, uint32_t slot, const VirtqBuffer *bufs, uint32_t n)
+{
+    int head = virtq_submit(&d->vq, bufs, n);
+    if (head < 0)
+        return false;
+
+    if (d->outstanding == 0u)
+        d->progress_tick = timer_get_ticks();
+
+    d->slot_head[slot] = (uint16_t)head;
+    d->outstanding |= 1u << slot;
+    d->info.requests++;
+
+    uint32_t inflight = 0u;
+    for (uint32_t v = d->outstanding; v; v &= v - 1u)
+        inflight++;
+    if (inflight > d->info.max_outstanding)
+        d->info.max_outstanding = inflight;
+
+    virtq_notify(&d->vd, &d->vq);
+    return true;
+}
+
+/* Reap completed chains. Interrupts are off, or softirq context. */
+static void virtio_blk_reap(VirtioBlkDisk *d)
+{
+    int head;
+
+    while ((head = virtq_next_used(&d->vq, 0)) >= 0)
+    {
+        d->progress_tick = timer_get_ticks();
+
+        for (uint32_t slot = 0; slot < BLOCK_QUEUE_MAX_TAGS; slot++)
+        {
+            uint32_t bit = 1u << slot;
+            if (!(d->outstanding & bit) || d->slot_head[slot] != (uint16_t)head)
+                continue;
+
+            bool ok = d->slots[slot].status == VIRTIO_BLK_S_OK;
+            if (!ok)
+                d->info.errors++;
+
+            /* Release first: completion may post the next unit in this slot. */
+            d->outstanding &= ~bit;
+
+            if (d->sync_mask & bit)
+            {
+                d->sync_mask = 0u;
+                d->sync_rc = ok ? VIRTIO_BLK_OK : VIRTIO_BLK_ERR_IO;
+            }
+            else
+            {
+                block_complete(&d->dev, slot, ok ? BLOCK_SUCCESS : BLOCK_ERROR);
+            }
+            break;
+        }
+    }
+}
+
+/* Sleep until the interrupt is handled when possible (other threads run
+ * meanwhile), otherwise poll the used ring. */
+static void virtio_blk_wait_event(VirtioBlkDisk *d)
+{
+    uint32_t flags = cpu_irq_save();
+
+    if (d->outstanding != 0u)
+    {
+        bool stalled = (timer_get_ticks() - d->progress_tick) > VIRTIO_BLK_IRQ_TIMEOUT_TICKS;
+
+        if (g_vblk_irq_mode && (flags & CPU_EFLAGS_IF) && !stalled)
+        {
+            /* Until the interrupt, or the stall deadline if it is lost. */
+            wait_queue_sleep(&d->waiters, (d->progress_tick + VIRTIO_BLK_IRQ_TIMEOUT_TICKS + 1u) * TIMER_TICK_NS);
+        }
+        else
+            virtio_blk_reap(d);
+    }
+
+    cpu_irq_restore(flags);
+}
+
+/*
+ * Synchronous request on slot 0: claim the disk (new async units are refused),
+ * let in-flight requests drain, then post and wait. `op` is BLOCK_OP_READ,
+ * BLOCK_OP_WRITE or BLOCK_OP_FLUSH.
+ */
+static int virtio_blk_sync_cmd(VirtioBlkDisk *d, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buf)
+{
+    VirtqBuffer bufs[VIRTIO_BLK_MAX_SEGMENTS + 2u];
+
+    uint32_t flags = cpu_irq_save();
+    if (d->sync_busy)
+    {
+        cpu_irq_restore(flags);
+        return VIRTIO_BLK_ERR_SETUP;
+    }
+    d->sync_busy = true;
+    cpu_irq_restore(flags);
+
+    while (d->outstanding != 0u)
+        virtio_blk_wait_event(d);
+
+    uint32_t n;
+    if (op == BLOCK_OP_FLUSH)
+    {
+        /* Header + status only. */
+        n = virtio_blk_build(d, 0u, VIRTIO_BLK_T_FLUSH, 0u, 0u, 0, bufs);
+    }
+    else
+    {
+        n = virtio_blk_build(d, 0u, (op == BLOCK_OP_WRITE) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, lba, count, buf, bufs);
+    }
+
+    int rc = VIRTIO_BLK_ERR_SETUP;
+    flags = cpu_irq_save();
+    if (n > 0u && virtio_blk_post(d, 0u, bufs, n))
+    {
+        d->sync_rc = VIRTIO_BLK_IN_PROGRESS;
+        d->sync_mask = 1u;
+        rc = VIRTIO_BLK_OK;
+    }
+    cpu_irq_restore(flags);
+
+    if (rc == VIRTIO_BLK_OK)
+    {
+        while (d->sync_rc == VIRTIO_BLK_IN_PROGRESS)
+            virtio_blk_wait_event(d);
+        rc = d->sync_rc;
+    }
+
+    d->sync_busy = false;
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+ * BlockDevice operations
+ * -------------------------------------------------------------------------- */
+
+static int virtio_blk_io(BlockDevice *dev, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !dev->ctx || !buffer)
+        return BLOCK_ERROR;
+
+    VirtioBlkDisk *d = (VirtioBlkDisk *)dev->ctx;
+    if (lba >= dev->sector_count || count > dev->sector_count - lba)
+        return BLOCK_ERROR;
+    if (op == BLOCK_OP_WRITE && d->info.read_only)
+        return BLOCK_ERROR;
+
+    while (count > 0u)
+    {
+        uint32_t n = (count > d->info.max_sectors) ? d->info.max_sectors : count;
+
+        if (virtio_blk_sync_cmd(d, op, lba, n, buffer) != VIRTIO_BLK_OK)
+            return BLOCK_ERROR;
+
+        lba += n;
+        count -= n;
+        buffer += n * VIRTIO_BLK_SECTOR_SIZE;
+    }
+
+    return BLOCK_SUCCESS;
+}
+
+static int virtio_blk_read(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return virtio_blk_io(dev, BLOCK_OP_READ, lba, 1u, buffer);
+}
+
+static int virtio_blk_write(BlockDevice *dev, uint32_t lba, uint8_t *buffer)
+{
+    return virtio_blk_io(dev, BLOCK_OP_WRITE, lba, 1u, buffer);
+}
+
+static int virtio_blk_read_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return virtio_blk_io(dev, BLOCK_OP_READ, lba, count, buffer);
+}
+
+static int virtio_blk_write_sectors(BlockDevice *dev, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    return virtio_blk_io(dev, BLOCK_OP_WRITE, lba, count, buffer);
+}
+
+static int virtio_blk_flush(BlockDevice *dev)
+{
+    if (!dev || !dev->ctx)
+        return BLOCK_ERROR;
+
+    VirtioBlkDisk *d = (VirtioBlkDisk *)dev->ctx;
+
+    /* Without VIRTIO_BLK_F_FLUSH the device has no volatile write cache. */
+    if (!d->info.flush)
+        return BLOCK_SUCCESS;
+
+    return (virtio_blk_sync_cmd(d, BLOCK_OP_FLUSH, 0u, 0u, 0) == VIRTIO_BLK_OK) ? BLOCK_SUCCESS : BLOCK_ERROR;
+}
+
+/* Called by the block queue with interrupts disabled; `tag` is the slot. */
+static int virtio_blk_submit(BlockDevice *dev, uint32_t tag, uint32_t op, uint32_t lba, uint32_t count, uint8_t *buffer)
+{
+    if (!dev || !dev->ctx)
+        return BLOCK_ERROR;
+
+    VirtioBlkDisk *d = (VirtioBlkDisk *)dev->ctx;
+    bool flush = (op == BLOCK_OP_FLUSH);
+
+    if (tag >= d->info.queue_depth)
+        return BLOCK_ERROR;
+    if (!flush && (!buffer || lba >= dev->sector_count || count > dev->sector_count - lba))
+        return BLOCK_ERROR;
+    if (op == BLOCK_OP_WRITE && d->info.read_only)
+        return BLOCK_ERROR;
+
+    if (d->sync_busy || (d->outstanding & (1u << tag)))
+        return BLOCK_BUSY;
+
+    VirtqBuffer bufs[VIRTIO_BLK_MAX_SEGMENTS + 2u];
+    uint32_t n;
+    if (flush)
+        n = virtio_blk_build(d, tag, VIRTIO_BLK_T_FLUSH, 0u, 0u, 0, bufs);
+    else
+        n = virtio_blk_build(d, tag, (op == BLOCK_OP_WRITE) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, lba, count, buffer, bufs);
+    if (n == 0u)
+        return BLOCK_ERROR;
+
+    /* Ring full: retried when an earlier request completes. */
+    if (!virtio_blk_post(d, tag, bufs, n))
+        return BLOCK_BUSY;
+
+    return BLOCK_SUCCESS;
+}
+
+static void virtio_blk_poll(BlockDevice *dev)
+{
+    if (dev && dev->ctx)
+        virtio_blk_wait_event((VirtioBlkDisk *)dev->ctx);
+}
+
+/* Hybrid polling: check the used ring once, never sleep. */
+static void virtio_blk_reap_dev(BlockDevice *dev)
+{
+    if (!dev || !dev->ctx)
+        return;
+
+    uint32_t flags = cpu_irq_save();
+    virtio_blk_reap((VirtioBlkDisk *)dev->ctx);
+    cpu_irq_restore(flags);
+}
+
+/* --------------------------------------------------------------------------
+ * Interrupts
+ * -------------------------------------------------------------------------- */
+
+/* One handler per disk (ctx); PCI INTx lines are level-triggered and may be shared. */
+static int virtio_blk_irq(uint8_t irq, void *ctx)
+{
+    VirtioBlkDisk *d = (VirtioBlkDisk *)ctx;
+    (void)irq;
+
+    /* Reading ISR deasserts the line; the used ring is reaped by the softirq. */
+    if (!(virtio_isr_status(&d->vd) & VIRTIO_ISR_QUEUE))
+        return IRQ_NONE;
+
+    d->info.irqs++;
+    softirq_queue(SOFTIRQ_BLOCK, &d->work);
+    return IRQ_HANDLED;
+}
+
+static void virtio_blk_softirq(void *arg)
+{
+    VirtioBlkDisk *d = (VirtioBlkDisk *)arg;
+
+    virtio_blk_reap(d);
+    wait_queue_wake_all(&d->waiters);
+}
+
+void virtio_blk_set_irq_mode(bool enabled)
+{
+    uint32_t flags = cpu_irq_save();
+
+    g_vblk_irq_mode = enabled;
+    for (uint32_t i = 0; i < g_vblk_count; i++)
+    {
+        VirtioBlkDisk *d = &g_vblk[i];
+        bool irq = enabled && d->info.irq_line < 16u;
+
+        d->vq.avail->flags = irq ? 0u : VIRTQ_AVAIL_F_NO_INTERRUPT;
+    }
+
+    cpu_irq_restore(flags);
+}
+
+/* --------------------------------------------------------------------------
+ * Discovery
+ * -------------------------------------------------------------------------- */
+
+static int virtio_blk_setup(VirtioBlkDisk *d, PciDevice *pci)
+{
+    memset(d, 0, sizeof(*d));
+
+    if (virtio_pci_init(&d->vd, pci) != VIRTIO_OK)
+        return VIRTIO_BLK_ERR_NO_DEVICE;
+
+    uint32_t offered = virtio_device_features(&d->vd);
+    uint32_t wanted = offered & (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO | VIRTIO_BLK_F_FLUSH);
+
+    if (virtio_set_features(&d->vd, wanted) != VIRTIO_OK
+        || virtio_queue_init(&d->vd, &d->vq, 0u, VIRTQ_MAX_SIZE) != VIRTIO_OK)
+    {
+        virtio_fail(&d->vd);
+        return VIRTIO_BLK_ERR_SETUP;
+    }
+
+    d->slots = (VirtioBlkSlot *)pmm_alloc_page_low(VIRTIO_BLK_LOWMEM_LIMIT);
+    if (!d->slots)
+    {
+        virtio_fail(&d->vd);
+        return VIRTIO_BLK_ERR_NO_MEMORY;
+    }
+    memset(d->slots, 0, PMM_PAGE_SIZE);
+
+    /* Segment limits: the device's, the ring's, and ours. */
+    d->size_max = (wanted & VIRTIO_BLK_F_SIZE_MAX) ? virtio_config_read32(&d->vd, VIRTIO_BLK_CFG_SIZE_MAX) : 0u;
+    if (d->size_max < VIRTIO_BLK_SECTOR_SIZE || d->size_max > 0x400000u)
+        d->size_max = 0x400000u;
+
+    d->seg_max = (wanted & VIRTIO_BLK_F_SEG_MAX) ? virtio_config_read32(&d->vd, VIRTIO_BLK_CFG_SEG_MAX) : VIRTIO_BLK_MAX_SEGMENTS;
+    if (d->seg_max == 0u || d->seg_max > VIRTIO_BLK_MAX_SEGMENTS)
+        d->seg_max = VIRTIO_BLK_MAX_SEGMENTS;
+    if (d->seg_max > (uint32_t)d->vq.size - 2u)
+        d->seg_max = (uint32_t)d->vq.size - 2u;
+
+    /* Largest request that fits in seg_max segments at any page alignment. */
+    uint32_t seg_bytes = (d->size_max < PAGE_SIZE) ? d->size_max : PAGE_SIZE;
+    uint32_t max_sectors = ((d->seg_max - 1u) * seg_bytes) / VIRTIO_BLK_SECTOR_SIZE;
+    if (max_sectors == 0u)
+        max_sectors = 1u;
+    if (max_sectors > VIRTIO_BLK_MAX_SECTORS_PER_REQ)
+        max_sectors = VIRTIO_BLK_MAX_SECTORS_PER_REQ;
+
+    uint32_t depth = d->vq.size / VIRTIO_BLK_MIN_CHAIN;
+    if (depth > BLOCK_QUEUE_MAX_TAGS)
+        depth = BLOCK_QUEUE_MAX_TAGS;
+    if (depth == 0u)
+        depth = 1u;
+
+    d->info.modern = d->vd.modern;
+    d->info.read_only = (wanted & VIRTIO_BLK_F_RO) != 0u;
+    d->info.flush = (wanted & VIRTIO_BLK_F_FLUSH) != 0u;
+    d->info.queue_size = d->vq.size;
+    d->info.queue_depth = depth;
+    d->info.max_sectors = max_sectors;
+    d->info.sectors = virtio_config_read64(&d->vd, VIRTIO_BLK_CFG_CAPACITY);
+    d->info.irq_line = pci->irq_line;
+
+    /* Polled until virtio_blk_set_irq_mode(true). */
+    d->vq.avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+    virtio_driver_ok(&d->vd);
+
+    BlockDevice *dev = &d->dev;
+    dev->name[0] = 'v';
+    dev->name[1] = 'd';
+    dev->name[2] = (char)('0' + (char)g_vblk_count);
+    dev->name[3] = '\0';
+
+    dev->sector_size = VIRTIO_BLK_SECTOR_SIZE;
+    dev->sector_count = (d->info.sectors > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)d->info.sectors;
+    dev->max_sectors = max_sectors;
+    dev->queue_depth = depth;
+    dev->ctx = d;
+    dev->read = virtio_blk_read;
+    dev->write = virtio_blk_write;
+    dev->read_sectors = virtio_blk_read_sectors;
+    dev->write_sectors = virtio_blk_write_sectors;
+    dev->submit = virtio_blk_submit;
+    dev->reap = virtio_blk_reap_dev;
+    dev->poll = virtio_blk_poll;
+    dev->flush = virtio_blk_flush;
+    dev->write_cache = d->info.flush;
+
+    if (block_register(dev) != BLOCK_SUCCESS)
+        return VIRTIO_BLK_ERR_SETUP;
+
+    return VIRTIO_BLK_OK;
+}
+
+int virtio_blk_register_devices(void)
+{
+    uint32_t n = pci_count();
+
+    for (uint32_t i = 0; i < n && g_vblk_count < VIRTIO_BLK_MAX_DISKS; i++)
+    {
+        PciDevice *pci = pci_get(i);
+        if (!pci || pci->vendor_id != VIRTIO_PCI_VENDOR)
+            continue;
+
+        if (pci->device_id != VIRTIO_PCI_DEVICE_BLK_LEGACY && pci->device_id != VIRTIO_PCI_DEVICE_BLK_MODERN)
+            continue;
+
+        VirtioBlkDisk *d = &g_vblk[g_vblk_count];
+        if (virtio_blk_setup(d, pci) != VIRTIO_BLK_OK)
+            continue;
+
+        d->work.fn = virtio_blk_softirq;
+        d->work.arg = d;
+        if (d->info.irq_line < 16u)
+            irq_register(d->info.irq_line, virtio_blk_irq, d, d->dev.name);
+        g_vblk_count++;
+    }
+
+    return (g_vblk_count > 0u) ? VIRTIO_BLK_OK : VIRTIO_BLK_ERR_NO_DEVICE;
+}
+
+uint32_t virtio_blk_count(void)
+{
+    return g_vblk_count;
+}
+
+const VirtioBlkInfo *virtio_blk_info(uint32_t index)
+{
+    return (index < g_vblk_count) ? &g_vblk[index].info : 0;
+}
@@ -0,0 +1,80 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * virtio-blk driver (legacy and modern PCI, one split virtqueue per disk).
+ *
+ * Every request is a descriptor chain: a 16-byte header (type, sector), one
+ * descriptor per physically contiguous run of the caller's buffer, and a
+ * status byte the device writes. Block queue tags select the per-request
+ * header slot, so up to BlockDevice.queue_depth requests are outstanding;
+ * the device may complete them in any order. Disks register as "vd<N>".
+ */
+
+/* Feature bits */
+#define VIRTIO_BLK_F_SIZE_MAX   (1u << 1)
+#define VIRTIO_BLK_F_SEG_MAX    (1u << 2)
+#define VIRTIO_BLK_F_RO         (1u << 5)
+#define VIRTIO_BLK_F_FLUSH      (1u << 9)
+
+/* Device configuration layout */
+#define VIRTIO_BLK_CFG_CAPACITY 0x00u   /* 64-bit, 512-byte sectors */
+#define VIRTIO_BLK_CFG_SIZE_MAX 0x08u
+#define VIRTIO_BLK_CFG_SEG_MAX  0x0Cu
+
+/* Request types */
+#define VIRTIO_BLK_T_IN         0u
+#define VIRTIO_BLK_T_OUT        1u
+#define VIRTIO_BLK_T_FLUSH      4u
+
+/* Request status (written by the device) */
+#define VIRTIO_BLK_S_OK         0u
+#define VIRTIO_BLK_S_IOERR      1u
+#define VIRTIO_BLK_S_UNSUPP     2u
+
+/* Driver limits */
+#define VIRTIO_BLK_MAX_DISKS    4u      /* vd0..vd3 */
+#define VIRTIO_BLK_SECTOR_SIZE  512u
+#define VIRTIO_BLK_MAX_SECTORS_PER_REQ 256u
+#define VIRTIO_BLK_MAX_SEGMENTS 33u     /* 128 KiB at any page alignment */
+
+/* Return codes (0 = success) */
+#define VIRTIO_BLK_OK           0
+#define VIRTIO_BLK_ERR_NO_DEVICE 1
+#define VIRTIO_BLK_ERR_SETUP    2
+#define VIRTIO_BLK_ERR_NO_MEMORY 3
+#define VIRTIO_BLK_ERR_IO       4
+
+typedef struct
+{
+    bool modern;
+    bool read_only;
+    bool flush;             /* VIRTIO_BLK_F_FLUSH negotiated */
+    uint16_t queue_size;
+    uint32_t queue_depth;   /* Tags usable by the block queue */
+    uint32_t max_sectors;
+    uint64_t sectors;
+    uint8_t irq_line;
+    uint32_t requests;
+    uint32_t max_outstanding;
+    uint32_t errors;
+    uint32_t irqs;
+} VirtioBlkInfo;
+
+/*
+ * Find every virtio-blk function on the PCI bus, set it up and register it
+ * (block device and IRQ handler).
+ * Returns VIRTIO_BLK_OK, or VIRTIO_BLK_ERR_NO_DEVICE if none was usable.
+ */
+int virtio_blk_register_devices(void);
+
+uint32_t virtio_blk_count(void);
+const VirtioBlkInfo *virtio_blk_info(uint32_t index);
+
+/* Interrupt mode: waiters sleep until the device interrupts (else they poll). */
+void virtio_blk_set_irq_mode(bool enabled);
+
+#endif /* VIRTIO_BLK_H */
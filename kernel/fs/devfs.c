@@ -13,11 +13,17 @@
 #define DEVFS_KIND_NULL 0u
 #define DEVFS_KIND_ZERO 1u
 #define DEVFS_KIND_BLOCK 2u
+#define DEVFS_KIND_TEXT 3u
+
+/* Text nodes render a snapshot at open time. */
+#define DEVFS_TEXT_MAX 8192u
 
 typedef struct
 {
     uint32_t kind;
     BlockDevice *blk;
+    char *text;
+    uint32_t text_len;
 } DevFsFileCtx;
 
 static int devfs_read_null(VfsFile *file, uint32_t offset, void *buffer, uint32_t size, uint32_t *out_read)
@@ -72,24 +78,48 @@ static int devfs_read_block(VfsFile *file, uint32_t offset, void *buffer, uint32
 
     uint32_t sector_size = ctx->blk->sector_size;
     uint32_t sectors = size / sector_size;
-
-    uint8_t *dst = (uint8_t *)buffer;
     uint32_t lba = offset / sector_size;
 
-    for (uint32_t i = 0; i < sectors; i++)
+    if (sectors == 0u)
+    {
+        *out_read = 0u;
+        return VFS_OK;
+    }
+
+    /* One queued transfer: the block queue merges the chunks back together. */
+    if (block_read(ctx->blk, lba, sectors, (uint8_t *)buffer) != BLOCK_SUCCESS)
     {
-        int rc = ctx->blk->read(ctx->blk, lba + i, dst + (i * sector_size));
-        if (rc != BLOCK_SUCCESS)
-        {
-            *out_read = i * sector_size;
-            return VFS_ERR_IO;
-        }
+        *out_read = 0u;
+        return VFS_ERR_IO;
     }
 
     *out_read = size;
     return VFS_OK;
 }
 
+static int devfs_read_text(VfsFile *file, uint32_t offset, void *buffer, uint32_t size, uint32_t *out_read)
+{
+    if (!file || !buffer || !out_read)
+        return VFS_ERR_INVALID_PARAM;
+
+    DevFsFileCtx *ctx = (DevFsFileCtx *)file->file_ctx;
+    if (!ctx || ctx->kind != DEVFS_KIND_TEXT || !ctx->text)
+        return VFS_ERR_IO;
+
+    if (offset >= ctx->text_len)
+    {
+        *out_read = 0u;
+        return VFS_OK;
+    }
+
+    uint32_t remaining = ctx->text_len - offset;
+    uint32_t to_copy = (size < remaining) ? size : remaining;
+
+    memcpy(buffer, ctx->text + offset, to_copy);
+    *out_read = to_copy;
+    return VFS_OK;
+}
+
 static int devfs_close(VfsFile *file)
 {
     if (!file)
@@ -97,6 +127,10 @@ static int devfs_close(VfsFile *file)
 
     if (file->file_ctx)
     {
+        DevFsFileCtx *ctx = (DevFsFileCtx *)file->file_ctx;
+        if (ctx->text)
+            kfree(ctx->text);
+
         kfree(file->file_ctx);
         file->file_ctx = 0;
     }
@@ -123,6 +157,38 @@ static const VfsFileOps DEVFS_BLOCK_FILE_OPS = {
     .close = devfs_close,
 };
 
+static const VfsFileOps DEVFS_TEXT_FILE_OPS = {
+    .read = devfs_read_text,
+    .close = devfs_close,
+};
+
+/* Renders a text node into `buf`; returns the text length. */
+typedef uint32_t (*DevFsTextFn)(char *buf, uint32_t size);
+
+static int devfs_open_text(DevFsTextFn render, VfsFile *out_file)
+{
+    DevFsFileCtx *ctx = (DevFsFileCtx *)kmalloc(sizeof(DevFsFileCtx));
+    if (!ctx)
+        return VFS_ERR_NO_SPACE;
+
+    ctx->text = (char *)kmalloc(DEVFS_TEXT_MAX);
+    if (!ctx->text)
+    {
+        kfree(ctx);
+        return VFS_ERR_NO_SPACE;
+    }
+
+    ctx->kind = DEVFS_KIND_TEXT;
+    ctx->blk = 0;
+    ctx->text_len = render(ctx->text, DEVFS_TEXT_MAX);
+
+    out_file->ops = &DEVFS_TEXT_FILE_OPS;
+    out_file->file_ctx = ctx;
+    out_file->size = ctx->text_len;
+    out_file->pos = 0u;
+    return VFS_OK;
+}
+
 static int devfs_open(void *fs_ctx, const char *path, uint32_t flags, VfsFile *out_file)
 {
     (void)fs_ctx;
@@ -143,6 +209,8 @@ static int devfs_open(void *fs_ctx, const char *path, uint32_t flags, VfsFile *o
 
         ctx->kind = DEVFS_KIND_NULL;
         ctx->blk = 0;
+        ctx->text = 0;
+        ctx->text_len = 0u;
 
         out_file->ops = &DEVFS_NULL_FILE_OPS;
         out_file->file_ctx = ctx;
@@ -159,6 +227,8 @@ static int devfs_open(void *fs_ctx, const char *path, uint32_t flags, VfsFile *o
 
         ctx->kind = DEVFS_KIND_ZERO;
         ctx->blk = 0;
+        ctx->text = 0;
+        ctx->text_len = 0u;
 
         out_file->ops = &DEVFS_ZERO_FILE_OPS;
         out_file->file_ctx = ctx;
@@ -167,8 +237,11 @@ static int devfs_open(void *fs_ctx, const char *path, uint32_t flags, VfsFile *o
         return VFS_OK;
     }
 
-    /* diskN nodes (raw block device) */
-    if (strncmp(path, "disk", 4u) == 0)
+    /* Block layer I/O statistics (text). */
+    if (strcmp(path, "iostat") == 0)
+        return devfs_open_text(block_stats_format, out_file);
+
+    /* Raw block device nodes (diskN, diskNpM, ramN, ...) */
     {
         BlockDevice *dev = block_get_by_name(path);
         if (!dev)
@@ -180,6 +253,8 @@ static int devfs_open(void *fs_ctx, const char *path, uint32_t flags, VfsFile *o
 
         ctx->kind = DEVFS_KIND_BLOCK;
         ctx->blk = dev;
+        ctx->text = 0;
+        ctx->text_len = 0u;
 
         out_file->ops = &DEVFS_BLOCK_FILE_OPS;
         out_file->file_ctx = ctx;
@@ -187,8 +262,6 @@ static int devfs_open(void *fs_ctx, const char *path, uint32_t flags, VfsFile *o
         out_file->pos = 0u;
         return VFS_OK;
     }
-
-    return VFS_ERR_NOT_FOUND;
 }
 
 const VfsFsOps DEVFS_OPS = {
@@ -9,6 +9,8 @@
  *   /dev/null
  *   /dev/zero
  *   /dev/disk0   (backed by the BlockDevice registry)
+ *   /dev/ram0    (any registered block device is exposed by name)
+ *   /dev/iostat  (text: per-device block I/O statistics)
  */
 extern const VfsFsOps DEVFS_OPS;
 
@@ -46,7 +46,7 @@ static int pyfs_read_superblock(PyfsCtx *fs, uint8_t out_sector[PYFS_BLOCK_SIZE]
     if (!fs || !fs->dev || !fs->dev->read || !out_sector)
         return PYFS_ERR_INVALID_PARAM;
 
-    if (fs->dev->read(fs->dev, PYFS_SUPERBLOCK_LBA, out_sector) != BLOCK_SUCCESS)
+    if (block_read(fs->dev, PYFS_SUPERBLOCK_LBA, 1u, out_sector) != BLOCK_SUCCESS)
         return PYFS_ERR_IO;
 
     return 0;
@@ -128,7 +128,7 @@ static int pyfs_file_read(VfsFile *file, uint32_t offset, void *buffer, uint32_t
         if (!fctx->cache)
             return VFS_ERR_NO_SPACE;
 
-        if (fctx->fs->dev->read(fctx->fs->dev, PYFS_SUPERBLOCK_LBA, fctx->cache) != BLOCK_SUCCESS)
+        if (block_read(fctx->fs->dev, PYFS_SUPERBLOCK_LBA, 1u, fctx->cache) != BLOCK_SUCCESS)
             return VFS_ERR_IO;
     }
 
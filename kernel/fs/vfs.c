@@ -1,5 +1,7 @@
 #include "fs/vfs.h"
 
+#include "sched.h"
+#include "spinlock.h"
 #include "string.h"
 
 typedef struct
@@ -11,15 +13,30 @@ typedef struct
     void *fs_ctx;
 } VfsMount;
 
+/* Descriptor slot states */
+#define VFS_SLOT_FREE       0u
+#define VFS_SLOT_OPENING    1u      /* Reserved; the filesystem open is running */
+#define VFS_SLOT_OPEN       2u
+#define VFS_SLOT_CLOSING    3u      /* vfs_close() waits for the readers */
+
 typedef struct
 {
-    bool used;
+    uint8_t state;
+    uint32_t generation;            /* Bumped on every reservation */
+    uint32_t readers;               /* vfs_read() calls using the file */
     VfsFile file;
 } VfsOpenEntry;
 
 static VfsMount g_mounts[VFS_MAX_MOUNTS];
 static VfsOpenEntry g_open[VFS_MAX_OPEN_FILES];
 
+/* Mount table, descriptor slots and their positions. Filesystem callbacks
+ * (which may do disk I/O) run without it; a read pins its file with the
+ * slot's reader count instead. */
+static Spinlock g_vfs_lock = SPINLOCK_INIT("vfs");
+
+static WaitQueue g_vfs_close_waiters = WAIT_QUEUE_INIT; /* vfs_close() for readers */
+
 static uint32_t vfs_strnlen(const char *s, uint32_t max_len)
 {
     if (!s)
@@ -76,6 +93,7 @@ static bool vfs_mountpoint_matches(const char *mountpoint, const char *path)
     return (path[mlen] == '/');
 }
 
+/* Caller holds g_vfs_lock. */
 static int vfs_find_mount(const char *path, uint32_t *out_mount_index, const char **out_rel_path)
 {
     if (!path || !out_mount_index || !out_rel_path)
@@ -139,12 +157,15 @@ void vfs_init(void)
 
     for (uint32_t i = 0; i < VFS_MAX_OPEN_FILES; i++)
     {
-        g_open[i].used = false;
+        g_open[i].state = VFS_SLOT_FREE;
+        g_open[i].readers = 0u;
         g_open[i].file.ops = 0;
         g_open[i].file.file_ctx = 0;
         g_open[i].file.size = 0u;
         g_open[i].file.pos = 0u;
     }
+
+    spinlock_register(&g_vfs_lock);
 }
 
 int vfs_mount(const char *mountpoint, const char *fs_name, const VfsFsOps *ops, void *fs_ctx)
@@ -157,34 +178,40 @@ int vfs_mount(const char *mountpoint, const char *fs_name, const VfsFsOps *ops,
     if (mountpoint[0] != '/')
         return VFS_ERR_INVALID_PARAM;
 
+    uint32_t irq_flags = spin_lock_irqsave(&g_vfs_lock);
+
     /* Reject duplicates to keep semantics simple. */
     for (uint32_t i = 0; i < VFS_MAX_MOUNTS; i++)
     {
         if (g_mounts[i].used && strcmp(g_mounts[i].mountpoint, mountpoint) == 0)
+        {
+            spin_unlock_irqrestore(&g_vfs_lock, irq_flags);
             return VFS_ERR_INVALID_PARAM;
+        }
     }
 
+    int rc = VFS_ERR_NO_SPACE;
     for (uint32_t i = 0; i < VFS_MAX_MOUNTS; i++)
     {
         if (g_mounts[i].used)
             continue;
 
-        int rc = vfs_strlcpy(g_mounts[i].mountpoint, VFS_MOUNTPOINT_MAX, mountpoint);
+        rc = vfs_strlcpy(g_mounts[i].mountpoint, VFS_MOUNTPOINT_MAX, mountpoint);
         if (rc != VFS_OK)
-            return rc;
+            break;
 
         rc = vfs_strlcpy(g_mounts[i].fs_name, VFS_FSNAME_MAX, fs_name);
         if (rc != VFS_OK)
-            return rc;
+            break;
 
         g_mounts[i].ops = ops;
         g_mounts[i].fs_ctx = fs_ctx;
         g_mounts[i].used = true;
-
-        return VFS_OK;
+        break;
     }
 
-    return VFS_ERR_NO_SPACE;
+    spin_unlock_irqrestore(&g_vfs_lock, irq_flags);
+    return rc;
 }
 
 uint32_t vfs_mount_count(void)
@@ -237,24 +264,42 @@ int vfs_open(const char *path, uint32_t flags, uint32_t *out_fd)
 
     uint32_t mount_index = 0u;
     const char *rel = 0;
+    uint32_t fd = VFS_MAX_OPEN_FILES;
+    uint32_t generation = 0u;
+    const VfsFsOps *ops = 0;
+    void *fs_ctx = 0;
 
-    int rc = vfs_find_mount(path, &mount_index, &rel);
-    if (rc != VFS_OK)
-        return rc;
+    uint32_t irq_flags = spin_lock_irqsave(&g_vfs_lock);
 
-    /* Find a free file descriptor slot. */
-    uint32_t fd = VFS_MAX_OPEN_FILES;
-    for (uint32_t i = 0; i < VFS_MAX_OPEN_FILES; i++)
+    int rc = vfs_find_mount(path, &mount_index, &rel);
+    if (rc == VFS_OK)
     {
-        if (!g_open[i].used)
+        /* Reserve a free file descriptor slot; it is not usable (read,
+         * closed) until the open below publishes the file. */
+        for (uint32_t i = 0; i < VFS_MAX_OPEN_FILES; i++)
         {
-            fd = i;
-            break;
+            if (g_open[i].state == VFS_SLOT_FREE)
+            {
+                fd = i;
+                g_open[i].state = VFS_SLOT_OPENING;
+                g_open[i].generation++;
+                g_open[i].file.ops = 0;
+                generation = g_open[i].generation;
+                break;
+            }
         }
+
+        if (fd == VFS_MAX_OPEN_FILES)
+            rc = VFS_ERR_NO_SPACE;
+
+        ops = g_mounts[mount_index].ops;
+        fs_ctx = g_mounts[mount_index].fs_ctx;
     }
 
-    if (fd == VFS_MAX_OPEN_FILES)
-        return VFS_ERR_NO_SPACE;
+    spin_unlock_irqrestore(&g_vfs_lock, irq_flags);
+
+    if (rc != VFS_OK)
+        return rc;
 
     VfsFile tmp;
     tmp.ops = 0;
@@ -262,16 +307,41 @@ int vfs_open(const char *path, uint32_t flags, uint32_t *out_fd)
     tmp.size = 0u;
     tmp.pos = 0u;
 
-    rc = g_mounts[mount_index].ops->open(g_mounts[mount_index].fs_ctx, rel, flags, &tmp);
+    rc = ops->open(fs_ctx, rel, flags, &tmp);
+    if (rc == VFS_OK && !tmp.ops)
+        rc = VFS_ERR_IO;
+
+    tmp.pos = 0u;
+
+    /* Publish only into this open's own reservation. */
+    irq_flags = spin_lock_irqsave(&g_vfs_lock);
+
+    bool reserved = g_open[fd].state == VFS_SLOT_OPENING && g_open[fd].generation == generation;
+    if (reserved)
+    {
+        if (rc == VFS_OK)
+        {
+            g_open[fd].file = tmp;
+            g_open[fd].state = VFS_SLOT_OPEN;
+        }
+        else
+            g_open[fd].state = VFS_SLOT_FREE;
+    }
+
+    spin_unlock_irqrestore(&g_vfs_lock, irq_flags);
+
     if (rc != VFS_OK)
         return rc;
 
-    if (!tmp.ops)
-        return VFS_ERR_IO;
-
-    g_open[fd].file = tmp;
-    g_open[fd].file.pos = 0u;
-    g_open[fd].used = true;
+    if (!reserved)
+    {
+        /* vfs_close() refuses an opening slot, so only a vfs_init() in the
+         * meantime gets here (what the generation check is for): the slot
+         * may belong to another open now and nobody owns this file. */
+        if (tmp.ops->close)
+            (void)tmp.ops->close(&tmp);
+        return VFS_ERR_BAD_FD;
+    }
 
     *out_fd = fd;
     return VFS_OK;
@@ -281,8 +351,6 @@ int vfs_read(uint32_t fd, void *buffer, uint32_t size, uint32_t *out_read)
 {
     if (fd >= VFS_MAX_OPEN_FILES)
         return VFS_ERR_BAD_FD;
-    if (!g_open[fd].used)
-        return VFS_ERR_BAD_FD;
 
     if (size > 0u && !buffer)
         return VFS_ERR_INVALID_PARAM;
@@ -291,39 +359,82 @@ int vfs_read(uint32_t fd, void *buffer, uint32_t size, uint32_t *out_read)
     uint32_t *read_ptr = out_read ? out_read : &tmp_read;
     *read_ptr = 0u;
 
+    /* Pin the file: vfs_close() waits for readers before it closes it. */
+    uint32_t irq_flags = spin_lock_irqsave(&g_vfs_lock);
+
+    if (g_open[fd].state != VFS_SLOT_OPEN)
+    {
+        spin_unlock_irqrestore(&g_vfs_lock, irq_flags);
+        return VFS_ERR_BAD_FD;
+    }
+
     VfsFile *f = &g_open[fd].file;
-    if (!f->ops || !f->ops->read)
-        return VFS_ERR_NOT_SUPPORTED;
+    uint32_t pos = f->pos;
+    g_open[fd].readers++;
 
-    int rc = f->ops->read(f, f->pos, buffer, size, read_ptr);
-    if (rc != VFS_OK)
-        return rc;
+    spin_unlock_irqrestore(&g_vfs_lock, irq_flags);
+
+    int rc = VFS_ERR_NOT_SUPPORTED;
+    if (f->ops->read)
+    {
+        rc = f->ops->read(f, pos, buffer, size, read_ptr);
+        if (rc == VFS_OK && *read_ptr > size)
+            rc = VFS_ERR_IO;
+    }
 
-    if (*read_ptr > size)
-        return VFS_ERR_IO;
+    irq_flags = spin_lock_irqsave(&g_vfs_lock);
 
-    f->pos += *read_ptr;
-    return VFS_OK;
+    if (rc == VFS_OK)
+        f->pos = pos + *read_ptr;
+
+    if (--g_open[fd].readers == 0u && g_open[fd].state == VFS_SLOT_CLOSING)
+        wait_queue_wake_all(&g_vfs_close_waiters);
+
+    spin_unlock_irqrestore(&g_vfs_lock, irq_flags);
+    return rc;
 }
 
 int vfs_close(uint32_t fd)
 {
     if (fd >= VFS_MAX_OPEN_FILES)
         return VFS_ERR_BAD_FD;
-    if (!g_open[fd].used)
+
+    /* Release the slot first; the close callback gets the detached copy. */
+    uint32_t irq_flags = spin_lock_irqsave(&g_vfs_lock);
+
+    /* A slot still being opened belongs to its vfs_open() call; one being
+     * closed, to the other vfs_close(). */
+    if (g_open[fd].state != VFS_SLOT_OPEN)
+    {
+        spin_unlock_irqrestore(&g_vfs_lock, irq_flags);
         return VFS_ERR_BAD_FD;
+    }
 
-    VfsFile *f = &g_open[fd].file;
+    /* New reads fail from here; let the ones in progress finish with the
+     * file. Interrupts stay off between the unlock and the sleep, so the
+     * last reader's wakeup (threads run on the boot CPU) cannot be missed. */
+    g_open[fd].state = VFS_SLOT_CLOSING;
 
-    int rc = VFS_OK;
-    if (f->ops && f->ops->close)
-        rc = f->ops->close(f);
+    while (g_open[fd].readers != 0u)
+    {
+        spin_unlock(&g_vfs_lock);
+        (void)wait_queue_sleep(&g_vfs_close_waiters, 0);
+        spin_lock(&g_vfs_lock);
+    }
 
-    g_open[fd].used = false;
+    VfsFile f = g_open[fd].file;
+
+    g_open[fd].state = VFS_SLOT_FREE;
     g_open[fd].file.ops = 0;
     g_open[fd].file.file_ctx = 0;
     g_open[fd].file.size = 0u;
     g_open[fd].file.pos = 0u;
 
+    spin_unlock_irqrestore(&g_vfs_lock, irq_flags);
+
+    int rc = VFS_OK;
+    if (f.ops && f.ops->close)
+        rc = f.ops->close(&f);
+
     return rc;
 }
\ No newline at end of file
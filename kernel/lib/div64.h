@@ -0,0 +1,31 @@
+#ifndef DIV64_H
+#define DIV64_H
+
+#include <stdint.h>
+
+/*
+ * 64-by-32 unsigned division without the libgcc helpers (__udivdi3 and
+ * friends are not linked into the kernel). Two DIVL steps: the high word
+ * first, then the remainder with the low word.
+ */
+static inline uint64_t div64_u32(uint64_t n, uint32_t d, uint32_t *rem)
+{
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q_hi = 0u;
+    uint32_t r;
+
+    if (hi >= d)
+    {
+        q_hi = hi / d;
+        hi -= q_hi * d;
+    }
+
+    asm("divl %4" : "=a"(lo), "=d"(r) : "0"(lo), "1"(hi), "rm"(d));
+
+    if (rem)
+        *rem = r;
+    return ((uint64_t)q_hi << 32) | lo;
+}
+
+#endif /* DIV64_H */
@@ -0,0 +1,56 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+
+/*
+ * Sequence counter for data written by one side (usually an interrupt
+ * handler) and read lock-free by everyone else.
+ *
+ * The writer makes the count odd while it updates the data and even again
+ * when it is done; a reader copies the data between seqcount_read_begin() and
+ * seqcount_read_retry() and starts over if a write overlapped. Writers must
+ * already be serialized (interrupts off, or a single writer).
+ *
+ * x86 keeps loads in order with other loads and stores with other stores, so
+ * compiler barriers are all the ordering needed.
+ */
+
+typedef struct
+{
+    volatile uint32_t sequence;
+} SeqCount;
+
+#define SEQCOUNT_INIT { 0u }
+
+#define seqcount_barrier() asm volatile("" ::: "memory")
+
+static inline uint32_t seqcount_read_begin(const SeqCount *s)
+{
+    uint32_t seq;
+    while ((seq = s->sequence) & 1u)
+        asm volatile("pause");
+    seqcount_barrier();
+    return seq;
+}
+
+/* Nonzero if the data read since seqcount_read_begin() may be torn. */
+static inline int seqcount_read_retry(const SeqCount *s, uint32_t seq)
+{
+    seqcount_barrier();
+    return s->sequence != seq;
+}
+
+static inline void seqcount_write_begin(SeqCount *s)
+{
+    s->sequence = s->sequence + 1u;
+    seqcount_barrier();
+}
+
+static inline void seqcount_write_end(SeqCount *s)
+{
+    seqcount_barrier();
+    s->sequence = s->sequence + 1u;
+}
+
+#endif /* SEQLOCK_H */
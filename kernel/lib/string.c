@@ -21,6 +21,20 @@ void *memcpy(void *dest, const void *src, size_t len)
     return dest;
 }
 
+int memcmp(const void *s1, const void *s2, size_t len)
+{
+    const unsigned char *a = (const unsigned char *)s1;
+    const unsigned char *b = (const unsigned char *)s2;
+    while (len--)
+    {
+        if (*a != *b)
+            return (int)*a - (int)*b;
+        a++;
+        b++;
+    }
+    return 0;
+}
+
 size_t strlen(const char *str)
 {
     size_t len = 0;
@@ -79,6 +93,30 @@ char *strcat(char *dest, const char *src)
     return saved;
 }
 
+// Convert unsigned integer to string in base 2..16 (buf needs 33 bytes for base 2)
+char *utoa(uint32_t value, char *buf, uint32_t base)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char tmp[33];
+    uint32_t n = 0;
+
+    if (base < 2u || base > 16u)
+        base = 10u;
+
+    do
+    {
+        tmp[n++] = digits[value % base];
+        value /= base;
+    } while (value != 0u);
+
+    uint32_t i = 0;
+    while (n > 0u)
+        buf[i++] = tmp[--n];
+    buf[i] = '\0';
+
+    return buf;
+}
+
 // Convert string to integer (e.g., "123" -> 123)
 int atoi(const char* str) {
     int res = 0;
@@ -6,11 +6,13 @@
 
 void *memset(void *dest, int val, size_t len);
 void *memcpy(void *dest, const void *src, size_t len);
+int memcmp(const void *s1, const void *s2, size_t len);
 size_t strlen(const char *str);
 int strcmp(const char *s1, const char *s2);
 int strncmp(const char *s1, const char *s2, size_t n);
 char *strcpy(char *dest, const char *src);
 char *strcat(char *dest, const char *src);
+char *utoa(uint32_t value, char *buf, uint32_t base);
 int atoi(const char* str);
 
 #endif
\ No newline at end of file